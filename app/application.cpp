@@ -13,58 +13,212 @@
 #include "wifi.h"
 #include "aws_iot.h"
 #include "can_bus.h"
+#include "gateway_core.h"
+#include "cov.h"
+#include "policy.h"
+#include "isotp.h"
+#include "j1939.h"
+#include "routing.h"
+#include "batch.h"
+#include "downlink.h"
+#include "remote_config.h"
+#include "boot.h"
+#include "latency.h"
+#include "counters.h"
+#include "cli.h"
+#include "mem_budget.h"
+#include "dlog.h"
+#include "trace.h"
+#include "cannelloni.h"
+#include "slcan.h"
+#include "gateway_config.h"
+
+#include <string.h>
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
 
 // --------------------------------------------------
 // Local private variables and functions 
 // --------------------------------------------------
-#define MAX_JSON_MSG_LEN            (80)
+#define MAX_JSON_ACK_LEN            (128)
+#define MAX_JSON_CONFIG_ACK_LEN     (64 + REMOTE_CONFIG_MAX_ERROR_LEN)
+#define MAX_JSON_METRICS_LEN        (128 * LATENCY_STAGES)
+#define MAX_JSON_COUNTERS_LEN       (1024)
 #define APP_QUEUE_SIZE              (10)
 
 static bool is_AWS_connected = false;
+static bool is_AWS_ever_connected = false;
 
 static const char *TAG = "APP";
 
 static TaskHandle_t  mainAppTask   = NULL;
 static QueueHandle_t mainAppQueue  = NULL;
+static TimerHandle_t aggWindowTimer = NULL;
+static TimerHandle_t metricsTimer   = NULL;
+
+// Task, queue and timers are allocated statically
+static StackType_t   mainAppStack[APP_TASK_STACK_SIZE];
+static StaticTask_t  mainAppTaskBuffer;
+static uint8_t       mainAppQueueStorage[APP_QUEUE_SIZE * sizeof(main_app_event_t)];
+static StaticQueue_t mainAppQueueBuffer;
+static StaticTimer_t aggWindowTimerBuffer;
+static StaticTimer_t metricsTimerBuffer;
+
+#define APP_STATIC_BYTES    (sizeof(mainAppStack) + sizeof(mainAppTaskBuffer)        \
+                             + sizeof(mainAppQueueStorage) + sizeof(mainAppQueueBuffer) \
+                             + sizeof(aggWindowTimerBuffer) + sizeof(metricsTimerBuffer))
+static_assert(APP_STATIC_BYTES <= MEM_BUDGET_APP, "Application exceeds MEM_BUDGET_APP");
+
+/// Commands waiting for the transmit path, the head is being sent
+static downlink_buffer_t* downlinkQueue[DOWNLINK_POOL_SIZE];
+static uint8_t            downlinkHead  = 0;
+static uint8_t            downlinkCount = 0;
+static downlink_iter_t    downlinkIter;
+static CAN_frame_t        downlinkFrame;
+static bool               downlinkFrameReady = false;
+static uint32_t           downlinkProgressMs = 0;
+
+/// @brief Function run in the application task for another task
+typedef struct
+{
+    void         (*fn)(void* arg);
+    void*        arg;
+    TaskHandle_t caller;
+} app_call_t;
+
+/// Configuration task waiting for EVENT_CONFIG_APPLY to be handled
+static TaskHandle_t configApplyTask  = NULL;
+static const char*  configApplyError = NULL;
 
 /// Locals function prototypes
 static void application_task_function(void* pvParams);
-static void construct_JSON_CAN_msg(char msg[MAX_JSON_MSG_LEN], const CAN_frame_t& frame);
+static void init_storage(void);
+static void poll_due(uint32_t now_ms);
+static bool is_uplink_open(void);
+static bool is_connected(void);
+static bool publish_traced(const char* topic, const char* payload, uint32_t origin_us);
+static void log_pipeline_stats(void);
+static void agg_window_timer_callback(TimerHandle_t timer);
+static void metrics_timer_callback(TimerHandle_t timer);
+static void publish_metrics(void);
+static void publish_latency_metrics(void);
+static void publish_counters(void);
+static void queue_downlink(downlink_buffer_t* buffer);
+static void start_downlink(void);
+static void transmit_downlink(void);
+static void finish_downlink(bool ok, const char* status);
+static const char* config_apply(const remote_config_t* config);
+static void config_report(uint32_t version, bool ok, const char* error);
+static const char* render_routes(const remote_config_t* config);
+static const char* apply_config_settings(const remote_config_t* config);
+
+/// The frame pipeline publishes through the AWS client and sends
+/// on the MCP2515
+static const gw_core_ops_t CORE_OPS =
+{
+    publish_traced,     // publish
+    CAN_send,           // send
+    is_connected,       // is_connected
+    is_uplink_open,     // is_uplink_open
+};
 
 // --------------------------------------------------
 // Public functions 
 // --------------------------------------------------
 void application_start(void)
 {
+    // Logs of the frame path are printed by a task of their own
+    dlog_start();
+
     ESP_LOGI(TAG, "Creating main application objects");
 
     // Create queue
-    mainAppQueue = xQueueCreate(APP_QUEUE_SIZE, sizeof(main_app_event_t));
+    mainAppQueue = xQueueCreateStatic(APP_QUEUE_SIZE,
+                                      sizeof(main_app_event_t),
+                                      mainAppQueueStorage,
+                                      &mainAppQueueBuffer);
 
     // Create task
-    xTaskCreate(application_task_function, 
-                "app_task", 
-                APP_TASK_STACK_SIZE, 
-                NULL, 
-                APP_TASK_PRIORITY, 
-                &mainAppTask);
+    mainAppTask = xTaskCreateStaticPinnedToCore(application_task_function, 
+                                                "app_task", 
+                                                APP_TASK_STACK_SIZE, 
+                                                NULL, 
+                                                APP_TASK_PRIORITY, 
+                                                mainAppStack,
+                                                &mainAppTaskBuffer,
+                                                APP_TASK_CORE);
+    mem_budget_account(MEM_APP, APP_STATIC_BYTES);
+
+    if (GW_MODE == GW_MODE_AGGREGATE)
+    {
+        // Closes the aggregation window periodically
+        aggWindowTimer = xTimerCreateStatic("agg_timer",
+                                            pdMS_TO_TICKS(AGG_WINDOW_MS),
+                                            pdTRUE,
+                                            NULL,
+                                            agg_window_timer_callback,
+                                            &aggWindowTimerBuffer);
+    }
+
+    metricsTimer = xTimerCreateStatic("metrics_timer",
+                                      pdMS_TO_TICKS(METRICS_REPORT_MS),
+                                      pdTRUE,
+                                      NULL,
+                                      metrics_timer_callback,
+                                      &metricsTimerBuffer);
+
+    // Diagnostics on the serial console
+    cli_start();
 }
 
-void application_sendEvent(main_app_event_t event)
+bool application_sendEvent(main_app_event_t event)
 {
-    xQueueSend(mainAppQueue, &event, 0);
+    counters_received(COUNTERS_EVENTS, 1);
+    if (xQueueSend(mainAppQueue, &event, 0) != pdTRUE)
+    {
+        counters_dropped(COUNTERS_EVENTS, DROP_QUEUE_FULL, 1);
+        return false;
+    }
+    counters_forwarded(COUNTERS_EVENTS, 1);
+    return true;
+}
+
+bool application_call(void (*fn)(void* arg), void* arg)
+{
+    app_call_t call = { fn, arg, xTaskGetCurrentTaskHandle() };
+
+    main_app_event_t event;
+    event.Type = EVENT_CALL;
+    event.Data = &call;
+    if (!application_sendEvent(event))
+    {
+        return false;
+    }
+
+    // The call lives on this stack, wait until it is done
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return true;
 }
 
 void application_sendEventFromIsr(main_app_event_t event)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    xQueueSendFromISR(mainAppQueue, &event, &xHigherPriorityTaskWoken);
+    counters_received(COUNTERS_EVENTS, 1);
+    if (xQueueSendFromISR(mainAppQueue, &event, &xHigherPriorityTaskWoken) != pdTRUE)
+    {
+        counters_dropped(COUNTERS_EVENTS, DROP_QUEUE_FULL, 1);
+    }
+    else
+    {
+        counters_forwarded(COUNTERS_EVENTS, 1);
+    }
 
     // If a lower priority was set to hold, force a context switch
     if (xHigherPriorityTaskWoken != pdFALSE)
@@ -76,25 +230,122 @@ void application_sendEventFromIsr(main_app_event_t event)
 // --------------------------------------------------
 // Local private functions 
 // --------------------------------------------------
+/// @brief Four payload bytes as a word, for the deferred log
+static inline uint32_t be32(const uint8_t* bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+         | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
 static void application_task_function(void* pvParameters)
 {
     main_app_event_t event;
 
     ESP_LOGI(TAG, "Main application thread running.");
+    boot_mark(BOOT_APP_START);
 
     // Initialize modules needed by the application
-    wifi_init();
+    downlink_init();
+
+    // Single controller, its bus index is 0
+    gw_core_init(&CORE_OPS, 0, TOPIC_PUB, CONFIG_AWS_EXAMPLE_CLIENT_ID,
+                 (uint32_t)(esp_timer_get_time() / 1000));
+
+    // The last configuration is stored in NVS. Its policies are in
+    // place before the first frame is received
+    init_storage();
+    const remote_config_t* config = remote_config_load();
+
+#if TRACE_ENABLE
+    // Capture starts with the first frame, the uplink is not needed
+    trace_sd_start();
+#endif
+
     if (!CAN_init())
     {
         ESP_LOGE(TAG, "Could not initialize CAN module");
     }
 
+    const char* error = (config != NULL) ? render_routes(config) : NULL;
+    if (config != NULL && error == NULL)
+    {
+        error = apply_config_settings(config);
+    }
+    if (error != NULL)
+    {
+        ESP_LOGE(TAG, "Stored CAN, routing and batching settings not applied: %s", error);
+    }
+    boot_mark(BOOT_CAN_READY);
+
+    // Frames are captured from here on. The AWS client is set up and
+    // the certificates are parsed while Wifi associates, and uplink
+    // messages wait in its queue until the first connection
+    aws_iot_task_start();
+    wifi_init();
+
+#if CANNELLONI_ENABLE
+    // Packets are discarded until Wifi is up and a peer is known
+    cannelloni_udp_start();
+#endif
+
+    remote_config_start(config_apply, config_report);
+
+    // Every long-lived object exists by now
+    mem_budget_report();
+
+    if (aggWindowTimer != NULL)
+    {
+        xTimerStart(aggWindowTimer, 0);
+    }
+    if (metricsTimer != NULL)
+    {
+        xTimerStart(metricsTimer, 0);
+    }
+
     // Main application event loop
     while (true)
     {
-        if (xQueueReceive(mainAppQueue, (void*)&event, portMAX_DELAY) != pdTRUE)
+        // While a command is being sent, wake up every tick to refill
+        // the transmit buffers of the controller. Otherwise wake up
+        // when the oldest open batch, a transport session timeout, the
+        // capture buffer or the stream packet is due
+        TickType_t timeout = portMAX_DELAY;
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        uint32_t due_ms = gw_core_next_due_ms(now_ms);
+#if TRACE_ENABLE
+        uint32_t trace_due_ms = trace_next_due_ms(now_ms);
+        if (trace_due_ms < due_ms)
+        {
+            due_ms = trace_due_ms;
+        }
+#endif
+#if CANNELLONI_ENABLE
+        uint32_t stream_due_ms = cannelloni_next_due_ms(now_ms);
+        if (stream_due_ms < due_ms)
+        {
+            due_ms = stream_due_ms;
+        }
+#endif
+#if SLCAN_ENABLE
+        uint32_t slcan_due_ms = slcan_next_due_ms(now_ms);
+        if (slcan_due_ms < due_ms)
+        {
+            due_ms = slcan_due_ms;
+        }
+#endif
+        if (due_ms != UINT32_MAX)
+        {
+            timeout = pdMS_TO_TICKS(due_ms) + 1;
+        }
+        if (downlinkCount > 0)
+        {
+            timeout = 1;
+        }
+
+        if (xQueueReceive(mainAppQueue, (void*)&event, timeout) != pdTRUE)
         {
-            // Failed to receive from queue, should never happen
+            transmit_downlink();
+            poll_due((uint32_t)(esp_timer_get_time() / 1000));
             continue;
         }
 
@@ -110,13 +361,19 @@ static void application_task_function(void* pvParameters)
             
             case EVENT_WIFI_CONNECTED:
                 ESP_LOGI(TAG, "WIFI Connection successful");
-                // Connect to AWS host as soon as Wifi is established
-                aws_iot_task_start(); 
+                // Connect to AWS host as soon as Wifi is established. The
+                // task reconnects on its own afterwards
+                aws_iot_network_ready();
+                break;
+
+            case EVENT_WIFI_DISCONNECTED:
+                ESP_LOGW(TAG, "WIFI disconnected, reconnecting");
                 break;
 
             case EVENT_AWS_CONNECTED:
                 ESP_LOGI(TAG, "AWS Connection successful");
                 is_AWS_connected = true;
+                is_AWS_ever_connected = true;
                 break;
 
             case EVENT_AWS_DISCONNECTED:
@@ -125,52 +382,559 @@ static void application_task_function(void* pvParameters)
                 break;
 
             case EVENT_AWS_TOPIC_MSG:
-                // Serialize and convert AWS json message to a format appropiate
-                // to send to can device
+                // Parse the command into frames and send them to the bus
+                queue_downlink((downlink_buffer_t*)event.Data);
                 break;
 
+            case EVENT_CANNELLONI_MSG:
+                // Frames of the local stream share the command path
+                queue_downlink((downlink_buffer_t*)event.Data);
+                break;
+
+            case EVENT_AWS_CONFIG_MSG:
+                // Validated and applied by the configuration task
+                if (!remote_config_submit((downlink_buffer_t*)event.Data))
+                {
+                    ESP_LOGW(TAG, "Configuration dropped, one is already pending");
+                    downlink_release((downlink_buffer_t*)event.Data);
+                }
+                break;
+
+            case EVENT_CONFIG_APPLY:
+            {
+                // Reconfiguring the controller pauses reception, so it
+                // is done here between two frames
+                configApplyError = apply_config_settings((const remote_config_t*)event.Data);
+                xTaskNotifyGive(configApplyTask);
+                break;
+            }
+
             case EVENT_CAN_MSG:
             {
-                ESP_LOGD(TAG, "EVENT_CAN_MSG");
+                DLOG_D(TAG, "EVENT_CAN_MSG");
 
-                // Convert CAN message to JSON and send to AWS
+                // The interrupt stamped the event with its capture time
+                uint32_t isr_us = (uint32_t)(uintptr_t)event.Data;
+                LATENCY_RECORD(LATENCY_ISR_TO_DEQUEUE, isr_us);
+
+                // Convert CAN messages to JSON and send to AWS. Both
+                // receive buffers are drained
                 CAN_frame_t frame;
-                if (CAN_receive(&frame))
+                uint32_t read_us = LATENCY_NOW();
+                while (CAN_receive(&frame))
                 {
-                    ESP_LOGD(TAG, "[CAN MSG] ID=%d DLC=%d", frame.can_id, frame.can_dlc);
-                    ESP_LOG_BUFFER_HEX_LEVEL(TAG, frame.data, frame.can_dlc, ESP_LOG_DEBUG);
+                    LATENCY_RECORD(LATENCY_SPI_READ, read_us);
+                    counters_received(COUNTERS_CONTROLLER, 1);
+                    counters_forwarded(COUNTERS_CONTROLLER, 1);
+                    boot_mark(BOOT_FIRST_FRAME);
+#if TRACE_ENABLE
+                    trace_frame(&frame, (uint64_t)esp_timer_get_time());
+#endif
+#if CANNELLONI_ENABLE
+                    cannelloni_frame(&frame, (uint32_t)(esp_timer_get_time() / 1000));
+#endif
+#if SLCAN_ENABLE
+                    slcan_frame(&frame, (uint32_t)(esp_timer_get_time() / 1000));
+#endif
+                    DLOG_D(TAG, "[CAN MSG] ID=0x%lx DLC=%u data=%08lx%08lx",
+                           (unsigned long)frame.can_id, frame.can_dlc,
+                           (unsigned long)be32(&frame.data[0]), (unsigned long)be32(&frame.data[4]));
 
-                    if (is_AWS_connected)
-                    {
-                        char msg[MAX_JSON_MSG_LEN];
-                        construct_JSON_CAN_msg(msg, frame);
+                    uint32_t process_us = LATENCY_NOW();
+                    gw_core_frame(&frame, isr_us, (uint32_t)(esp_timer_get_time() / 1000));
+                    LATENCY_RECORD(LATENCY_PROCESS, process_us);
+                    read_us = LATENCY_NOW();
+                }
 
-                        ESP_LOGI(TAG, "Sending to AWS: %s", msg);
-                        aws_iot_publish(msg);
-                    }
+                uint8_t overflows = CAN_check_overflow();
+                if (overflows > 0)
+                {
+                    counters_dropped(COUNTERS_CONTROLLER, DROP_OVERFLOW, overflows);
                 }
                 break;
             }
 
+            case EVENT_AGG_WINDOW:
+                gw_core_close_window((uint32_t)(esp_timer_get_time() / 1000));
+                break;
+
+            case EVENT_METRICS:
+                // Logged between two drains of the controller, never
+                // while its buffers fill
+                publish_metrics();
+                log_pipeline_stats();
+                break;
+
+            case EVENT_CALL:
+            {
+                app_call_t* call = (app_call_t*)event.Data;
+                call->fn(call->arg);
+                xTaskNotifyGive(call->caller);
+                break;
+            }
+
             default:
                 break;
         }
+
+        if (downlinkCount > 0)
+        {
+            transmit_downlink();
+        }
+        poll_due((uint32_t)(esp_timer_get_time() / 1000));
+    }
+}
+
+/// @brief Runs what is due in the pipeline, the capture and the
+/// streams. Called after every event as well as on timeouts, a busy
+/// bus would never let the queue time out
+static void poll_due(uint32_t now_ms)
+{
+    gw_core_poll(now_ms);
+#if TRACE_ENABLE
+    trace_poll(now_ms);
+#endif
+#if CANNELLONI_ENABLE
+    cannelloni_poll(now_ms);
+#endif
+#if SLCAN_ENABLE
+    slcan_poll(now_ms);
+#endif
+}
+
+static void init_storage(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES
+        || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ESP_ERROR_CHECK(nvs_flash_init());
     }
 }
 
-static void construct_JSON_CAN_msg(char msg[MAX_JSON_MSG_LEN], const CAN_frame_t& frame)
+static bool is_uplink_open(void)
 {
-    char data_str[30];
+    // Frames captured during boot are queued for the first connection.
+    // Later outages drop them, the queue is kept for retransmissions
+    return is_AWS_connected || !is_AWS_ever_connected;
+}
+
+static bool is_connected(void)
+{
+    return is_AWS_connected;
+}
+
+static bool publish_traced(const char* topic, const char* payload, uint32_t origin_us)
+{
+    return aws_iot_publish_traced(topic, payload, origin_us);
+}
+
+static void queue_downlink(downlink_buffer_t* buffer)
+{
+    // Never more commands than buffers, the ring cannot overflow
+    downlinkQueue[(downlinkHead + downlinkCount) % DOWNLINK_POOL_SIZE] = buffer;
+    downlinkCount++;
+
+    if (downlinkCount == 1)
+    {
+        start_downlink();
+    }
+}
+
+static void start_downlink(void)
+{
+    const downlink_buffer_t* buffer = downlinkQueue[downlinkHead];
+
+    downlinkFrameReady = false;
+    downlinkProgressMs = (uint32_t)(esp_timer_get_time() / 1000);
 
-    // Translate the frame's hex data into a string
-    int buf_idx = 0;
-    for (int i = 0; i < frame.can_dlc; i++) {
-        sprintf(&data_str[buf_idx], "%02x ", frame.data[i]);
-        buf_idx += 3;
-    } 
+    if (!downlink_begin(&downlinkIter, buffer->data, buffer->length))
+    {
+        ESP_LOGW(TAG, "Malformed command of %u bytes", buffer->length);
+        finish_downlink(false, "invalid");
+    }
+}
+
+static void transmit_downlink(void)
+{
+    while (downlinkCount > 0)
+    {
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+        if (!downlinkFrameReady)
+        {
+            downlink_status_e status = downlink_next(&downlinkIter, &downlinkFrame);
+            if (status == DOWNLINK_END)
+            {
+                finish_downlink(true, "ok");
+                continue;
+            }
+            if (status == DOWNLINK_ERROR)
+            {
+                finish_downlink(false, "invalid");
+                continue;
+            }
+            downlinkFrameReady = true;
+        }
 
-    // Construct the JSON message
-    sprintf(msg, 
-            "{\n\t\"id\": \"%d\",\n\t \"dlc\": \"%d\",\n\t\"data\": \"%s\"\n}",
-            frame.can_id, frame.can_dlc, data_str);
-}
\ No newline at end of file
+        if (CAN_send(&downlinkFrame))
+        {
+            downlinkFrameReady = false;
+            downlinkProgressMs = now_ms;
+        }
+        else if ((uint32_t)(now_ms - downlinkProgressMs) > DOWNLINK_TX_TIMEOUT_MS)
+        {
+            finish_downlink(false, "tx_timeout");
+        }
+        else
+        {
+            // All transmit buffers busy, retry on the next tick
+            return;
+        }
+    }
+}
+
+static void finish_downlink(bool ok, const char* status)
+{
+    downlink_buffer_t* buffer = downlinkQueue[downlinkHead];
+    uint32_t latency_us = (uint32_t)esp_timer_get_time() - buffer->received_us;
+
+    // Frames returned by the parser and still pending were never sent
+    uint16_t sent = downlinkIter.frames - (downlinkFrameReady ? 1 : 0);
+    downlink_record(sent, ok, latency_us);
+
+    // Stream packets have no identifier and are not acknowledged
+    bool is_command = (downlinkIter.format != DOWNLINK_FORMAT_CANNELLONI);
+
+    if (is_command && is_AWS_connected)
+    {
+        // The identifier is echoed as is, minus characters that
+        // would break the JSON string
+        char cmd_id[DOWNLINK_MAX_CMD_ID_LEN + 1];
+        for (uint8_t i = 0; i < downlinkIter.cmd_id_len; i++)
+        {
+            char c = downlinkIter.cmd_id[i];
+            cmd_id[i] = (c < 0x20 || c == '"' || c == '\\') ? '_' : c;
+        }
+        cmd_id[downlinkIter.cmd_id_len] = '\0';
+
+        char msg[MAX_JSON_ACK_LEN];
+        snprintf(msg, sizeof(msg),
+                 "{\n\t\"cmd\": \"%s\",\n\t\"status\": \"%s\",\n\t\"frames\": %u,\n\t\"latency_us\": %lu\n}",
+                 cmd_id, status, sent, (unsigned long)latency_us);
+        aws_iot_publish_topic(TOPIC_ACK, msg);
+    }
+
+    if (is_command)
+    {
+        ESP_LOGI(TAG, "Command %.*s %s: %u frames in %lu us",
+                 downlinkIter.cmd_id_len, downlinkIter.cmd_id, status, sent, (unsigned long)latency_us);
+    }
+    else if (!ok)
+    {
+        DLOG_W(TAG, "Stream packet %s after %u frames", status, sent);
+    }
+
+    downlink_release(buffer);
+    downlinkHead = (downlinkHead + 1) % DOWNLINK_POOL_SIZE;
+    downlinkCount--;
+
+    if (downlinkCount > 0)
+    {
+        start_downlink();
+    }
+}
+
+static const char* config_apply(const remote_config_t* config)
+{
+    // Topics are rendered here, the application task only swaps tables
+    const char* error = render_routes(config);
+    if (error != NULL)
+    {
+        return error;
+    }
+
+    configApplyTask = xTaskGetCurrentTaskHandle();
+
+    main_app_event_t event;
+    event.Type = EVENT_CONFIG_APPLY;
+    event.Data = (void*)config;
+    if (!application_sendEvent(event))
+    {
+        return "gateway busy";
+    }
+
+    // Blocks the configuration task only, frames keep flowing
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return configApplyError;
+}
+
+static void config_report(uint32_t version, bool ok, const char* error)
+{
+    if (!is_AWS_connected)
+    {
+        return;
+    }
+
+    char msg[MAX_JSON_CONFIG_ACK_LEN];
+    if (ok)
+    {
+        snprintf(msg, sizeof(msg), "{\n\t\"config\": %lu,\n\t\"status\": \"applied\"\n}",
+                 (unsigned long)version);
+    }
+    else
+    {
+        snprintf(msg, sizeof(msg), "{\n\t\"config\": %lu,\n\t\"status\": \"rejected\",\n\t\"error\": \"%.*s\"\n}",
+                 (unsigned long)version, REMOTE_CONFIG_MAX_ERROR_LEN, error);
+    }
+    aws_iot_publish_topic(TOPIC_ACK, msg);
+}
+
+static const char* render_routes(const remote_config_t* config)
+{
+    // Topics are rendered into the standby table, the running one is
+    // untouched if one of them is rejected
+    routing_update_begin();
+    for (uint8_t i = 0; i < config->n_routes; i++)
+    {
+        const remote_config_route_t* route = &config->routes[i];
+        bool ok = route->is_pgn ? routing_update_pgn(route->first, route->topic)
+                                : routing_update_ids(route->first, route->last, route->topic);
+        if (!ok)
+        {
+            return "route rejected, check topic and range";
+        }
+    }
+    return NULL;
+}
+
+static const char* apply_config_settings(const remote_config_t* config)
+{
+    // Routes were rendered by render_routes, only the controller and
+    // the commit of the standby table run on this task
+    if (config->can_changed && !CAN_configure(config->bitrate, config->filters, config->n_filters))
+    {
+        return "controller rejected the settings";
+    }
+
+    gw_core_commit_routes();
+    batch_set_limits(config->batch_max_frames, config->batch_max_delay_ms);
+    return NULL;
+}
+
+static void log_pipeline_stats(void)
+{
+    policy_stats_t policy_stats;
+    policy_get_stats(&policy_stats);
+
+    for (int rule = 0; rule < N_POLICY_RULES; rule++)
+    {
+        if (policy_stats.hits[rule] != 0)
+        {
+            ESP_LOGI(TAG, "Policy %s hits=%lu passed=%lu",
+                     policy_rule_name((policy_rule_e)rule),
+                     (unsigned long)policy_stats.hits[rule],
+                     (unsigned long)policy_stats.passed[rule]);
+        }
+    }
+
+    cov_stats_t cov_stats;
+    cov_get_stats(&cov_stats);
+    ESP_LOGI(TAG, "COV seen=%lu published=%lu suppressed=%lu ratio=%.2f",
+             (unsigned long)cov_stats.seen, (unsigned long)cov_stats.published,
+             (unsigned long)cov_stats.suppressed, cov_suppression_ratio());
+
+    isotp_stats_t isotp_stats;
+    isotp_get_stats(&isotp_stats);
+    ESP_LOGI(TAG, "ISO-TP single=%lu multi=%lu timeouts=%lu seq_errors=%lu overflows=%lu",
+             (unsigned long)isotp_stats.single_frames, (unsigned long)isotp_stats.multi_frames,
+             (unsigned long)isotp_stats.timeouts, (unsigned long)isotp_stats.sequence_errors,
+             (unsigned long)isotp_stats.overflows);
+
+    j1939_stats_t j1939_stats;
+    j1939_get_stats(&j1939_stats);
+    ESP_LOGI(TAG, "J1939 bam=%lu cmdt=%lu timeouts=%lu seq_errors=%lu overflows=%lu aborts=%lu",
+             (unsigned long)j1939_stats.bam_sessions, (unsigned long)j1939_stats.cmdt_sessions,
+             (unsigned long)j1939_stats.timeouts, (unsigned long)j1939_stats.sequence_errors,
+             (unsigned long)j1939_stats.overflows, (unsigned long)j1939_stats.aborts);
+
+    batch_stats_t batch_stats;
+    batch_get_stats(&batch_stats);
+    ESP_LOGI(TAG, "Batch messages=%lu publishes=%lu evictions=%lu",
+             (unsigned long)batch_stats.messages, (unsigned long)batch_stats.publishes,
+             (unsigned long)batch_stats.evictions);
+
+#if TRACE_ENABLE
+    trace_stats_t trace_stats;
+    trace_get_stats(&trace_stats);
+    ESP_LOGI(TAG, "Trace frames=%lu dropped=%lu bytes=%lu files=%lu errors=%lu",
+             (unsigned long)trace_stats.frames, (unsigned long)trace_stats.dropped,
+             (unsigned long)trace_stats.bytes, (unsigned long)trace_stats.files,
+             (unsigned long)trace_stats.errors);
+#endif
+
+#if CANNELLONI_ENABLE
+    cannelloni_stats_t stream_stats;
+    cannelloni_get_stats(&stream_stats);
+    ESP_LOGI(TAG, "Stream frames=%lu dropped=%lu packets=%lu unsent=%lu",
+             (unsigned long)stream_stats.frames, (unsigned long)stream_stats.dropped,
+             (unsigned long)stream_stats.packets, (unsigned long)stream_stats.unsent);
+#endif
+
+    aws_publish_stats_t publish_stats;
+    aws_iot_get_publish_stats(&publish_stats);
+    if (publish_stats.acked != 0)
+    {
+        ESP_LOGI(TAG, "Publish queued=%lu acked=%lu failed=%lu dropped=%lu retransmits=%lu latency us avg=%lu max=%lu",
+                 (unsigned long)publish_stats.queued, (unsigned long)publish_stats.acked,
+                 (unsigned long)publish_stats.failed, (unsigned long)publish_stats.dropped,
+                 (unsigned long)publish_stats.retransmits,
+                 (unsigned long)(publish_stats.latency_sum_us / publish_stats.acked),
+                 (unsigned long)publish_stats.latency_max_us);
+    }
+
+    aws_connect_stats_t connect_stats;
+    aws_iot_get_connect_stats(&connect_stats);
+    ESP_LOGI(TAG, "AWS connects=%lu reconnects=%lu failed_attempts=%lu last ms dns=%lu tcp+tls=%lu connect=%lu subscribe=%lu total=%lu",
+             (unsigned long)connect_stats.connects, (unsigned long)connect_stats.reconnects,
+             (unsigned long)connect_stats.attempts, (unsigned long)(connect_stats.dns_us / 1000),
+             (unsigned long)(connect_stats.tls_us / 1000), (unsigned long)(connect_stats.connect_us / 1000),
+             (unsigned long)(connect_stats.subscribe_us / 1000),
+             (unsigned long)(connect_stats.total_us / 1000));
+
+    wifi_stats_t wifi_stats;
+    wifi_get_stats(&wifi_stats);
+    ESP_LOGI(TAG, "WIFI connects=%lu disconnects=%lu fast=%lu scans=%lu time to IP ms last=%lu max=%lu",
+             (unsigned long)wifi_stats.connects, (unsigned long)wifi_stats.disconnects,
+             (unsigned long)wifi_stats.fast_connects, (unsigned long)wifi_stats.full_scans,
+             (unsigned long)wifi_stats.last_time_to_ip_ms, (unsigned long)wifi_stats.max_time_to_ip_ms);
+
+    aws_loop_stats_t loop_stats;
+    aws_iot_get_loop_stats(&loop_stats);
+    ESP_LOGI(TAG, "AWS wakeups socket=%lu publish=%lu timeout=%lu",
+             (unsigned long)loop_stats.socket_wakeups, (unsigned long)loop_stats.publish_wakeups,
+             (unsigned long)loop_stats.timeout_wakeups);
+
+    downlink_stats_t downlink_stats;
+    downlink_get_stats(&downlink_stats);
+    if (downlink_stats.commands != 0)
+    {
+        ESP_LOGI(TAG, "Downlink commands=%lu frames=%lu errors=%lu dropped=%lu latency us min=%lu avg=%lu max=%lu",
+                 (unsigned long)downlink_stats.commands, (unsigned long)downlink_stats.frames,
+                 (unsigned long)downlink_stats.errors, (unsigned long)downlink_stats.dropped,
+                 (unsigned long)downlink_stats.latency_min_us,
+                 (unsigned long)(downlink_stats.latency_sum_us / downlink_stats.commands),
+                 (unsigned long)downlink_stats.latency_max_us);
+    }
+}
+
+static void metrics_timer_callback(TimerHandle_t timer)
+{
+    (void)timer;
+
+    main_app_event_t event;
+    event.Type = EVENT_METRICS;
+    event.Data = NULL;
+    application_sendEvent(event);
+}
+
+static void publish_metrics(void)
+{
+    publish_counters();
+#if LATENCY_ENABLE
+    publish_latency_metrics();
+#endif
+}
+
+static void publish_counters(void)
+{
+    static char msg[MAX_JSON_COUNTERS_LEN];
+    counters_snapshot_t snapshot;
+    counters_get(&snapshot);
+
+    int len = snprintf(msg, sizeof(msg), "{\"counters\":{");
+    for (int stage = 0; stage < COUNTERS_STAGES && len < (int)sizeof(msg); stage++)
+    {
+        ESP_LOGI(TAG, "Counters %s received=%lu forwarded=%lu",
+                 counters_stage_name((counters_stage_e)stage),
+                 (unsigned long)snapshot.received[stage], (unsigned long)snapshot.forwarded[stage]);
+
+        len += snprintf(&msg[len], sizeof(msg) - len, "%s\"%s\":{\"in\":%lu,\"out\":%lu,\"drop\":{",
+                        (stage > 0) ? "," : "", counters_stage_name((counters_stage_e)stage),
+                        (unsigned long)snapshot.received[stage], (unsigned long)snapshot.forwarded[stage]);
+
+        bool first = true;
+        for (int reason = 0; reason < DROP_REASONS && len < (int)sizeof(msg); reason++)
+        {
+            uint32_t dropped = snapshot.dropped[stage][reason];
+            if (dropped == 0)
+            {
+                continue;
+            }
+
+            ESP_LOGI(TAG, "Counters %s dropped %s=%lu", counters_stage_name((counters_stage_e)stage),
+                     counters_drop_name((counters_drop_e)reason), (unsigned long)dropped);
+            len += snprintf(&msg[len], sizeof(msg) - len, "%s\"%s\":%lu", first ? "" : ",",
+                            counters_drop_name((counters_drop_e)reason), (unsigned long)dropped);
+            first = false;
+        }
+
+        if (len < (int)sizeof(msg))
+        {
+            len += snprintf(&msg[len], sizeof(msg) - len, "}}");
+        }
+    }
+
+    if (len < (int)sizeof(msg) - 2 && is_AWS_connected)
+    {
+        snprintf(&msg[len], sizeof(msg) - len, "}}");
+        aws_iot_publish_topic(TOPIC_METRICS, msg);
+    }
+}
+
+static void publish_latency_metrics(void)
+{
+    static char msg[MAX_JSON_METRICS_LEN];
+    int len = snprintf(msg, sizeof(msg), "{\"latency_us\":{");
+
+    for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+        latency_summary_t summary;
+        latency_summarize((latency_stage_e)stage, &summary);
+
+        ESP_LOGI(TAG, "Latency %s n=%lu p50=%lu p90=%lu p99=%lu max=%lu us",
+                 latency_stage_name((latency_stage_e)stage), (unsigned long)summary.count,
+                 (unsigned long)summary.p50_us, (unsigned long)summary.p90_us,
+                 (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+
+        if (len < (int)sizeof(msg))
+        {
+            len += snprintf(&msg[len], sizeof(msg) - len,
+                            "%s\"%s\":{\"n\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                            (stage > 0) ? "," : "", latency_stage_name((latency_stage_e)stage),
+                            (unsigned long)summary.count, (unsigned long)summary.p50_us,
+                            (unsigned long)summary.p90_us, (unsigned long)summary.p99_us,
+                            (unsigned long)summary.max_us);
+        }
+    }
+
+    // Each report covers one period
+    latency_reset();
+
+    if (len < (int)sizeof(msg) - 2 && is_AWS_connected)
+    {
+        snprintf(&msg[len], sizeof(msg) - len, "}}");
+        aws_iot_publish_topic(TOPIC_METRICS, msg);
+    }
+}
+
+static void agg_window_timer_callback(TimerHandle_t timer)
+{
+    (void)timer;
+
+    main_app_event_t event;
+    event.Type = EVENT_AGG_WINDOW;
+    event.Data = NULL;
+    application_sendEvent(event);
+}
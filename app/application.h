@@ -12,6 +12,11 @@ extern "C"
 {
 #endif // __cplusplus
 
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stdbool.h>
+
 // --------------------------------------------------
 // Type definitions
 // --------------------------------------------------
@@ -25,7 +30,13 @@ typedef enum
     EVENT_AWS_CONNECTED,
     EVENT_AWS_DISCONNECTED,
     EVENT_AWS_TOPIC_MSG,
-    EVENT_CAN_MSG
+    EVENT_AWS_CONFIG_MSG,
+    EVENT_CANNELLONI_MSG,
+    EVENT_CONFIG_APPLY,
+    EVENT_CAN_MSG,
+    EVENT_AGG_WINDOW,
+    EVENT_METRICS,
+    EVENT_CALL
 } event_type_e;
 
 typedef struct
@@ -39,9 +50,16 @@ typedef struct
 // --------------------------------------------------
 
 void application_start(void);
-void application_sendEvent(main_app_event_t event);
+bool application_sendEvent(main_app_event_t event);
 void application_sendEventFromIsr(main_app_event_t event);
 
+/// @brief Runs a function in the application task and waits for it,
+/// for resources only that task may use, such as the SPI bus
+/// @param fn Function to run
+/// @param arg Argument of the function
+/// @return false if the event queue is full and fn did not run
+bool application_call(void (*fn)(void* arg), void* arg);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -14,4 +14,7 @@
 
 // MCP2515 specific pins
 #define MCP_SPI_PIN_CS         GPIO_NUM_5
-#define MCP_SPI_PIN_INTERRUPT  GPIO_NUM_21
\ No newline at end of file
+#define MCP_SPI_PIN_INTERRUPT  GPIO_NUM_21
+
+// Crystal of the MCP2515 module
+#define MCP_CRYSTAL            MCP_8MHZ
\ No newline at end of file
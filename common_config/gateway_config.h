@@ -0,0 +1,166 @@
+// ***************************************************** //
+/// @file gateway_config.h
+/// @brief Tuning parameters of the CAN to cloud pipeline
+// ***************************************************** //
+
+#ifndef _GATEWAY_CONFIG_H_
+#define _GATEWAY_CONFIG_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------
+// Constants 
+// --------------------------------------------------
+
+/// Bus bitrate used until a configuration document sets another one
+#define CAN_DEFAULT_BITRATE         (100000)
+
+/// Publishing mode. RAW publishes every forwarded frame, AGGREGATE
+/// publishes one statistics summary per tumbling window instead
+#define GW_MODE_RAW                 (0)
+#define GW_MODE_AGGREGATE           (1)
+#define GW_MODE                     GW_MODE_RAW
+
+/// Length of the aggregation window, e.g. 1000, 10000 or 60000
+#define AGG_WINDOW_MS               (10000)
+
+/// ISO-TP reassembly of the OBD-II diagnostic responses 0x7E8-0x7EF.
+/// With flow control enabled the gateway answers First Frames on the
+/// matching request ID 0x7E0-0x7E7, otherwise it only listens
+#define ISOTP_ENABLE                (1)
+#define ISOTP_FLOW_CONTROL          (0)
+#define ISOTP_OBD_RX_BASE_ID        (0x7E8)
+#define ISOTP_OBD_TX_BASE_ID        (0x7E0)
+#define ISOTP_OBD_CHANNELS          (8)
+
+/// J1939 support. Extended frames are indexed by PGN for policies and
+/// decoding, and TP.BAM / TP.CM parameter groups are reassembled. With
+/// replies enabled, connection mode sessions addressed to the gateway
+/// are answered with CTS/EOMA, otherwise the gateway only listens
+#define J1939_ENABLE                (1)
+#define J1939_GATEWAY_ADDRESS       (0x80)
+#define J1939_CMDT_REPLY            (0)
+
+/// Cloud to CAN commands. A command is abandoned when the controller
+/// has not accepted a frame for this long, e.g. on a bus without ACK
+#define DOWNLINK_TX_TIMEOUT_MS      (500)
+
+/// Rule applied to CAN IDs without an entry in the policy table
+#define POLICY_DEFAULT_RULE         POLICY_PASS
+#define POLICY_DEFAULT_ARG          (0)
+
+/// Uplink batching. Frames are grouped in one MQTT message until
+/// either limit is reached. Both can be changed at run time through
+/// the config topic
+#define BATCH_MAX_FRAMES            (1)
+#define BATCH_MAX_DELAY_MS          (0)
+
+/// Uplink queue between the application and the AWS task. Messages
+/// stay queued until acknowledged and are sent again after a
+/// reconnect. The publish of the v3 SDK waits for its PUBACK, so
+/// one message goes out per round trip to the broker: batching is
+/// what raises the rate. The buffer must hold twice the largest message
+#define AWS_PUBLISH_BUFFER_SIZE     (20 * 1024)
+#define AWS_PUBLISH_MAX_ATTEMPTS    (3)
+
+/// The AWS task sleeps in select until the broker or the application
+/// has something for it. Yield then only reads what already arrived.
+/// Unacknowledged messages and reconnects are retried at the retry wait
+#define AWS_YIELD_TIMEOUT_MS        (10)
+#define AWS_RETRY_WAIT_MS           (100)
+
+/// Reconnect backoff, doubled on each failed attempt with up to half
+/// of it removed at random
+#define AWS_RECONNECT_MIN_MS        (500)
+#define AWS_RECONNECT_MAX_MS        (60000)
+
+/// Wifi reconnect backoff, doubled on each failed attempt with up to
+/// half of it removed at random. Attempts never stop
+#define WIFI_RETRY_MIN_MS           (250)
+#define WIFI_RETRY_MAX_MS           (30000)
+
+/// Static address of the STA, which saves the DHCP exchange on every
+/// connection. An empty string uses DHCP
+#define WIFI_STATIC_IP              ""
+#define WIFI_STATIC_NETMASK         "255.255.255.0"
+#define WIFI_STATIC_GATEWAY         "192.168.1.1"
+#define WIFI_STATIC_DNS             "192.168.1.1"
+
+/// Period of the metrics topic: frame counters, cumulative, and
+/// latency percentiles of the period
+#define METRICS_REPORT_MS           (60000)
+
+/// Latency histograms of the uplink stages. Set to 0 to compile the
+/// instrumentation out
+#define LATENCY_ENABLE              (1)
+
+/// Change-of-value suppression. An unchanged frame or signal is
+/// republished at least every heartbeat so consumers know it is current
+#define COV_ENABLE                  (1)
+#define COV_HEARTBEAT_MS            (5000)
+
+/// Deferred log sites above this level are compiled out, see dlog.h.
+/// DLOG_LEVEL_DEBUG traces every frame
+#define DLOG_LEVEL                  DLOG_LEVEL_INFO
+
+/// Records waiting to be printed. Must be a power of two
+#define DLOG_SLOTS                  (128)
+
+/// Capture of every received frame to the SD card, see trace.h.
+/// Formats are TRACE_FORMAT_BINARY, TRACE_FORMAT_CANDUMP and
+/// TRACE_FORMAT_ASC. A new file is started past the size or the age
+#define TRACE_ENABLE                (0)
+#define TRACE_FORMAT                TRACE_FORMAT_CANDUMP
+#define TRACE_FILE_MAX_BYTES        (64 * 1024 * 1024)
+#define TRACE_FILE_MAX_MS           (15 * 60 * 1000)
+#define TRACE_FLUSH_MS              (1000)
+
+/// Stream of every received frame in cannelloni UDP packets, see
+/// cannelloni.h. Without a remote address, frames are streamed to
+/// the first host that sends a packet to the local port, until the
+/// next reset. Packets of other hosts are dropped. A packet is
+/// sent once it holds CANNELLONI_BATCH_FRAMES or is CANNELLONI_TIMEOUT_MS old
+#define CANNELLONI_ENABLE           (0)
+#define CANNELLONI_LOCAL_PORT       (20000)
+#define CANNELLONI_REMOTE_IP        ""
+#define CANNELLONI_REMOTE_PORT      (20000)
+#define CANNELLONI_BATCH_FRAMES     (64)
+#define CANNELLONI_TIMEOUT_MS       (20)
+
+/// Frames received from the peer are sent on the bus. Needs
+/// CANNELLONI_REMOTE_IP, so no other host can send on the bus
+#define CANNELLONI_TX_ENABLE        (0)
+
+/// SLCAN adapter mode of the console UART, entered with the slcan
+/// command until the next reset, see slcan.h. Received frames wait
+/// at most SLCAN_FLUSH_MS before being written
+#define SLCAN_ENABLE                (0)
+#define SLCAN_BAUD_RATE             (2000000)
+#define SLCAN_FLUSH_MS              (2)
+
+/// State of the pipeline modules is reached through a context pointer
+/// bound per thread, so the Linux daemon can run one pipeline per CAN
+/// interface on a pool of threads. The firmware runs a single pipeline
+/// from the app task and keeps the constant pointer to static memory
+#ifndef GW_CONTEXT_PER_THREAD
+#define GW_CONTEXT_PER_THREAD       (0)
+#endif
+
+/// Declares the context of a module: its static instance and ctx,
+/// the pointer every function goes through
+#if GW_CONTEXT_PER_THREAD
+#define GW_CONTEXT(type)            static type ctxDefault; \
+                                    static _Thread_local type* ctx = &ctxDefault
+#else
+#define GW_CONTEXT(type)            static type ctxDefault; \
+                                    static type* const ctx = &ctxDefault
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GATEWAY_CONFIG_H_
@@ -15,13 +15,47 @@ extern "C"
 // --------------------------------------------------
 // Constants 
 // --------------------------------------------------
-#define CLI_TASK_STACK_SIZE         (1024 * 2)
-#define APP_TASK_STACK_SIZE         (1024 * 3)
+#define CLI_TASK_STACK_SIZE         (1024 * 3)
+#define APP_TASK_STACK_SIZE         (1024 * 4)
 #define AWS_TASK_STACK_SIZE         (1024 * 9)
+#define CONFIG_TASK_STACK_SIZE      (1024 * 3)
+#define DLOG_TASK_STACK_SIZE        (1024 * 3)
+#define TRACE_TASK_STACK_SIZE       (1024 * 3)
+#define CANNELLONI_TASK_STACK_SIZE  (1024 * 3)
 
-#define CLI_TASK_PRIORITY           (configMAX_PRIORITIES - 8)
+#define CLI_TASK_PRIORITY           (tskIDLE_PRIORITY + 1)
 #define APP_TASK_PRIORITY           (configMAX_PRIORITIES - 7)
 #define AWS_TASK_PRIORITY           (configMAX_PRIORITIES - 20)
+#define CONFIG_TASK_PRIORITY        (configMAX_PRIORITIES - 21)
+#define DLOG_TASK_PRIORITY          (tskIDLE_PRIORITY + 1)
+#define TRACE_TASK_PRIORITY         (configMAX_PRIORITIES - 19)
+#define CANNELLONI_TASK_PRIORITY    (configMAX_PRIORITIES - 19)
+#define SLCAN_TASK_PRIORITY         (configMAX_PRIORITIES - 19)
+
+// Core affinity. Wifi, lwIP and the TLS session run on core 0, the
+// CAN interrupt, reception and processing on core 1 so that TLS
+// bursts never delay the draining of the controller. The CAN ISR is
+// installed by the app task and runs on its core
+#define APP_TASK_CORE               (1)
+#define AWS_TASK_CORE               (0)
+#define CONFIG_TASK_CORE            (0)
+#define CLI_TASK_CORE               (tskNO_AFFINITY)
+#define DLOG_TASK_CORE              (0)
+#define TRACE_TASK_CORE             (0)
+#define CANNELLONI_TASK_CORE        (0)
+
+// Static memory budget per subsystem, in bytes. Each owner checks
+// its stacks, control blocks, queues and buffers against its budget
+// at compile time, see mem_budget.h
+#define MEM_BUDGET_CAN              (256)
+#define MEM_BUDGET_APP              (5 * 1024)
+#define MEM_BUDGET_AWS              (31 * 1024)
+#define MEM_BUDGET_CONFIG           (4 * 1024)
+#define MEM_BUDGET_CLI              (6 * 1024)
+#define MEM_BUDGET_LOG              (9 * 1024)
+#define MEM_BUDGET_TRACE            (36 * 1024)
+#define MEM_BUDGET_CANNELLONI       (10 * 1024)
+#define MEM_BUDGET_SLCAN            (5 * 1024)
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,89 @@
+// ***************************************************** //
+/// @file bench_dbc.c
+/// @brief Decoding throughput of the DBC tables: every
+/// message of dbc/gateway.dbc with varying payloads, in
+/// signals decoded per second
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "dbc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BENCH_DEFAULT_ROUNDS    (2000000)
+
+/// Payloads per message, so the multiplexed signals take turns
+#define BENCH_PAYLOADS          (16)
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(int argc, char* argv[])
+{
+    uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ROUNDS;
+
+    static CAN_frame_t frames[BENCH_PAYLOADS];
+    uint32_t           rng = 12345;
+    for (int i = 0; i < BENCH_PAYLOADS; i++)
+    {
+        frames[i].can_dlc = CAN_MAX_DLEN;
+        for (int b = 0; b < CAN_MAX_DLEN; b++)
+        {
+            rng = rng * 1103515245UL + 12345UL;
+            frames[i].data[b] = (uint8_t)(rng >> 16);
+        }
+        // Mux in the low nibble of byte 0
+        frames[i].data[0] = (uint8_t)((frames[i].data[0] & 0xF0) | (i & 1));
+    }
+
+    dbc_value_t values[DBC_MAX_SIGNALS_PER_MSG];
+    uint64_t    signals = 0;
+    uint64_t    lookups = 0;
+    double      sum = 0;
+
+    double start = now_s();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint16_t m = 0; m < DBC_NUM_MESSAGES; m++)
+        {
+            CAN_frame_t* frame = &frames[(r + m) % BENCH_PAYLOADS];
+            frame->can_id = DBC_MESSAGES[m].can_id;
+
+            // The lookup is part of the path of every frame
+            const dbc_message_t* msg = dbc_find_message(frame->can_id);
+            lookups++;
+            if (msg == NULL)
+            {
+                continue;
+            }
+
+            uint8_t n = dbc_decode(msg, frame, values, DBC_MAX_SIGNALS_PER_MSG);
+            signals += n;
+            sum += values[0].value;
+        }
+    }
+    double elapsed = now_s() - start;
+
+    printf("messages=%u lookups=%llu signals=%llu in %.3f s: %.1f M signals/s %.1f M frames/s (checksum %g)\n",
+           DBC_NUM_MESSAGES, (unsigned long long)lookups, (unsigned long long)signals, elapsed,
+           (double)signals / elapsed / 1e6, (double)lookups / elapsed / 1e6, sum);
+    return (signals > 0) ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// ***************************************************** //
+/// @file bench_mqtt.c
+/// @brief QoS 1 publish rate of the MQTT publisher against
+/// the fake broker, its PUBACKs delayed by the round trip
+/// of a remote broker. One publish waiting at a time, as
+/// the blocking SDK of the firmware does, then a window of
+/// them. Fails if the window is not several times faster
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "mqtt_tcp.h"
+#include "fake_broker.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BENCH_DEFAULT_MESSAGES  (1000)
+#define BENCH_DEFAULT_RTT_MS    (20)
+#define BENCH_DEFAULT_WINDOW    (32)
+
+/// Speedup of the window over a single publish waiting, at least
+#define BENCH_MIN_SPEEDUP       (4.0)
+
+/// Wait for the broker when nothing can be published
+#define BENCH_WAIT_MS           (100)
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static mqtt_tcp_t client;
+static uint32_t   acked;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(now_s() * 1000);
+}
+
+static void count_ack(void* arg, uint32_t tag, bool ok)
+{
+    (void)arg;
+    (void)tag;
+    acked += ok ? 1 : 0;
+}
+
+/// @brief Publishes every message and waits for the last PUBACK
+/// @return Messages acknowledged per second, 0 on error
+static double run_window(uint16_t port, uint32_t n_messages, uint16_t window)
+{
+    mqtt_tcp_init(&client);
+    mqtt_tcp_set_window(&client, window, count_ack, NULL);
+    if (!mqtt_tcp_connect(&client, "127.0.0.1", port, "bench_mqtt"))
+    {
+        return 0;
+    }
+
+    acked = 0;
+    uint32_t sent    = 0;
+    double   start   = now_s();
+    char     payload[] = "{\"id\":\"0x18FEF100\",\"data\":\"0011223344556677\"}";
+    while (acked < n_messages && mqtt_tcp_is_connected(&client))
+    {
+        while (sent < n_messages && mqtt_tcp_can_publish(&client, sizeof(payload) + 16))
+        {
+            if (!mqtt_tcp_publish(&client, "gw/bench", payload, sent))
+            {
+                break;
+            }
+            sent++;
+        }
+        mqtt_tcp_poll(&client, now_ms());
+
+        struct pollfd fd = { .fd = mqtt_tcp_fd(&client), .events = POLLIN };
+        if (fd.fd >= 0 && acked < n_messages)
+        {
+            poll(&fd, 1, BENCH_WAIT_MS);
+            mqtt_tcp_poll(&client, now_ms());
+        }
+    }
+    double elapsed = now_s() - start;
+
+    mqtt_tcp_stats_t stats;
+    mqtt_tcp_get_stats(&client, &stats);
+    mqtt_tcp_disconnect(&client);
+
+    double rate = (acked == n_messages) ? n_messages / elapsed : 0;
+    printf("window=%-3u messages=%u acked=%u max_inflight=%u in %.3f s: %.0f msg/s\n",
+           window, n_messages, stats.acked, stats.max_inflight, elapsed, rate);
+    return rate;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(int argc, char* argv[])
+{
+    uint32_t n_messages = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_MESSAGES;
+    uint32_t rtt_ms     = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : BENCH_DEFAULT_RTT_MS;
+    uint32_t window     = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 0) : BENCH_DEFAULT_WINDOW;
+    if (window < 1 || window > MQTT_TCP_MAX_WINDOW)
+    {
+        fprintf(stderr, "window must be 1 to %u\n", MQTT_TCP_MAX_WINDOW);
+        return 1;
+    }
+
+    uint16_t port = fake_broker_start(rtt_ms);
+    if (port == 0)
+    {
+        fprintf(stderr, "cannot start the broker\n");
+        return 1;
+    }
+    printf("round trip %u ms\n", rtt_ms);
+    double single    = run_window(port, n_messages, 1);
+    double pipelined = run_window(port, n_messages, (uint16_t)window);
+    fake_broker_stop();
+
+    if (single == 0 || pipelined < single * BENCH_MIN_SPEEDUP)
+    {
+        fprintf(stderr, "window %u is not %.0f times faster than 1\n", window, BENCH_MIN_SPEEDUP);
+        return 1;
+    }
+    printf("speedup %.1f\n", pipelined / single);
+    return 0;
+}
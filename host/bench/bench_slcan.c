@@ -0,0 +1,167 @@
+// ***************************************************** //
+/// @file bench_slcan.c
+/// @brief Throughput of the SLCAN encoder, of the transmit
+/// line decoder and of the command parser, in frames per
+/// second against a saturated 1 Mbit/s bus
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "slcan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BENCH_DEFAULT_ROUNDS    (5000000)
+
+/// Frames cycled through, with every length and both formats
+#define BENCH_FRAMES            (64)
+
+/// Standard data frame of 8 bytes without stuff bits, at 1 Mbit/s
+#define LINE_RATE_FRAME_US      (111)
+#define LINE_RATE_FPS           (1000000.0 / LINE_RATE_FRAME_US)
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static uint32_t transmitted;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static bool bench_open(bool timestamps, bool listen_only)
+{
+    (void)timestamps;
+    (void)listen_only;
+    return true;
+}
+
+static void bench_close(void)
+{
+}
+
+static bool bench_set_bitrate(uint32_t bitrate)
+{
+    (void)bitrate;
+    return true;
+}
+
+static bool bench_transmit(const CAN_frame_t* frame)
+{
+    transmitted += frame->can_dlc;
+    return true;
+}
+
+static void bench_write(const char* data, uint32_t len)
+{
+    (void)data;
+    (void)len;
+}
+
+static void bench_ready(void)
+{
+}
+
+static const slcan_ops_t BENCH_OPS =
+{
+    .open        = bench_open,
+    .close       = bench_close,
+    .set_bitrate = bench_set_bitrate,
+    .transmit    = bench_transmit,
+    .write       = bench_write,
+    .ready       = bench_ready,
+};
+
+static void report(const char* name, uint32_t frames, double elapsed, uint64_t checksum)
+{
+    double fps = (double)frames / elapsed;
+    printf("%-7s frames=%u in %.3f s: %.1f M frames/s, %.0fx the 1 Mbit/s line rate (checksum %llu)\n",
+           name, frames, elapsed, fps / 1e6, fps / LINE_RATE_FPS, (unsigned long long)checksum);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(int argc, char* argv[])
+{
+    uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ROUNDS;
+
+    static CAN_frame_t frames[BENCH_FRAMES];
+    static char        lines[BENCH_FRAMES][SLCAN_MAX_FRAME_LEN];
+    static uint8_t     lens[BENCH_FRAMES];
+    uint32_t           rng = 12345;
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        rng = rng * 1103515245UL + 12345UL;
+        frames[i].can_id  = (i % 4 == 0) ? (CAN_EFF_FLAG | (rng & CAN_EFF_MASK)) : ((rng >> 8) & CAN_SFF_MASK);
+        frames[i].can_dlc = (uint8_t)(i % (CAN_MAX_DLEN + 1));
+        memcpy(frames[i].data, &rng, sizeof(rng));
+        memcpy(&frames[i].data[4], &i, sizeof(i));
+
+        // Commands are lines without their CR, and without timestamps
+        lens[i] = (uint8_t)(slcan_encode(&frames[i], false, 0, lines[i]) - 1);
+    }
+
+    // Received frames, as streamed with timestamps
+    char     out[SLCAN_MAX_FRAME_LEN];
+    uint64_t checksum = 0;
+    double   start = now_s();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        uint8_t len = slcan_encode(&frames[r % BENCH_FRAMES], true, r, out);
+        checksum += len + (uint8_t)out[len - 2];
+    }
+    report("encode", rounds, now_s() - start, checksum);
+
+    // Transmit lines, parsed alone
+    CAN_frame_t frame;
+    checksum = 0;
+    start = now_s();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        uint32_t i = r % BENCH_FRAMES;
+        if (slcan_decode(lines[i], lens[i], &frame))
+        {
+            checksum += frame.can_id + frame.data[0];
+        }
+    }
+    report("decode", rounds, now_s() - start, checksum);
+
+    // Transmit lines fed one character at a time, as read from the
+    // UART, with their replies
+    slcan_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    char reply[SLCAN_MAX_REPLY_LEN];
+    slcan_feed(&parser, &BENCH_OPS, 'O', reply);
+    slcan_feed(&parser, &BENCH_OPS, '\r', reply);
+
+    checksum = 0;
+    start = now_s();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        uint32_t i = r % BENCH_FRAMES;
+        for (uint8_t c = 0; c < lens[i]; c++)
+        {
+            slcan_feed(&parser, &BENCH_OPS, lines[i][c], reply);
+        }
+        checksum += slcan_feed(&parser, &BENCH_OPS, '\r', reply);
+    }
+    report("feed", rounds, now_s() - start, checksum + transmitted);
+
+    // Every line is a valid transmit command, replied with z or Z
+    return (checksum == 2ULL * rounds) ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+// ***************************************************** //
+/// @file bench_trace.c
+/// @brief Capture throughput of the trace module into real
+/// files, for each record format, against the frame rate of
+/// a saturated 1 Mbit/s bus. Fails if the file offset is not
+/// back on a sector boundary after a partial buffer
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BENCH_DEFAULT_FRAMES    (2000000)
+
+/// Standard data frame of 8 bytes without stuff bits, at 1 Mbit/s
+#define LINE_RATE_FRAME_US      (111)
+#define LINE_RATE_FPS           (1000000.0 / LINE_RATE_FRAME_US)
+
+/// Several files per run, so rotation is part of the measure. The
+/// bus goes quiet now and then, so partial buffers are written in
+/// the middle of files too
+#define BENCH_FILE_BYTES        (8 * 1024 * 1024)
+#define BENCH_FLUSH_MS          (1000)
+#define BENCH_QUIET_FRAMES      (10000)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief File side of the bench, also checks the alignment
+typedef struct
+{
+    const char* dir;
+    int         fd;
+    char        path[256];
+    uint64_t    offset;         // Of the current file
+    bool        unaligned;      // The last write ended mid-sector
+    bool        suspect;        // So did the one before, unless it was the last
+    uint32_t    files;
+    uint32_t    writes;
+    uint32_t    partial;        // Writes ending mid-sector
+    uint32_t    misaligned;     // Two of them in a row, not closing the file
+    uint64_t    bytes;
+    sem_t       ready;
+    bool        stop;
+} bench_file_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static bench_file_t file;
+
+static const char* FORMAT_NAMES[] = { "binary", "candump", "asc" };
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void file_close(void)
+{
+    if (file.fd >= 0)
+    {
+        close(file.fd);
+        unlink(file.path);
+        file.fd      = -1;
+        file.suspect = false;
+    }
+}
+
+static bool file_open(trace_format_e format)
+{
+    file_close();
+    snprintf(file.path, sizeof(file.path), "%s/bench_trace_%u.%s",
+             file.dir, file.files, FORMAT_NAMES[format]);
+    file.fd = open(file.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file.fd < 0)
+    {
+        perror(file.path);
+        return false;
+    }
+
+    file.offset    = 0;
+    file.unaligned = false;
+    file.suspect   = false;
+    file.files++;
+    return true;
+}
+
+static bool file_write(const uint8_t* data, uint32_t len)
+{
+    if (write(file.fd, data, len) != (ssize_t)len)
+    {
+        perror(file.path);
+        return false;
+    }
+
+    // A partial buffer ends inside a sector, the next write of the
+    // file must end on a boundary again. Only the last write of the
+    // file, when the file closes, may not
+    if (file.suspect)
+    {
+        file.misaligned++;
+    }
+    file.offset += len;
+    bool unaligned = (file.offset % TRACE_SECTOR_SIZE) != 0;
+    if (unaligned)
+    {
+        file.partial++;
+    }
+    file.suspect   = unaligned && file.unaligned;
+    file.unaligned = unaligned;
+    file.writes++;
+    file.bytes += len;
+    return true;
+}
+
+static void file_ready(void)
+{
+    sem_post(&file.ready);
+}
+
+static const trace_ops_t FILE_OPS =
+{
+    file_open,
+    file_write,
+    file_close,
+    file_ready,
+};
+
+/// @brief Writer task of the firmware, on a thread
+static void* writer(void* arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        sem_wait(&file.ready);
+        while (trace_write_next())
+        {
+        }
+        if (__atomic_load_n(&file.stop, __ATOMIC_ACQUIRE))
+        {
+            return NULL;
+        }
+    }
+}
+
+/// @brief Captures frames as fast as the writer takes them
+/// @return Captured frames per second
+static double run_format(trace_format_e format, uint32_t n_frames)
+{
+    file.fd         = -1;
+    file.files      = 0;
+    file.writes     = 0;
+    file.partial    = 0;
+    file.misaligned = 0;
+    file.bytes      = 0;
+    file.stop       = false;
+    sem_init(&file.ready, 0, 0);
+    trace_init(&FILE_OPS, format, BENCH_FILE_BYTES, UINT32_MAX, BENCH_FLUSH_MS);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    uint64_t time_us = 0;
+    uint32_t rng = 12345;
+
+    double start = now_s();
+    for (uint32_t i = 0; i < n_frames; i++)
+    {
+        rng = rng * 1103515245UL + 12345UL;
+        frame.can_id  = (i % 4 == 0) ? (CAN_EFF_FLAG | (rng & CAN_EFF_MASK)) : ((rng >> 8) & CAN_SFF_MASK);
+        frame.can_dlc = (uint8_t)(1 + (rng >> 24) % CAN_MAX_DLEN);
+        memcpy(frame.data, &rng, sizeof(rng));
+        memcpy(&frame.data[4], &i, sizeof(i));
+        time_us += LINE_RATE_FRAME_US;
+
+        // Every buffer is waiting for the file: wait for the writer
+        // rather than drop, so the rate is the sustained one
+        while (!trace_frame(&frame, time_us))
+        {
+            sched_yield();
+        }
+        if (i % BENCH_QUIET_FRAMES == BENCH_QUIET_FRAMES - 1)
+        {
+            time_us += BENCH_FLUSH_MS * 1000;
+            trace_poll((uint32_t)(time_us / 1000));
+        }
+    }
+
+    // The partial buffer goes out once it is older than the flush time
+    trace_poll((uint32_t)(time_us / 1000) + BENCH_FLUSH_MS);
+    __atomic_store_n(&file.stop, true, __ATOMIC_RELEASE);
+    sem_post(&file.ready);
+    pthread_join(thread, NULL);
+    double elapsed = now_s() - start;
+
+    file_close();
+    sem_destroy(&file.ready);
+
+    trace_stats_t stats;
+    trace_get_stats(&stats);
+    double fps = (double)stats.frames / elapsed;
+    printf("%-8s frames=%u files=%u writes=%u partial=%u misaligned=%u stalls=%u errors=%u in %.3f s: "
+           "%.2f MB/s %.0f frames/s, %.0fx the 1 Mbit/s line rate\n",
+           FORMAT_NAMES[format], stats.frames, file.files, file.writes, file.partial, file.misaligned,
+           stats.dropped, stats.errors, elapsed,
+           (double)file.bytes / elapsed / 1e6, fps, fps / LINE_RATE_FPS);
+
+    bool ok = stats.frames == n_frames && stats.errors == 0 && file.partial > 0
+              && file.misaligned == 0 && stats.bytes == file.bytes;
+    return ok ? fps : 0;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(int argc, char* argv[])
+{
+    uint32_t n_frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_FRAMES;
+    file.dir = (argc > 2) ? argv[2] : "/tmp";
+
+    int failed = 0;
+    for (int format = TRACE_FORMAT_BINARY; format <= TRACE_FORMAT_ASC; format++)
+    {
+        if (run_format((trace_format_e)format, n_frames) < LINE_RATE_FPS)
+        {
+            fprintf(stderr, "%s: below line rate or misaligned writes\n", FORMAT_NAMES[format]);
+            failed = 1;
+        }
+    }
+    return failed;
+}
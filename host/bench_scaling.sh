@@ -0,0 +1,21 @@
+#!/bin/sh
+# Throughput of the Linux gateway against the number of workers, with a
+# saturated synthetic 1 Mbit/s bus on every interface and no broker
+#
+#   host/bench_scaling.sh [BUILD_DIR] [BUSES] [SECONDS] [WORKERS...]
+set -e
+
+BUILD_DIR=${1:-build-host}
+BUSES=${2:-8}
+SECONDS_PER_RUN=${3:-5}
+shift 3 2>/dev/null || shift $#
+WORKERS=${*:-1 2 4 8}
+
+base=""
+printf "%8s %12s %8s\n" workers frames/s speedup
+for w in $WORKERS; do
+    rate=$("$BUILD_DIR/can_gateway" -S "$BUSES" -x 0 -d "$SECONDS_PER_RUN" -n -q -w "$w" 2>&1 \
+           | sed -n 's/^frames=.* \([0-9]*\) frames\/s.*/\1/p')
+    base=${base:-$rate}
+    printf "%8s %12s %8s\n" "$w" "$rate" "$(awk "BEGIN { printf \"%.2f\", $rate / $base }")"
+done
@@ -0,0 +1,242 @@
+// ***************************************************** //
+/// @file can_replay.c
+/// @brief Frames of a candump log, as written by candump -l
+/// or by the SD capture in candump format
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "can_replay.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Longest line: time, interface, 8 ID digits and 16 data digits
+#define REPLAY_MAX_LINE     (128)
+
+/// Read buffer of the log, large enough to stream big captures
+#define REPLAY_FILE_BUFFER  (1024 * 1024)
+
+/// Time between the last frame of a loop and the first of the next
+#define REPLAY_LOOP_GAP_US  (1000)
+
+static FILE*    logFile = NULL;
+static bool     isStdin = false;
+static uint32_t loopsLeft = 0;
+static bool     hasFirst = false;
+static uint64_t firstUs = 0;        // Time of the first frame of the log
+static uint64_t loopOffsetUs = 0;   // Added to the times of the current loop
+static uint64_t lastUs = 0;         // Time of the last frame returned
+static char     fileBuffer[REPLAY_FILE_BUFFER];
+
+static can_replay_stats_t stats;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/// @brief Reads decimal digits
+/// @return Position after the digits, NULL if there were none
+static const char* parse_dec(const char* p, uint64_t* value, int* digits)
+{
+    *value  = 0;
+    *digits = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        *value = *value * 10 + (uint64_t)(*p++ - '0');
+        (*digits)++;
+    }
+    return (*digits > 0) ? p : NULL;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool can_replay_parse(const char* line, CAN_frame_t* frame, uint64_t* time_us)
+{
+    const char* p = line;
+    uint64_t    seconds;
+    uint64_t    fraction;
+    int         digits;
+
+    // (1436509052.249713)
+    if (*p++ != '(' || (p = parse_dec(p, &seconds, &digits)) == NULL || *p++ != '.'
+        || (p = parse_dec(p, &fraction, &digits)) == NULL || *p++ != ')')
+    {
+        return false;
+    }
+    for (; digits < 6; digits++)
+    {
+        fraction *= 10;
+    }
+    for (; digits > 6; digits--)
+    {
+        fraction /= 10;
+    }
+    *time_us = seconds * 1000000 + fraction;
+
+    // Interface
+    while (*p == ' ')
+    {
+        p++;
+    }
+    while (*p != ' ' && *p != '\0')
+    {
+        p++;
+    }
+    while (*p == ' ')
+    {
+        p++;
+    }
+
+    // 3 digits for a standard ID, 8 for an extended ID or an error
+    // frame, whose flag is part of the ID
+    uint32_t id = 0;
+    int      n_id = 0;
+    int      v;
+    while ((v = hex_value(*p)) >= 0)
+    {
+        id = (id << 4) | (uint32_t)v;
+        n_id++;
+        p++;
+    }
+    if (*p++ != '#' || (n_id != 3 && n_id != 8))
+    {
+        return false;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    if (n_id == 3)
+    {
+        frame->can_id = id & CAN_SFF_MASK;
+    }
+    else
+    {
+        frame->can_id = (id & CAN_ERR_FLAG) ? id : ((id & CAN_EFF_MASK) | CAN_EFF_FLAG);
+    }
+
+    // Remote frame, with an optional length
+    if (*p == 'R')
+    {
+        frame->can_id |= CAN_RTR_FLAG;
+        v = hex_value(p[1]);
+        frame->can_dlc = (v >= 0 && v <= CAN_MAX_DLEN) ? (uint8_t)v : 0;
+        return true;
+    }
+
+    // CAN FD frames (##) are not supported
+    uint8_t len = 0;
+    int     hi;
+    int     lo;
+    while ((hi = hex_value(p[0])) >= 0 && (lo = hex_value(p[1])) >= 0)
+    {
+        if (len == CAN_MAX_DLEN)
+        {
+            return false;
+        }
+        frame->data[len++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+    frame->can_dlc = len;
+
+    return (*p == '\0' || *p == '\n' || *p == '\r' || *p == ' ');
+}
+
+bool can_replay_open(const char* path, uint32_t loops)
+{
+    isStdin = (strcmp(path, "-") == 0);
+    logFile = isStdin ? stdin : fopen(path, "r");
+    if (logFile == NULL)
+    {
+        perror("replay: fopen");
+        return false;
+    }
+    setvbuf(logFile, fileBuffer, _IOFBF, sizeof(fileBuffer));
+
+    loopsLeft    = (isStdin || loops == 0) ? 1 : loops;
+    hasFirst     = false;
+    loopOffsetUs = 0;
+    lastUs       = 0;
+    memset(&stats, 0, sizeof(stats));
+    return true;
+}
+
+bool can_replay_next(CAN_frame_t* frame, uint64_t* time_us)
+{
+    char line[REPLAY_MAX_LINE];
+
+    while (logFile != NULL)
+    {
+        if (fgets(line, sizeof(line), logFile) == NULL)
+        {
+            if (--loopsLeft == 0)
+            {
+                return false;
+            }
+
+            // The next loop starts right after this one
+            rewind(logFile);
+            loopOffsetUs = lastUs + REPLAY_LOOP_GAP_US;
+            hasFirst     = false;
+            continue;
+        }
+        stats.lines++;
+
+        uint64_t line_us;
+        if (!can_replay_parse(line, frame, &line_us))
+        {
+            stats.skipped++;
+            continue;
+        }
+
+        if (!hasFirst)
+        {
+            firstUs  = line_us;
+            hasFirst = true;
+        }
+
+        // Logs of several interfaces may be slightly out of order
+        uint64_t rel_us = loopOffsetUs + ((line_us > firstUs) ? line_us - firstUs : 0);
+        lastUs   = (rel_us > lastUs) ? rel_us : lastUs;
+        *time_us = lastUs;
+        stats.frames++;
+        return true;
+    }
+
+    return false;
+}
+
+void can_replay_close(void)
+{
+    if (logFile != NULL && !isStdin)
+    {
+        fclose(logFile);
+    }
+    logFile = NULL;
+}
+
+void can_replay_get_stats(can_replay_stats_t* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,69 @@
+// ***************************************************** //
+/// @file can_replay.h
+/// @brief Frames of a candump log, as written by candump -l
+/// or by the SD capture in candump format
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _CAN_REPLAY_H_
+#define _CAN_REPLAY_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t lines;         // Lines read, every loop
+    uint32_t frames;        // Frames returned
+    uint32_t skipped;       // Malformed lines and CAN FD frames
+} can_replay_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Parses a candump line: (time) interface id#data. The
+/// interface is ignored
+/// @param line Line, with or without its newline
+/// @param frame Output frame
+/// @param time_us Output time of the line
+/// @return false if the line is not a classic CAN frame
+bool can_replay_parse(const char* line, CAN_frame_t* frame, uint64_t* time_us);
+
+/// @brief Opens a log
+/// @param path Path of the log, - for stdin
+/// @param loops Times the log is read. Each loop follows the
+/// previous one in time. Ignored for stdin
+/// @return false if the log cannot be opened
+bool can_replay_open(const char* path, uint32_t loops);
+
+/// @brief Reads the next frame of the log
+/// @param frame Output frame
+/// @param time_us Output time of the frame since the first one
+/// @return false at the end of the last loop
+bool can_replay_next(CAN_frame_t* frame, uint64_t* time_us);
+
+/// @brief Closes the log
+void can_replay_close(void);
+
+/// @brief Copies the counters of the log
+/// @param stats Output statistics
+void can_replay_get_stats(can_replay_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _CAN_REPLAY_H_
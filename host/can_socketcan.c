@@ -0,0 +1,131 @@
+// ***************************************************** //
+/// @file can_socketcan.c
+/// @brief Frames of a Linux CAN interface through a raw
+/// SocketCAN socket
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#define _GNU_SOURCE
+#include "can_socketcan.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+// The gateway frame follows the SocketCAN layout and flags
+_Static_assert(CAN_EFF_FLAG == 0x80000000U && CAN_RTR_FLAG == 0x40000000U && CAN_ERR_FLAG == 0x20000000U,
+               "CAN_frame_t flags differ from SocketCAN");
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int can_socketcan_open(const char* ifname)
+{
+    int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0)
+    {
+        perror("socketcan: socket");
+        return -1;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = (int)if_nametoindex(ifname);
+    if (addr.can_ifindex == 0)
+    {
+        fprintf(stderr, "socketcan: no interface %s\n", ifname);
+        close(sock);
+        return -1;
+    }
+
+    can_err_mask_t err_mask = CAN_ERR_MASK;
+    setsockopt(sock, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        perror("socketcan: bind");
+        close(sock);
+        return -1;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    return sock;
+}
+
+bool can_socketcan_receive(int sock, CAN_frame_t* frame)
+{
+    struct can_frame raw;
+    if (read(sock, &raw, sizeof(raw)) != (ssize_t)sizeof(raw))
+    {
+        return false;
+    }
+
+    frame->can_id  = raw.can_id;
+    frame->can_dlc = (raw.can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : raw.can_dlc;
+    memcpy(frame->data, raw.data, CAN_MAX_DLEN);
+    return true;
+}
+
+int can_socketcan_receive_burst(int sock, CAN_frame_t frames[], int max)
+{
+    struct can_frame raw[CAN_SOCKETCAN_BURST];
+    struct iovec     iov[CAN_SOCKETCAN_BURST];
+    struct mmsghdr   msgs[CAN_SOCKETCAN_BURST];
+
+    if (max > CAN_SOCKETCAN_BURST)
+    {
+        max = CAN_SOCKETCAN_BURST;
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * (size_t)max);
+    for (int i = 0; i < max; i++)
+    {
+        iov[i].iov_base            = &raw[i];
+        iov[i].iov_len             = sizeof(raw[i]);
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(sock, msgs, (unsigned int)max, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+    {
+        return 0;
+    }
+
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (msgs[i].msg_len != sizeof(raw[i]))
+        {
+            continue;
+        }
+        frames[count].can_id  = raw[i].can_id;
+        frames[count].can_dlc = (raw[i].can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : raw[i].can_dlc;
+        memcpy(frames[count].data, raw[i].data, CAN_MAX_DLEN);
+        count++;
+    }
+    return count;
+}
+
+bool can_socketcan_send(int sock, const CAN_frame_t* frame)
+{
+    struct can_frame raw;
+    memset(&raw, 0, sizeof(raw));
+    raw.can_id  = frame->can_id;
+    raw.can_dlc = (frame->can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->can_dlc;
+    memcpy(raw.data, frame->data, raw.can_dlc);
+
+    return write(sock, &raw, sizeof(raw)) == (ssize_t)sizeof(raw);
+}
@@ -0,0 +1,62 @@
+// ***************************************************** //
+/// @file can_socketcan.h
+/// @brief Frames of a Linux CAN interface through a raw
+/// SocketCAN socket
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _CAN_SOCKETCAN_H_
+#define _CAN_SOCKETCAN_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Most frames read by one call of can_socketcan_receive_burst
+#define CAN_SOCKETCAN_BURST     (64)
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Opens a non-blocking raw socket bound to an interface.
+/// Error frames are received too, as on the MCP2515
+/// @param ifname Interface name, e.g. can0 or vcan0
+/// @return Socket, -1 on error
+int can_socketcan_open(const char* ifname);
+
+/// @brief Reads a frame if one is waiting
+/// @param sock Socket of can_socketcan_open
+/// @param frame Output frame
+/// @return false if none is waiting or the socket failed
+bool can_socketcan_receive(int sock, CAN_frame_t* frame);
+
+/// @brief Reads the waiting frames with a single system call
+/// @param sock Socket of can_socketcan_open
+/// @param frames Output frames
+/// @param max Size of frames, up to CAN_SOCKETCAN_BURST
+/// @return Number of frames read, 0 if none is waiting or the socket failed
+int can_socketcan_receive_burst(int sock, CAN_frame_t frames[], int max);
+
+/// @brief Queues a frame on the interface
+/// @param sock Socket of can_socketcan_open
+/// @param frame Frame to transmit
+/// @return false if the transmit queue of the interface is full
+bool can_socketcan_send(int sock, const CAN_frame_t* frame);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _CAN_SOCKETCAN_H_
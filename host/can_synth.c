@@ -0,0 +1,122 @@
+// ***************************************************** //
+/// @file can_synth.c
+/// @brief Synthetic traffic of a saturated CAN bus, for the
+/// benchmarks. Frames of the DBC mixed with raw frames,
+/// timed back to back at the bitrate of the bus
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "can_synth.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Messages of dbc/gateway.dbc
+#define SYNTH_ENGINE_DATA       (0x100)
+#define SYNTH_VEHICLE_DYNAMICS  (0x200)
+#define SYNTH_BATTERY_STATUS    (0x300)
+#define SYNTH_EEC1              (0x0CF00400UL)
+
+/// Raw frames whose payload changes every time, and raw frames
+/// that repeat and are suppressed by change-of-value
+#define SYNTH_RAW_BASE          (0x400)
+#define SYNTH_RAW_IDS           (64)
+#define SYNTH_STATIC_BASE       (0x500)
+#define SYNTH_STATIC_IDS        (32)
+
+/// Bits of a frame without its data, interframe space included.
+/// Stuff bits are not counted, so the synthetic bus carries a few
+/// more frames than a real one
+#define SYNTH_SFF_BITS          (47)
+#define SYNTH_EFF_BITS          (67)
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline uint32_t next_random(can_synth_t* synth)
+{
+    synth->rng ^= synth->rng << 13;
+    synth->rng ^= synth->rng >> 17;
+    synth->rng ^= synth->rng << 5;
+    return synth->rng;
+}
+
+/// @brief Payload of a DBC message, signals moving slowly so the
+/// deadbands hold some of them back
+static void fill_signals(can_synth_t* synth, CAN_frame_t* frame)
+{
+    uint16_t c = synth->counter;
+    for (int i = 0; i < CAN_MAX_DLEN; i++)
+    {
+        frame->data[i] = (uint8_t)((c >> (i & 3)) + i * 17);
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void can_synth_init(can_synth_t* synth, uint32_t seed, uint32_t bitrate)
+{
+    memset(synth, 0, sizeof(*synth));
+    synth->rng     = 0x9E3779B9UL * (seed + 1);
+    synth->bitrate = bitrate;
+}
+
+void can_synth_next(can_synth_t* synth, CAN_frame_t* frame, uint64_t* time_us)
+{
+    uint32_t r = next_random(synth);
+
+    memset(frame, 0, sizeof(*frame));
+    frame->can_dlc = CAN_MAX_DLEN;
+    synth->counter++;
+
+    switch (r % 16)
+    {
+        case 0:
+            frame->can_id = SYNTH_ENGINE_DATA;
+            fill_signals(synth, frame);
+            break;
+
+        case 1:
+            frame->can_id = SYNTH_VEHICLE_DYNAMICS;
+            fill_signals(synth, frame);
+            break;
+
+        case 2:
+            frame->can_id = SYNTH_BATTERY_STATUS;
+            fill_signals(synth, frame);
+            frame->data[0] = synth->counter & 1;     // Multiplexer
+            break;
+
+        case 3:
+            // Any source address matches the PGN
+            frame->can_id = CAN_EFF_FLAG | SYNTH_EEC1 | ((r >> 8) & 0x03);
+            fill_signals(synth, frame);
+            break;
+
+        case 4: case 5: case 6: case 7: case 8: case 9:
+        {
+            frame->can_id  = SYNTH_RAW_BASE + ((r >> 8) % SYNTH_RAW_IDS);
+            frame->can_dlc = (uint8_t)((r >> 16) % (CAN_MAX_DLEN + 1));
+            uint32_t data[2] = { next_random(synth), next_random(synth) };
+            memcpy(frame->data, data, frame->can_dlc);
+            break;
+        }
+
+        default:
+            frame->can_id = SYNTH_STATIC_BASE + ((r >> 8) % SYNTH_STATIC_IDS);
+            memset(frame->data, (int)frame->can_id, CAN_MAX_DLEN);
+            break;
+    }
+
+    *time_us = synth->bits * 1000000ULL / synth->bitrate;
+
+    uint32_t bits = (frame->can_id & CAN_EFF_FLAG) ? SYNTH_EFF_BITS : SYNTH_SFF_BITS;
+    synth->bits += bits + 8U * frame->can_dlc;
+    synth->frames++;
+}
@@ -0,0 +1,57 @@
+// ***************************************************** //
+/// @file can_synth.h
+/// @brief Synthetic traffic of a saturated CAN bus, for the
+/// benchmarks. Frames of the DBC mixed with raw frames,
+/// timed back to back at the bitrate of the bus
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _CAN_SYNTH_H_
+#define _CAN_SYNTH_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Generator of one bus, only used by one thread
+typedef struct
+{
+    uint32_t rng;
+    uint32_t bitrate;
+    uint64_t bits;          // Bits sent since the start
+    uint32_t frames;
+    uint16_t counter;       // Moves the decoded signals
+} can_synth_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Starts a bus. The same seed gives the same frames
+/// @param synth Generator
+/// @param seed Seed, e.g. the bus index
+/// @param bitrate Bitrate in bit/s
+void can_synth_init(can_synth_t* synth, uint32_t seed, uint32_t bitrate);
+
+/// @brief Next frame on the bus
+/// @param synth Generator
+/// @param frame Output frame
+/// @param time_us Output time of the frame since the start
+void can_synth_next(can_synth_t* synth, CAN_frame_t* frame, uint64_t* time_us);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _CAN_SYNTH_H_
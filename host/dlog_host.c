@@ -0,0 +1,58 @@
+// ***************************************************** //
+/// @file dlog_host.c
+/// @brief Deferred logging on Linux. Records are printed to
+/// stderr as they are written, stdio keeps the lines whole
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "dlog.h"
+
+#include <time.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char LEVEL_CHARS[] = "?EWID";
+
+static bool muted = false;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void dlog_start(void)
+{
+    muted = false;
+}
+
+void dlog_write(uint8_t level, const char* tag, const char* format,
+                uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3)
+{
+    if (__atomic_load_n(&muted, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    flockfile(stderr);
+    fprintf(stderr, "%c (%lu) %s: ", LEVEL_CHARS[level],
+            (unsigned long)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000), tag);
+    fprintf(stderr, format, a0, a1, a2, a3);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+}
+
+uint32_t dlog_get_dropped(void)
+{
+    // Nothing is queued, nothing is lost
+    return 0;
+}
+
+void dlog_set_muted(bool mute)
+{
+    __atomic_store_n(&muted, mute, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,1241 @@
+// ***************************************************** //
+/// @file gateway_linux.c
+/// @brief Gateway on Linux: the frame pipeline of the
+/// firmware between CAN interfaces and an MQTT broker over
+/// plain TCP. Each interface has its own reader thread and
+/// its own pipeline, run by a work-stealing pool of workers.
+/// Publishes are sharded per topic over publisher threads.
+/// Also the reference throughput benchmark of the pipeline
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#define _GNU_SOURCE
+#include "gateway_core.h"
+#include "can_socketcan.h"
+#include "can_replay.h"
+#include "can_synth.h"
+#include "mqtt_tcp.h"
+#include "spsc_ring.h"
+#include "ws_pool.h"
+#include "batch.h"
+#include "counters.h"
+#include "dlog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define HOST_DEFAULT_BROKER     "127.0.0.1"
+#define HOST_DEFAULT_PORT       (1883)
+#define HOST_DEFAULT_THING      "linux_gw"
+#define HOST_DEFAULT_TOPIC      "gateway/can{bus}"
+
+#define HOST_MAX_INTERFACES     (16)
+#define HOST_MAX_SHARDS         (8)
+
+/// Frames waiting between a reader and its pipeline, about 6500
+#define HOST_FRAME_RING_SIZE    (256 * 1024)
+
+/// Payloads waiting between a pipeline and a publisher shard
+#define HOST_UPLINK_RING_SIZE   (256 * 1024)
+
+/// Frames of an interface processed in one slice of a worker, and
+/// payloads of an interface published in one turn of a shard
+#define HOST_FRAMES_PER_TURN    (256)
+
+/// Period of the batch deadlines and of the broker upkeep
+#define HOST_HOUSEKEEPING_MS    (10)
+
+/// Period of the statistics line while running
+#define HOST_STATS_PERIOD_MS    (10000)
+
+/// Wait between two connection attempts to the broker
+#define HOST_RETRY_MS           (1000)
+
+/// Longest sleep of an idle shard, it still keeps its connection alive
+#define HOST_SHARD_WAIT_MS      (100)
+
+/// A replayed frame this close to its time is not waited for
+#define HOST_REPLAY_SLACK_US    (1000)
+
+/// Synthetic buses run saturated at this bitrate
+#define HOST_SYNTH_BITRATE      (1000000)
+
+/// Run time of synthetic buses when -d is not given
+#define HOST_SYNTH_SECONDS      (10)
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+typedef enum
+{
+    SOURCE_SOCKETCAN,
+    SOURCE_REPLAY,
+    SOURCE_SYNTH,
+} host_source_e;
+
+typedef struct
+{
+    const char* interfaces[HOST_MAX_INTERFACES];
+    uint32_t    n_interfaces;
+    const char* replay_path;    // candump log, or NULL
+    uint32_t    synthetic;      // Synthetic buses, or 0
+    double      speed;          // Replay speed, 0 for as fast as possible
+    uint32_t    loops;
+    uint32_t    duration_s;     // 0 runs until interrupted or the end of the log
+    uint32_t    workers;
+    uint32_t    shards;
+    const char* broker;
+    uint16_t    port;
+    bool        null_sink;      // Payloads are counted, not sent
+    const char* thing;
+    const char* topic;
+    uint16_t    batch_frames;
+    uint16_t    batch_delay_ms;
+    uint16_t    window;         // QoS 1 publishes waiting for their PUBACK, 0 for QoS 0
+    bool        quiet;
+} host_options_t;
+
+/// Frame queued by a reader for its pipeline
+typedef struct
+{
+    uint64_t    time_us;        // Pipeline time of the frame
+    uint32_t    origin_us;      // Capture time
+    CAN_frame_t frame;
+} host_frame_t;
+
+/// @brief CAN interface: its reader, its pipeline and the queues
+/// between them and the shards. Each queue has a single producer,
+/// the reader or the worker running the pipeline at the time
+typedef struct
+{
+    host_source_e      source;
+    const char*        name;
+    uint8_t            bus;
+    int                sock;
+    pthread_t          reader;
+    can_synth_t        synth;
+    spsc_ring_t        frames;
+    spsc_ring_t        uplink[HOST_MAX_SHARDS];
+    gw_core_context_t* core;
+    ws_task_t          task;
+
+    // Pipeline side, only used by the worker running the task
+    uint64_t lastFrameUs;
+    uint32_t touchedShards;
+
+    // Read by the main thread
+    uint32_t flushRequested;
+    uint32_t readerDone;
+    uint64_t framesRead;        // Written by the reader
+    uint64_t framesDropped;     // Written by the reader
+    uint64_t busTimeUs;         // Written by the reader, time of its last frame
+    uint64_t framesProcessed;   // Written by the pipeline
+} host_iface_t;
+
+/// @brief Publisher thread with its own broker connection. Takes
+/// the payloads of its topics from every interface in turn
+typedef struct
+{
+    uint32_t   index;
+    pthread_t  thread;
+    int        wakeFd;
+    uint32_t   sleeping;
+    bool       connected;
+    uint64_t   lastAttemptUs;
+    char       clientId[64];
+    mqtt_tcp_t client;
+    uint64_t   publishes;       // Written by the shard
+    uint64_t   bytes;           // Topics and payloads, written by the shard
+} host_shard_t;
+
+static host_options_t options =
+{
+    .speed          = 1.0,
+    .loops          = 1,
+    .shards         = 1,
+    .broker         = HOST_DEFAULT_BROKER,
+    .port           = HOST_DEFAULT_PORT,
+    .thing          = HOST_DEFAULT_THING,
+    .topic          = HOST_DEFAULT_TOPIC,
+    .batch_frames   = BATCH_MAX_FRAMES,
+    .batch_delay_ms = BATCH_MAX_DELAY_MS,
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static host_iface_t ifaces[HOST_MAX_INTERFACES];
+static uint32_t     nIfaces = 0;
+static host_shard_t shards[HOST_MAX_SHARDS];
+
+/// Readers stop, then shards once every pipeline is drained. The
+/// event stays readable so every reader sees it
+static uint32_t readersStop = 0;
+static uint32_t shardsStop = 0;
+static int      stopFd = -1;
+
+static uint64_t startUs = 0;
+
+/// Shards connected to the broker, and whether all of them ever were
+static uint32_t brokerUp = 0;
+static uint32_t everConnected = 0;
+
+/// Interface of the pipeline running on the calling worker
+static _Thread_local host_iface_t* currentIface = NULL;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static uint64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint64_t elapsed_us(void)
+{
+    return wall_us() - startUs;
+}
+
+static inline uint64_t load_u64(const uint64_t* value)
+{
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+/// @brief Adds to a counter that only the calling thread writes
+static inline void add_u64(uint64_t* value, uint64_t n)
+{
+    __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Time of the pipeline of an interface. A replay runs on the
+/// time of its log and a synthetic bus on its own, so rate limits and
+/// batch delays see the original bus
+static uint32_t pipeline_ms(const host_iface_t* iface)
+{
+    if (iface->source == SOURCE_SOCKETCAN)
+    {
+        return (uint32_t)(elapsed_us() / 1000);
+    }
+    if (options.speed <= 0)
+    {
+        return (uint32_t)(iface->lastFrameUs / 1000);
+    }
+    return (uint32_t)((double)elapsed_us() * options.speed / 1000);
+}
+
+static bool is_connected(void)
+{
+    return options.null_sink || __atomic_load_n(&brokerUp, __ATOMIC_RELAXED) == options.shards;
+}
+
+static bool is_uplink_open(void)
+{
+    // As on the target, frames wait for the first connection only
+    return is_connected() || !__atomic_load_n(&everConnected, __ATOMIC_RELAXED);
+}
+
+static uint32_t topic_shard(const char* topic)
+{
+    // FNV-1a. A topic always goes through the same shard, so its
+    // payloads stay in order
+    uint32_t hash = 2166136261UL;
+    for (const char* p = topic; *p != '\0'; p++)
+    {
+        hash = (hash ^ (uint8_t)*p) * 16777619UL;
+    }
+    return hash % options.shards;
+}
+
+/// @brief Wakes a shard waiting for payloads. The fence pairs with
+/// the one of the shard before it sleeps
+static void wake_shard(host_shard_t* shard)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shard->sleeping, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&shard->sleeping, 0, __ATOMIC_ACQ_REL))
+    {
+        uint64_t one = 1;
+        if (write(shard->wakeFd, &one, sizeof(one)) < 0)
+        {
+            perror("gateway: wake");
+        }
+    }
+}
+
+static bool host_publish(const char* topic, const char* payload, uint32_t origin_us)
+{
+    (void)origin_us;
+
+    host_iface_t* iface       = currentIface;
+    uint32_t      shard       = topic_shard(topic);
+    spsc_ring_t*  ring        = &iface->uplink[shard];
+    uint32_t      topic_len   = (uint32_t)strlen(topic) + 1;
+    uint32_t      payload_len = (uint32_t)strlen(payload) + 1;
+
+    counters_received(COUNTERS_PUBLISH_QUEUE, 1);
+    if (topic_len + payload_len > HOST_UPLINK_RING_SIZE / 2)
+    {
+        counters_dropped(COUNTERS_PUBLISH_QUEUE, DROP_QUEUE_FULL, 1);
+        return false;
+    }
+
+    // A shard behind holds the pipeline back, and in turn the reader
+    char* record;
+    while ((record = spsc_ring_reserve(ring, topic_len + payload_len)) == NULL)
+    {
+        wake_shard(&shards[shard]);
+        sched_yield();
+    }
+    memcpy(record, topic, topic_len);
+    memcpy(&record[topic_len], payload, payload_len);
+    spsc_ring_commit(ring, topic_len + payload_len);
+
+    iface->touchedShards |= 1U << shard;
+    return true;
+}
+
+static bool host_send(const CAN_frame_t* frame)
+{
+    // Logs and synthetic buses cannot be answered
+    return currentIface->sock >= 0 && can_socketcan_send(currentIface->sock, frame);
+}
+
+static const gw_core_ops_t HOST_OPS =
+{
+    .publish        = host_publish,
+    .send           = host_send,
+    .is_connected   = is_connected,
+    .is_uplink_open = is_uplink_open,
+};
+
+/// @brief Runs a slice of the pipeline of an interface, on a worker
+static bool run_pipeline(ws_task_t* task)
+{
+    host_iface_t*       iface = task->arg;
+    const host_frame_t* in;
+    uint32_t            len;
+    uint32_t            n = 0;
+
+    gw_core_bind(iface->core);
+    currentIface = iface;
+
+    while (n < HOST_FRAMES_PER_TURN && (in = spsc_ring_peek(&iface->frames, &len)) != NULL)
+    {
+        iface->lastFrameUs = in->time_us;
+        gw_core_frame(&in->frame, in->origin_us, (uint32_t)(in->time_us / 1000));
+        spsc_ring_release(&iface->frames);
+        n++;
+    }
+    gw_core_poll(pipeline_ms(iface));
+
+    // Nothing is left waiting once the reader is done
+    if (n < HOST_FRAMES_PER_TURN && __atomic_load_n(&iface->flushRequested, __ATOMIC_ACQUIRE))
+    {
+        batch_flush();
+        __atomic_store_n(&iface->flushRequested, 0, __ATOMIC_RELEASE);
+    }
+
+    add_u64(&iface->framesProcessed, n);
+    for (uint32_t i = 0; i < options.shards; i++)
+    {
+        if (iface->touchedShards & (1U << i))
+        {
+            wake_shard(&shards[i]);
+        }
+    }
+    iface->touchedShards = 0;
+    currentIface = NULL;
+
+    return n == HOST_FRAMES_PER_TURN;
+}
+
+static bool pipeline_pending(ws_task_t* task)
+{
+    host_iface_t* iface = task->arg;
+    return !spsc_ring_is_empty(&iface->frames);
+}
+
+static bool readers_stopping(void)
+{
+    return __atomic_load_n(&readersStop, __ATOMIC_ACQUIRE) != 0;
+}
+
+/// @brief Queues a frame for the pipeline of an interface
+/// @param wait Waits for room rather than dropping the frame, for
+/// sources that can be held back
+static void queue_frame(host_iface_t* iface, const CAN_frame_t* frame, uint64_t time_us, bool wait)
+{
+    host_frame_t* out;
+    while ((out = spsc_ring_reserve(&iface->frames, sizeof(*out))) == NULL)
+    {
+        if (!wait || readers_stopping())
+        {
+            add_u64(&iface->framesDropped, 1);
+            counters_dropped(COUNTERS_CONTROLLER, DROP_QUEUE_FULL, 1);
+            return;
+        }
+        ws_pool_schedule(&iface->task);
+        sched_yield();
+    }
+
+    out->time_us   = time_us;
+    out->origin_us = (uint32_t)wall_us();
+    out->frame     = *frame;
+    spsc_ring_commit(&iface->frames, sizeof(*out));
+}
+
+/// @brief Accounts a burst of frames and hands it to the pool
+static void burst_done(host_iface_t* iface, uint32_t n, uint64_t time_us)
+{
+    add_u64(&iface->framesRead, n);
+    __atomic_store_n(&iface->busTimeUs, time_us, __ATOMIC_RELAXED);
+    counters_received(COUNTERS_CONTROLLER, n);
+    counters_forwarded(COUNTERS_CONTROLLER, n);
+    ws_pool_schedule(&iface->task);
+}
+
+/// @brief Reader of a SocketCAN interface, woken by epoll
+static void* read_socketcan(void* arg)
+{
+    host_iface_t* iface = arg;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events  = EPOLLIN;
+    event.data.fd = iface->sock;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, iface->sock, &event);
+    event.data.fd = stopFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, stopFd, &event);
+
+    while (!readers_stopping())
+    {
+        struct epoll_event events[2];
+        if (epoll_wait(epfd, events, 2, -1) < 0 && errno != EINTR)
+        {
+            perror("gateway: epoll_wait");
+            break;
+        }
+
+        CAN_frame_t frames[CAN_SOCKETCAN_BURST];
+        int         n;
+        while ((n = can_socketcan_receive_burst(iface->sock, frames, CAN_SOCKETCAN_BURST)) > 0)
+        {
+            uint64_t now_us = elapsed_us();
+            for (int i = 0; i < n; i++)
+            {
+                queue_frame(iface, &frames[i], now_us, false);
+            }
+            burst_done(iface, (uint32_t)n, now_us);
+        }
+    }
+
+    close(epfd);
+    __atomic_store_n(&iface->readerDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/// @brief Waits for a time since the start, or for the stop
+static void wait_until(uint64_t due_us)
+{
+    uint64_t now_us = elapsed_us();
+    if (now_us < due_us)
+    {
+        struct pollfd fd = { .fd = stopFd, .events = POLLIN };
+        poll(&fd, 1, (int)((due_us - now_us) / 1000));
+    }
+}
+
+/// @brief Reader of a candump log or of a synthetic bus. Paced on the
+/// time of the frames scaled by the speed, or as fast as the pipeline
+/// takes them
+static void* read_generated(void* arg)
+{
+    host_iface_t* iface = arg;
+    CAN_frame_t   frame;
+    uint64_t      frame_us = 0;
+    uint32_t      burst = 0;
+
+    while (!readers_stopping())
+    {
+        if (iface->source == SOURCE_REPLAY)
+        {
+            if (!can_replay_next(&frame, &frame_us))
+            {
+                break;
+            }
+        }
+        else
+        {
+            can_synth_next(&iface->synth, &frame, &frame_us);
+        }
+
+        if (options.speed > 0)
+        {
+            uint64_t due_us = (uint64_t)((double)frame_us / options.speed);
+            if (elapsed_us() + HOST_REPLAY_SLACK_US < due_us)
+            {
+                if (burst > 0)
+                {
+                    burst_done(iface, burst, frame_us);
+                    burst = 0;
+                }
+                wait_until(due_us);
+            }
+        }
+
+        queue_frame(iface, &frame, frame_us, true);
+        if (++burst == HOST_FRAMES_PER_TURN)
+        {
+            burst_done(iface, burst, frame_us);
+            burst = 0;
+        }
+    }
+
+    if (burst > 0)
+    {
+        burst_done(iface, burst, frame_us);
+    }
+    __atomic_store_n(&iface->readerDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool shard_rings_empty(const host_shard_t* shard)
+{
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        if (!spsc_ring_is_empty(&ifaces[i].uplink[shard->index]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Completion of a QoS 1 publish, on the thread of its shard
+static void shard_complete(void* arg, uint32_t tag, bool acked)
+{
+    (void)arg;
+    (void)tag;
+    if (acked)
+    {
+        counters_forwarded(COUNTERS_BROKER, 1);
+    }
+    else
+    {
+        counters_dropped(COUNTERS_BROKER, DROP_PUBLISH_FAILED, 1);
+    }
+}
+
+static void shard_publish(host_shard_t* shard, const char* topic, const char* payload, uint32_t len)
+{
+    if (options.null_sink || mqtt_tcp_publish(&shard->client, topic, payload, 0))
+    {
+        counters_forwarded(COUNTERS_PUBLISH_QUEUE, 1);
+        if (options.window > 0 && !options.null_sink)
+        {
+            counters_received(COUNTERS_BROKER, 1);
+        }
+        add_u64(&shard->publishes, 1);
+        add_u64(&shard->bytes, len - 2);
+    }
+    else
+    {
+        counters_dropped(COUNTERS_PUBLISH_QUEUE,
+                         shard->connected ? DROP_PUBLISH_FAILED : DROP_OFFLINE, 1);
+    }
+}
+
+/// @brief Connects to the broker when needed and keeps the
+/// connection alive
+static void shard_housekeeping(host_shard_t* shard, uint64_t now_us)
+{
+    if (options.null_sink)
+    {
+        return;
+    }
+
+    if (!shard->connected
+        && (shard->lastAttemptUs == 0 || now_us - shard->lastAttemptUs >= HOST_RETRY_MS * 1000ULL))
+    {
+        shard->lastAttemptUs = now_us;
+        if (mqtt_tcp_connect(&shard->client, options.broker, options.port, shard->clientId))
+        {
+            fprintf(stderr, "Shard %u connected to %s:%u\n", shard->index, options.broker, options.port);
+            shard->connected = true;
+            if (__atomic_add_fetch(&brokerUp, 1, __ATOMIC_RELAXED) == options.shards)
+            {
+                __atomic_store_n(&everConnected, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    mqtt_tcp_poll(&shard->client, (uint32_t)(now_us / 1000));
+    if (shard->connected && !mqtt_tcp_is_connected(&shard->client))
+    {
+        shard->connected = false;
+        __atomic_sub_fetch(&brokerUp, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/// @brief Publisher shard. Merges the payloads of its topics from
+/// every interface, each interface in order, without locks
+static void* run_shard(void* arg)
+{
+    host_shard_t* shard = arg;
+    uint64_t      next_house_us = 0;
+
+    for (;;)
+    {
+        // Read first: once set, every payload is already queued
+        bool stop    = __atomic_load_n(&shardsStop, __ATOMIC_ACQUIRE) != 0;
+        bool idle    = true;
+        bool blocked = false;
+
+        for (uint32_t i = 0; i < nIfaces && !blocked; i++)
+        {
+            spsc_ring_t* ring = &ifaces[i].uplink[shard->index];
+            const char*  record;
+            uint32_t     len;
+            for (int n = 0; n < HOST_FRAMES_PER_TURN && (record = spsc_ring_peek(ring, &len)) != NULL; n++)
+            {
+                // A full QoS 1 window keeps the payload queued
+                if (!options.null_sink && !mqtt_tcp_can_publish(&shard->client, len - 2))
+                {
+                    blocked = true;
+                    break;
+                }
+                shard_publish(shard, record, &record[strlen(record) + 1], len);
+                spsc_ring_release(ring);
+                idle = false;
+            }
+        }
+
+        uint32_t waiting = mqtt_tcp_inflight(&shard->client);
+        uint64_t now_us  = wall_us();
+        if (idle || blocked || now_us >= next_house_us)
+        {
+            shard_housekeeping(shard, now_us);
+            next_house_us = now_us + HOST_HOUSEKEEPING_MS * 1000ULL;
+        }
+
+        // The window went out with the housekeeping. While it is full,
+        // and before stopping, waits for PUBACKs unless some arrived.
+        // A blocked shard still has payloads queued, so it never stops
+        bool acks_due = mqtt_tcp_is_connected(&shard->client) && mqtt_tcp_inflight(&shard->client) > 0;
+        if (blocked || (idle && stop && acks_due))
+        {
+            if (acks_due && mqtt_tcp_inflight(&shard->client) >= waiting)
+            {
+                struct pollfd fd = { .fd = mqtt_tcp_fd(&shard->client), .events = POLLIN };
+                poll(&fd, 1, HOST_SHARD_WAIT_MS);
+            }
+            continue;
+        }
+
+        if (!idle)
+        {
+            continue;
+        }
+        if (stop)
+        {
+            break;
+        }
+
+        __atomic_store_n(&shard->sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (shard_rings_empty(shard))
+        {
+            struct pollfd fds[2] =
+            {
+                { .fd = shard->wakeFd, .events = POLLIN },
+                { .fd = mqtt_tcp_fd(&shard->client), .events = POLLIN },
+            };
+            if (poll(fds, (fds[1].fd >= 0) ? 2 : 1, HOST_SHARD_WAIT_MS) > 0 && (fds[0].revents & POLLIN))
+            {
+                uint64_t count;
+                if (read(shard->wakeFd, &count, sizeof(count)) < 0)
+                {
+                    perror("gateway: wake");
+                }
+            }
+        }
+        __atomic_store_n(&shard->sleeping, 0, __ATOMIC_RELAXED);
+    }
+
+    mqtt_tcp_disconnect(&shard->client);
+    return NULL;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stopRequested = 1;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s (-i IFACE... | -r LOG | -S N) [options]\n"
+            "  -i IFACE        Read frames from a SocketCAN interface, repeat for more\n"
+            "  -r LOG          Replay a candump log, - for stdin\n"
+            "  -S N            Generate N saturated synthetic buses of %u kbit/s\n"
+            "  -x SPEED        Pace logs and synthetic buses at SPEED times real time,\n"
+            "                  0 for as fast as possible (1)\n"
+            "  -l LOOPS        Replay the log LOOPS times (1)\n"
+            "  -d SECONDS      Stop after SECONDS, 0 for never (%u with -S, else 0)\n"
+            "  -w WORKERS      Pipeline worker threads (one per CPU)\n"
+            "  -p SHARDS       Publisher threads, each with its own connection (1)\n"
+            "  -b HOST[:PORT]  MQTT broker (" HOST_DEFAULT_BROKER ":%u)\n"
+            "  -n              No broker, payloads are counted and discarded\n"
+            "  -c THING        Client identifier and {thing} of the topics (" HOST_DEFAULT_THING ")\n"
+            "  -t TOPIC        Topic of the frames, {bus} is the interface index (" HOST_DEFAULT_TOPIC ")\n"
+            "  -B N[,MS]       Batch N messages, waiting at most MS (%u,%u)\n"
+            "  -Q WINDOW       Publish with QoS 1, up to WINDOW publishes waiting for\n"
+            "                  their PUBACK, at most %u (0, QoS 0)\n"
+            "  -q              No periodic statistics\n",
+            name, HOST_SYNTH_BITRATE / 1000, HOST_SYNTH_SECONDS, HOST_DEFAULT_PORT,
+            BATCH_MAX_FRAMES, BATCH_MAX_DELAY_MS, MQTT_TCP_MAX_WINDOW);
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    static char broker[256];
+    bool        duration_set = false;
+    int         opt;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options.workers = (cpus > 0) ? (uint32_t)cpus : 1;
+
+    while ((opt = getopt(argc, argv, "i:r:S:x:l:d:w:p:b:nc:t:B:Q:qh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i':
+                if (options.n_interfaces >= HOST_MAX_INTERFACES)
+                {
+                    fprintf(stderr, "At most %u interfaces\n", HOST_MAX_INTERFACES);
+                    return false;
+                }
+                options.interfaces[options.n_interfaces++] = optarg;
+                break;
+
+            case 'r':
+                options.replay_path = optarg;
+                break;
+
+            case 'S':
+                options.synthetic = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'x':
+                options.speed = atof(optarg);
+                break;
+
+            case 'l':
+                options.loops = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'd':
+                options.duration_s = (uint32_t)strtoul(optarg, NULL, 0);
+                duration_set = true;
+                break;
+
+            case 'w':
+                options.workers = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'p':
+                options.shards = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'b':
+            {
+                snprintf(broker, sizeof(broker), "%s", optarg);
+                char* colon = strrchr(broker, ':');
+                if (colon != NULL)
+                {
+                    *colon = '\0';
+                    options.port = (uint16_t)strtoul(colon + 1, NULL, 10);
+                }
+                options.broker = broker;
+                break;
+            }
+
+            case 'n':
+                options.null_sink = true;
+                break;
+
+            case 'c':
+                options.thing = optarg;
+                break;
+
+            case 't':
+                options.topic = optarg;
+                break;
+
+            case 'B':
+            {
+                char* end;
+                options.batch_frames = (uint16_t)strtoul(optarg, &end, 0);
+                if (*end == ',')
+                {
+                    options.batch_delay_ms = (uint16_t)strtoul(end + 1, NULL, 0);
+                }
+                break;
+            }
+
+            case 'Q':
+                options.window = (uint16_t)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'q':
+                options.quiet = true;
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    if (options.synthetic > 0 && !duration_set)
+    {
+        options.duration_s = HOST_SYNTH_SECONDS;
+    }
+
+    int sources = (options.n_interfaces > 0) + (options.replay_path != NULL) + (options.synthetic > 0);
+    return sources == 1
+        && options.synthetic <= HOST_MAX_INTERFACES
+        && options.workers >= 1 && options.workers <= WS_POOL_MAX_WORKERS
+        && options.shards >= 1 && options.shards <= HOST_MAX_SHARDS
+        && options.window <= MQTT_TCP_MAX_WINDOW;
+}
+
+/// @brief Opens the sources and sets up the pipeline of each one
+static bool setup_interfaces(void)
+{
+    static char synth_names[HOST_MAX_INTERFACES][16];
+
+    if (options.replay_path != NULL)
+    {
+        ifaces[0].source = SOURCE_REPLAY;
+        ifaces[0].name   = options.replay_path;
+        nIfaces = 1;
+    }
+    else if (options.synthetic > 0)
+    {
+        for (uint32_t i = 0; i < options.synthetic; i++)
+        {
+            snprintf(synth_names[i], sizeof(synth_names[i]), "synth%u", i);
+            ifaces[i].source = SOURCE_SYNTH;
+            ifaces[i].name   = synth_names[i];
+            can_synth_init(&ifaces[i].synth, i, HOST_SYNTH_BITRATE);
+        }
+        nIfaces = options.synthetic;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < options.n_interfaces; i++)
+        {
+            ifaces[i].source = SOURCE_SOCKETCAN;
+            ifaces[i].name   = options.interfaces[i];
+        }
+        nIfaces = options.n_interfaces;
+    }
+
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        ifaces[i].sock = -1;
+    }
+    if (options.replay_path != NULL && !can_replay_open(options.replay_path, options.loops))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        host_iface_t* iface = &ifaces[i];
+        iface->bus = (uint8_t)i;
+
+        if (iface->source == SOURCE_SOCKETCAN)
+        {
+            iface->sock = can_socketcan_open(iface->name);
+            if (iface->sock < 0)
+            {
+                return false;
+            }
+        }
+
+        bool ok = spsc_ring_init(&iface->frames, HOST_FRAME_RING_SIZE);
+        for (uint32_t s = 0; s < options.shards; s++)
+        {
+            ok = spsc_ring_init(&iface->uplink[s], HOST_UPLINK_RING_SIZE) && ok;
+        }
+
+        // Contexts of the buses on their own cache lines
+        iface->core = aligned_alloc(64, gw_core_context_size());
+        if (!ok || iface->core == NULL)
+        {
+            fprintf(stderr, "gateway: out of memory\n");
+            return false;
+        }
+        memset(iface->core, 0, gw_core_context_size());
+
+        iface->task.run     = run_pipeline;
+        iface->task.pending = pipeline_pending;
+        iface->task.arg     = iface;
+
+        // Set up from this thread, before any worker exists
+        gw_core_bind(iface->core);
+        currentIface = iface;
+        gw_core_init(&HOST_OPS, iface->bus, options.topic, options.thing, 0);
+        batch_set_limits(options.batch_frames, options.batch_delay_ms);
+    }
+
+    gw_core_bind(NULL);
+    currentIface = NULL;
+    return true;
+}
+
+static bool start_threads(void)
+{
+    for (uint32_t s = 0; s < options.shards; s++)
+    {
+        host_shard_t* shard = &shards[s];
+        shard->index  = s;
+        shard->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        mqtt_tcp_init(&shard->client);
+        mqtt_tcp_set_window(&shard->client, options.window, shard_complete, NULL);
+
+        // Each connection needs its own identifier
+        if (options.shards > 1)
+        {
+            snprintf(shard->clientId, sizeof(shard->clientId), "%s-%u", options.thing, s);
+        }
+        else
+        {
+            snprintf(shard->clientId, sizeof(shard->clientId), "%s", options.thing);
+        }
+
+        if (shard->wakeFd < 0 || pthread_create(&shard->thread, NULL, run_shard, shard) != 0)
+        {
+            perror("gateway: shard");
+            options.shards = s;
+            return false;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "pub-%u", s);
+        pthread_setname_np(shard->thread, name);
+    }
+
+    if (!ws_pool_start(options.workers))
+    {
+        nIfaces = 0;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        host_iface_t* iface = &ifaces[i];
+        void* (*reader)(void*) = (iface->source == SOURCE_SOCKETCAN) ? read_socketcan : read_generated;
+        if (pthread_create(&iface->reader, NULL, reader, iface) != 0)
+        {
+            perror("gateway: reader");
+            nIfaces = i;
+            return false;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "rx-%.12s", iface->name);
+        pthread_setname_np(iface->reader, name);
+    }
+
+    return true;
+}
+
+/// @brief Waits until every pipeline has taken its frames and
+/// served its flush
+static void wait_pipelines_idle(void)
+{
+    for (;;)
+    {
+        bool idle = true;
+        for (uint32_t i = 0; i < nIfaces; i++)
+        {
+            if (!spsc_ring_is_empty(&ifaces[i].frames)
+                || __atomic_load_n(&ifaces[i].flushRequested, __ATOMIC_ACQUIRE)
+                || ws_pool_is_scheduled(&ifaces[i].task))
+            {
+                ws_pool_schedule(&ifaces[i].task);
+                idle = false;
+            }
+        }
+        if (idle)
+        {
+            return;
+        }
+        usleep(1000);
+    }
+}
+
+/// @brief Stops the readers, drains the pipelines into the shards,
+/// then stops the shards once they published everything
+static void stop_threads(void)
+{
+    uint64_t one = 1;
+
+    __atomic_store_n(&readersStop, 1, __ATOMIC_RELEASE);
+    if (write(stopFd, &one, sizeof(one)) < 0)
+    {
+        perror("gateway: stop");
+    }
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        pthread_join(ifaces[i].reader, NULL);
+    }
+
+    wait_pipelines_idle();
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        __atomic_store_n(&ifaces[i].flushRequested, 1, __ATOMIC_RELEASE);
+    }
+    wait_pipelines_idle();
+    ws_pool_stop();
+
+    __atomic_store_n(&shardsStop, 1, __ATOMIC_RELEASE);
+    for (uint32_t s = 0; s < options.shards; s++)
+    {
+        if (write(shards[s].wakeFd, &one, sizeof(one)) < 0)
+        {
+            perror("gateway: stop");
+        }
+        pthread_join(shards[s].thread, NULL);
+        close(shards[s].wakeFd);
+    }
+}
+
+static bool readers_done(void)
+{
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        if (!__atomic_load_n(&ifaces[i].readerDone, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_stats(bool detailed)
+{
+    double   elapsed_s = (double)elapsed_us() / 1e6;
+    uint64_t frames    = 0;
+    uint64_t publishes = 0;
+    uint64_t bytes     = 0;
+
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        frames += load_u64(&ifaces[i].framesProcessed);
+    }
+    for (uint32_t s = 0; s < options.shards; s++)
+    {
+        publishes += load_u64(&shards[s].publishes);
+        bytes     += load_u64(&shards[s].bytes);
+    }
+
+    fprintf(stderr, "frames=%llu publishes=%llu bytes=%llu in %.3f s: %.0f frames/s %.0f publishes/s %.1f MB/s\n",
+            (unsigned long long)frames, (unsigned long long)publishes, (unsigned long long)bytes,
+            elapsed_s, (elapsed_s > 0) ? (double)frames / elapsed_s : 0.0,
+            (elapsed_s > 0) ? (double)publishes / elapsed_s : 0.0,
+            (elapsed_s > 0) ? (double)bytes / elapsed_s / 1e6 : 0.0);
+
+    if (!detailed)
+    {
+        return;
+    }
+
+    uint64_t bus_us = 0;
+    for (uint32_t i = 0; i < nIfaces; i++)
+    {
+        fprintf(stderr, "Interface %s bus=%u read=%llu dropped=%llu processed=%llu\n",
+                ifaces[i].name, ifaces[i].bus,
+                (unsigned long long)load_u64(&ifaces[i].framesRead),
+                (unsigned long long)load_u64(&ifaces[i].framesDropped),
+                (unsigned long long)load_u64(&ifaces[i].framesProcessed));
+        bus_us += load_u64(&ifaces[i].busTimeUs);
+    }
+    if (options.synthetic > 0 && elapsed_s > 0)
+    {
+        // Bus time carried per second of run time, over every bus
+        fprintf(stderr, "Synthetic %.2f buses of %u kbit/s carried in real time\n",
+                (double)bus_us / 1e6 / elapsed_s, HOST_SYNTH_BITRATE / 1000);
+    }
+
+    ws_pool_stats_t pool_stats;
+    ws_pool_get_stats(&pool_stats);
+    fprintf(stderr, "Pool workers=%u runs=%llu steals=%llu parks=%llu\n", options.workers,
+            (unsigned long long)pool_stats.runs, (unsigned long long)pool_stats.steals,
+            (unsigned long long)pool_stats.parks);
+
+    for (uint32_t s = 0; s < options.shards; s++)
+    {
+        fprintf(stderr, "Shard %u publishes=%llu bytes=%llu", s,
+                (unsigned long long)load_u64(&shards[s].publishes),
+                (unsigned long long)load_u64(&shards[s].bytes));
+        if (!options.null_sink)
+        {
+            mqtt_tcp_stats_t mqtt_stats;
+            mqtt_tcp_get_stats(&shards[s].client, &mqtt_stats);
+            fprintf(stderr, " connects=%lu dropped=%lu", (unsigned long)mqtt_stats.connects,
+                    (unsigned long)mqtt_stats.dropped);
+            if (options.window > 0)
+            {
+                fprintf(stderr, " acked=%lu retransmits=%lu max_inflight=%lu",
+                        (unsigned long)mqtt_stats.acked, (unsigned long)mqtt_stats.retransmits,
+                        (unsigned long)mqtt_stats.max_inflight);
+            }
+        }
+        fputc('\n', stderr);
+    }
+
+    counters_snapshot_t snapshot;
+    counters_get(&snapshot);
+    for (int stage = 0; stage < COUNTERS_STAGES; stage++)
+    {
+        if (snapshot.received[stage] == 0)
+        {
+            continue;
+        }
+        fprintf(stderr, "Counters %s received=%lu forwarded=%lu",
+                counters_stage_name((counters_stage_e)stage),
+                (unsigned long)snapshot.received[stage], (unsigned long)snapshot.forwarded[stage]);
+        for (int reason = 0; reason < DROP_REASONS; reason++)
+        {
+            if (snapshot.dropped[stage][reason] != 0)
+            {
+                fprintf(stderr, " %s=%lu", counters_drop_name((counters_drop_e)reason),
+                        (unsigned long)snapshot.dropped[stage][reason]);
+            }
+        }
+        fputc('\n', stderr);
+    }
+
+    if (options.replay_path != NULL)
+    {
+        can_replay_stats_t replay_stats;
+        can_replay_get_stats(&replay_stats);
+        fprintf(stderr, "Replay lines=%lu frames=%lu skipped=%lu\n",
+                (unsigned long)replay_stats.lines, (unsigned long)replay_stats.frames,
+                (unsigned long)replay_stats.skipped);
+    }
+}
+
+static void release_interfaces(void)
+{
+    for (uint32_t i = 0; i < HOST_MAX_INTERFACES; i++)
+    {
+        if (ifaces[i].name == NULL)
+        {
+            continue;
+        }
+        if (ifaces[i].sock >= 0)
+        {
+            close(ifaces[i].sock);
+        }
+        spsc_ring_free(&ifaces[i].frames);
+        for (uint32_t s = 0; s < HOST_MAX_SHARDS; s++)
+        {
+            spsc_ring_free(&ifaces[i].uplink[s]);
+        }
+        free(ifaces[i].core);
+    }
+    if (options.replay_path != NULL)
+    {
+        can_replay_close();
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(int argc, char* argv[])
+{
+    if (!parse_options(argc, argv))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    dlog_start();
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd < 0 || !setup_interfaces())
+    {
+        release_interfaces();
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Signals go to this thread only, the others inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    startUs = wall_us();
+    bool started = start_threads();
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+    uint64_t next_stats_us = HOST_STATS_PERIOD_MS * 1000ULL;
+    while (started && !stopRequested && !readers_done())
+    {
+        usleep(HOST_HOUSEKEEPING_MS * 1000);
+
+        uint64_t now_us = elapsed_us();
+        if (options.duration_s > 0 && now_us >= options.duration_s * 1000000ULL)
+        {
+            break;
+        }
+
+        // Batches waiting for their delay and stale transport sessions
+        // are served by their pipeline, even on an idle bus
+        for (uint32_t i = 0; i < nIfaces; i++)
+        {
+            ws_pool_schedule(&ifaces[i].task);
+        }
+
+        if (!options.quiet && now_us >= next_stats_us)
+        {
+            print_stats(false);
+            next_stats_us += HOST_STATS_PERIOD_MS * 1000ULL;
+        }
+    }
+
+    stop_threads();
+    print_stats(true);
+    release_interfaces();
+    close(stopFd);
+    return started ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+// ***************************************************** //
+/// @file mqtt_tcp.c
+/// @brief MQTT 3.1.1 publisher over plain TCP, for a broker
+/// on the local network such as mosquitto. Packets are
+/// buffered and written in large chunks. QoS 1 publishes are
+/// pipelined: up to a window of them wait for their PUBACK
+/// at once, and are sent again after a reconnect
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "mqtt_tcp.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define MQTT_CONNECT        (0x10)
+#define MQTT_CONNACK        (0x20)
+#define MQTT_PUBLISH        (0x30)
+#define MQTT_PUBACK         (0x40)
+#define MQTT_PINGREQ        (0xC0)
+#define MQTT_DISCONNECT     (0xE0)
+
+/// Flags of a publish
+#define MQTT_DUP            (0x08)
+#define MQTT_QOS1           (0x02)
+
+/// Fixed header: type and up to 4 bytes of remaining length
+#define MQTT_MAX_FIXED_LEN  (5)
+
+#define MQTT_CONNACK_TIMEOUT_S  (5)
+
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void close_socket(mqtt_tcp_t* client)
+{
+    if (client->sock >= 0)
+    {
+        close(client->sock);
+    }
+    client->sock  = -1;
+    client->txLen = 0;
+    client->rxLen = 0;
+}
+
+/// @brief Writes the buffer, blocking until the broker took it
+static bool flush_buffer(mqtt_tcp_t* client)
+{
+    uint32_t done = 0;
+    while (done < client->txLen)
+    {
+        ssize_t n = send(client->sock, &client->txBuffer[done], client->txLen - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror("mqtt: send");
+            close_socket(client);
+            return false;
+        }
+        done += (uint32_t)n;
+    }
+
+    client->stats.bytes   += client->txLen;
+    client->txLen          = 0;
+    client->sentSinceCheck = true;
+    return true;
+}
+
+/// @brief Writes a fixed header
+/// @return Its length
+static uint32_t put_fixed_header(uint8_t* out, uint8_t type, uint32_t remaining)
+{
+    uint32_t len = 0;
+    out[len++] = type;
+    do
+    {
+        uint8_t byte = remaining & 0x7F;
+        remaining >>= 7;
+        out[len++] = byte | ((remaining > 0) ? 0x80 : 0);
+    } while (remaining > 0);
+    return len;
+}
+
+static uint8_t* put_string(uint8_t* out, const char* str, uint16_t len)
+{
+    out[0] = (uint8_t)(len >> 8);
+    out[1] = (uint8_t)len;
+    memcpy(&out[2], str, len);
+    return &out[2 + len];
+}
+
+static mqtt_tcp_inflight_t* inflight_at(mqtt_tcp_t* client, uint32_t i)
+{
+    return &client->inflight[(client->inflightHead + i) % MQTT_TCP_MAX_WINDOW];
+}
+
+/// @brief Finds room for a packet in the store, after the newest
+/// publish waiting and before the oldest one
+/// @return Offset of the packet, UINT32_MAX if it does not fit
+static uint32_t store_alloc(mqtt_tcp_t* client, uint32_t len)
+{
+    if (client->inflightCount == 0)
+    {
+        return (len <= sizeof(client->store)) ? 0 : UINT32_MAX;
+    }
+
+    uint32_t oldest = inflight_at(client, 0)->offset;
+    uint32_t end    = client->storeEnd;
+    if (end > oldest)
+    {
+        if (end + len <= sizeof(client->store))
+        {
+            return end;
+        }
+        return (len <= oldest) ? 0 : UINT32_MAX;
+    }
+    return (end + len <= oldest) ? end : UINT32_MAX;
+}
+
+/// @brief Frees the acknowledged publishes at the head of the window
+static void release_acked(mqtt_tcp_t* client)
+{
+    while (client->inflightCount > 0 && inflight_at(client, 0)->acked)
+    {
+        client->inflightHead = (client->inflightHead + 1) % MQTT_TCP_MAX_WINDOW;
+        client->inflightCount--;
+    }
+    if (client->inflightCount == 0)
+    {
+        client->inflightHead = 0;
+        client->storeEnd     = 0;
+    }
+}
+
+/// @brief Completes the publish of a PUBACK. Brokers acknowledge in
+/// order, so it is usually the oldest
+static void handle_puback(mqtt_tcp_t* client, uint16_t packet_id)
+{
+    for (uint32_t i = 0; i < client->inflightCount; i++)
+    {
+        mqtt_tcp_inflight_t* publish = inflight_at(client, i);
+        if (publish->packetId == packet_id && !publish->acked)
+        {
+            publish->acked = true;
+            client->stats.acked++;
+            if (client->complete != NULL)
+            {
+                client->complete(client->completeArg, publish->tag, true);
+            }
+            break;
+        }
+    }
+    release_acked(client);
+}
+
+/// @brief Completes every publish still waiting as not acknowledged
+static void drop_inflight(mqtt_tcp_t* client)
+{
+    for (uint32_t i = 0; i < client->inflightCount; i++)
+    {
+        mqtt_tcp_inflight_t* publish = inflight_at(client, i);
+        if (!publish->acked)
+        {
+            client->stats.dropped++;
+            if (client->complete != NULL)
+            {
+                client->complete(client->completeArg, publish->tag, false);
+            }
+        }
+    }
+    client->inflightCount = 0;
+    release_acked(client);
+}
+
+/// @brief Handles the complete packets received
+/// @return false if the broker sent a packet larger than expected
+static bool parse_packets(mqtt_tcp_t* client)
+{
+    uint32_t pos = 0;
+    while (client->rxLen - pos >= 2)
+    {
+        // Remaining length, up to 4 bytes
+        const uint8_t* p         = &client->rxBuffer[pos];
+        uint32_t       available = client->rxLen - pos;
+        uint32_t       remaining = 0;
+        uint32_t       header    = 0;
+        for (uint32_t i = 1; i <= 4 && i < available && header == 0; i++)
+        {
+            remaining |= (uint32_t)(p[i] & 0x7F) << (7 * (i - 1));
+            if (!(p[i] & 0x80))
+            {
+                header = i + 1;
+            }
+        }
+        if (header == 0)
+        {
+            if (available > 4)
+            {
+                return false;
+            }
+            break;
+        }
+        if (header + remaining > sizeof(client->rxBuffer))
+        {
+            return false;
+        }
+        if (header + remaining > available)
+        {
+            break;
+        }
+
+        // Nothing is expected but PUBACK and PINGRESP
+        if ((p[0] & 0xF0) == MQTT_PUBACK && remaining >= 2)
+        {
+            handle_puback(client, (uint16_t)((p[header] << 8) | p[header + 1]));
+        }
+        pos += header + remaining;
+    }
+
+    memmove(client->rxBuffer, &client->rxBuffer[pos], client->rxLen - pos);
+    client->rxLen -= pos;
+    return true;
+}
+
+/// @brief Sends again the publishes left without PUBACK by the
+/// previous connection, in their order and flagged as duplicates
+static bool resend_inflight(mqtt_tcp_t* client)
+{
+    for (uint32_t i = 0; i < client->inflightCount; i++)
+    {
+        mqtt_tcp_inflight_t* publish = inflight_at(client, i);
+        if (publish->acked)
+        {
+            continue;
+        }
+        if (client->txLen + publish->len > sizeof(client->txBuffer) && !flush_buffer(client))
+        {
+            return false;
+        }
+        client->store[publish->offset] |= MQTT_DUP;
+        memcpy(&client->txBuffer[client->txLen], &client->store[publish->offset], publish->len);
+        client->txLen += publish->len;
+        client->stats.retransmits++;
+    }
+    return true;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void mqtt_tcp_init(mqtt_tcp_t* client)
+{
+    memset(client, 0, sizeof(*client));
+    client->sock = -1;
+}
+
+void mqtt_tcp_set_window(mqtt_tcp_t* client, uint16_t window, mqtt_tcp_complete_t complete, void* arg)
+{
+    drop_inflight(client);
+    client->window       = (window > MQTT_TCP_MAX_WINDOW) ? MQTT_TCP_MAX_WINDOW : window;
+    client->complete     = complete;
+    client->completeArg  = arg;
+    client->nextPacketId = 1;
+}
+
+bool mqtt_tcp_connect(mqtt_tcp_t* client, const char* host, uint16_t port, const char* client_id)
+{
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo  hints;
+    struct addrinfo* res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, service, &hints, &res) != 0 || res == NULL)
+    {
+        fprintf(stderr, "mqtt: cannot resolve %s\n", host);
+        return false;
+    }
+
+    close_socket(client);
+    for (struct addrinfo* ai = res; ai != NULL && client->sock < 0; ai = ai->ai_next)
+    {
+        client->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (client->sock >= 0 && connect(client->sock, ai->ai_addr, ai->ai_addrlen) != 0)
+        {
+            close_socket(client);
+        }
+    }
+    freeaddrinfo(res);
+    if (client->sock < 0)
+    {
+        fprintf(stderr, "mqtt: cannot connect to %s:%u\n", host, port);
+        return false;
+    }
+
+    // Packets are already grouped in the buffer
+    int one = 1;
+    setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval timeout = { MQTT_CONNACK_TIMEOUT_S, 0 };
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // No will, no credentials. QoS 1 keeps the session, so the
+    // publishes sent again are duplicates for the broker
+    uint16_t id_len    = (uint16_t)strlen(client_id);
+    uint32_t remaining = 10 + 2 + id_len;
+    uint8_t* p         = &client->txBuffer[put_fixed_header(client->txBuffer, MQTT_CONNECT, remaining)];
+    p    = put_string(p, "MQTT", 4);
+    *p++ = 4;                                   // Protocol level 3.1.1
+    *p++ = (client->window > 0) ? 0x00 : 0x02;  // Clean session
+    *p++ = (uint8_t)(MQTT_TCP_KEEPALIVE_S >> 8);
+    *p++ = (uint8_t)MQTT_TCP_KEEPALIVE_S;
+    p    = put_string(p, client_id, id_len);
+    client->txLen = (uint32_t)(p - client->txBuffer);
+    if (!flush_buffer(client))
+    {
+        return false;
+    }
+
+    uint8_t connack[4];
+    if (recv(client->sock, connack, sizeof(connack), MSG_WAITALL) != (ssize_t)sizeof(connack)
+        || connack[0] != MQTT_CONNACK || connack[3] != 0)
+    {
+        fprintf(stderr, "mqtt: connection refused by %s:%u\n", host, port);
+        close_socket(client);
+        return false;
+    }
+
+    client->stats.connects++;
+    return resend_inflight(client);
+}
+
+void mqtt_tcp_disconnect(mqtt_tcp_t* client)
+{
+    if (client->sock >= 0 && client->txLen + 2 <= sizeof(client->txBuffer))
+    {
+        client->txLen += put_fixed_header(&client->txBuffer[client->txLen], MQTT_DISCONNECT, 0);
+        flush_buffer(client);
+    }
+    close_socket(client);
+    drop_inflight(client);
+}
+
+bool mqtt_tcp_is_connected(mqtt_tcp_t* client)
+{
+    return client->sock >= 0;
+}
+
+int mqtt_tcp_fd(mqtt_tcp_t* client)
+{
+    return client->sock;
+}
+
+bool mqtt_tcp_can_publish(mqtt_tcp_t* client, uint32_t size)
+{
+    if (client->sock < 0 || client->window == 0)
+    {
+        return true;
+    }
+    return client->inflightCount < client->window
+        && store_alloc(client, MQTT_MAX_FIXED_LEN + 4 + size) != UINT32_MAX;
+}
+
+uint32_t mqtt_tcp_inflight(mqtt_tcp_t* client)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < client->inflightCount; i++)
+    {
+        n += inflight_at(client, i)->acked ? 0 : 1;
+    }
+    return n;
+}
+
+bool mqtt_tcp_publish(mqtt_tcp_t* client, const char* topic, const char* payload, uint32_t tag)
+{
+    bool     qos1        = client->window > 0;
+    uint32_t topic_len   = (uint32_t)strlen(topic);
+    uint32_t payload_len = (uint32_t)strlen(payload);
+    uint32_t remaining   = 2 + topic_len + (qos1 ? 2 : 0) + payload_len;
+    uint32_t packet_len  = MQTT_MAX_FIXED_LEN + remaining;
+
+    if (client->sock < 0 || packet_len > sizeof(client->txBuffer) || topic_len > UINT16_MAX)
+    {
+        client->stats.dropped++;
+        return false;
+    }
+
+    // The copy kept until the PUBACK must fit too
+    uint32_t offset = 0;
+    if (qos1)
+    {
+        offset = (client->inflightCount < client->window) ? store_alloc(client, packet_len) : UINT32_MAX;
+        if (offset == UINT32_MAX)
+        {
+            client->stats.dropped++;
+            return false;
+        }
+    }
+
+    if (client->txLen + packet_len > sizeof(client->txBuffer) && !flush_buffer(client))
+    {
+        client->stats.dropped++;
+        return false;
+    }
+
+    uint8_t* start = &client->txBuffer[client->txLen];
+    uint8_t* p     = &start[put_fixed_header(start, MQTT_PUBLISH | (qos1 ? MQTT_QOS1 : 0), remaining)];
+    p = put_string(p, topic, (uint16_t)topic_len);
+
+    uint16_t packet_id = 0;
+    if (qos1)
+    {
+        packet_id = client->nextPacketId;
+        client->nextPacketId = (packet_id == UINT16_MAX) ? 1 : packet_id + 1;
+        *p++ = (uint8_t)(packet_id >> 8);
+        *p++ = (uint8_t)packet_id;
+    }
+    memcpy(p, payload, payload_len);
+    p += payload_len;
+    client->txLen = (uint32_t)(p - client->txBuffer);
+
+    if (qos1)
+    {
+        mqtt_tcp_inflight_t* publish = inflight_at(client, client->inflightCount);
+        publish->offset   = offset;
+        publish->len      = (uint32_t)(p - start);
+        publish->tag      = tag;
+        publish->packetId = packet_id;
+        publish->acked    = false;
+        memcpy(&client->store[offset], start, publish->len);
+        client->storeEnd = offset + publish->len;
+        client->inflightCount++;
+
+        uint32_t waiting = mqtt_tcp_inflight(client);
+        if (waiting > client->stats.max_inflight)
+        {
+            client->stats.max_inflight = waiting;
+        }
+    }
+
+    client->stats.publishes++;
+    return true;
+}
+
+void mqtt_tcp_poll(mqtt_tcp_t* client, uint32_t now_ms)
+{
+    if (client->sock < 0)
+    {
+        return;
+    }
+
+    // PUBACKs complete their publishes. A closed socket is noticed here
+    ssize_t n;
+    while ((n = recv(client->sock, &client->rxBuffer[client->rxLen],
+                     sizeof(client->rxBuffer) - client->rxLen, MSG_DONTWAIT)) > 0)
+    {
+        client->rxLen += (uint32_t)n;
+        if (!parse_packets(client))
+        {
+            fprintf(stderr, "mqtt: unexpected packet from the broker\n");
+            close_socket(client);
+            return;
+        }
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        fprintf(stderr, "mqtt: connection closed by the broker\n");
+        close_socket(client);
+        return;
+    }
+
+    if (client->txLen > 0 && !flush_buffer(client))
+    {
+        return;
+    }
+
+    // The broker drops clients silent for 1.5 times the keep alive
+    if (client->sentSinceCheck)
+    {
+        client->lastTxMs       = now_ms;
+        client->sentSinceCheck = false;
+    }
+    else if ((uint32_t)(now_ms - client->lastTxMs) >= MQTT_TCP_KEEPALIVE_S * 1000 / 2)
+    {
+        client->txLen = put_fixed_header(client->txBuffer, MQTT_PINGREQ, 0);
+        flush_buffer(client);
+        client->lastTxMs       = now_ms;
+        client->sentSinceCheck = false;
+    }
+}
+
+void mqtt_tcp_get_stats(mqtt_tcp_t* client, mqtt_tcp_stats_t* out)
+{
+    *out = client->stats;
+}
@@ -0,0 +1,178 @@
+// ***************************************************** //
+/// @file mqtt_tcp.h
+/// @brief MQTT 3.1.1 publisher over plain TCP, for a broker
+/// on the local network such as mosquitto. Packets are
+/// buffered and written in large chunks. QoS 1 publishes are
+/// pipelined: up to a window of them wait for their PUBACK
+/// at once, and are sent again after a reconnect
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _MQTT_TCP_H_
+#define _MQTT_TCP_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Packets waiting to be written. A publish that does not fit
+/// first writes the buffer, blocking until the broker takes it
+#define MQTT_TCP_BUFFER_SIZE    (64 * 1024)
+
+/// Keep alive announced to the broker
+#define MQTT_TCP_KEEPALIVE_S    (60)
+
+/// Largest window of QoS 1 publishes waiting for their PUBACK
+#define MQTT_TCP_MAX_WINDOW     (256)
+
+/// Copies of the QoS 1 publishes waiting for their PUBACK, kept to
+/// be sent again after a reconnect
+#define MQTT_TCP_STORE_SIZE     (256 * 1024)
+
+/// Packets received from the broker: PUBACK and PINGRESP
+#define MQTT_TCP_RX_SIZE        (256)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t connects;
+    uint32_t publishes;     // Publish packets written to the socket
+    uint32_t dropped;       // Publishes while disconnected or too large
+    uint32_t acked;         // QoS 1 publishes acknowledged
+    uint32_t retransmits;   // QoS 1 publishes sent again after a reconnect
+    uint32_t max_inflight;  // Most QoS 1 publishes waiting at once
+    uint64_t bytes;         // Bytes written, every packet
+} mqtt_tcp_stats_t;
+
+/// @brief Called once per QoS 1 publish, when the broker acknowledged
+/// it or when the connection is closed without its PUBACK
+/// @param arg Argument given with the callback
+/// @param tag Tag given with the publish
+/// @param acked true if acknowledged
+typedef void (*mqtt_tcp_complete_t)(void* arg, uint32_t tag, bool acked);
+
+/// @brief QoS 1 publish waiting for its PUBACK
+typedef struct
+{
+    uint32_t offset;        // Of its packet in the store
+    uint32_t len;
+    uint32_t tag;
+    uint16_t packetId;
+    bool     acked;         // Acknowledged, freed once the older ones are
+} mqtt_tcp_inflight_t;
+
+/// @brief Connection to a broker. Only used through the functions
+/// below, by one thread at a time
+typedef struct
+{
+    int                 sock;           // -1 while disconnected
+    uint8_t             txBuffer[MQTT_TCP_BUFFER_SIZE];
+    uint32_t            txLen;
+    uint32_t            lastTxMs;
+    bool                sentSinceCheck;
+    uint8_t             rxBuffer[MQTT_TCP_RX_SIZE];
+    uint32_t            rxLen;
+
+    // QoS 1, in the order they were sent
+    uint16_t            window;         // 0 for QoS 0
+    mqtt_tcp_complete_t complete;
+    void*               completeArg;
+    mqtt_tcp_inflight_t inflight[MQTT_TCP_MAX_WINDOW];
+    uint16_t            inflightHead;
+    uint16_t            inflightCount;  // Including acknowledged ones not freed yet
+    uint16_t            nextPacketId;
+    uint8_t             store[MQTT_TCP_STORE_SIZE];
+    uint32_t            storeEnd;       // Where the next packet is copied
+
+    mqtt_tcp_stats_t    stats;
+} mqtt_tcp_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Prepares a disconnected connection, publishing with QoS 0
+/// @param client Connection
+void mqtt_tcp_init(mqtt_tcp_t* client);
+
+/// @brief Publishes with QoS 1 from now on. Call before connecting
+/// @param client Connection
+/// @param window Publishes waiting for their PUBACK at most, up to
+/// MQTT_TCP_MAX_WINDOW. 0 goes back to QoS 0
+/// @param complete Called when each publish completes, or NULL
+/// @param arg Argument of the callback
+void mqtt_tcp_set_window(mqtt_tcp_t* client, uint16_t window, mqtt_tcp_complete_t complete, void* arg);
+
+/// @brief Connects and waits for the CONNACK of the broker. With
+/// QoS 1 the session is kept by the broker, and the publishes still
+/// waiting for their PUBACK are sent again, flagged as duplicates
+/// @param client Connection
+/// @param host Name or address of the broker
+/// @param port TCP port, usually 1883
+/// @param client_id Client identifier
+/// @return false if the broker is unreachable or refused
+bool mqtt_tcp_connect(mqtt_tcp_t* client, const char* host, uint16_t port, const char* client_id);
+
+/// @brief Sends DISCONNECT and closes the connection. QoS 1 publishes
+/// still waiting for their PUBACK complete as not acknowledged
+/// @param client Connection
+void mqtt_tcp_disconnect(mqtt_tcp_t* client);
+
+/// @brief Tells if the connection is up
+/// @param client Connection
+bool mqtt_tcp_is_connected(mqtt_tcp_t* client);
+
+/// @brief Socket of the connection, readable when the broker sent
+/// something. -1 while disconnected
+/// @param client Connection
+int mqtt_tcp_fd(mqtt_tcp_t* client);
+
+/// @brief Tells if a publish would be taken now. Only false while
+/// connected with QoS 1, when the window or the store is full
+/// @param client Connection
+/// @param size Length of the topic and of the payload
+bool mqtt_tcp_can_publish(mqtt_tcp_t* client, uint32_t size);
+
+/// @brief Number of QoS 1 publishes waiting for their PUBACK
+/// @param client Connection
+uint32_t mqtt_tcp_inflight(mqtt_tcp_t* client);
+
+/// @brief Buffers a publish, without waiting for the broker. With
+/// QoS 1, check mqtt_tcp_can_publish first
+/// @param client Connection
+/// @param topic Topic
+/// @param payload Payload, a string
+/// @param tag Given back to the completion callback of QoS 1
+/// @return false if dropped: disconnected, too large, window full or
+/// the connection failed
+bool mqtt_tcp_publish(mqtt_tcp_t* client, const char* topic, const char* payload, uint32_t tag);
+
+/// @brief Writes the buffered packets, reads what the broker sent,
+/// matching PUBACKs to their publishes, and keeps the connection
+/// alive. Closes it on error
+/// @param client Connection
+/// @param now_ms Current time in milliseconds
+void mqtt_tcp_poll(mqtt_tcp_t* client, uint32_t now_ms);
+
+/// @brief Copies the counters of the connection
+/// @param client Connection
+/// @param stats Output statistics
+void mqtt_tcp_get_stats(mqtt_tcp_t* client, mqtt_tcp_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _MQTT_TCP_H_
@@ -0,0 +1,14 @@
+// ***************************************************** //
+/// @file esp_attr.h
+/// @brief Section attributes of ESP-IDF for the portable
+/// modules built on Linux, where they mean nothing
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _ESP_ATTR_H_
+#define _ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif // _ESP_ATTR_H_
@@ -0,0 +1,136 @@
+// ***************************************************** //
+/// @file spsc_ring.c
+/// @brief Lock-free ring of variable length records between
+/// one producer thread and one consumer thread. Records are
+/// contiguous, written and read in place
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Each record starts with its length, padded so the record
+/// itself is 8-byte aligned
+#define RING_HEADER         (8)
+#define RING_ALIGN          (8)
+
+/// Length of the record ending the buffer when the next one does
+/// not fit before its end. The consumer skips to the start
+#define RING_WRAP           (0xFFFFFFFFUL)
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline uint32_t record_size(uint32_t len)
+{
+    return (RING_HEADER + len + RING_ALIGN - 1) & ~(uint32_t)(RING_ALIGN - 1);
+}
+
+static inline uint32_t* header_at(spsc_ring_t* ring, uint32_t pos)
+{
+    return (uint32_t*)&ring->buffer[pos & (ring->size - 1)];
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool spsc_ring_init(spsc_ring_t* ring, uint32_t size)
+{
+    memset(ring, 0, sizeof(*ring));
+    if (size < RING_HEADER || (size & (size - 1)) != 0)
+    {
+        return false;
+    }
+
+    ring->buffer = aligned_alloc(64, size);
+    ring->size   = size;
+    return ring->buffer != NULL;
+}
+
+void spsc_ring_free(spsc_ring_t* ring)
+{
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
+
+void* spsc_ring_reserve(spsc_ring_t* ring, uint32_t len)
+{
+    uint32_t tail   = ring->producer.tail;
+    uint32_t need   = record_size(len);
+    uint32_t offset = tail & (ring->size - 1);
+    uint32_t wrap   = (offset + need > ring->size) ? ring->size - offset : 0;
+
+    if (need > ring->size)
+    {
+        return NULL;
+    }
+
+    if (tail + wrap + need - ring->producer.headCache > ring->size)
+    {
+        ring->producer.headCache = __atomic_load_n(&ring->consumer.head, __ATOMIC_ACQUIRE);
+        if (tail + wrap + need - ring->producer.headCache > ring->size)
+        {
+            return NULL;
+        }
+    }
+
+    ring->producer.reserved = tail + wrap;
+    ring->producer.wrap     = wrap;
+    return (uint8_t*)header_at(ring, tail + wrap) + RING_HEADER;
+}
+
+void spsc_ring_commit(spsc_ring_t* ring, uint32_t len)
+{
+    if (ring->producer.wrap != 0)
+    {
+        *header_at(ring, ring->producer.tail) = RING_WRAP;
+    }
+    *header_at(ring, ring->producer.reserved) = len;
+
+    __atomic_store_n(&ring->producer.tail, ring->producer.reserved + record_size(len), __ATOMIC_RELEASE);
+}
+
+const void* spsc_ring_peek(spsc_ring_t* ring, uint32_t* len)
+{
+    uint32_t head = ring->consumer.head;
+
+    if (head == ring->consumer.tailCache)
+    {
+        ring->consumer.tailCache = __atomic_load_n(&ring->producer.tail, __ATOMIC_ACQUIRE);
+        if (head == ring->consumer.tailCache)
+        {
+            return NULL;
+        }
+    }
+
+    // A wrap marker is always committed with the record after it
+    uint32_t hdr = *header_at(ring, head);
+    if (hdr == RING_WRAP)
+    {
+        head += ring->size - (head & (ring->size - 1));
+        hdr   = *header_at(ring, head);
+    }
+
+    ring->consumer.next = head + record_size(hdr);
+    *len = hdr;
+    return (const uint8_t*)header_at(ring, head) + RING_HEADER;
+}
+
+void spsc_ring_release(spsc_ring_t* ring)
+{
+    __atomic_store_n(&ring->consumer.head, ring->consumer.next, __ATOMIC_RELEASE);
+}
+
+bool spsc_ring_is_empty(spsc_ring_t* ring)
+{
+    return __atomic_load_n(&ring->producer.tail, __ATOMIC_ACQUIRE)
+        == __atomic_load_n(&ring->consumer.head, __ATOMIC_RELAXED);
+}
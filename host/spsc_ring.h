@@ -0,0 +1,94 @@
+// ***************************************************** //
+/// @file spsc_ring.h
+/// @brief Lock-free ring of variable length records between
+/// one producer thread and one consumer thread. Records are
+/// contiguous, written and read in place
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Ring. The producer and the consumer each keep their
+/// position on their own cache line, with a cached copy of the
+/// other one so the shared line is only read when needed
+typedef struct
+{
+    uint8_t* buffer;
+    uint32_t size;
+
+    struct
+    {
+        uint32_t tail;          // Written by the producer
+        uint32_t headCache;
+        uint32_t reserved;      // Start of the reserved record
+        uint32_t wrap;          // Bytes skipped to reach it
+    } __attribute__((aligned(64))) producer;
+
+    struct
+    {
+        uint32_t head;          // Written by the consumer
+        uint32_t tailCache;
+        uint32_t next;          // Position after the record peeked
+    } __attribute__((aligned(64))) consumer;
+} spsc_ring_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Allocates an empty ring
+/// @param ring Ring
+/// @param size Bytes of the buffer, a power of two
+/// @return false if out of memory or the size is not a power of two
+bool spsc_ring_init(spsc_ring_t* ring, uint32_t size);
+
+/// @brief Frees the buffer of a ring
+/// @param ring Ring
+void spsc_ring_free(spsc_ring_t* ring);
+
+/// @brief Reserves room for a record. Producer only
+/// @param ring Ring
+/// @param len Largest length of the record
+/// @return Record to fill, 8-byte aligned. NULL if the ring is full
+void* spsc_ring_reserve(spsc_ring_t* ring, uint32_t len);
+
+/// @brief Hands the reserved record to the consumer. Producer only
+/// @param ring Ring
+/// @param len Length written, at most the length reserved
+void spsc_ring_commit(spsc_ring_t* ring, uint32_t len);
+
+/// @brief Oldest record. Consumer only
+/// @param ring Ring
+/// @param len Output length of the record
+/// @return Record, NULL if the ring is empty
+const void* spsc_ring_peek(spsc_ring_t* ring, uint32_t* len);
+
+/// @brief Frees the record returned by spsc_ring_peek. Consumer only
+/// @param ring Ring
+void spsc_ring_release(spsc_ring_t* ring);
+
+/// @brief Tells if no record is waiting. Exact for the consumer, a
+/// hint for other threads
+/// @param ring Ring
+bool spsc_ring_is_empty(spsc_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _SPSC_RING_H_
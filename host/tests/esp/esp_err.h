@@ -0,0 +1,21 @@
+// ***************************************************** //
+/// @file esp_err.h
+/// @brief Error codes of ESP-IDF for the host tests of the
+/// firmware modules
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _ESP_ERR_H_
+#define _ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK                  (0)
+#define ESP_FAIL                (-1)
+#define ESP_ERR_NO_MEM          (0x101)
+#define ESP_ERR_INVALID_ARG     (0x102)
+#define ESP_ERR_NVS_NOT_FOUND   (0x1102)
+
+const char* esp_err_to_name(esp_err_t code);
+
+#endif // _ESP_ERR_H_
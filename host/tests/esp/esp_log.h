@@ -0,0 +1,22 @@
+// ***************************************************** //
+/// @file esp_log.h
+/// @brief ESP-IDF logging for the host tests, printed to
+/// stderr so ctest shows it next to failed checks
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+
+#include <stdio.h>
+
+#define ESP_LOG_HOST(level, tag, format, ...) \
+    fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, format, ...) do { (void)(tag); } while (0)
+
+#endif // _ESP_LOG_H_
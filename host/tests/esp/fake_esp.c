@@ -0,0 +1,232 @@
+// ***************************************************** //
+/// @file fake_esp.c
+/// @brief ESP-IDF fakes for the host tests of the firmware
+/// modules: in-memory NVS, queues that never block and
+/// tasks that are never started
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "fake_esp.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "nvs.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define NVS_ENTRIES         (8)
+#define NVS_NAME_LEN        (16)
+#define NVS_BLOB_LEN        (4096)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    char    space[NVS_NAME_LEN];
+    char    key[NVS_NAME_LEN];
+    uint8_t data[NVS_BLOB_LEN];
+    size_t  length;
+} nvs_entry_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static nvs_entry_t nvsEntries[NVS_ENTRIES];
+static uint8_t     nvsUsed;
+
+/// Namespace of each open handle, the handle is the index + 1
+static char        nvsHandles[NVS_ENTRIES][NVS_NAME_LEN];
+
+static TickType_t nTicks;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static nvs_entry_t* find_entry(const char* space, const char* key)
+{
+    for (uint8_t i = 0; i < nvsUsed; i++)
+    {
+        if (strcmp(nvsEntries[i].space, space) == 0
+            && (key == NULL || strcmp(nvsEntries[i].key, key) == 0))
+        {
+            return &nvsEntries[i];
+        }
+    }
+    return NULL;
+}
+
+static const char* handle_space(nvs_handle_t handle)
+{
+    return (handle >= 1 && handle <= NVS_ENTRIES) ? nvsHandles[handle - 1] : NULL;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void fake_nvs_erase(void)
+{
+    memset(nvsEntries, 0, sizeof(nvsEntries));
+    nvsUsed = 0;
+}
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        default:                    return "ESP_FAIL";
+    }
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle)
+{
+    // As on the target, a namespace only exists once written
+    if (mode == NVS_READONLY && find_entry(name, NULL) == NULL)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (uint8_t i = 0; i < NVS_ENTRIES; i++)
+    {
+        if (nvsHandles[i][0] == '\0')
+        {
+            strncpy(nvsHandles[i], name, NVS_NAME_LEN - 1);
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    const char* space = handle_space(handle);
+    if (space == NULL || length > NVS_BLOB_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_entry_t* entry = find_entry(space, key);
+    if (entry == NULL)
+    {
+        if (nvsUsed >= NVS_ENTRIES)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        entry = &nvsEntries[nvsUsed++];
+        strncpy(entry->space, space, NVS_NAME_LEN - 1);
+        strncpy(entry->key, key, NVS_NAME_LEN - 1);
+    }
+
+    memcpy(entry->data, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* value, size_t* length)
+{
+    const char* space = handle_space(handle);
+    nvs_entry_t* entry = (space != NULL) ? find_entry(space, key) : NULL;
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->length > *length)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(value, entry->data, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return (handle_space(handle) != NULL) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle >= 1 && handle <= NVS_ENTRIES)
+    {
+        nvsHandles[handle - 1][0] = '\0';
+    }
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                           void* arg, UBaseType_t priority, StackType_t* stack,
+                                           StaticTask_t* task, BaseType_t core)
+{
+    (void)function;
+    (void)name;
+    (void)stack_depth;
+    (void)arg;
+    (void)priority;
+    (void)stack;
+    (void)core;
+    return (TaskHandle_t)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    nTicks += ticks;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return nTicks;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t* storage, StaticQueue_t* queue)
+{
+    queue->storage   = storage;
+    queue->item_size = item_size;
+    queue->length    = length;
+    queue->head      = 0;
+    queue->count     = 0;
+    return (QueueHandle_t)queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t wait)
+{
+    StaticQueue_t* queue = (StaticQueue_t*)handle;
+    (void)wait;
+
+    if (queue->count >= queue->length)
+    {
+        return pdFALSE;
+    }
+
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t wait)
+{
+    StaticQueue_t* queue = (StaticQueue_t*)handle;
+    (void)wait;
+
+    if (queue->count == 0)
+    {
+        return pdFALSE;
+    }
+
+    memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
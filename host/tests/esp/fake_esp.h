@@ -0,0 +1,23 @@
+// ***************************************************** //
+/// @file fake_esp.h
+/// @brief Controls of the ESP-IDF fakes used by the host
+/// tests of the firmware modules
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _FAKE_ESP_H_
+#define _FAKE_ESP_H_
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "nvs.h"
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Erases every namespace of the in-memory NVS
+void fake_nvs_erase(void);
+
+#endif // _FAKE_ESP_H_
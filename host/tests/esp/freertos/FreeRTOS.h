@@ -0,0 +1,46 @@
+// ***************************************************** //
+/// @file FreeRTOS.h
+/// @brief FreeRTOS types for the host tests. Tasks are never
+/// started, the tests call the task bodies they need
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t  StackType_t;
+
+typedef struct fake_task*  TaskHandle_t;
+typedef struct fake_queue* QueueHandle_t;
+
+typedef struct
+{
+    uint32_t notifications;
+} StaticTask_t;
+
+typedef struct
+{
+    uint8_t*    storage;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+} StaticQueue_t;
+
+#define pdFALSE                 (0)
+#define pdTRUE                  (1)
+#define pdPASS                  (1)
+#define portMAX_DELAY           (0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS      (1)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define configMAX_PRIORITIES    (25)
+#define tskIDLE_PRIORITY        (0)
+#define tskNO_AFFINITY          (0x7FFFFFFF)
+
+#endif // _FREERTOS_H_
@@ -0,0 +1,18 @@
+// ***************************************************** //
+/// @file queue.h
+/// @brief FreeRTOS queues for the host tests. Nothing blocks,
+/// an empty or full queue fails at once
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+#include "FreeRTOS.h"
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t* storage, StaticQueue_t* queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+
+#endif // _QUEUE_H_
@@ -0,0 +1,21 @@
+// ***************************************************** //
+/// @file task.h
+/// @brief FreeRTOS tasks for the host tests. The tick count
+/// only moves when a task delays
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void* arg);
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                           void* arg, UBaseType_t priority, StackType_t* stack,
+                                           StaticTask_t* task, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#endif // _TASK_H_
@@ -0,0 +1,388 @@
+// ***************************************************** //
+/// @file fake_broker.c
+/// @brief MQTT broker on the loopback interface for the
+/// host tests and benches of the publisher. One thread
+/// accepts the client, parses its packets and writes the
+/// PUBACKs once they are due
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "fake_broker.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BROKER_RX_SIZE      (64 * 1024)
+#define BROKER_MAX_ACKS     (1024)
+
+/// Longest wait of the thread, so requests of the test are served
+#define BROKER_TICK_MS      (1)
+
+#define MQTT_CONNECT        (0x10)
+#define MQTT_PUBLISH        (0x30)
+#define MQTT_PINGREQ        (0xC0)
+#define MQTT_DISCONNECT     (0xE0)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief PUBACK waiting to be written
+typedef struct
+{
+    uint16_t packetId;
+    uint64_t dueMs;
+} broker_ack_t;
+
+typedef struct
+{
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    bool            running;
+    int             listenFd;
+    int             clientFd;
+    bool            dropClient;
+
+    uint32_t        ackDelayMs;
+    bool            holdAcks;
+    broker_ack_t    acks[BROKER_MAX_ACKS];
+    uint32_t        nAcks;
+
+    uint8_t         rx[BROKER_RX_SIZE];
+    uint32_t        rxLen;
+
+    fake_publish_t  records[FAKE_BROKER_RECORDS];
+    uint32_t        publishes;
+    uint8_t         connectFlags;
+    uint32_t        connects;
+} broker_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static broker_t broker;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void send_all(const uint8_t* data, uint32_t len)
+{
+    if (broker.clientFd >= 0 && send(broker.clientFd, data, len, MSG_NOSIGNAL) != (ssize_t)len)
+    {
+        broker.dropClient = true;
+    }
+}
+
+static void close_client(void)
+{
+    if (broker.clientFd >= 0)
+    {
+        close(broker.clientFd);
+    }
+    broker.clientFd   = -1;
+    broker.dropClient = false;
+    broker.rxLen      = 0;
+    broker.nAcks      = 0;
+}
+
+static void queue_ack(uint16_t packet_id, uint64_t due_ms)
+{
+    if (broker.nAcks < BROKER_MAX_ACKS)
+    {
+        broker.acks[broker.nAcks].packetId = packet_id;
+        broker.acks[broker.nAcks].dueMs    = due_ms;
+        broker.nAcks++;
+    }
+}
+
+/// @brief Writes the PUBACKs that are due, in the order they were queued
+static void send_due_acks(uint64_t now)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < broker.nAcks; i++)
+    {
+        if (broker.acks[i].dueMs <= now)
+        {
+            uint8_t puback[4] = { 0x40, 2, (uint8_t)(broker.acks[i].packetId >> 8), (uint8_t)broker.acks[i].packetId };
+            send_all(puback, sizeof(puback));
+        }
+        else
+        {
+            broker.acks[kept++] = broker.acks[i];
+        }
+    }
+    broker.nAcks = kept;
+}
+
+/// @return Milliseconds to wait for the client, 0 if a PUBACK is due
+static int next_timeout(uint64_t now)
+{
+    for (uint32_t i = 0; i < broker.nAcks; i++)
+    {
+        if (broker.acks[i].dueMs <= now)
+        {
+            return 0;
+        }
+    }
+    return BROKER_TICK_MS;
+}
+
+static void handle_publish(uint8_t flags, const uint8_t* p, uint32_t len)
+{
+    fake_publish_t* record = &broker.records[broker.publishes % FAKE_BROKER_RECORDS];
+    memset(record, 0, sizeof(*record));
+    record->flags = flags;
+
+    uint32_t topic_len = (len >= 2) ? (uint32_t)((p[0] << 8) | p[1]) : 0;
+    uint32_t pos       = 2 + topic_len;
+    if (pos > len)
+    {
+        broker.dropClient = true;
+        return;
+    }
+    memcpy(record->topic, &p[2], (topic_len < sizeof(record->topic)) ? topic_len : sizeof(record->topic) - 1);
+
+    if ((flags & 0x06) != 0 && pos + 2 <= len)
+    {
+        record->packetId = (uint16_t)((p[pos] << 8) | p[pos + 1]);
+        pos += 2;
+    }
+    uint32_t payload_len = len - pos;
+    memcpy(record->payload, &p[pos], (payload_len < sizeof(record->payload)) ? payload_len : sizeof(record->payload) - 1);
+    broker.publishes++;
+
+    if (record->packetId != 0 && !broker.holdAcks)
+    {
+        queue_ack(record->packetId, now_ms() + broker.ackDelayMs);
+    }
+}
+
+/// @brief Handles the complete packets received
+static void parse_packets(void)
+{
+    uint32_t pos = 0;
+    while (broker.rxLen - pos >= 2)
+    {
+        const uint8_t* p         = &broker.rx[pos];
+        uint32_t       available = broker.rxLen - pos;
+        uint32_t       remaining = 0;
+        uint32_t       header    = 0;
+        for (uint32_t i = 1; i <= 4 && i < available && header == 0; i++)
+        {
+            remaining |= (uint32_t)(p[i] & 0x7F) << (7 * (i - 1));
+            if (!(p[i] & 0x80))
+            {
+                header = i + 1;
+            }
+        }
+        if (header == 0 || header + remaining > available)
+        {
+            break;
+        }
+
+        const uint8_t* body = &p[header];
+        switch (p[0] & 0xF0)
+        {
+            case MQTT_CONNECT:
+            {
+                // Protocol name, level, then the flags
+                static const uint8_t connack[4] = { 0x20, 2, 0, 0 };
+                broker.connectFlags = (remaining > 7) ? body[7] : 0;
+                broker.connects++;
+                send_all(connack, sizeof(connack));
+                break;
+            }
+            case MQTT_PUBLISH:
+                handle_publish(p[0] & 0x0F, body, remaining);
+                break;
+            case MQTT_PINGREQ:
+            {
+                static const uint8_t pingresp[2] = { 0xD0, 0 };
+                send_all(pingresp, sizeof(pingresp));
+                break;
+            }
+            case MQTT_DISCONNECT:
+                broker.dropClient = true;
+                break;
+            default:
+                break;
+        }
+        pos += header + remaining;
+    }
+
+    memmove(broker.rx, &broker.rx[pos], broker.rxLen - pos);
+    broker.rxLen -= pos;
+    if (broker.rxLen == sizeof(broker.rx))
+    {
+        broker.dropClient = true;
+    }
+}
+
+static void* broker_thread(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&broker.lock);
+    while (broker.running)
+    {
+        struct pollfd fds[1];
+        fds[0].fd     = (broker.clientFd >= 0) ? broker.clientFd : broker.listenFd;
+        fds[0].events = POLLIN;
+        int timeout   = next_timeout(now_ms());
+        pthread_mutex_unlock(&broker.lock);
+
+        int ready = poll(fds, 1, timeout);
+
+        pthread_mutex_lock(&broker.lock);
+        if (broker.clientFd < 0)
+        {
+            if (ready > 0)
+            {
+                // PUBACKs go out as soon as they are due, as a broker
+                // would send them
+                int one = 1;
+                broker.clientFd = accept(broker.listenFd, NULL, NULL);
+                setsockopt(broker.clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            continue;
+        }
+
+        if (ready > 0 && !broker.dropClient)
+        {
+            ssize_t n = recv(broker.clientFd, &broker.rx[broker.rxLen], sizeof(broker.rx) - broker.rxLen, MSG_DONTWAIT);
+            if (n > 0)
+            {
+                broker.rxLen += (uint32_t)n;
+                parse_packets();
+            }
+            else
+            {
+                broker.dropClient = true;
+            }
+        }
+        send_due_acks(now_ms());
+        if (broker.dropClient)
+        {
+            close_client();
+        }
+    }
+    close_client();
+    pthread_mutex_unlock(&broker.lock);
+    return NULL;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+uint16_t fake_broker_start(uint32_t ack_delay_ms)
+{
+    memset(&broker, 0, sizeof(broker));
+    pthread_mutex_init(&broker.lock, NULL);
+    broker.clientFd   = -1;
+    broker.ackDelayMs = ack_delay_ms;
+
+    struct sockaddr_in addr;
+    socklen_t          addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    broker.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (broker.listenFd < 0 || bind(broker.listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(broker.listenFd, 1) != 0 || getsockname(broker.listenFd, (struct sockaddr*)&addr, &addr_len) != 0)
+    {
+        if (broker.listenFd >= 0)
+        {
+            close(broker.listenFd);
+        }
+        return 0;
+    }
+
+    broker.running = true;
+    pthread_create(&broker.thread, NULL, broker_thread, NULL);
+    return ntohs(addr.sin_port);
+}
+
+void fake_broker_stop(void)
+{
+    pthread_mutex_lock(&broker.lock);
+    broker.running = false;
+    pthread_mutex_unlock(&broker.lock);
+    pthread_join(broker.thread, NULL);
+    close(broker.listenFd);
+    pthread_mutex_destroy(&broker.lock);
+}
+
+void fake_broker_hold_acks(bool hold)
+{
+    pthread_mutex_lock(&broker.lock);
+    broker.holdAcks = hold;
+    pthread_mutex_unlock(&broker.lock);
+}
+
+void fake_broker_ack(uint16_t packet_id)
+{
+    pthread_mutex_lock(&broker.lock);
+    queue_ack(packet_id, 0);
+    pthread_mutex_unlock(&broker.lock);
+}
+
+void fake_broker_drop_client(void)
+{
+    pthread_mutex_lock(&broker.lock);
+    broker.dropClient = broker.clientFd >= 0;
+    pthread_mutex_unlock(&broker.lock);
+}
+
+uint32_t fake_broker_publishes(void)
+{
+    pthread_mutex_lock(&broker.lock);
+    uint32_t n = broker.publishes;
+    pthread_mutex_unlock(&broker.lock);
+    return n;
+}
+
+bool fake_broker_get_publish(uint32_t index, fake_publish_t* out)
+{
+    pthread_mutex_lock(&broker.lock);
+    bool recorded = index < broker.publishes && broker.publishes - index <= FAKE_BROKER_RECORDS;
+    if (recorded)
+    {
+        *out = broker.records[index % FAKE_BROKER_RECORDS];
+    }
+    pthread_mutex_unlock(&broker.lock);
+    return recorded;
+}
+
+uint8_t fake_broker_connect_flags(void)
+{
+    pthread_mutex_lock(&broker.lock);
+    uint8_t flags = broker.connectFlags;
+    pthread_mutex_unlock(&broker.lock);
+    return flags;
+}
+
+uint32_t fake_broker_connects(void)
+{
+    pthread_mutex_lock(&broker.lock);
+    uint32_t n = broker.connects;
+    pthread_mutex_unlock(&broker.lock);
+    return n;
+}
@@ -0,0 +1,78 @@
+// ***************************************************** //
+/// @file fake_broker.h
+/// @brief MQTT broker on the loopback interface for the
+/// host tests and benches of the publisher. Takes one
+/// client at a time, records its publishes and answers
+/// QoS 1 ones after an injected delay, or when told to
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _FAKE_BROKER_H_
+#define _FAKE_BROKER_H_
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdbool.h>
+#include <stdint.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Publishes recorded, the oldest ones are overwritten
+#define FAKE_BROKER_RECORDS     (64)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Publish received by the broker
+typedef struct
+{
+    uint8_t  flags;         // Low nibble of the fixed header
+    uint16_t packetId;      // 0 for QoS 0
+    char     topic[64];
+    char     payload[128];
+} fake_publish_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Starts listening on a free loopback port
+/// @param ack_delay_ms Delay of every PUBACK, the round trip of the
+/// network being simulated
+/// @return Port of the broker, 0 on error
+uint16_t fake_broker_start(uint32_t ack_delay_ms);
+
+/// @brief Closes the connection and stops the broker
+void fake_broker_stop(void);
+
+/// @brief Holds the PUBACKs of the next publishes until
+/// fake_broker_ack, or sends them after the delay again
+/// @param hold true to hold them
+void fake_broker_hold_acks(bool hold);
+
+/// @brief Sends the PUBACK of a held publish
+/// @param packet_id Packet identifier of the publish
+void fake_broker_ack(uint16_t packet_id);
+
+/// @brief Closes the connection of the client, as a broker restart
+/// would. The next client is then accepted
+void fake_broker_drop_client(void);
+
+/// @brief Number of publishes received since the start
+uint32_t fake_broker_publishes(void);
+
+/// @brief Copies a recorded publish
+/// @param index Index among the publishes since the start
+/// @param out Output publish
+/// @return false if not recorded, or overwritten
+bool fake_broker_get_publish(uint32_t index, fake_publish_t* out);
+
+/// @brief Flags byte of the last CONNECT, 0x02 for a clean session
+uint8_t fake_broker_connect_flags(void);
+
+/// @brief Number of CONNECT packets accepted
+uint32_t fake_broker_connects(void);
+
+#endif // _FAKE_BROKER_H_
@@ -0,0 +1,84 @@
+// ***************************************************** //
+/// @file test.h
+/// @brief Minimal checks for the host tests. A failed check
+/// is printed and the test goes on, main returns the result
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+static int testFailures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            testFailures++;                                                 \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                      \
+    do                                                                      \
+    {                                                                       \
+        long long _a = (long long)(a);                                      \
+        long long _b = (long long)(b);                                      \
+        if (_a != _b)                                                       \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                    \
+            testFailures++;                                                 \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                         \
+    do                                                                      \
+    {                                                                       \
+        double _a = (double)(a);                                            \
+        double _b = (double)(b);                                            \
+        if (fabs(_a - _b) > (tolerance))                                    \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %g != %g\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                    \
+            testFailures++;                                                 \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_STR(a, b)                                                     \
+    do                                                                      \
+    {                                                                       \
+        const char* _a = (a);                                               \
+        const char* _b = (b);                                               \
+        if (strcmp(_a, _b) != 0)                                            \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: CHECK_STR(%s, %s) failed:\n  %s\n  %s\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                    \
+            testFailures++;                                                 \
+        }                                                                   \
+    } while (0)
+
+/// Runs a test function, named in the output
+#define RUN_TEST(fn)                                                        \
+    do                                                                      \
+    {                                                                       \
+        int _before = testFailures;                                         \
+        fn();                                                               \
+        printf("%s %s\n", (testFailures == _before) ? "PASS" : "FAIL", #fn); \
+    } while (0)
+
+#define TEST_RESULT()   ((testFailures == 0) ? 0 : 1)
+
+#endif // _TEST_H_
@@ -0,0 +1,220 @@
+// ***************************************************** //
+/// @file test_aggregate.c
+/// @brief Window statistics of the aggregation mode checked
+/// against a reference computed in double precision, and
+/// the summary documents they serialize to
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "aggregate.h"
+#include "test.h"
+
+#include <stdlib.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define SUMMARY_LEN     (1024)
+
+/// PGN of EEC1 in dbc/gateway.dbc
+#define PGN_EEC1        (61444)
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Index of a signal in DBC_SIGNALS, -1 if not found
+static int find_signal(const char* message, const char* signal)
+{
+    for (uint16_t m = 0; m < DBC_NUM_MESSAGES; m++)
+    {
+        const dbc_message_t* msg = &DBC_MESSAGES[m];
+        if (strcmp(msg->name, message) != 0)
+        {
+            continue;
+        }
+        for (uint8_t i = 0; i < msg->num_signals; i++)
+        {
+            if (strcmp(DBC_SIGNALS[msg->first_signal + i].name, signal) == 0)
+            {
+                return msg->first_signal + i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void update_signal(int signal, float value, uint8_t source)
+{
+    dbc_value_t v = { .signal = (uint16_t)signal, .value = value };
+    agg_update_signals(&v, 1, source);
+}
+
+/// @brief Serializes the whole window into one document
+static void serialize_all(char* buf, uint32_t now_ms)
+{
+    agg_cursor_t cursor;
+    memset(&cursor, 0, sizeof(cursor));
+    CHECK(agg_serialize(buf, SUMMARY_LEN, &cursor, now_ms));
+    CHECK(!agg_serialize(buf + SUMMARY_LEN / 2, SUMMARY_LEN / 2, &cursor, now_ms));
+}
+
+static void test_frame_period(void)
+{
+    agg_init(1000);
+
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id  = 0x100;
+    frame.can_dlc = 2;
+    frame.data[0] = 0x01;
+
+    // Periods of 10, 20 and 30 ms
+    const uint32_t times[] = { 1000, 1010, 1030, 1060 };
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+    {
+        frame.data[1] = (uint8_t)i;
+        CHECK(agg_update_frame(&frame, times[i]));
+    }
+
+    const agg_id_stats_t* stats = agg_get_id_stats(0x100);
+    CHECK(stats != NULL);
+    CHECK_EQ(stats->count, 4);
+    CHECK_EQ(stats->period.count, 3);
+
+    char buf[SUMMARY_LEN];
+    serialize_all(buf, 2000);
+    CHECK_STR(buf, "{\"start\":1000,\"len\":1000,\"ids\":["
+                   "{\"id\":256,\"n\":4,\"period\":[10,30,20.0],\"last\":\"0103\"}"
+                   "],\"signals\":[]}");
+
+    // The first frame of the next window is timed from the last one
+    agg_reset_window(2000);
+    CHECK(agg_get_id_stats(0x100) == NULL);
+    CHECK(agg_update_frame(&frame, 2100));
+    stats = agg_get_id_stats(0x100);
+    CHECK(stats != NULL);
+    CHECK_EQ(stats->count, 1);
+    CHECK_NEAR(stats->period.min, 1040, 0);
+}
+
+static void test_signal_reference(void)
+{
+    int speed = find_signal("EngineData", "EngineSpeed");
+    CHECK(speed >= 0);
+
+    agg_init(0);
+
+    // Reference in double precision over the same float inputs
+    double ref_min = 0, ref_max = 0, ref_sum = 0;
+    float  last = 0;
+    srand(42);
+    for (int i = 0; i < 10000; i++)
+    {
+        float value = (float)(rand() % 65536) * 0.25f;
+        if (i == 0 || value < ref_min) ref_min = value;
+        if (i == 0 || value > ref_max) ref_max = value;
+        ref_sum += value;
+        last = value;
+        update_signal(speed, value, 0);
+    }
+    double ref_mean = ref_sum / 10000;
+
+    const agg_value_stats_t* stats = agg_get_signal_stats((uint16_t)speed, 0);
+    CHECK(stats != NULL);
+    CHECK_EQ(stats->count, 10000);
+    CHECK_NEAR(stats->min, ref_min, 0);
+    CHECK_NEAR(stats->max, ref_max, 0);
+    CHECK_NEAR(stats->last, last, 0);
+    CHECK_NEAR(stats->sum / stats->count, ref_mean, 1e-9 * ref_mean);
+
+    // The document carries the same numbers, the mean as a float
+    char buf[SUMMARY_LEN];
+    char expected[256];
+    serialize_all(buf, 10000);
+    snprintf(expected, sizeof(expected),
+             "{\"id\":256,\"name\":\"EngineSpeed\",\"n\":10000,\"min\":%g,\"max\":%g,\"mean\":%g,\"last\":%g}",
+             ref_min, ref_max, (double)(float)ref_mean, (double)last);
+    CHECK(strstr(buf, expected) != NULL);
+}
+
+static void test_signal_sources(void)
+{
+    int speed      = find_signal("EngineData", "EngineSpeed");
+    int eec1_speed = find_signal("EEC1", "EngineSpeed");
+    CHECK(speed >= 0 && eec1_speed >= 0);
+
+    agg_init(0);
+
+    // Same signal name in two messages, and EEC1 from two senders
+    update_signal(speed, 800, 0);
+    update_signal(eec1_speed, 1000, 0x00);
+    update_signal(eec1_speed, 1200, 0x00);
+    update_signal(eec1_speed, 2000, 0x03);
+
+    const agg_value_stats_t* engine1 = agg_get_signal_stats((uint16_t)eec1_speed, 0x00);
+    const agg_value_stats_t* engine2 = agg_get_signal_stats((uint16_t)eec1_speed, 0x03);
+    CHECK(engine1 != NULL && engine2 != NULL);
+    CHECK_EQ(engine1->count, 2);
+    CHECK_NEAR(engine1->sum / engine1->count, 1100, 0);
+    CHECK_EQ(engine2->count, 1);
+    CHECK(agg_get_signal_stats((uint16_t)eec1_speed, 0x05) == NULL);
+
+    char buf[SUMMARY_LEN];
+    char expected[128];
+    serialize_all(buf, 1000);
+    CHECK(strstr(buf, "{\"id\":256,\"name\":\"EngineSpeed\",\"n\":1,\"min\":800,") != NULL);
+    snprintf(expected, sizeof(expected),
+             "{\"pgn\":%u,\"sa\":0,\"name\":\"EngineSpeed\",\"n\":2,\"min\":1000,\"max\":1200,\"mean\":1100,", PGN_EEC1);
+    CHECK(strstr(buf, expected) != NULL);
+    snprintf(expected, sizeof(expected),
+             "{\"pgn\":%u,\"sa\":3,\"name\":\"EngineSpeed\",\"n\":1,\"min\":2000,", PGN_EEC1);
+    CHECK(strstr(buf, expected) != NULL);
+}
+
+static void test_split_documents(void)
+{
+    agg_init(0);
+
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_dlc = 8;
+    for (uint32_t id = 0; id < 40; id++)
+    {
+        frame.can_id = 0x600 + id;
+        CHECK(agg_update_frame(&frame, id));
+    }
+
+    // Every ID appears in exactly one document, each one valid on its own
+    char         buf[400];
+    agg_cursor_t cursor;
+    memset(&cursor, 0, sizeof(cursor));
+    int documents = 0;
+    int entries = 0;
+    while (agg_serialize(buf, sizeof(buf), &cursor, 100))
+    {
+        documents++;
+        CHECK(strlen(buf) < sizeof(buf));
+        CHECK(strcmp(&buf[strlen(buf) - 2], "]}") == 0);
+        for (const char* p = buf; (p = strstr(p, "{\"id\":")) != NULL; p++)
+        {
+            entries++;
+        }
+    }
+    CHECK(documents > 1);
+    CHECK_EQ(entries, 40);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_frame_period);
+    RUN_TEST(test_signal_reference);
+    RUN_TEST(test_signal_sources);
+    RUN_TEST(test_split_documents);
+    return TEST_RESULT();
+}
@@ -0,0 +1,186 @@
+// ***************************************************** //
+/// @file test_can_filters.c
+/// @brief Placement of the acceptance filters in the masks and
+/// filter registers: every filter loaded, sets that do not fit
+/// rejected
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "can_bus.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define SFF_MASK_A      (0x7F0)
+#define SFF_MASK_B      (0x7FF)
+#define EFF_MASK_PGN    (0x03FFFF00)
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static CAN_filter_t make_filter(uint32_t id, uint32_t mask)
+{
+    CAN_filter_t filter = { .id = id, .mask = mask };
+    return filter;
+}
+
+/// @brief Number of registers loaded with a requested filter
+static uint8_t slots_of(const CAN_filter_layout_t* layout, uint8_t filter)
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CAN_MAX_FILTERS; i++)
+    {
+        if (layout->slot[i] == filter)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+/// @brief Checks every requested filter is loaded in a register of
+/// a buffer whose mask and format are its own
+static void check_loaded(const CAN_filter_t filters[], uint8_t n_filters, const CAN_filter_layout_t* layout)
+{
+    for (uint8_t i = 0; i < CAN_MAX_FILTERS; i++)
+    {
+        uint8_t  buffer = (i < CAN_RXB0_FILTERS) ? 0 : 1;
+        uint8_t  filter = layout->slot[i];
+        bool     ext    = (filters[filter].id & CAN_EFF_FLAG) != 0;
+        uint32_t mask   = filters[filter].mask & (ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+        CHECK(filter < n_filters);
+        CHECK_EQ(layout->ext[buffer], ext);
+        CHECK_EQ(layout->mask[buffer], mask);
+    }
+    for (uint8_t f = 0; f < n_filters; f++)
+    {
+        CHECK(slots_of(layout, f) > 0);
+    }
+}
+
+static void test_accept_all(void)
+{
+    CAN_filter_layout_t layout;
+    CHECK(CAN_layout_filters(NULL, 0, &layout));
+    CHECK_EQ(layout.n_masks, 0);
+    CHECK(CAN_check_filters(NULL, 0));
+}
+
+static void test_single_group(void)
+{
+    CAN_filter_t filters[CAN_MAX_FILTERS];
+    for (uint8_t i = 0; i < CAN_MAX_FILTERS; i++)
+    {
+        filters[i] = make_filter(0x100 + 0x10 * i, SFF_MASK_A);
+    }
+
+    // Every size of a group fits, its filters spread over both buffers
+    for (uint8_t n = 1; n <= CAN_MAX_FILTERS; n++)
+    {
+        CAN_filter_layout_t layout;
+        CHECK(CAN_layout_filters(filters, n, &layout));
+        CHECK_EQ(layout.n_masks, 1);
+        check_loaded(filters, n, &layout);
+    }
+
+    // Six filters take a register each
+    CAN_filter_layout_t layout;
+    CHECK(CAN_layout_filters(filters, CAN_MAX_FILTERS, &layout));
+    for (uint8_t f = 0; f < CAN_MAX_FILTERS; f++)
+    {
+        CHECK_EQ(slots_of(&layout, f), 1);
+    }
+}
+
+static void test_two_groups(void)
+{
+    // 4 filters on one mask and 2 on the other, in any order
+    CAN_filter_t filters[CAN_MAX_FILTERS] =
+    {
+        make_filter(0x100, SFF_MASK_A), make_filter(0x123, SFF_MASK_B),
+        make_filter(0x200, SFF_MASK_A), make_filter(0x300, SFF_MASK_A),
+        make_filter(0x456, SFF_MASK_B), make_filter(0x400, SFF_MASK_A),
+    };
+    CAN_filter_layout_t layout;
+    CHECK(CAN_layout_filters(filters, CAN_MAX_FILTERS, &layout));
+    CHECK_EQ(layout.n_masks, 2);
+    CHECK_EQ(layout.mask[0], SFF_MASK_B);
+    CHECK_EQ(layout.mask[1], SFF_MASK_A);
+    check_loaded(filters, CAN_MAX_FILTERS, &layout);
+
+    // 1 and 3 filters
+    CHECK(CAN_layout_filters(filters, 4, &layout));
+    check_loaded(filters, 4, &layout);
+    CHECK_EQ(layout.mask[0], SFF_MASK_B);
+
+    // Standard and extended filters with the same mask are two groups
+    CAN_filter_t formats[3] =
+    {
+        make_filter(0x100, EFF_MASK_PGN),
+        make_filter(CAN_EFF_FLAG | 0x18FEF100, EFF_MASK_PGN),
+        make_filter(CAN_EFF_FLAG | 0x18FEEE00, EFF_MASK_PGN),
+    };
+    CHECK(CAN_layout_filters(formats, 3, &layout));
+    CHECK_EQ(layout.n_masks, 2);
+    CHECK(!layout.ext[0]);
+    CHECK_EQ(layout.mask[0], EFF_MASK_PGN & CAN_SFF_MASK);
+    CHECK(layout.ext[1]);
+    CHECK_EQ(layout.mask[1], EFF_MASK_PGN);
+    check_loaded(formats, 3, &layout);
+}
+
+static void test_rejected(void)
+{
+    CAN_filter_layout_t layout;
+
+    // 1 and 5: RXB1 holds only 4 filters
+    CAN_filter_t one_five[CAN_MAX_FILTERS] =
+    {
+        make_filter(0x123, SFF_MASK_B), make_filter(0x100, SFF_MASK_A),
+        make_filter(0x200, SFF_MASK_A), make_filter(0x300, SFF_MASK_A),
+        make_filter(0x400, SFF_MASK_A), make_filter(0x500, SFF_MASK_A),
+    };
+    CHECK(!CAN_layout_filters(one_five, CAN_MAX_FILTERS, &layout));
+    CHECK(!CAN_check_filters(one_five, CAN_MAX_FILTERS));
+
+    // 3 and 3: RXB0 holds only 2 filters
+    CAN_filter_t three_three[CAN_MAX_FILTERS] =
+    {
+        make_filter(0x100, SFF_MASK_A), make_filter(0x200, SFF_MASK_A),
+        make_filter(0x300, SFF_MASK_A), make_filter(0x123, SFF_MASK_B),
+        make_filter(0x456, SFF_MASK_B), make_filter(0x789, SFF_MASK_B),
+    };
+    CHECK(!CAN_check_filters(three_three, CAN_MAX_FILTERS));
+
+    // Three masks
+    CAN_filter_t three_masks[3] =
+    {
+        make_filter(0x100, SFF_MASK_A), make_filter(0x123, SFF_MASK_B),
+        make_filter(CAN_EFF_FLAG | 0x18FEF100, EFF_MASK_PGN),
+    };
+    CHECK(!CAN_check_filters(three_masks, 3));
+
+    // More filters than registers
+    CAN_filter_t too_many[CAN_MAX_FILTERS + 1];
+    for (uint8_t i = 0; i < CAN_MAX_FILTERS + 1; i++)
+    {
+        too_many[i] = make_filter(0x100 + i, SFF_MASK_B);
+    }
+    CHECK(!CAN_check_filters(too_many, CAN_MAX_FILTERS + 1));
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_accept_all);
+    RUN_TEST(test_single_group);
+    RUN_TEST(test_two_groups);
+    RUN_TEST(test_rejected);
+    return TEST_RESULT();
+}
@@ -0,0 +1,279 @@
+// ***************************************************** //
+/// @file test_cannelloni.c
+/// @brief Cannelloni stream sent through a UDP loopback socket:
+/// packet headers, sequence numbers and the order of the frames
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cannelloni.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define MAX_FRAMES      (2000)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Both ends of the loopback and what went through it
+typedef struct
+{
+    int                tx;
+    int                rx;
+    struct sockaddr_in rx_addr;
+    uint32_t           ready;
+    uint32_t           packets;
+    uint8_t            next_seq;
+    uint32_t           seq_errors;
+    uint32_t           n_frames;
+    CAN_frame_t        frames[MAX_FRAMES];
+} loopback_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static loopback_t loop;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool udp_send(const uint8_t* data, uint16_t len)
+{
+    return sendto(loop.tx, data, len, 0, (const struct sockaddr*)&loop.rx_addr, sizeof(loop.rx_addr)) == len;
+}
+
+static void udp_ready(void)
+{
+    loop.ready++;
+}
+
+static const cannelloni_ops_t UDP_OPS =
+{
+    .send  = udp_send,
+    .ready = udp_ready,
+};
+
+static void loop_open(void)
+{
+    memset(&loop, 0, sizeof(loop));
+    loop.tx = socket(AF_INET, SOCK_DGRAM, 0);
+    loop.rx = socket(AF_INET, SOCK_DGRAM, 0);
+
+    loop.rx_addr.sin_family      = AF_INET;
+    loop.rx_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    loop.rx_addr.sin_port        = 0;
+    socklen_t len = sizeof(loop.rx_addr);
+    CHECK(bind(loop.rx, (struct sockaddr*)&loop.rx_addr, sizeof(loop.rx_addr)) == 0);
+    CHECK(getsockname(loop.rx, (struct sockaddr*)&loop.rx_addr, &len) == 0);
+}
+
+static void loop_close(void)
+{
+    close(loop.tx);
+    close(loop.rx);
+}
+
+/// @brief Parses the packets waiting on the receiving socket
+static void receive_all(void)
+{
+    uint8_t packet[CANNELLONI_MAX_PACKET + 1];
+    int     len;
+    while ((len = recv(loop.rx, packet, sizeof(packet), MSG_DONTWAIT)) > 0)
+    {
+        CHECK(len >= CANNELLONI_HEADER_LEN && len <= CANNELLONI_MAX_PACKET);
+        CHECK_EQ(packet[0], CANNELLONI_VERSION);
+        CHECK_EQ(packet[1], CANNELLONI_OP_DATA);
+        if (packet[2] != loop.next_seq)
+        {
+            loop.seq_errors++;
+        }
+        loop.next_seq = packet[2] + 1;
+        loop.packets++;
+
+        uint16_t count = (uint16_t)((packet[3] << 8) | packet[4]);
+        int      pos   = CANNELLONI_HEADER_LEN;
+        for (uint16_t i = 0; i < count && pos + CANNELLONI_FRAME_HEADER_LEN <= len; i++)
+        {
+            CAN_frame_t* frame = &loop.frames[loop.n_frames % MAX_FRAMES];
+            memset(frame, 0, sizeof(*frame));
+            frame->can_id  = ((uint32_t)packet[pos] << 24) | ((uint32_t)packet[pos + 1] << 16)
+                           | ((uint32_t)packet[pos + 2] << 8) | packet[pos + 3];
+            frame->can_dlc = packet[pos + 4];
+            pos += CANNELLONI_FRAME_HEADER_LEN;
+
+            uint8_t n_data = (frame->can_id & CAN_RTR_FLAG) ? 0 : frame->can_dlc;
+            memcpy(frame->data, &packet[pos], n_data);
+            pos += n_data;
+            loop.n_frames++;
+        }
+        CHECK_EQ(pos, len);
+    }
+}
+
+/// @brief Sender task: every waiting packet goes out
+static void send_all(void)
+{
+    while (cannelloni_send_next())
+    {
+    }
+    receive_all();
+}
+
+/// @brief Frame i of a stream, with standard, extended and remote
+/// frames of every length
+static void make_frame(CAN_frame_t* frame, uint32_t i)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id  = (i % 3 == 0) ? (CAN_EFF_FLAG | (0x18FEF100 + i)) : (i & CAN_SFF_MASK);
+    frame->can_dlc = (uint8_t)(i % (CAN_MAX_DLEN + 1));
+    if (i % 7 == 0)
+    {
+        frame->can_id |= CAN_RTR_FLAG;
+    }
+    else
+    {
+        for (uint8_t b = 0; b < frame->can_dlc; b++)
+        {
+            frame->data[b] = (uint8_t)(i + b);
+        }
+    }
+}
+
+static bool same_frame(const CAN_frame_t* a, const CAN_frame_t* b)
+{
+    uint8_t n_data = (a->can_id & CAN_RTR_FLAG) ? 0 : a->can_dlc;
+    return a->can_id == b->can_id && a->can_dlc == b->can_dlc && memcmp(a->data, b->data, n_data) == 0;
+}
+
+static void test_order(void)
+{
+    loop_open();
+    cannelloni_init(&UDP_OPS, 4, 20);
+
+    // More than 256 packets, the sequence number wraps
+    const uint32_t n_frames = 1500;
+    for (uint32_t i = 0; i < n_frames; i++)
+    {
+        CAN_frame_t frame;
+        make_frame(&frame, i);
+        CHECK(cannelloni_frame(&frame, i));
+        send_all();
+    }
+    cannelloni_poll(n_frames + 20);
+    send_all();
+
+    CHECK_EQ(loop.packets, n_frames / 4);
+    CHECK_EQ(loop.seq_errors, 0);
+    CHECK_EQ(loop.n_frames, n_frames);
+    for (uint32_t i = 0; i < n_frames; i++)
+    {
+        CAN_frame_t frame;
+        make_frame(&frame, i);
+        CHECK(same_frame(&loop.frames[i], &frame));
+    }
+
+    cannelloni_stats_t stats;
+    cannelloni_get_stats(&stats);
+    CHECK_EQ(stats.frames, n_frames);
+    CHECK_EQ(stats.packets, n_frames / 4);
+    CHECK_EQ(stats.dropped, 0);
+    loop_close();
+}
+
+static void test_timeout_and_full_packets(void)
+{
+    loop_open();
+    cannelloni_init(&UDP_OPS, 0, 20);
+
+    // A partial packet waits for the timeout
+    CAN_frame_t frame;
+    make_frame(&frame, 1);
+    CHECK(cannelloni_frame(&frame, 1000));
+    CHECK_EQ(cannelloni_next_due_ms(1005), 15);
+    cannelloni_poll(1019);
+    CHECK_EQ(loop.ready, 0);
+    cannelloni_poll(1020);
+    CHECK_EQ(loop.ready, 1);
+    CHECK_EQ(cannelloni_next_due_ms(1020), UINT32_MAX);
+    send_all();
+    CHECK_EQ(loop.packets, 1);
+    CHECK_EQ(loop.n_frames, 1);
+
+    // Without a frame limit, packets go out when the next frame may
+    // not fit, never above the largest packet
+    for (uint32_t i = 0; i < 400; i++)
+    {
+        make_frame(&frame, 8);
+        frame.can_id += i;
+        CHECK(cannelloni_frame(&frame, 2000));
+        send_all();
+    }
+    CHECK(loop.packets >= 1 + 400 / CANNELLONI_MAX_FRAMES);
+    CHECK_EQ(loop.seq_errors, 0);
+    cannelloni_poll(2020);
+    send_all();
+    CHECK_EQ(loop.n_frames, 401);
+    CHECK_EQ(loop.frames[400].can_id, 8 + 399);
+    loop_close();
+}
+
+static void test_sender_late(void)
+{
+    loop_open();
+    cannelloni_init(&UDP_OPS, 2, 20);
+
+    // The sender does not run: every packet fills, then frames are
+    // dropped without using a sequence number
+    CAN_frame_t frame;
+    uint32_t    accepted = 0;
+    for (uint32_t i = 0; i < 2 * CANNELLONI_PACKETS + 5; i++)
+    {
+        make_frame(&frame, i);
+        if (cannelloni_frame(&frame, 0))
+        {
+            accepted++;
+        }
+    }
+    CHECK_EQ(accepted, 2 * CANNELLONI_PACKETS);
+
+    cannelloni_stats_t stats;
+    cannelloni_get_stats(&stats);
+    CHECK_EQ(stats.dropped, 5);
+
+    send_all();
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        make_frame(&frame, 100 + i);
+        CHECK(cannelloni_frame(&frame, 0));
+    }
+    send_all();
+    CHECK_EQ(loop.packets, CANNELLONI_PACKETS + 2);
+    CHECK_EQ(loop.seq_errors, 0);
+    CHECK_EQ(loop.n_frames, accepted + 4);
+
+    make_frame(&frame, 2 * CANNELLONI_PACKETS - 1);
+    CHECK(same_frame(&loop.frames[accepted - 1], &frame));
+    make_frame(&frame, 100);
+    CHECK(same_frame(&loop.frames[accepted], &frame));
+    loop_close();
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_order);
+    RUN_TEST(test_timeout_and_full_packets);
+    RUN_TEST(test_sender_late);
+    return TEST_RESULT();
+}
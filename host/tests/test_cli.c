@@ -0,0 +1,176 @@
+// ***************************************************** //
+/// @file test_cli.c
+/// @brief Line editor and command parser of the console with
+/// valid, truncated and malformed input
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cli.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static int   lastArgc;
+static char  lastArgs[CLI_MAX_ARGS][CLI_MAX_LINE_LEN];
+static int   nCalls;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool record(int argc, char* argv[])
+{
+    nCalls++;
+    lastArgc = argc;
+    for (int i = 0; i < argc; i++)
+    {
+        strcpy(lastArgs[i], argv[i]);
+    }
+    return true;
+}
+
+static bool fail(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+    nCalls++;
+    return false;
+}
+
+static const cli_command_t COMMANDS[] =
+{
+    { "stats", "Frame rates and drops", record },
+    { "stat",  "Prefix of stats",       record },
+    { "spi",   "Fails",                 fail },
+};
+#define N_COMMANDS  (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+/// @brief Types a string, returns how many lines it completed. The
+/// last complete line is left in line->text
+static int type(cli_line_t* line, const char* keys)
+{
+    int complete = 0;
+    for (; *keys != '\0'; keys++)
+    {
+        if (cli_line_feed(line, *keys))
+        {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+static cli_result_e run(const char* text)
+{
+    char line[CLI_MAX_LINE_LEN];
+    snprintf(line, sizeof(line), "%s", text);
+    nCalls = 0;
+    lastArgc = 0;
+    return cli_execute(COMMANDS, N_COMMANDS, line);
+}
+
+static void test_valid(void)
+{
+    CHECK_EQ(run("stats"), CLI_OK);
+    CHECK_EQ(nCalls, 1);
+    CHECK_EQ(lastArgc, 1);
+    CHECK_STR(lastArgs[0], "stats");
+
+    // Names match whole, blanks of any kind and count separate arguments
+    CHECK_EQ(run("  stat\t reset   now "), CLI_OK);
+    CHECK_EQ(lastArgc, 3);
+    CHECK_STR(lastArgs[0], "stat");
+    CHECK_STR(lastArgs[1], "reset");
+    CHECK_STR(lastArgs[2], "now");
+
+    CHECK_EQ(run("a b c d e f g"), CLI_UNKNOWN);
+    CHECK_EQ(run("stats 1 2 3 4 5 6 7"), CLI_OK);
+    CHECK_EQ(lastArgc, CLI_MAX_ARGS);
+    CHECK_STR(lastArgs[CLI_MAX_ARGS - 1], "7");
+
+    CHECK_EQ(run("spi"), CLI_FAILED);
+    CHECK_EQ(nCalls, 1);
+}
+
+static void test_malformed(void)
+{
+    CHECK_EQ(run(""), CLI_EMPTY);
+    CHECK_EQ(run(" \t  "), CLI_EMPTY);
+    CHECK_EQ(nCalls, 0);
+
+    CHECK_EQ(run("STATS"), CLI_UNKNOWN);
+    CHECK_EQ(run("stats2"), CLI_UNKNOWN);
+    CHECK_EQ(run("sta"), CLI_UNKNOWN);
+    CHECK_EQ(nCalls, 0);
+
+    // One argument too many never reaches the handler
+    CHECK_EQ(run("stats 1 2 3 4 5 6 7 8"), CLI_TOO_MANY_ARGS);
+    CHECK_EQ(nCalls, 0);
+
+    char* argv[2];
+    char  line[] = "a b c";
+    CHECK_EQ(cli_tokenize(line, argv, 2), -1);
+}
+
+static void test_line_editing(void)
+{
+    cli_line_t line;
+    memset(&line, 0, sizeof(line));
+
+    CHECK_EQ(type(&line, "stata\bs\r"), 1);
+    CHECK_STR(line.text, "stats");
+
+    // CR LF gives the line, then an empty one
+    CHECK_EQ(type(&line, "lat\r\n"), 2);
+    CHECK_STR(line.text, "");
+
+    // Backspace on an empty line and DEL are harmless
+    CHECK_EQ(type(&line, "\b\bheap\x7f\x7f" "ap\n"), 1);
+    CHECK_STR(line.text, "heap");
+
+    // A line is only complete once terminated
+    CHECK_EQ(type(&line, "top"), 0);
+    CHECK_EQ(type(&line, "\n"), 1);
+    CHECK_STR(line.text, "top");
+}
+
+static void test_truncated(void)
+{
+    cli_line_t line;
+    memset(&line, 0, sizeof(line));
+
+    // The longest line that fits
+    char text[CLI_MAX_LINE_LEN + 8];
+    memset(text, 'x', CLI_MAX_LINE_LEN - 1);
+    text[CLI_MAX_LINE_LEN - 1] = '\n';
+    text[CLI_MAX_LINE_LEN] = '\0';
+    CHECK_EQ(type(&line, text), 1);
+    CHECK_EQ(strlen(line.text), CLI_MAX_LINE_LEN - 1);
+
+    // One more character and the whole line is dropped, never cut
+    // into a shorter command
+    memcpy(text, "stats ", 6);
+    memset(&text[6], 'x', CLI_MAX_LINE_LEN - 6);
+    text[CLI_MAX_LINE_LEN] = '\0';
+    CHECK_EQ(type(&line, text), 0);
+
+    // Erasing the excess does not bring it back, the next line is fine
+    CHECK_EQ(type(&line, "\b\b\b\b\r"), 0);
+    CHECK_EQ(type(&line, "stats\r"), 1);
+    CHECK_STR(line.text, "stats");
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_valid);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_line_editing);
+    RUN_TEST(test_truncated);
+    return TEST_RESULT();
+}
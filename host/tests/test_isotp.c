@@ -0,0 +1,234 @@
+// ***************************************************** //
+/// @file test_isotp.c
+/// @brief ISO-TP reassembly of interleaved sessions, their
+/// timeout and the exhaustion of the buffer pool
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "isotp.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define BUS             (0)
+#define RX_ID_A         (0x7E8)
+#define RX_ID_B         (0x7E9)
+#define TX_ID_A         (0x7E0)
+#define TX_ID_B         (0x7E1)
+
+#define MAX_RECEIVED    (8)
+#define MAX_SENT        (8)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t rx_id;
+    uint16_t length;
+    uint8_t  data[64];
+} received_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static received_t  received[MAX_RECEIVED];
+static int         nReceived;
+static CAN_frame_t sent[MAX_SENT];
+static int         nSent;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool on_tx(uint8_t bus, const CAN_frame_t* frame)
+{
+    (void)bus;
+    if (nSent < MAX_SENT)
+    {
+        sent[nSent++] = *frame;
+    }
+    return true;
+}
+
+static void on_rx(const isotp_message_t* msg)
+{
+    if (nReceived < MAX_RECEIVED && msg->length <= sizeof(received[0].data))
+    {
+        received[nReceived].rx_id  = msg->rx_id;
+        received[nReceived].length = msg->length;
+        memcpy(received[nReceived].data, msg->data, msg->length);
+        nReceived++;
+    }
+}
+
+static void setup(bool flow_control)
+{
+    nReceived = 0;
+    nSent = 0;
+    isotp_init(on_tx, on_rx);
+    CHECK(isotp_add_channel(BUS, RX_ID_A, TX_ID_A, flow_control));
+    CHECK(isotp_add_channel(BUS, RX_ID_B, TX_ID_B, flow_control));
+}
+
+static void feed(uint32_t can_id, const uint8_t* data, uint8_t dlc, uint32_t now_ms)
+{
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id  = can_id;
+    frame.can_dlc = dlc;
+    memcpy(frame.data, data, dlc);
+    CHECK(isotp_process(BUS, &frame, now_ms));
+}
+
+/// @brief Sends the First Frame of a message whose byte i is base + i
+static void first_frame(uint32_t can_id, uint16_t length, uint8_t base, uint32_t now_ms)
+{
+    uint8_t data[8] = { (uint8_t)(0x10 | (length >> 8)), (uint8_t)length };
+    for (int i = 0; i < 6; i++)
+    {
+        data[2 + i] = (uint8_t)(base + i);
+    }
+    feed(can_id, data, 8, now_ms);
+}
+
+/// @brief Sends Consecutive Frame sn of the same message
+static void consecutive_frame(uint32_t can_id, uint8_t sn, uint8_t base, uint32_t now_ms)
+{
+    uint8_t data[8] = { (uint8_t)(0x20 | (sn & 0x0F)) };
+    for (int i = 0; i < 7; i++)
+    {
+        data[1 + i] = (uint8_t)(base + 6 + 7 * (sn - 1) + i);
+    }
+    feed(can_id, data, 8, now_ms);
+}
+
+static bool has_pattern(const received_t* msg, uint8_t base)
+{
+    for (uint16_t i = 0; i < msg->length; i++)
+    {
+        if (msg->data[i] != (uint8_t)(base + i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_interleaved(void)
+{
+    setup(false);
+
+    // A: 20 bytes in FF + 2 CF. B: a Single Frame, then 12 bytes
+    // in FF + 1 CF, all interleaved with A
+    const uint8_t single[] = { 0x03, 0x41, 0x0D, 0x32 };
+    first_frame(RX_ID_A, 20, 0x00, 0);
+    feed(RX_ID_B, single, sizeof(single), 1);
+    first_frame(RX_ID_B, 12, 0x80, 2);
+    consecutive_frame(RX_ID_A, 1, 0x00, 3);
+    consecutive_frame(RX_ID_B, 1, 0x80, 4);
+    consecutive_frame(RX_ID_A, 2, 0x00, 5);
+
+    CHECK_EQ(nReceived, 3);
+    CHECK_EQ(received[0].rx_id, RX_ID_B);
+    CHECK_EQ(received[0].length, 3);
+    CHECK(memcmp(received[0].data, &single[1], 3) == 0);
+    CHECK_EQ(received[1].rx_id, RX_ID_B);
+    CHECK_EQ(received[1].length, 12);
+    CHECK(has_pattern(&received[1], 0x80));
+    CHECK_EQ(received[2].rx_id, RX_ID_A);
+    CHECK_EQ(received[2].length, 20);
+    CHECK(has_pattern(&received[2], 0x00));
+
+    isotp_stats_t stats;
+    isotp_get_stats(&stats);
+    CHECK_EQ(stats.single_frames, 1);
+    CHECK_EQ(stats.multi_frames, 2);
+    CHECK_EQ(stats.flow_controls, 0);
+    CHECK_EQ(isotp_next_due_ms(5), UINT32_MAX);
+
+    // Frames of other IDs are left to the pipeline
+    CAN_frame_t other = { .can_id = 0x100, .can_dlc = 1 };
+    CHECK(!isotp_process(BUS, &other, 6));
+}
+
+static void test_timeout(void)
+{
+    setup(false);
+
+    first_frame(RX_ID_A, 20, 0x00, 1000);
+    consecutive_frame(RX_ID_A, 1, 0x00, 1500);
+    CHECK_EQ(isotp_next_due_ms(1500), ISOTP_TIMEOUT_MS + 1);
+
+    // N_Cr runs from the last frame, not from the First Frame
+    isotp_poll(1500 + ISOTP_TIMEOUT_MS);
+    CHECK_EQ(isotp_next_due_ms(1500 + ISOTP_TIMEOUT_MS), 1);
+    isotp_poll(1500 + ISOTP_TIMEOUT_MS + 1);
+    CHECK_EQ(isotp_next_due_ms(1500 + ISOTP_TIMEOUT_MS + 1), UINT32_MAX);
+
+    isotp_stats_t stats;
+    isotp_get_stats(&stats);
+    CHECK_EQ(stats.timeouts, 1);
+
+    // The rest of the aborted message is dropped
+    consecutive_frame(RX_ID_A, 2, 0x00, 2600);
+    CHECK_EQ(nReceived, 0);
+}
+
+static void test_pool_exhaustion(void)
+{
+    nReceived = 0;
+    nSent = 0;
+    isotp_init(on_tx, on_rx);
+    for (uint32_t i = 0; i <= ISOTP_POOL_SIZE; i++)
+    {
+        CHECK(isotp_add_channel(BUS, RX_ID_A + i, TX_ID_A + i, true));
+    }
+
+    // One session more than there are buffers
+    for (uint32_t i = 0; i <= ISOTP_POOL_SIZE; i++)
+    {
+        first_frame(RX_ID_A + i, 20, (uint8_t)(0x10 * i), 0);
+    }
+
+    isotp_stats_t stats;
+    isotp_get_stats(&stats);
+    CHECK_EQ(stats.overflows, 1);
+    CHECK_EQ(nSent, ISOTP_POOL_SIZE + 1);
+    CHECK_EQ(sent[ISOTP_POOL_SIZE - 1].data[0], 0x30);
+    CHECK_EQ(sent[ISOTP_POOL_SIZE].can_id, TX_ID_A + ISOTP_POOL_SIZE);
+    CHECK_EQ(sent[ISOTP_POOL_SIZE].data[0], 0x32);
+
+    // The sessions that got a buffer complete normally
+    consecutive_frame(RX_ID_A, 1, 0x00, 10);
+    consecutive_frame(RX_ID_A, 2, 0x00, 11);
+    CHECK_EQ(nReceived, 1);
+    CHECK(has_pattern(&received[0], 0x00));
+
+    // Timed out sessions give their buffer back to the rejected channel
+    isotp_poll(ISOTP_TIMEOUT_MS + 1);
+    uint32_t last = RX_ID_A + ISOTP_POOL_SIZE;
+    first_frame(last, 13, 0x40, 2000);
+    consecutive_frame(last, 1, 0x40, 2001);
+    CHECK_EQ(nReceived, 2);
+    CHECK_EQ(received[1].rx_id, last);
+    CHECK(has_pattern(&received[1], 0x40));
+
+    isotp_get_stats(&stats);
+    CHECK_EQ(stats.timeouts, ISOTP_POOL_SIZE - 1);
+    CHECK_EQ(stats.overflows, 1);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_interleaved);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_pool_exhaustion);
+    return TEST_RESULT();
+}
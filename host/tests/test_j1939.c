@@ -0,0 +1,452 @@
+// ***************************************************** //
+/// @file test_j1939.c
+/// @brief J1939 transport sessions of several senders sharing
+/// a 250 kbit/s bus, with the gateway answering RTS/CTS
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "j1939.h"
+#include "test.h"
+
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define GATEWAY_ADDRESS     (0x80)
+
+/// Extended frame of 8 bytes at 250 kbit/s, worst case bit stuffing
+#define FRAME_US            (640)
+
+/// BAM packets are spaced 50 to 200 ms
+#define BAM_GAP_US          (50000)
+
+#define PGN_ENGINE_CONFIG   (0xFEE3)
+#define PGN_PROPRIETARY_A   (0xEF00)
+
+#define TP_CM_RTS           (16)
+#define TP_CM_CTS           (17)
+#define TP_CM_EOMA          (19)
+#define TP_CM_BAM           (32)
+#define TP_CM_ABORT         (255)
+
+#define MAX_RECEIVED        (4)
+#define MAX_SENT            (16)
+#define MAX_SENDERS         (3)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t pgn;
+    uint8_t  sa;
+    uint16_t length;
+    uint8_t  data[J1939_MAX_MSG_LEN];
+} received_t;
+
+/// @brief A node transmitting one parameter group
+typedef struct
+{
+    uint8_t  sa;
+    uint8_t  da;                // Global for BAM
+    uint32_t pgn;
+    uint16_t length;
+    uint8_t  per_cts;           // RTS byte 4
+    uint8_t  base;              // Byte i of the message is base + i
+    uint32_t gap_us;
+    uint8_t  n_packets;
+    uint8_t  next_packet;       // 0 for the announcement
+    uint8_t  cleared_to;        // Last packet allowed by a CTS
+    uint8_t  stop_after;        // Packets sent before going silent, 0 for all
+    uint64_t ready_us;
+} sender_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static received_t  received[MAX_RECEIVED];
+static int         nReceived;
+static CAN_frame_t sent[MAX_SENT];
+static int         nSent;
+
+static sender_t    senders[MAX_SENDERS];
+static int         nSenders;
+static uint64_t    busUs;
+static uint32_t    lastFrameMs;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool on_tx(const CAN_frame_t* frame)
+{
+    if (nSent < MAX_SENT)
+    {
+        sent[nSent++] = *frame;
+    }
+
+    // Answers take the bus too, a CTS releases its sender
+    busUs += FRAME_US;
+    uint8_t da = (uint8_t)(frame->can_id >> 8);
+    for (int i = 0; i < nSenders; i++)
+    {
+        if (senders[i].sa == da && frame->data[0] == TP_CM_CTS)
+        {
+            senders[i].cleared_to = frame->data[2] + frame->data[1] - 1;
+            senders[i].ready_us   = busUs;
+        }
+    }
+    return true;
+}
+
+static void on_rx(const j1939_message_t* msg)
+{
+    if (nReceived < MAX_RECEIVED)
+    {
+        received[nReceived].pgn    = msg->pgn;
+        received[nReceived].sa     = msg->sa;
+        received[nReceived].length = msg->length;
+        memcpy(received[nReceived].data, msg->data, msg->length);
+        nReceived++;
+    }
+}
+
+static void setup(void)
+{
+    nReceived = 0;
+    nSent = 0;
+    nSenders = 0;
+    busUs = 0;
+    j1939_init(GATEWAY_ADDRESS, on_tx, on_rx);
+}
+
+static void add_sender(uint8_t sa, uint8_t da, uint32_t pgn, uint16_t length, uint8_t per_cts, uint8_t base)
+{
+    sender_t* s = &senders[nSenders++];
+    memset(s, 0, sizeof(*s));
+    s->sa        = sa;
+    s->da        = da;
+    s->pgn       = pgn;
+    s->length    = length;
+    s->per_cts   = per_cts;
+    s->base      = base;
+    s->gap_us    = (da == J1939_ADDR_GLOBAL) ? BAM_GAP_US : 0;
+    s->n_packets = (uint8_t)((length + 6) / 7);
+}
+
+static CAN_frame_t make_frame(uint32_t pgn_pf, uint8_t da, uint8_t sa)
+{
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id  = CAN_EFF_FLAG | (7UL << 26) | (pgn_pf << 8) | ((uint32_t)da << 8) | sa;
+    frame.can_dlc = CAN_MAX_DLEN;
+    return frame;
+}
+
+/// @brief Next frame of a sender, the announcement then the packets
+static CAN_frame_t sender_frame(sender_t* s)
+{
+    if (s->next_packet == 0)
+    {
+        CAN_frame_t frame = make_frame(J1939_PGN_TP_CM, s->da, s->sa);
+        bool bam = (s->da == J1939_ADDR_GLOBAL);
+        frame.data[0] = bam ? TP_CM_BAM : TP_CM_RTS;
+        frame.data[1] = (uint8_t)s->length;
+        frame.data[2] = (uint8_t)(s->length >> 8);
+        frame.data[3] = s->n_packets;
+        frame.data[4] = bam ? 0xFF : s->per_cts;
+        frame.data[5] = (uint8_t)s->pgn;
+        frame.data[6] = (uint8_t)(s->pgn >> 8);
+        frame.data[7] = (uint8_t)(s->pgn >> 16);
+        return frame;
+    }
+
+    CAN_frame_t frame = make_frame(J1939_PGN_TP_DT, s->da, s->sa);
+    frame.data[0] = s->next_packet;
+    for (int i = 0; i < 7; i++)
+    {
+        uint16_t offset = (uint16_t)((s->next_packet - 1) * 7 + i);
+        frame.data[1 + i] = (offset < s->length) ? (uint8_t)(s->base + offset) : 0xFF;
+    }
+    return frame;
+}
+
+static bool sender_done(const sender_t* s)
+{
+    uint8_t last = (s->stop_after != 0) ? s->stop_after : s->n_packets;
+    return s->next_packet > last;
+}
+
+static bool sender_ready(const sender_t* s)
+{
+    // Connection mode packets wait for their CTS
+    bool bam = (s->da == J1939_ADDR_GLOBAL);
+    return !sender_done(s) && (bam || s->next_packet == 0 || s->next_packet <= s->cleared_to);
+}
+
+/// @brief Runs the bus until every sender is done or stalled. The
+/// earliest ready sender wins, ties go to the lower source address
+static void run_bus(void)
+{
+    for (;;)
+    {
+        sender_t* next = NULL;
+        for (int i = 0; i < nSenders; i++)
+        {
+            if (!sender_ready(&senders[i]))
+            {
+                continue;
+            }
+            if (next == NULL || senders[i].ready_us < next->ready_us
+                || (senders[i].ready_us == next->ready_us && senders[i].sa < next->sa))
+            {
+                next = &senders[i];
+            }
+        }
+        if (next == NULL)
+        {
+            return;
+        }
+
+        if (busUs < next->ready_us)
+        {
+            busUs = next->ready_us;
+        }
+        CAN_frame_t frame = sender_frame(next);
+        busUs += FRAME_US;
+        next->next_packet++;
+        next->ready_us = busUs + next->gap_us;
+
+        lastFrameMs = (uint32_t)(busUs / 1000);
+        j1939_poll(lastFrameMs);
+        CHECK(j1939_process(&frame, lastFrameMs));
+    }
+}
+
+static bool has_pattern(const received_t* msg, uint8_t base)
+{
+    for (uint16_t i = 0; i < msg->length; i++)
+    {
+        if (msg->data[i] != (uint8_t)(base + i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const received_t* find_received(uint8_t sa)
+{
+    for (int i = 0; i < nReceived; i++)
+    {
+        if (received[i].sa == sa)
+        {
+            return &received[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_parse_id(void)
+{
+    j1939_id_t id;
+    CHECK(!j1939_parse_id(0x100, &id));
+
+    // EEC1 from the engine: PDU2, always broadcast
+    CHECK(j1939_parse_id(CAN_EFF_FLAG | 0x0CF00400, &id));
+    CHECK_EQ(id.pgn, 61444);
+    CHECK_EQ(id.priority, 3);
+    CHECK_EQ(id.sa, 0x00);
+    CHECK_EQ(id.da, J1939_ADDR_GLOBAL);
+
+    // TP.CM to the gateway: PDU1, PS is the destination
+    CHECK(j1939_parse_id(CAN_EFF_FLAG | 0x1CEC8017, &id));
+    CHECK_EQ(id.pgn, J1939_PGN_TP_CM);
+    CHECK_EQ(id.da, GATEWAY_ADDRESS);
+    CHECK_EQ(id.sa, 0x17);
+}
+
+static void test_concurrent_sessions(void)
+{
+    setup();
+
+    // Two engines broadcasting their configuration while a tool
+    // sends 100 bytes to the gateway, at most 4 packets per CTS
+    add_sender(0x00, J1939_ADDR_GLOBAL, PGN_ENGINE_CONFIG, 40, 0xFF, 0x00);
+    add_sender(0x01, J1939_ADDR_GLOBAL, PGN_ENGINE_CONFIG, 30, 0xFF, 0x40);
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 4, 0x80);
+    run_bus();
+
+    for (int i = 0; i < nSenders; i++)
+    {
+        CHECK(sender_done(&senders[i]));
+    }
+
+    j1939_stats_t stats;
+    j1939_get_stats(&stats);
+    CHECK_EQ(stats.bam_sessions, 2);
+    CHECK_EQ(stats.cmdt_sessions, 1);
+    CHECK_EQ(stats.timeouts, 0);
+    CHECK_EQ(stats.sequence_errors, 0);
+    CHECK_EQ(stats.overflows, 0);
+
+    // The connection mode session completes between two BAM packets
+    CHECK_EQ(nReceived, 3);
+    CHECK_EQ(received[0].sa, 0x17);
+
+    const received_t* engine1 = find_received(0x00);
+    const received_t* engine2 = find_received(0x01);
+    const received_t* tool    = find_received(0x17);
+    CHECK(engine1 != NULL && engine2 != NULL && tool != NULL);
+    CHECK_EQ(engine1->pgn, PGN_ENGINE_CONFIG);
+    CHECK_EQ(engine1->length, 40);
+    CHECK(has_pattern(engine1, 0x00));
+    CHECK_EQ(engine2->length, 30);
+    CHECK(has_pattern(engine2, 0x40));
+    CHECK_EQ(tool->pgn, PGN_PROPRIETARY_A);
+    CHECK_EQ(tool->length, 100);
+    CHECK(has_pattern(tool, 0x80));
+
+    // 15 packets cleared in blocks of 4, then acknowledged
+    const uint8_t blocks[][2] = { { 4, 1 }, { 4, 5 }, { 4, 9 }, { 3, 13 } };
+    CHECK_EQ(nSent, 5);
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK_EQ(sent[i].can_id, CAN_EFF_FLAG | 0x1CEC1780);
+        CHECK_EQ(sent[i].data[0], TP_CM_CTS);
+        CHECK_EQ(sent[i].data[1], blocks[i][0]);
+        CHECK_EQ(sent[i].data[2], blocks[i][1]);
+    }
+    CHECK_EQ(sent[4].data[0], TP_CM_EOMA);
+    CHECK_EQ(sent[4].data[1], 100);
+    CHECK_EQ(sent[4].data[3], 15);
+
+    // Six BAM packets 50 ms apart
+    CHECK(busUs >= 6 * BAM_GAP_US && busUs < 7 * BAM_GAP_US);
+    CHECK_EQ(j1939_next_due_ms((uint32_t)(busUs / 1000)), UINT32_MAX);
+}
+
+static void test_no_limit(void)
+{
+    setup();
+
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 0xFF, 0x10);
+    run_bus();
+
+    CHECK_EQ(nReceived, 1);
+    CHECK_EQ(nSent, 2);
+    CHECK_EQ(sent[0].data[0], TP_CM_CTS);
+    CHECK_EQ(sent[0].data[1], 15);
+    CHECK_EQ(sent[0].data[2], 1);
+    CHECK_EQ(sent[1].data[0], TP_CM_EOMA);
+}
+
+static void test_zero_per_cts(void)
+{
+    setup();
+
+    // A cap of 0 packets per CTS is taken as no limit
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 0, 0x20);
+    run_bus();
+
+    CHECK_EQ(nReceived, 1);
+    CHECK(has_pattern(&received[0], 0x20));
+    CHECK_EQ(nSent, 2);
+    CHECK_EQ(sent[0].data[0], TP_CM_CTS);
+    CHECK_EQ(sent[0].data[1], 15);
+    CHECK_EQ(sent[0].data[2], 1);
+    CHECK_EQ(sent[1].data[0], TP_CM_EOMA);
+
+    j1939_stats_t stats;
+    j1939_get_stats(&stats);
+    CHECK_EQ(stats.timeouts, 0);
+}
+
+static void test_sequence_error(void)
+{
+    setup();
+
+    // The tool skips its second packet
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 0xFF, 0x10);
+    sender_t*   s = &senders[0];
+    CAN_frame_t frame = sender_frame(s);
+    CHECK(j1939_process(&frame, 0));
+    CHECK_EQ(nSent, 1);
+
+    s->next_packet = 1;
+    frame = sender_frame(s);
+    CHECK(j1939_process(&frame, 1));
+    s->next_packet = 3;
+    frame = sender_frame(s);
+    CHECK(j1939_process(&frame, 2));
+
+    // The session is dropped, the packets that follow are ignored
+    j1939_stats_t stats;
+    j1939_get_stats(&stats);
+    CHECK_EQ(stats.sequence_errors, 1);
+    CHECK_EQ(j1939_next_due_ms(2), UINT32_MAX);
+
+    for (s->next_packet = 4; s->next_packet <= s->n_packets; s->next_packet++)
+    {
+        frame = sender_frame(s);
+        CHECK(j1939_process(&frame, 3));
+    }
+    j1939_get_stats(&stats);
+    CHECK_EQ(stats.sequence_errors, 1);
+    CHECK_EQ(stats.cmdt_sessions, 0);
+    CHECK_EQ(nReceived, 0);
+    CHECK_EQ(nSent, 1);
+
+    // A new announcement starts over
+    nSenders = 0;
+    nSent    = 0;
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 0xFF, 0x10);
+    run_bus();
+    CHECK_EQ(nReceived, 1);
+}
+
+static void test_timeout(void)
+{
+    setup();
+
+    // The tool stops after its first block
+    add_sender(0x17, GATEWAY_ADDRESS, PGN_PROPRIETARY_A, 100, 4, 0x10);
+    senders[0].stop_after = 4;
+    run_bus();
+
+    uint32_t last_ms = lastFrameMs;
+    CHECK_EQ(nSent, 2);
+    CHECK_EQ(sent[1].data[0], TP_CM_CTS);
+    CHECK_EQ(sent[1].data[2], 5);
+    CHECK_EQ(j1939_next_due_ms(last_ms), J1939_TIMEOUT_MS + 1);
+
+    j1939_poll(last_ms + J1939_TIMEOUT_MS);
+    CHECK_EQ(nSent, 2);
+    j1939_poll(last_ms + J1939_TIMEOUT_MS + 1);
+    CHECK_EQ(nSent, 3);
+    CHECK_EQ(sent[2].data[0], TP_CM_ABORT);
+    CHECK_EQ(sent[2].data[1], 3);
+    CHECK_EQ(j1939_next_due_ms(last_ms + J1939_TIMEOUT_MS + 1), UINT32_MAX);
+
+    j1939_stats_t stats;
+    j1939_get_stats(&stats);
+    CHECK_EQ(stats.timeouts, 1);
+    CHECK_EQ(nReceived, 0);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_parse_id);
+    RUN_TEST(test_concurrent_sessions);
+    RUN_TEST(test_no_limit);
+    RUN_TEST(test_zero_per_cts);
+    RUN_TEST(test_sequence_error);
+    RUN_TEST(test_timeout);
+    return TEST_RESULT();
+}
@@ -0,0 +1,330 @@
+// ***************************************************** //
+/// @file test_mqtt_tcp.c
+/// @brief Pipelined QoS 1 of the MQTT publisher against the
+/// fake broker: the window bounds the publishes waiting,
+/// PUBACKs complete them in any order, and a reconnect sends
+/// the unacknowledged ones again as duplicates
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "mqtt_tcp.h"
+#include "fake_broker.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define CLIENT_ID           "test_mqtt_tcp"
+#define TOPIC               "gw/test"
+
+/// Polls of the client before a wait gives up, 1 ms apart
+#define WAIT_POLLS          (2000)
+
+#define MQTT_DUP            (0x08)
+#define MQTT_QOS1           (0x02)
+#define MQTT_CLEAN_SESSION  (0x02)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Publishes completed, in the order of the callbacks
+typedef struct
+{
+    uint32_t count;
+    uint32_t tags[MQTT_TCP_MAX_WINDOW];
+    bool     acked[MQTT_TCP_MAX_WINDOW];
+} completions_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static mqtt_tcp_t*   client;
+static completions_t completed;
+static uint16_t      port;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void on_complete(void* arg, uint32_t tag, bool acked)
+{
+    completions_t* log = arg;
+    if (log->count < MQTT_TCP_MAX_WINDOW)
+    {
+        log->tags[log->count]  = tag;
+        log->acked[log->count] = acked;
+    }
+    log->count++;
+}
+
+static void setup(uint16_t window)
+{
+    memset(&completed, 0, sizeof(completed));
+    port = fake_broker_start(0);
+    CHECK(port != 0);
+    mqtt_tcp_init(client);
+    mqtt_tcp_set_window(client, window, on_complete, &completed);
+    CHECK(mqtt_tcp_connect(client, "127.0.0.1", port, CLIENT_ID));
+}
+
+static void teardown(void)
+{
+    mqtt_tcp_disconnect(client);
+    fake_broker_stop();
+}
+
+/// @brief Polls the client until the broker received a number of
+/// publishes since its start
+static bool wait_publishes(uint32_t n)
+{
+    for (uint32_t i = 0; i < WAIT_POLLS && fake_broker_publishes() < n; i++)
+    {
+        mqtt_tcp_poll(client, i);
+        usleep(1000);
+    }
+    return fake_broker_publishes() >= n;
+}
+
+/// @brief Polls the client until a number of publishes completed
+static bool wait_completed(uint32_t n)
+{
+    for (uint32_t i = 0; i < WAIT_POLLS && completed.count < n; i++)
+    {
+        mqtt_tcp_poll(client, i);
+        usleep(1000);
+    }
+    return completed.count >= n;
+}
+
+/// @brief Polls the client until it sees the broker closed the connection
+static bool wait_disconnected(void)
+{
+    for (uint32_t i = 0; i < WAIT_POLLS && mqtt_tcp_is_connected(client); i++)
+    {
+        mqtt_tcp_poll(client, i);
+        usleep(1000);
+    }
+    return !mqtt_tcp_is_connected(client);
+}
+
+static bool publish(uint32_t tag)
+{
+    char payload[16];
+    snprintf(payload, sizeof(payload), "%u", tag);
+    return mqtt_tcp_publish(client, TOPIC, payload, tag);
+}
+
+static void test_window(void)
+{
+    setup(4);
+    fake_broker_hold_acks(true);
+
+    // The window is full after 4 publishes, the 5th is dropped
+    for (uint32_t tag = 0; tag < 4; tag++)
+    {
+        CHECK(mqtt_tcp_can_publish(client, 16));
+        CHECK(publish(tag));
+    }
+    CHECK(!mqtt_tcp_can_publish(client, 16));
+    CHECK(!publish(4));
+    CHECK_EQ(mqtt_tcp_inflight(client), 4);
+
+    // All are sent before any PUBACK, each with its own identifier
+    CHECK(wait_publishes(4));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        fake_publish_t record;
+        CHECK(fake_broker_get_publish(i, &record));
+        CHECK_EQ(record.flags, MQTT_QOS1);
+        CHECK_EQ(record.packetId, i + 1);
+        CHECK_STR(record.topic, TOPIC);
+    }
+    CHECK_EQ(fake_broker_connect_flags() & MQTT_CLEAN_SESSION, 0);
+
+    // A PUBACK opens the window again
+    fake_broker_ack(1);
+    CHECK(wait_completed(1));
+    CHECK_EQ(completed.tags[0], 0);
+    CHECK(completed.acked[0]);
+    CHECK(mqtt_tcp_can_publish(client, 16));
+    CHECK_EQ(mqtt_tcp_inflight(client), 3);
+
+    mqtt_tcp_stats_t stats;
+    mqtt_tcp_get_stats(client, &stats);
+    CHECK_EQ(stats.publishes, 4);
+    CHECK_EQ(stats.dropped, 1);
+    CHECK_EQ(stats.acked, 1);
+    CHECK_EQ(stats.max_inflight, 4);
+    teardown();
+}
+
+static void test_out_of_order_acks(void)
+{
+    setup(8);
+    fake_broker_hold_acks(true);
+    for (uint32_t tag = 10; tag < 13; tag++)
+    {
+        CHECK(publish(tag));
+    }
+    CHECK(wait_publishes(3));
+
+    // Each PUBACK completes the publish of its identifier
+    fake_broker_ack(3);
+    CHECK(wait_completed(1));
+    CHECK_EQ(completed.tags[0], 12);
+    CHECK_EQ(mqtt_tcp_inflight(client), 2);
+
+    fake_broker_ack(1);
+    CHECK(wait_completed(2));
+    CHECK_EQ(completed.tags[1], 10);
+
+    fake_broker_ack(2);
+    CHECK(wait_completed(3));
+    CHECK_EQ(completed.tags[2], 11);
+    CHECK_EQ(mqtt_tcp_inflight(client), 0);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        CHECK(completed.acked[i]);
+    }
+
+    // A PUBACK of nothing waiting is ignored
+    fake_broker_ack(2);
+    CHECK(publish(13));
+    fake_broker_ack(4);
+    CHECK(wait_completed(4));
+    CHECK_EQ(completed.count, 4);
+    CHECK_EQ(completed.tags[3], 13);
+    teardown();
+}
+
+static void test_reconnect_resends(void)
+{
+    setup(8);
+    fake_broker_hold_acks(true);
+    for (uint32_t tag = 0; tag < 3; tag++)
+    {
+        CHECK(publish(tag));
+    }
+    CHECK(wait_publishes(3));
+    fake_broker_ack(2);
+    CHECK(wait_completed(1));
+
+    // The broker goes away, the publishes stay in flight
+    fake_broker_drop_client();
+    CHECK(wait_disconnected());
+    CHECK_EQ(completed.count, 1);
+    CHECK_EQ(mqtt_tcp_inflight(client), 2);
+
+    // The session is kept, and the two left are sent again in order
+    CHECK(mqtt_tcp_connect(client, "127.0.0.1", port, CLIENT_ID));
+    CHECK_EQ(fake_broker_connects(), 2);
+    CHECK_EQ(fake_broker_connect_flags() & MQTT_CLEAN_SESSION, 0);
+    CHECK(wait_publishes(5));
+    const uint16_t resent[2] = { 1, 3 };
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        fake_publish_t record;
+        char           payload[16];
+        CHECK(fake_broker_get_publish(3 + i, &record));
+        CHECK_EQ(record.flags, MQTT_QOS1 | MQTT_DUP);
+        CHECK_EQ(record.packetId, resent[i]);
+        snprintf(payload, sizeof(payload), "%u", resent[i] - 1);
+        CHECK_STR(record.payload, payload);
+    }
+
+    // New publishes are not duplicates
+    CHECK(publish(3));
+    CHECK(wait_publishes(6));
+    fake_publish_t record;
+    CHECK(fake_broker_get_publish(5, &record));
+    CHECK_EQ(record.flags, MQTT_QOS1);
+    CHECK_EQ(record.packetId, 4);
+
+    fake_broker_ack(1);
+    fake_broker_ack(3);
+    fake_broker_ack(4);
+    CHECK(wait_completed(4));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(completed.acked[i]);
+    }
+
+    mqtt_tcp_stats_t stats;
+    mqtt_tcp_get_stats(client, &stats);
+    CHECK_EQ(stats.connects, 2);
+    CHECK_EQ(stats.retransmits, 2);
+    CHECK_EQ(stats.acked, 4);
+    teardown();
+}
+
+static void test_disconnect_drops(void)
+{
+    setup(8);
+    fake_broker_hold_acks(true);
+    CHECK(publish(7));
+    CHECK(publish(8));
+    CHECK(wait_publishes(2));
+
+    // Closing the connection ourselves completes them as not acknowledged
+    mqtt_tcp_disconnect(client);
+    CHECK_EQ(completed.count, 2);
+    CHECK_EQ(completed.tags[0], 7);
+    CHECK_EQ(completed.tags[1], 8);
+    CHECK(!completed.acked[0]);
+    CHECK(!completed.acked[1]);
+    CHECK_EQ(mqtt_tcp_inflight(client), 0);
+
+    // Nothing is left to send again
+    CHECK(mqtt_tcp_connect(client, "127.0.0.1", port, CLIENT_ID));
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        mqtt_tcp_poll(client, i);
+        usleep(1000);
+    }
+    CHECK_EQ(fake_broker_publishes(), 2);
+    teardown();
+}
+
+static void test_qos0(void)
+{
+    setup(0);
+    fake_broker_hold_acks(true);
+    for (uint32_t tag = 0; tag < MQTT_TCP_MAX_WINDOW + 1; tag++)
+    {
+        CHECK(mqtt_tcp_can_publish(client, 16));
+        CHECK(publish(tag));
+    }
+    CHECK(wait_publishes(MQTT_TCP_MAX_WINDOW + 1));
+
+    fake_publish_t record;
+    CHECK(fake_broker_get_publish(MQTT_TCP_MAX_WINDOW, &record));
+    CHECK_EQ(record.flags, 0);
+    CHECK_EQ(record.packetId, 0);
+    CHECK_EQ(fake_broker_connect_flags() & MQTT_CLEAN_SESSION, MQTT_CLEAN_SESSION);
+    CHECK_EQ(mqtt_tcp_inflight(client), 0);
+    CHECK_EQ(completed.count, 0);
+    teardown();
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    // Too large for the stack
+    client = malloc(sizeof(*client));
+
+    RUN_TEST(test_window);
+    RUN_TEST(test_out_of_order_acks);
+    RUN_TEST(test_reconnect_resends);
+    RUN_TEST(test_disconnect_drops);
+    RUN_TEST(test_qos0);
+
+    free(client);
+    return TEST_RESULT();
+}
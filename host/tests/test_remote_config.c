@@ -0,0 +1,137 @@
+// ***************************************************** //
+/// @file test_remote_config.c
+/// @brief Boot time load of the stored configuration: sections
+/// missing from the document keep the compiled defaults
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "remote_config.h"
+#include "gateway_config.h"
+#include "mem_budget.h"
+#include "fake_esp.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Stores a document as remote_config does after applying it
+static void store_document(const char* doc)
+{
+    nvs_handle_t handle;
+    fake_nvs_erase();
+    CHECK_EQ(nvs_open("gw_config", NVS_READWRITE, &handle), ESP_OK);
+    CHECK_EQ(nvs_set_blob(handle, "document", doc, strlen(doc)), ESP_OK);
+    nvs_close(handle);
+}
+
+static void check_defaults(const remote_config_t* config)
+{
+    CHECK_EQ(config->bitrate, CAN_DEFAULT_BITRATE);
+    CHECK_EQ(config->n_filters, 0);
+    CHECK_EQ(config->default_rule, POLICY_DEFAULT_RULE);
+    CHECK_EQ(config->default_arg, POLICY_DEFAULT_ARG);
+    CHECK_EQ(config->n_policies, 0);
+    CHECK_EQ(config->n_routes, 0);
+    CHECK_EQ(config->batch_max_frames, BATCH_MAX_FRAMES);
+    CHECK_EQ(config->batch_max_delay_ms, BATCH_MAX_DELAY_MS);
+    CHECK(!config->can_changed);
+}
+
+static void test_load_minimal(void)
+{
+    store_document("{\"version\":7}");
+
+    const remote_config_t* config = remote_config_load();
+    CHECK(config != NULL);
+    if (config != NULL)
+    {
+        CHECK_EQ(config->version, 7);
+        check_defaults(config);
+    }
+}
+
+static void test_load_full(void)
+{
+    store_document("{\"version\":8,\"bitrate\":250000,"
+                   "\"default\":{\"rule\":\"decimate\",\"arg\":10},"
+                   "\"policies\":[{\"id\":\"0x100\",\"rule\":\"drop\"}],"
+                   "\"routes\":[{\"pgn\":61444,\"topic\":\"fleet/{thing}/engine\"}],"
+                   "\"batch\":{\"max_frames\":20,\"max_delay_ms\":200}}");
+
+    const remote_config_t* config = remote_config_load();
+    CHECK(config != NULL);
+    if (config != NULL)
+    {
+        CHECK_EQ(config->version, 8);
+        CHECK_EQ(config->bitrate, 250000);
+        CHECK(config->can_changed);
+        CHECK_EQ(config->default_rule, POLICY_DECIMATE);
+        CHECK_EQ(config->default_arg, 10);
+        CHECK_EQ(config->n_policies, 1);
+        CHECK_EQ(config->n_routes, 1);
+        CHECK_EQ(config->batch_max_frames, 20);
+        CHECK_EQ(config->batch_max_delay_ms, 200);
+    }
+
+    // A later boot with a smaller document starts from the defaults,
+    // not from what the previous load left behind
+    store_document("{\"version\":9}");
+    config = remote_config_load();
+    CHECK(config != NULL);
+    if (config != NULL)
+    {
+        CHECK_EQ(config->version, 9);
+        check_defaults(config);
+    }
+}
+
+static void test_load_invalid(void)
+{
+    fake_nvs_erase();
+    CHECK(remote_config_load() == NULL);
+
+    store_document("{\"bitrate\":250000}");
+    CHECK(remote_config_load() == NULL);
+
+    store_document("{\"version\":3,\"bitrate\":33333}");
+    CHECK(remote_config_load() == NULL);
+
+    store_document("{\"version\":3,");
+    CHECK(remote_config_load() == NULL);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+/// The controller is not part of the test, the bitrates of the
+/// MCP2515 table are accepted and filters always fit
+bool CAN_is_bitrate_supported(uint32_t bitrate)
+{
+    return bitrate == 100000 || bitrate == 125000 || bitrate == 250000 || bitrate == 500000;
+}
+
+bool CAN_check_filters(const CAN_filter_t filters[], uint8_t n_filters)
+{
+    (void)filters;
+    return n_filters <= CAN_MAX_FILTERS;
+}
+
+void mem_budget_account(mem_subsystem_e subsystem, uint32_t bytes)
+{
+    (void)subsystem;
+    (void)bytes;
+}
+
+int main(void)
+{
+    downlink_init();
+    policy_init(POLICY_DEFAULT_RULE, POLICY_DEFAULT_ARG);
+
+    RUN_TEST(test_load_minimal);
+    RUN_TEST(test_load_full);
+    RUN_TEST(test_load_invalid);
+    return TEST_RESULT();
+}
@@ -0,0 +1,430 @@
+// ***************************************************** //
+/// @file test_slcan.c
+/// @brief SLCAN encoder, transmit line decoder and command
+/// parser against a fake controller, and the stream of the
+/// received frames
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "slcan.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief What the parser asked of the controller
+typedef struct
+{
+    uint32_t    opens;
+    uint32_t    closes;
+    bool        listen_only;        // Mode of the controller
+    bool        timestamps;
+    uint32_t    bitrate;
+    uint32_t    transmits;
+    CAN_frame_t last_frame;
+    bool        fail;               // Every operation fails
+    uint32_t    ready;
+    char        written[8 * SLCAN_BUFFER_SIZE];
+    uint32_t    written_len;
+} controller_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static controller_t controller;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool fake_open(bool timestamps, bool listen_only)
+{
+    if (controller.fail)
+    {
+        return false;
+    }
+    controller.opens++;
+    controller.timestamps  = timestamps;
+    controller.listen_only = listen_only;
+    return true;
+}
+
+static void fake_close(void)
+{
+    controller.closes++;
+    controller.listen_only = false;
+}
+
+static bool fake_set_bitrate(uint32_t bitrate)
+{
+    controller.bitrate = bitrate;
+    return !controller.fail;
+}
+
+static bool fake_transmit(const CAN_frame_t* frame)
+{
+    controller.transmits++;
+    controller.last_frame = *frame;
+    return !controller.fail;
+}
+
+static void fake_write(const char* data, uint32_t len)
+{
+    if (controller.written_len + len < sizeof(controller.written))
+    {
+        memcpy(&controller.written[controller.written_len], data, len);
+        controller.written_len += len;
+        controller.written[controller.written_len] = '\0';
+    }
+}
+
+static void fake_ready(void)
+{
+    controller.ready++;
+}
+
+static const slcan_ops_t FAKE_OPS =
+{
+    .open        = fake_open,
+    .close       = fake_close,
+    .set_bitrate = fake_set_bitrate,
+    .transmit    = fake_transmit,
+    .write       = fake_write,
+    .ready       = fake_ready,
+};
+
+/// @brief Feeds a string, returns the replies of its commands
+static const char* feed(slcan_parser_t* parser, const char* text)
+{
+    static char replies[64];
+    uint32_t    n = 0;
+
+    for (; *text != '\0'; text++)
+    {
+        char    reply[SLCAN_MAX_REPLY_LEN];
+        uint8_t len = slcan_feed(parser, &FAKE_OPS, *text, reply);
+        if (n + len < sizeof(replies))
+        {
+            memcpy(&replies[n], reply, len);
+            n += len;
+        }
+    }
+    replies[n] = '\0';
+    return replies;
+}
+
+static CAN_frame_t make_frame(uint32_t can_id, uint8_t dlc, const char* data)
+{
+    CAN_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id  = can_id;
+    frame.can_dlc = dlc;
+    memcpy(frame.data, data, dlc);
+    return frame;
+}
+
+static const char* encode(const CAN_frame_t* frame, bool timestamps, uint32_t time_ms)
+{
+    static char line[SLCAN_MAX_FRAME_LEN + 1];
+    uint8_t     len = slcan_encode(frame, timestamps, time_ms, line);
+    line[len] = '\0';
+    return line;
+}
+
+static bool decode(const char* cmd, CAN_frame_t* frame)
+{
+    memset(frame, 0, sizeof(*frame));
+    return slcan_decode(cmd, (uint8_t)strlen(cmd), frame);
+}
+
+static void test_encode(void)
+{
+    CAN_frame_t frame = make_frame(0x123, 2, "\x01\xAB");
+    CHECK_STR(encode(&frame, false, 0), "t123201AB\r");
+    CHECK_STR(encode(&frame, true, 61234), "t123201AB04D2\r");
+
+    frame = make_frame(CAN_EFF_FLAG | 0x18FEF100, 8, "\x00\x11\x22\x33\x44\x55\x66\x77");
+    CHECK_STR(encode(&frame, false, 0), "T18FEF10080011223344556677\r");
+    CHECK_EQ(strlen(encode(&frame, true, 59999)), SLCAN_MAX_FRAME_LEN);
+
+    // Remote frames carry their length but no data
+    frame = make_frame(CAN_RTR_FLAG | 0x7FF, 4, "\x01\x02\x03\x04");
+    CHECK_STR(encode(&frame, false, 0), "r7FF4\r");
+    frame = make_frame(CAN_EFF_FLAG | CAN_RTR_FLAG | 0x1, 0, "");
+    CHECK_STR(encode(&frame, false, 0), "R000000010\r");
+
+    // Lengths above 8 are clipped, error frames have no line
+    frame = make_frame(0x001, 8, "\x01\x02\x03\x04\x05\x06\x07\x08");
+    frame.can_dlc = 15;
+    CHECK_STR(encode(&frame, false, 0), "t00180102030405060708\r");
+    char line[SLCAN_MAX_FRAME_LEN];
+    frame.can_id = CAN_ERR_FLAG | 0x4;
+    CHECK_EQ(slcan_encode(&frame, false, 0, line), 0);
+}
+
+static void test_decode(void)
+{
+    CAN_frame_t frame;
+    CHECK(decode("t123201AB", &frame));
+    CHECK_EQ(frame.can_id, 0x123);
+    CHECK_EQ(frame.can_dlc, 2);
+    CHECK_EQ(frame.data[0], 0x01);
+    CHECK_EQ(frame.data[1], 0xAB);
+
+    CHECK(decode("T18fef1003a1b2c3", &frame));
+    CHECK_EQ(frame.can_id, CAN_EFF_FLAG | 0x18FEF100);
+    CHECK_EQ(frame.data[2], 0xC3);
+
+    CHECK(decode("r7FF8", &frame));
+    CHECK_EQ(frame.can_id, CAN_RTR_FLAG | 0x7FF);
+    CHECK_EQ(frame.can_dlc, 8);
+    CHECK(decode("R1FFFFFFF0", &frame));
+    CHECK_EQ(frame.can_id, CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK);
+
+    // Every encoded frame decodes back to itself
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        char        data[8] = { (char)i, (char)(i >> 3), 1, 2, 3, 4, 5, (char)0xFF };
+        CAN_frame_t sent = make_frame((i % 2) ? (CAN_EFF_FLAG | (i * 0x10001)) : (i & CAN_SFF_MASK),
+                                      (uint8_t)(i % 9), data);
+        if (i % 5 == 0)
+        {
+            sent.can_id |= CAN_RTR_FLAG;
+            memset(sent.data, 0, sizeof(sent.data));
+        }
+        const char* line = encode(&sent, false, 0);
+        CHECK(slcan_decode(line, (uint8_t)(strlen(line) - 1), &frame));
+        CHECK_EQ(frame.can_id, sent.can_id);
+        CHECK_EQ(frame.can_dlc, sent.can_dlc);
+        CHECK(memcmp(frame.data, sent.data, (sent.can_id & CAN_RTR_FLAG) ? 0 : sent.can_dlc) == 0);
+    }
+
+    // Malformed lines
+    CHECK(!decode("t12", &frame));
+    CHECK(!decode("t1232", &frame));
+    CHECK(!decode("t123201AB00", &frame));
+    CHECK(!decode("t1G320102", &frame));
+    CHECK(!decode("t12320G02", &frame));
+    CHECK(!decode("t8000", &frame));
+    CHECK(!decode("T200000000", &frame));
+    CHECK(!decode("t1239", &frame));
+    CHECK(!decode("t123:", &frame));
+    CHECK(!decode("r12301", &frame));
+}
+
+static void test_commands(void)
+{
+    slcan_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    memset(&controller, 0, sizeof(controller));
+
+    // What slcand sends: close, bitrate, open
+    CHECK_STR(feed(&parser, "C\rS6\rZ1\rO\r"), "\r\r\r\r");
+    CHECK_EQ(controller.bitrate, 500000);
+    CHECK_EQ(controller.opens, 1);
+    CHECK_EQ(controller.closes, 0);
+    CHECK(controller.timestamps);
+    CHECK(!controller.listen_only);
+
+    // Settings while open, a second open and out of range values fail
+    CHECK_STR(feed(&parser, "S4\rZ0\rO\rL\r"), "\a\a\a\a");
+    CHECK_EQ(controller.opens, 1);
+
+    CHECK_STR(feed(&parser, "t12320102\rT000000010\rr1230\r"), "z\rZ\rz\r");
+    CHECK_EQ(controller.transmits, 3);
+    CHECK_EQ(controller.last_frame.can_id, CAN_RTR_FLAG | 0x123);
+    CHECK_STR(feed(&parser, "t1232\r"), "\a");
+    CHECK_EQ(controller.transmits, 3);
+
+    CHECK_STR(feed(&parser, "C\rS9\rZ2\rS8\r"), "\r\a\a\r");
+    CHECK_EQ(controller.closes, 1);
+    CHECK_EQ(controller.bitrate, 1000000);
+
+    // Transmit needs an open channel
+    CHECK_STR(feed(&parser, "t12320102\rF\r"), "\a\a");
+    CHECK_EQ(controller.transmits, 3);
+
+    CHECK_STR(feed(&parser, "V\rN\r"), "V0101\rNGW01\r");
+    CHECK_STR(feed(&parser, "X\r\r\n"), "\a");
+
+    // A controller that fails is reported, the channel stays closed
+    controller.fail = true;
+    CHECK_STR(feed(&parser, "O\rS5\r"), "\a\a");
+    CHECK(!parser.open);
+    controller.fail = false;
+    CHECK_STR(feed(&parser, "O\rt12320102\r"), "\rz\r");
+    controller.fail = true;
+    CHECK_STR(feed(&parser, "t12320102\r"), "\a");
+    controller.fail = false;
+    CHECK_STR(feed(&parser, "C\r"), "\r");
+}
+
+static void test_listen_only(void)
+{
+    slcan_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    memset(&controller, 0, sizeof(controller));
+
+    // L puts the controller in listen only mode, transmit is refused
+    CHECK_STR(feed(&parser, "L\r"), "\r");
+    CHECK_EQ(controller.opens, 1);
+    CHECK(controller.listen_only);
+    CHECK_STR(feed(&parser, "t12320102\rT000000010\r"), "\a\a");
+    CHECK_EQ(controller.transmits, 0);
+
+    // C returns to normal mode, and the next O transmits
+    CHECK_STR(feed(&parser, "C\r"), "\r");
+    CHECK_EQ(controller.closes, 1);
+    CHECK(!controller.listen_only);
+    CHECK(!parser.listen_only);
+
+    CHECK_STR(feed(&parser, "O\rt12320102\r"), "\rz\r");
+    CHECK_EQ(controller.opens, 2);
+    CHECK(!controller.listen_only);
+    CHECK_EQ(controller.transmits, 1);
+}
+
+static void test_overflow(void)
+{
+    slcan_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    memset(&controller, 0, sizeof(controller));
+    feed(&parser, "O\r");
+
+    // The longest command fits, one more character fails it whole
+    CHECK_STR(feed(&parser, "T1FFFFFFF80011223344556677\r"), "Z\r");
+    CHECK_EQ(controller.last_frame.data[7], 0x77);
+    CHECK_STR(feed(&parser, "T1FFFFFFF8001122334455667788\r"), "\a");
+    CHECK_EQ(controller.transmits, 1);
+
+    // The next command is not affected
+    CHECK_STR(feed(&parser, "t12320102\r"), "z\r");
+    CHECK_EQ(controller.transmits, 2);
+}
+
+static void test_stream(void)
+{
+    memset(&controller, 0, sizeof(controller));
+    slcan_stream_start(&FAKE_OPS, false, 10);
+
+    CAN_frame_t frame = make_frame(0x123, 2, "\x01\x02");
+    CHECK(slcan_frame(&frame, 100));
+    frame.can_id = CAN_ERR_FLAG;
+    CHECK(!slcan_frame(&frame, 100));
+
+    // Lines wait for the flush time
+    CHECK_EQ(slcan_next_due_ms(105), 5);
+    slcan_poll(109);
+    CHECK_EQ(controller.ready, 0);
+    slcan_poll(110);
+    CHECK_EQ(controller.ready, 1);
+    CHECK(slcan_write_next());
+    CHECK(!slcan_write_next());
+    CHECK_STR(controller.written, "t12320102\r");
+
+    // Full buffers go out at once, in order
+    uint32_t n_lines = 0;
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        frame = make_frame(i & CAN_SFF_MASK, 8, "\x00\x01\x02\x03\x04\x05\x06\x07");
+        CHECK(slcan_frame(&frame, 200));
+        n_lines++;
+        while (slcan_write_next())
+        {
+        }
+    }
+    slcan_stream_stop();
+    CHECK(slcan_write_next());
+    CHECK_EQ(controller.written_len, 10 + n_lines * 22);
+    CHECK(memcmp(&controller.written[10], "t00080001020304050607\rt001", 26) == 0);
+    CHECK(memcmp(&controller.written[controller.written_len - 22], "t0C7", 4) == 0);
+
+    // Nothing is stored once stopped
+    CHECK(!slcan_frame(&frame, 300));
+    CHECK(!slcan_write_next());
+}
+
+static void test_stream_drops(void)
+{
+    memset(&controller, 0, sizeof(controller));
+    slcan_stats_t before;
+    slcan_get_stats(&before);
+    slcan_stream_start(&FAKE_OPS, true, 10);
+
+    // The UART does not keep up: every buffer fills, then frames are
+    // dropped and F reports the overrun once
+    CAN_frame_t frame   = make_frame(CAN_EFF_FLAG | 0x1234567, 8, "\x00\x01\x02\x03\x04\x05\x06\x07");
+    uint32_t    dropped = 0;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        if (!slcan_frame(&frame, i))
+        {
+            dropped++;
+        }
+    }
+    CHECK(dropped > 0);
+    CHECK_EQ(controller.ready, SLCAN_BUFFERS);
+
+    slcan_stats_t stats;
+    slcan_get_stats(&stats);
+    CHECK_EQ(stats.dropped - before.dropped, dropped);
+
+    slcan_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.reported_drops = before.dropped;
+    feed(&parser, "O\r");
+    CHECK_STR(feed(&parser, "F\rF\r"), "F08\rF00\r");
+
+    while (slcan_write_next())
+    {
+    }
+    CHECK(slcan_frame(&frame, 2000));
+    slcan_stream_stop();
+    CHECK(slcan_write_next());
+    CHECK_EQ(controller.written_len % SLCAN_MAX_FRAME_LEN, 0);
+    CHECK(memcmp(&controller.written[controller.written_len - 5], "07D0\r", 5) == 0);
+}
+
+static void test_stream_restart(void)
+{
+    memset(&controller, 0, sizeof(controller));
+    slcan_stream_start(&FAKE_OPS, false, 10);
+
+    // Closed and opened again before the writer ran: the lines of the
+    // first stream are written, then those of the second
+    CAN_frame_t frame = make_frame(0x123, 1, "\x01");
+    CHECK(slcan_frame(&frame, 0));
+    slcan_stream_stop();
+    CHECK_EQ(controller.ready, 1);
+
+    slcan_stream_start(&FAKE_OPS, false, 10);
+    frame = make_frame(0x456, 1, "\x02");
+    CHECK(slcan_frame(&frame, 5));
+    slcan_poll(15);
+    CHECK_EQ(controller.ready, 2);
+
+    while (slcan_write_next())
+    {
+    }
+    CHECK_STR(controller.written, "t123101\rt456102\r");
+    slcan_stream_stop();
+    CHECK(!slcan_write_next());
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_encode);
+    RUN_TEST(test_decode);
+    RUN_TEST(test_commands);
+    RUN_TEST(test_listen_only);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_stream);
+    RUN_TEST(test_stream_drops);
+    RUN_TEST(test_stream_restart);
+    return TEST_RESULT();
+}
@@ -0,0 +1,245 @@
+// ***************************************************** //
+/// @file test_wifi_sm.c
+/// @brief Wifi state machine driven through a fake driver:
+/// backoff, cached AP fallback and losses while online
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "wifi_sm.h"
+#include "gateway_config.h"
+#include "test.h"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief What the state machine asked of the driver
+typedef struct
+{
+    uint32_t     connects;
+    bool         last_fast;         // Last connect was on a given AP
+    wifi_sm_ap_t last_ap;
+    uint32_t     timers;
+    uint32_t     last_timer_ms;
+    uint32_t     online_calls;
+    bool         online;
+    uint32_t     saves;
+    uint32_t     random;            // Returned by ops.random
+} driver_t;
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static driver_t driver;
+
+static const wifi_sm_ap_t HOME_AP = { { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 }, 6, true };
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void fake_connect(const wifi_sm_ap_t* ap)
+{
+    driver.connects++;
+    driver.last_fast = (ap != NULL);
+    if (ap != NULL)
+    {
+        driver.last_ap = *ap;
+    }
+}
+
+static void fake_start_timer(uint32_t ms)
+{
+    driver.timers++;
+    driver.last_timer_ms = ms;
+}
+
+static void fake_online(bool online)
+{
+    driver.online_calls++;
+    driver.online = online;
+}
+
+static void fake_save_ap(const wifi_sm_ap_t* ap)
+{
+    (void)ap;
+    driver.saves++;
+}
+
+static uint32_t fake_random(void)
+{
+    return driver.random;
+}
+
+static const wifi_sm_ops_t FAKE_OPS =
+{
+    fake_connect,
+    fake_start_timer,
+    fake_online,
+    fake_save_ap,
+    fake_random,
+};
+
+static void setup(wifi_sm_t* sm, const wifi_sm_ap_t* cached)
+{
+    memset(&driver, 0, sizeof(driver));
+    wifi_sm_init(sm, &FAKE_OPS, cached);
+}
+
+/// @brief Backoff before the jitter after a number of failures
+static uint32_t full_backoff_ms(uint32_t failures)
+{
+    uint32_t wait_ms = WIFI_RETRY_MIN_MS;
+    for (uint32_t i = 1; i < failures && wait_ms < WIFI_RETRY_MAX_MS; i++)
+    {
+        wait_ms *= 2;
+    }
+    return (wait_ms < WIFI_RETRY_MAX_MS) ? wait_ms : WIFI_RETRY_MAX_MS;
+}
+
+static void test_backoff_growth(void)
+{
+    wifi_sm_t sm;
+    setup(&sm, NULL);
+
+    wifi_sm_handle(&sm, WIFI_SM_EV_START, NULL, 0);
+    CHECK_EQ(sm.state, WIFI_SM_CONNECTING);
+    CHECK_EQ(driver.connects, 1);
+    CHECK(!driver.last_fast);
+
+    // Each failure doubles the wait up to the cap, the jitter takes
+    // away up to half of it. A random value of 0 gives the least wait
+    uint32_t now_ms = 0;
+    for (uint32_t failures = 1; failures <= 12; failures++)
+    {
+        wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, now_ms);
+        CHECK_EQ(sm.state, WIFI_SM_BACKOFF);
+        CHECK_EQ(driver.timers, failures);
+        CHECK_EQ(driver.last_timer_ms, full_backoff_ms(failures) / 2);
+
+        now_ms += driver.last_timer_ms;
+        wifi_sm_handle(&sm, WIFI_SM_EV_TIMER, NULL, now_ms);
+        CHECK_EQ(sm.state, WIFI_SM_CONNECTING);
+        CHECK_EQ(driver.connects, failures + 1);
+    }
+    CHECK_EQ(full_backoff_ms(12), WIFI_RETRY_MAX_MS);
+
+    // The whole wait when the jitter is at its top
+    driver.random = WIFI_RETRY_MAX_MS / 2;
+    wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, now_ms);
+    CHECK_EQ(driver.last_timer_ms, WIFI_RETRY_MAX_MS);
+
+    // The failure count saturates, the wait stays at the cap
+    for (int i = 0; i < 300; i++)
+    {
+        wifi_sm_handle(&sm, WIFI_SM_EV_TIMER, NULL, now_ms);
+        wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, now_ms);
+        CHECK(driver.last_timer_ms >= WIFI_RETRY_MAX_MS / 2);
+        CHECK(driver.last_timer_ms <= WIFI_RETRY_MAX_MS);
+    }
+    CHECK_EQ(sm.failures, UINT8_MAX);
+
+    // Nothing but the timer leaves the backoff
+    uint32_t connects = driver.connects;
+    wifi_sm_handle(&sm, WIFI_SM_EV_GOT_IP, NULL, now_ms);
+    wifi_sm_handle(&sm, WIFI_SM_EV_START, NULL, now_ms);
+    CHECK_EQ(sm.state, WIFI_SM_BACKOFF);
+    CHECK_EQ(driver.connects, connects);
+    CHECK_EQ(driver.online_calls, 0);
+}
+
+static void test_fast_then_scan(void)
+{
+    wifi_sm_t sm;
+    setup(&sm, &HOME_AP);
+
+    // The cached AP is tried first
+    wifi_sm_handle(&sm, WIFI_SM_EV_START, NULL, 1000);
+    CHECK_EQ(driver.connects, 1);
+    CHECK(driver.last_fast);
+    CHECK(memcmp(&driver.last_ap, &HOME_AP, sizeof(HOME_AP)) == 0);
+    CHECK_EQ(sm.stats.fast_connects, 1);
+
+    // It moved to another channel: the retry scans every channel
+    wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, 1400);
+    CHECK_EQ(driver.last_timer_ms, WIFI_RETRY_MIN_MS / 2);
+    wifi_sm_handle(&sm, WIFI_SM_EV_TIMER, NULL, 1525);
+    CHECK_EQ(driver.connects, 2);
+    CHECK(!driver.last_fast);
+    CHECK_EQ(sm.stats.full_scans, 1);
+
+    // The new channel is stored for the next boot, once
+    wifi_sm_ap_t moved = HOME_AP;
+    moved.channel = 11;
+    wifi_sm_handle(&sm, WIFI_SM_EV_ASSOCIATED, &moved, 3000);
+    CHECK_EQ(sm.state, WIFI_SM_ASSOCIATED);
+    CHECK_EQ(driver.saves, 1);
+    CHECK_EQ(sm.ap.channel, 11);
+
+    wifi_sm_handle(&sm, WIFI_SM_EV_GOT_IP, NULL, 3200);
+    CHECK_EQ(sm.state, WIFI_SM_ONLINE);
+    CHECK(driver.online);
+    CHECK_EQ(sm.failures, 0);
+    CHECK_EQ(sm.stats.connects, 1);
+    CHECK_EQ(sm.stats.last_time_to_ip_ms, 2200);
+    CHECK_EQ(sm.stats.max_time_to_ip_ms, 2200);
+
+    // The next outage tries the new channel first
+    wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, 5000);
+    CHECK(driver.last_fast);
+    CHECK_EQ(driver.last_ap.channel, 11);
+    wifi_sm_handle(&sm, WIFI_SM_EV_ASSOCIATED, &moved, 5050);
+    CHECK_EQ(driver.saves, 1);
+}
+
+static void test_online_losses(void)
+{
+    wifi_sm_t sm;
+    setup(&sm, &HOME_AP);
+
+    wifi_sm_handle(&sm, WIFI_SM_EV_START, NULL, 0);
+    wifi_sm_handle(&sm, WIFI_SM_EV_ASSOCIATED, &HOME_AP, 100);
+    wifi_sm_handle(&sm, WIFI_SM_EV_GOT_IP, NULL, 300);
+    CHECK(driver.online);
+    CHECK_EQ(driver.saves, 0);
+
+    // Losing the address keeps the association, DHCP renews it
+    wifi_sm_handle(&sm, WIFI_SM_EV_LOST_IP, NULL, 10000);
+    CHECK_EQ(sm.state, WIFI_SM_ASSOCIATED);
+    CHECK(!driver.online);
+    CHECK_EQ(driver.connects, 1);
+    CHECK_EQ(sm.stats.disconnects, 0);
+
+    wifi_sm_handle(&sm, WIFI_SM_EV_GOT_IP, NULL, 10700);
+    CHECK(driver.online);
+    CHECK_EQ(sm.stats.connects, 2);
+    CHECK_EQ(sm.stats.last_time_to_ip_ms, 700);
+
+    // A disconnection while online retries the AP without waiting
+    wifi_sm_handle(&sm, WIFI_SM_EV_DISCONNECTED, NULL, 20000);
+    CHECK_EQ(sm.state, WIFI_SM_CONNECTING);
+    CHECK(!driver.online);
+    CHECK_EQ(sm.stats.disconnects, 1);
+    CHECK_EQ(driver.connects, 2);
+    CHECK(driver.last_fast);
+    CHECK_EQ(driver.timers, 0);
+
+    wifi_sm_handle(&sm, WIFI_SM_EV_ASSOCIATED, &HOME_AP, 20100);
+    wifi_sm_handle(&sm, WIFI_SM_EV_GOT_IP, NULL, 21500);
+    CHECK_EQ(sm.stats.connects, 3);
+    CHECK_EQ(sm.stats.last_time_to_ip_ms, 1500);
+    CHECK_EQ(sm.stats.max_time_to_ip_ms, 1500);
+    CHECK_EQ(driver.online_calls, 5);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+int main(void)
+{
+    RUN_TEST(test_backoff_growth);
+    RUN_TEST(test_fast_then_scan);
+    RUN_TEST(test_online_losses);
+    return TEST_RESULT();
+}
@@ -0,0 +1,436 @@
+// ***************************************************** //
+/// @file ws_pool.c
+/// @brief Work-stealing thread pool for tasks that run in
+/// slices, such as the pipeline of a CAN interface. A task
+/// never runs on two workers at once, so the work of one
+/// task is done in order
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#define _GNU_SOURCE
+#include "ws_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Every queue holds more than all the tasks, a task being in at
+/// most one queue, so a push never fails
+#define WS_QUEUE_SIZE           (2 * WS_POOL_MAX_TASKS)
+
+/// Slices run between two looks at the shared queue, so tasks
+/// scheduled from outside are not starved by busy local ones
+#define WS_INJECT_INTERVAL      (31)
+
+/// Rounds of yielding before an idle worker goes to sleep
+#define WS_SPIN_ROUNDS          (16)
+
+_Static_assert((WS_QUEUE_SIZE & (WS_QUEUE_SIZE - 1)) == 0, "WS_QUEUE_SIZE must be a power of two");
+
+/// @brief Tasks of a worker. The owner pushes at the tail, the owner
+/// and the thieves take from the head, so the local tasks of a
+/// worker take turns
+typedef struct
+{
+    uint32_t   head;
+    uint32_t   tail;
+    ws_task_t* slots[WS_QUEUE_SIZE];
+} ws_queue_t;
+
+typedef struct
+{
+    ws_queue_t      queue;
+    pthread_t       thread;
+    uint32_t        index;
+    uint32_t        rng;        // Picks the first victim of a steal
+    ws_pool_stats_t stats;
+} __attribute__((aligned(64))) ws_worker_t;
+
+/// Cell of the shared queue, a bounded MPMC queue after D. Vyukov
+typedef struct
+{
+    uint32_t   seq;
+    ws_task_t* task;
+} ws_cell_t;
+
+static struct
+{
+    ws_cell_t cells[WS_QUEUE_SIZE];
+    uint32_t  enqueuePos __attribute__((aligned(64)));
+    uint32_t  dequeuePos __attribute__((aligned(64)));
+} injector;
+
+static ws_worker_t workers[WS_POOL_MAX_WORKERS];
+static uint32_t    n_workers;
+static uint32_t    stopping;
+
+/// Workers asleep on parkCond
+static uint32_t        sleepers;
+static pthread_mutex_t parkLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  parkCond = PTHREAD_COND_INITIALIZER;
+
+/// Worker of the calling thread, NULL outside of the pool
+static _Thread_local ws_worker_t* self;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void queue_push(ws_worker_t* worker, ws_task_t* task)
+{
+    uint32_t tail = worker->queue.tail;
+    __atomic_store_n(&worker->queue.slots[tail & (WS_QUEUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->queue.tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Takes the oldest task of a worker, by its owner or a thief
+static ws_task_t* queue_take(ws_worker_t* worker)
+{
+    uint32_t head = __atomic_load_n(&worker->queue.head, __ATOMIC_ACQUIRE);
+    for (;;)
+    {
+        uint32_t tail = __atomic_load_n(&worker->queue.tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            return NULL;
+        }
+
+        // The slot cannot be reused before the head moves, the
+        // queue being larger than the number of tasks
+        ws_task_t* task = __atomic_load_n(&worker->queue.slots[head & (WS_QUEUE_SIZE - 1)], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&worker->queue.head, &head, head + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return task;
+        }
+    }
+}
+
+static uint32_t queue_length(ws_worker_t* worker)
+{
+    return __atomic_load_n(&worker->queue.tail, __ATOMIC_ACQUIRE)
+         - __atomic_load_n(&worker->queue.head, __ATOMIC_ACQUIRE);
+}
+
+static void inject_init(void)
+{
+    for (uint32_t i = 0; i < WS_QUEUE_SIZE; i++)
+    {
+        injector.cells[i].seq  = i;
+        injector.cells[i].task = NULL;
+    }
+    injector.enqueuePos = 0;
+    injector.dequeuePos = 0;
+}
+
+static bool inject_push(ws_task_t* task)
+{
+    uint32_t   pos = __atomic_load_n(&injector.enqueuePos, __ATOMIC_RELAXED);
+    ws_cell_t* cell;
+
+    for (;;)
+    {
+        cell = &injector.cells[pos & (WS_QUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&injector.enqueuePos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = __atomic_load_n(&injector.enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->task = task;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static ws_task_t* inject_pop(void)
+{
+    uint32_t   pos = __atomic_load_n(&injector.dequeuePos, __ATOMIC_RELAXED);
+    ws_cell_t* cell;
+
+    for (;;)
+    {
+        cell = &injector.cells[pos & (WS_QUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&injector.dequeuePos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = __atomic_load_n(&injector.dequeuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    ws_task_t* task = cell->task;
+    __atomic_store_n(&cell->seq, pos + WS_QUEUE_SIZE, __ATOMIC_RELEASE);
+    return task;
+}
+
+static bool has_work(void)
+{
+    if (__atomic_load_n(&injector.enqueuePos, __ATOMIC_ACQUIRE)
+        != __atomic_load_n(&injector.dequeuePos, __ATOMIC_ACQUIRE))
+    {
+        return true;
+    }
+    for (uint32_t i = 0; i < n_workers; i++)
+    {
+        if (queue_length(&workers[i]) > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Wakes a sleeping worker after a task was queued. The
+/// fence pairs with the one of park, so either the worker sees the
+/// task or this sees the worker
+static void wake_one(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_RELAXED) > 0)
+    {
+        pthread_mutex_lock(&parkLock);
+        pthread_cond_signal(&parkCond);
+        pthread_mutex_unlock(&parkLock);
+    }
+}
+
+static void park(ws_worker_t* worker)
+{
+    pthread_mutex_lock(&parkLock);
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE) && !has_work())
+    {
+        __atomic_fetch_add(&worker->stats.parks, 1, __ATOMIC_RELAXED);
+        pthread_cond_wait(&parkCond, &parkLock);
+    }
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&parkLock);
+}
+
+static ws_task_t* steal(ws_worker_t* worker)
+{
+    worker->rng ^= worker->rng << 13;
+    worker->rng ^= worker->rng >> 17;
+    worker->rng ^= worker->rng << 5;
+
+    for (uint32_t i = 0; i < n_workers; i++)
+    {
+        ws_worker_t* victim = &workers[(worker->rng + i) % n_workers];
+        if (victim == worker)
+        {
+            continue;
+        }
+
+        ws_task_t* task = queue_take(victim);
+        if (task != NULL)
+        {
+            __atomic_fetch_add(&worker->stats.steals, 1, __ATOMIC_RELAXED);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static ws_task_t* find_task(ws_worker_t* worker, uint32_t tick)
+{
+    ws_task_t* task = NULL;
+
+    if ((tick % WS_INJECT_INTERVAL) == 0)
+    {
+        task = inject_pop();
+    }
+    if (task == NULL)
+    {
+        task = queue_take(worker);
+    }
+    if (task == NULL)
+    {
+        task = inject_pop();
+    }
+    if (task == NULL)
+    {
+        task = steal(worker);
+    }
+    return task;
+}
+
+static void run_task(ws_worker_t* worker, ws_task_t* task)
+{
+    bool more = task->run(task);
+    __atomic_fetch_add(&worker->stats.runs, 1, __ATOMIC_RELAXED);
+
+    if (more)
+    {
+        // Back of the local queue, behind the other local tasks.
+        // Another worker may take one of them
+        queue_push(worker, task);
+        if (queue_length(worker) > 1)
+        {
+            wake_one();
+        }
+        return;
+    }
+
+    // Work queued while the task finished found it still scheduled
+    // and left it alone. The fence pairs with ws_pool_schedule
+    __atomic_store_n(&task->scheduled, 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (task->pending != NULL && task->pending(task)
+        && __atomic_exchange_n(&task->scheduled, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        queue_push(worker, task);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    ws_worker_t* worker = arg;
+    uint32_t     tick   = 0;
+    uint32_t     spins  = 0;
+
+    self = worker;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+    {
+        ws_task_t* task = find_task(worker, tick++);
+        if (task == NULL)
+        {
+            if (spins++ < WS_SPIN_ROUNDS)
+            {
+                sched_yield();
+            }
+            else
+            {
+                spins = 0;
+                park(worker);
+            }
+            continue;
+        }
+
+        spins = 0;
+        run_task(worker, task);
+    }
+
+    return NULL;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool ws_pool_start(uint32_t count)
+{
+    if (count == 0 || count > WS_POOL_MAX_WORKERS)
+    {
+        return false;
+    }
+
+    inject_init();
+    memset(workers, 0, sizeof(workers));
+    __atomic_store_n(&stopping, 0, __ATOMIC_RELEASE);
+    n_workers = count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        workers[i].index = i;
+        workers[i].rng   = 0x9E3779B9UL * (i + 1);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0)
+        {
+            perror("ws_pool: pthread_create");
+            n_workers = i;
+            ws_pool_stop();
+            return false;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "worker-%u", i);
+        pthread_setname_np(workers[i].thread, name);
+    }
+
+    return true;
+}
+
+void ws_pool_schedule(ws_task_t* task)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&task->scheduled, 1, __ATOMIC_SEQ_CST) != 0)
+    {
+        return;
+    }
+
+    if (self != NULL)
+    {
+        queue_push(self, task);
+    }
+    else
+    {
+        while (!inject_push(task))
+        {
+            sched_yield();
+        }
+    }
+    wake_one();
+}
+
+bool ws_pool_is_scheduled(ws_task_t* task)
+{
+    return __atomic_load_n(&task->scheduled, __ATOMIC_ACQUIRE) != 0;
+}
+
+void ws_pool_stop(void)
+{
+    pthread_mutex_lock(&parkLock);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&parkCond);
+    pthread_mutex_unlock(&parkLock);
+
+    for (uint32_t i = 0; i < n_workers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+void ws_pool_get_stats(ws_pool_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t i = 0; i < n_workers; i++)
+    {
+        stats->runs   += __atomic_load_n(&workers[i].stats.runs, __ATOMIC_RELAXED);
+        stats->steals += __atomic_load_n(&workers[i].stats.steals, __ATOMIC_RELAXED);
+        stats->parks  += __atomic_load_n(&workers[i].stats.parks, __ATOMIC_RELAXED);
+    }
+}
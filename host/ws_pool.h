@@ -0,0 +1,91 @@
+// ***************************************************** //
+/// @file ws_pool.h
+/// @brief Work-stealing thread pool for tasks that run in
+/// slices, such as the pipeline of a CAN interface. A task
+/// never runs on two workers at once, so the work of one
+/// task is done in order
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _WS_POOL_H_
+#define _WS_POOL_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define WS_POOL_MAX_WORKERS     (64)
+
+/// Tasks that may be scheduled at once. Queues are sized so
+/// they never fill up
+#define WS_POOL_MAX_TASKS       (64)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct ws_task ws_task_t;
+
+/// @brief Runs a slice of a task, on a worker
+/// @return true if work is left, the task is run again later
+typedef bool (*ws_run_fn)(ws_task_t* task);
+
+/// @brief Tells if work arrived for a task, on the worker that
+/// just ran it. Closes the race with ws_pool_schedule
+typedef bool (*ws_pending_fn)(ws_task_t* task);
+
+struct ws_task
+{
+    ws_run_fn     run;
+    ws_pending_fn pending;
+    void*         arg;
+    uint32_t      scheduled;    // Owned by the pool, 0 initially
+};
+
+typedef struct
+{
+    uint64_t runs;          // Slices run
+    uint64_t steals;        // Tasks taken from another worker
+    uint64_t parks;         // Workers gone to sleep for lack of tasks
+} ws_pool_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Starts the workers
+/// @param n_workers Number of threads, up to WS_POOL_MAX_WORKERS
+/// @return false if a thread could not be created
+bool ws_pool_start(uint32_t n_workers);
+
+/// @brief Queues a task unless it is already queued or running.
+/// From a worker the task stays on that worker until stolen, from
+/// any other thread it goes through the shared queue
+/// @param task Task
+void ws_pool_schedule(ws_task_t* task);
+
+/// @brief Tells if a task is queued or running
+/// @param task Task
+bool ws_pool_is_scheduled(ws_task_t* task);
+
+/// @brief Stops and joins the workers. Queued tasks are not run
+void ws_pool_stop(void);
+
+/// @brief Sums the counters of the workers
+/// @param stats Output statistics
+void ws_pool_get_stats(ws_pool_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _WS_POOL_H_
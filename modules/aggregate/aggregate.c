@@ -0,0 +1,351 @@
+// ***************************************************** //
+/// @file aggregate.c
+/// @brief Tumbling window statistics per CAN ID and per
+/// decoded signal, published instead of raw frames
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "aggregate.h"
+#include "gateway_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define AGG_EMPTY_KEY       (0xFFFFFFFFUL)
+#define AGG_ENTRY_MAX_LEN   (160)
+
+/// Window of one bus
+struct agg_context
+{
+    agg_id_stats_t    id_stats[AGG_MAX_IDS];
+
+    // Keyed by signal index and source address
+    uint32_t          signal_keys[AGG_MAX_SIGNALS];
+    agg_value_stats_t signal_stats[AGG_MAX_SIGNALS];
+
+    uint32_t          window_start_ms;
+};
+
+GW_CONTEXT(agg_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline void value_update(agg_value_stats_t* stats, float value)
+{
+    if (stats->count == 0)
+    {
+        stats->min = value;
+        stats->max = value;
+    }
+    else
+    {
+        if (value < stats->min) stats->min = value;
+        if (value > stats->max) stats->max = value;
+    }
+
+    stats->last = value;
+    stats->sum += value;
+    stats->count++;
+}
+
+static inline float value_mean(const agg_value_stats_t* stats)
+{
+    return (stats->count != 0) ? (float)(stats->sum / stats->count) : 0.0f;
+}
+
+static int find_slot(uint32_t can_id, bool create, bool* is_new)
+{
+    uint32_t slot = ((uint32_t)(can_id * 0x9E3779B1UL) >> 16) & (AGG_MAX_IDS - 1);
+
+    for (int probe = 0; probe < AGG_MAX_IDS; probe++)
+    {
+        if (ctx->id_stats[slot].can_id == can_id)
+        {
+            *is_new = false;
+            return slot;
+        }
+        if (ctx->id_stats[slot].can_id == AGG_EMPTY_KEY)
+        {
+            if (!create)
+            {
+                return -1;
+            }
+            ctx->id_stats[slot].can_id = can_id;
+            *is_new = true;
+            return slot;
+        }
+        slot = (slot + 1) & (AGG_MAX_IDS - 1);
+    }
+
+    return -1;
+}
+
+static int find_signal_slot(uint16_t signal, uint8_t source, bool create)
+{
+    uint32_t key  = ((uint32_t)signal << 8) | source;
+    uint32_t slot = ((uint32_t)(key * 0x9E3779B1UL) >> 16) & (AGG_MAX_SIGNALS - 1);
+
+    for (int probe = 0; probe < AGG_MAX_SIGNALS; probe++)
+    {
+        if (ctx->signal_keys[slot] == key)
+        {
+            return slot;
+        }
+        if (ctx->signal_keys[slot] == AGG_EMPTY_KEY)
+        {
+            if (!create)
+            {
+                return -1;
+            }
+            ctx->signal_keys[slot] = key;
+            return slot;
+        }
+        slot = (slot + 1) & (AGG_MAX_SIGNALS - 1);
+    }
+
+    return -1;
+}
+
+/// @brief Message defining a signal. Messages hold consecutive runs
+/// of DBC_SIGNALS in order
+static const dbc_message_t* message_of(uint16_t signal)
+{
+    uint16_t lo = 0;
+    uint16_t hi = DBC_NUM_MESSAGES;
+    while (hi - lo > 1)
+    {
+        uint16_t mid = (lo + hi) / 2;
+        if (DBC_MESSAGES[mid].first_signal <= signal)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return &DBC_MESSAGES[lo];
+}
+
+static int write_id_entry(char* buf, size_t len, const agg_id_stats_t* stats, bool first)
+{
+    char data_str[2 * CAN_MAX_DLEN + 1];
+    for (int i = 0; i < stats->last_dlc; i++)
+    {
+        sprintf(&data_str[2 * i], "%02x", stats->last_data[i]);
+    }
+    data_str[2 * stats->last_dlc] = '\0';
+
+    return snprintf(buf, len,
+                    "%s{\"id\":%lu,\"n\":%lu,\"period\":[%.0f,%.0f,%.1f],\"last\":\"%s\"}",
+                    first ? "" : ",",
+                    (unsigned long)(stats->can_id & CAN_EFF_MASK),
+                    (unsigned long)stats->count,
+                    stats->period.min, stats->period.max, value_mean(&stats->period),
+                    data_str);
+}
+
+static int write_signal_entry(char* buf, size_t len, uint16_t slot, bool first)
+{
+    const agg_value_stats_t* stats = &ctx->signal_stats[slot];
+    uint16_t signal = (uint16_t)(ctx->signal_keys[slot] >> 8);
+    uint8_t  source = (uint8_t)ctx->signal_keys[slot];
+
+    // Signal names are only unique within their message
+    const dbc_message_t* msg = message_of(signal);
+    char message[32];
+    if (msg->is_j1939)
+    {
+        snprintf(message, sizeof(message), "\"pgn\":%lu,\"sa\":%u",
+                 (unsigned long)((msg->can_id >> 8) & 0x3FFFFUL), source);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "\"id\":%lu", (unsigned long)(msg->can_id & CAN_EFF_MASK));
+    }
+
+    return snprintf(buf, len,
+                    "%s{%s,\"name\":\"%s\",\"n\":%lu,\"min\":%g,\"max\":%g,\"mean\":%g,\"last\":%g}",
+                    first ? "" : ",",
+                    message,
+                    DBC_SIGNALS[signal].name,
+                    (unsigned long)stats->count,
+                    stats->min, stats->max, value_mean(stats), stats->last);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void agg_init(uint32_t now_ms)
+{
+    for (int i = 0; i < AGG_MAX_IDS; i++)
+    {
+        memset(&ctx->id_stats[i], 0, sizeof(ctx->id_stats[i]));
+        ctx->id_stats[i].can_id = AGG_EMPTY_KEY;
+    }
+    memset(ctx->signal_keys, 0xFF, sizeof(ctx->signal_keys));
+    memset(ctx->signal_stats, 0, sizeof(ctx->signal_stats));
+    ctx->window_start_ms = now_ms;
+}
+
+bool agg_update_frame(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    bool is_new = false;
+    int slot = find_slot(frame->can_id, true, &is_new);
+    if (slot < 0)
+    {
+        return false;
+    }
+
+    // The period spans window boundaries, only the very first frame has none
+    agg_id_stats_t* stats = &ctx->id_stats[slot];
+    if (!is_new)
+    {
+        value_update(&stats->period, (float)(uint32_t)(now_ms - stats->last_ms));
+    }
+
+    stats->count++;
+    stats->last_ms = now_ms;
+    stats->last_dlc = frame->can_dlc;
+    memcpy(stats->last_data, frame->data, frame->can_dlc);
+    return true;
+}
+
+void agg_update_signals(const dbc_value_t values[], uint8_t n_values, uint8_t source)
+{
+    for (uint8_t i = 0; i < n_values; i++)
+    {
+        int slot = find_signal_slot(values[i].signal, source, true);
+        if (slot >= 0)
+        {
+            value_update(&ctx->signal_stats[slot], values[i].value);
+        }
+    }
+}
+
+bool agg_serialize(char* buf, size_t len, agg_cursor_t* cursor, uint32_t now_ms)
+{
+    // Skip empty entries so a finished summary is detected before writing
+    while (cursor->id_slot < AGG_MAX_IDS && ctx->id_stats[cursor->id_slot].count == 0)
+    {
+        cursor->id_slot++;
+    }
+    while (cursor->signal_slot < AGG_MAX_SIGNALS && ctx->signal_stats[cursor->signal_slot].count == 0)
+    {
+        cursor->signal_slot++;
+    }
+    if (cursor->id_slot >= AGG_MAX_IDS && cursor->signal_slot >= AGG_MAX_SIGNALS)
+    {
+        return false;
+    }
+
+    // Keep room for the closing brackets of both arrays
+    const size_t reserve = 8;
+    if (len < AGG_ENTRY_MAX_LEN + reserve)
+    {
+        return false;
+    }
+
+    size_t pos = snprintf(buf, len, "{\"start\":%lu,\"len\":%lu,\"ids\":[",
+                          (unsigned long)ctx->window_start_ms,
+                          (unsigned long)(uint32_t)(now_ms - ctx->window_start_ms));
+
+    bool first = true;
+    for (; cursor->id_slot < AGG_MAX_IDS; cursor->id_slot++)
+    {
+        const agg_id_stats_t* stats = &ctx->id_stats[cursor->id_slot];
+        if (stats->count == 0)
+        {
+            continue;
+        }
+
+        int written = write_id_entry(&buf[pos], len - reserve - pos, stats, first);
+        if (written < 0 || (size_t)written >= len - reserve - pos)
+        {
+            buf[pos] = '\0';
+            if (first)
+            {
+                // Entry can never fit, drop it rather than stall
+                continue;
+            }
+            break;
+        }
+        pos += written;
+        first = false;
+    }
+
+    pos += snprintf(&buf[pos], len - pos, "],\"signals\":[");
+
+    first = true;
+    for (; cursor->id_slot >= AGG_MAX_IDS && cursor->signal_slot < AGG_MAX_SIGNALS; cursor->signal_slot++)
+    {
+        if (ctx->signal_stats[cursor->signal_slot].count == 0)
+        {
+            continue;
+        }
+
+        int written = write_signal_entry(&buf[pos], len - reserve - pos, cursor->signal_slot, first);
+        if (written < 0 || (size_t)written >= len - reserve - pos)
+        {
+            buf[pos] = '\0';
+            if (first)
+            {
+                continue;
+            }
+            break;
+        }
+        pos += written;
+        first = false;
+    }
+
+    snprintf(&buf[pos], len - pos, "]}");
+    return true;
+}
+
+void agg_reset_window(uint32_t now_ms)
+{
+    // IDs and signals keep their slot so the tables do not churn
+    // between windows
+    for (int i = 0; i < AGG_MAX_IDS; i++)
+    {
+        if (ctx->id_stats[i].can_id != AGG_EMPTY_KEY)
+        {
+            ctx->id_stats[i].count = 0;
+            memset(&ctx->id_stats[i].period, 0, sizeof(ctx->id_stats[i].period));
+        }
+    }
+    memset(ctx->signal_stats, 0, sizeof(ctx->signal_stats));
+    ctx->window_start_ms = now_ms;
+}
+
+const agg_id_stats_t* agg_get_id_stats(uint32_t can_id)
+{
+    bool is_new = false;
+    int slot = find_slot(can_id, false, &is_new);
+    return (slot >= 0 && ctx->id_stats[slot].count != 0) ? &ctx->id_stats[slot] : NULL;
+}
+
+const agg_value_stats_t* agg_get_signal_stats(uint16_t signal, uint8_t source)
+{
+    int slot = find_signal_slot(signal, source, false);
+    return (slot >= 0 && ctx->signal_stats[slot].count != 0) ? &ctx->signal_stats[slot] : NULL;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t agg_context_size(void)
+{
+    return sizeof(agg_context_t);
+}
+
+void agg_bind(agg_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
@@ -0,0 +1,130 @@
+// ***************************************************** //
+/// @file aggregate.h
+/// @brief Tumbling window statistics per CAN ID and per
+/// decoded signal, published instead of raw frames
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _AGGREGATE_H_
+#define _AGGREGATE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+#include "dbc.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Number of CAN IDs aggregated per window. Must be a power of two
+#define AGG_MAX_IDS         (128)
+
+/// Number of decoded signals aggregated, per DBC signal and source
+/// address. Must be a power of two
+#define AGG_MAX_SIGNALS     (256)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct agg_context agg_context_t;
+
+/// @brief Running statistics of a numeric value over one window
+typedef struct
+{
+    uint32_t count;
+    float    min;
+    float    max;
+    float    last;
+    double   sum;
+} agg_value_stats_t;
+
+/// @brief Statistics of a CAN ID. The value statistics track the
+/// inter-arrival period of the frames in milliseconds
+typedef struct
+{
+    uint32_t          can_id;
+    uint32_t          count;
+    uint32_t          last_ms;
+    agg_value_stats_t period;
+    uint8_t           last_data[CAN_MAX_DLEN];
+    uint8_t           last_dlc;
+} agg_id_stats_t;
+
+/// @brief Position of a partially serialized summary
+typedef struct
+{
+    uint16_t id_slot;
+    uint16_t signal_slot;
+} agg_cursor_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Clears all statistics and starts the first window
+/// @param now_ms Current time in milliseconds
+void agg_init(uint32_t now_ms);
+
+/// @brief Accounts a received frame in the statistics of its CAN ID
+/// @param frame Received CAN frame
+/// @param now_ms Current time in milliseconds
+/// @return false if the ID table is full and the frame was not counted
+bool agg_update_frame(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Accounts decoded values in the statistics of their signals.
+/// Each sender of a J1939 message has its own statistics
+/// @param values Values returned by dbc_decode
+/// @param n_values Number of values
+/// @param source Source address of a J1939 message, 0 for other messages
+void agg_update_signals(const dbc_value_t values[], uint8_t n_values, uint8_t source);
+
+/// @brief Serializes as much of the window summary as fits into
+/// a JSON document. Call repeatedly until it returns false. Signal
+/// entries name their message by "id", or by "pgn" and "sa" for
+/// J1939 messages
+/// @param buf Output buffer
+/// @param len Size of buf
+/// @param cursor Position to resume from. Zero it before the first call
+/// @param now_ms Current time in milliseconds, marks the window end
+/// @return true if a document was written to buf
+bool agg_serialize(char* buf, size_t len, agg_cursor_t* cursor, uint32_t now_ms);
+
+/// @brief Closes the current window and starts a new one
+/// @param now_ms Current time in milliseconds
+void agg_reset_window(uint32_t now_ms);
+
+/// @brief Statistics of an ID in the current window, for diagnostics
+/// @param can_id CAN identifier including the EFF flag
+/// @return Statistics, or NULL if the ID was not seen
+const agg_id_stats_t* agg_get_id_stats(uint32_t can_id);
+
+/// @brief Statistics of a signal in the current window
+/// @param signal Index into DBC_SIGNALS
+/// @param source Source address, 0 for messages other than J1939
+/// @return Statistics, or NULL if the signal was not seen
+const agg_value_stats_t* agg_get_signal_stats(uint16_t signal, uint8_t source);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t agg_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by agg_init once bound
+/// @param context Context, NULL for the static one
+void agg_bind(agg_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _AGGREGATE_H_
@@ -14,21 +14,31 @@
 #include "aws_iot.h"
 #include "application.h"
 #include "rtos_config.h"
+#include "gateway_config.h"
+#include "downlink.h"
+#include "boot.h"
+#include "latency.h"
+#include "counters.h"
+#include "mem_budget.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/select.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/ringbuf.h"
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_log.h"
-#include "esp_vfs_fat.h"
-#include "driver/sdmmc_host.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/netdb.h"
 
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -37,6 +47,8 @@
 #include "aws_iot_log.h"
 #include "aws_iot_version.h"
 #include "aws_iot_mqtt_client_interface.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
 
 // --------------------------------------------------------
 // Local private variables
@@ -44,6 +56,51 @@
 static const char *TAG = "AWS_IOT";
 
 static AWS_IoT_Client client;
+static TaskHandle_t   awsTask = NULL;
+
+/// @brief Queued message, followed by the topic, its terminator
+/// and the payload
+typedef struct
+{
+    uint32_t queued_us;
+    uint32_t origin_us;     // Capture of the frame, 0 if unknown
+    uint16_t payload_len;
+    uint8_t  topic_len;
+    uint8_t  attempts;
+    char     strings[];
+} publish_item_t;
+
+/// Messages written by any task, published by the AWS task only
+static RingbufHandle_t publishRing = NULL;
+
+// Task and publish queue are allocated statically. The ring storage
+// must be 32-bit aligned
+static StackType_t        awsStack[AWS_TASK_STACK_SIZE];
+static StaticTask_t       awsTaskBuffer;
+static uint8_t            publishRingStorage[AWS_PUBLISH_BUFFER_SIZE] __attribute__((aligned(4)));
+static StaticRingbuffer_t publishRingBuffer;
+
+#define AWS_STATIC_BYTES    (sizeof(awsStack) + sizeof(awsTaskBuffer) \
+                             + sizeof(publishRingStorage) + sizeof(publishRingBuffer))
+_Static_assert(AWS_STATIC_BYTES <= MEM_BUDGET_AWS, "AWS client exceeds MEM_BUDGET_AWS");
+
+/// Message taken from the queue and not acknowledged yet. The SDK
+/// publish waits for its PUBACK, so there is never more than one
+static publish_item_t* pendingItem = NULL;
+
+static aws_publish_stats_t publishStats;
+
+/// Written by publishers to wake the AWS task out of select
+static int wakeFd = -1;
+
+static aws_loop_stats_t loopStats;
+
+static aws_connect_stats_t connectStats;
+
+/// TCP and TLS connect of the SDK, wrapped to time them apart from
+/// the MQTT CONNECT
+static IoT_Error_t (*tlsConnect)(Network* pNetwork, TLSConnectParams* params) = NULL;
+static int64_t tlsConnectedUs = 0;
 
 /// @brief Certificates for AWS. These are read from the files on certs directory 
 extern const uint8_t aws_root_ca_pem_start[] asm("_binary_aws_root_ca_pem_start");
@@ -64,44 +121,351 @@ static void iot_subscribe_callback_handler(
     AWS_IoT_Client *pClient, char *topicName, uint16_t topicNameLen,
     IoT_Publish_Message_Params *params, void *pData) 
 {
-    ESP_LOGI(TAG, "Subscribe callback");
-    ESP_LOGI(TAG, "%.*s\t%.*s", topicNameLen, topicName, (int) params->payloadLen, (char *)params->payload);
+    ESP_LOGD(TAG, "Subscribe callback %.*s: %u bytes", topicNameLen, topicName, (unsigned) params->payloadLen);
+
+    if (params->payloadLen > DOWNLINK_MAX_PAYLOAD)
+    {
+        ESP_LOGW(TAG, "Command of %u bytes dropped, too large", (unsigned) params->payloadLen);
+        return;
+    }
+
+    // The SDK reuses its receive buffer, so the payload is copied
+    // once here and parsed in place by the application
+    downlink_buffer_t* buffer = downlink_acquire();
+    if (NULL == buffer)
+    {
+        ESP_LOGW(TAG, "Command dropped, all downlink buffers in use");
+        return;
+    }
+
+    memcpy(buffer->data, params->payload, params->payloadLen);
+    buffer->length      = (uint16_t) params->payloadLen;
+    buffer->received_us = (uint32_t) esp_timer_get_time();
 
+    // pData holds the event type chosen when subscribing
     main_app_event_t event;
-    event.Type = EVENT_AWS_TOPIC_MSG;
-    event.Data = NULL; // TODO put actual data here.
-    application_sendEventFromIsr(event);
+    event.Type = (event_type_e)(uintptr_t) pData;
+    event.Data = buffer;
+    if (!application_sendEvent(event))
+    {
+        ESP_LOGW(TAG, "Command dropped, application queue full");
+        downlink_release(buffer);
+    }
+}
+
+static bool is_transient_error(IoT_Error_t rc)
+{
+    return rc == MQTT_REQUEST_TIMEOUT_ERROR
+        || rc == NETWORK_DISCONNECTED_ERROR
+        || rc == NETWORK_ATTEMPTING_RECONNECT
+        || rc == NETWORK_RECONNECTED
+        || rc == MQTT_CLIENT_NOT_IDLE_ERROR
+        || rc == NETWORK_SSL_WRITE_ERROR
+        || rc == NETWORK_SSL_WRITE_TIMEOUT_ERROR;
+}
+
+static void complete_publish(bool acked)
+{
+    publish_item_t* item = pendingItem;
+    uint32_t latency_us = (uint32_t) esp_timer_get_time() - item->queued_us;
+
+    if (acked)
+    {
+        publishStats.acked++;
+        counters_forwarded(COUNTERS_BROKER, 1);
+        boot_mark(BOOT_FIRST_PUBLISH);
+        LATENCY_RECORD(LATENCY_SUBMIT_TO_PUBACK, item->queued_us);
+        if (item->origin_us != 0)
+        {
+            LATENCY_RECORD(LATENCY_END_TO_END, item->origin_us);
+        }
+        publishStats.latency_sum_us += latency_us;
+        if (latency_us > publishStats.latency_max_us)
+        {
+            publishStats.latency_max_us = latency_us;
+        }
+    }
+    else
+    {
+        publishStats.failed++;
+        counters_dropped(COUNTERS_BROKER, DROP_PUBLISH_FAILED, 1);
+        ESP_LOGW(TAG, "Message to %s dropped after %u attempts", item->strings, item->attempts);
+    }
+
+    // Frees the space of the message for new ones
+    vRingbufferReturnItem(publishRing, item);
+    pendingItem = NULL;
+}
+
+static void take_from_queue(void)
+{
+    if (NULL == pendingItem)
+    {
+        size_t size;
+        pendingItem = (publish_item_t *) xRingbufferReceive(publishRing, &size, 0);
+        if (pendingItem != NULL)
+        {
+            counters_received(COUNTERS_BROKER, 1);
+        }
+    }
+}
+
+/// @brief Publishes queued messages in order. A message is only
+/// removed from the queue once the broker acknowledged it, so
+/// messages queued while offline go out after the reconnect
+/// @return false if a message is waiting to be sent again
+static bool service_publish_queue(void)
+{
+    for (take_from_queue(); pendingItem != NULL; take_from_queue())
+    {
+        publish_item_t* item = pendingItem;
+
+        IoT_Publish_Message_Params params;
+        params.qos        = QOS1;
+        params.isRetained = 0;
+        params.isDup      = 0;
+        params.payload    = (void *) &item->strings[item->topic_len + 1];
+        params.payloadLen = item->payload_len;
+
+        // Every call sends a new packet identifier, so a retry is a new
+        // publish for the broker and not a duplicate of the failed one
+        if (item->attempts > 0)
+        {
+            publishStats.retransmits++;
+        }
+        item->attempts++;
+
+        IoT_Error_t rc = aws_iot_mqtt_publish(&client, item->strings, item->topic_len, &params);
+        if (SUCCESS == rc)
+        {
+            complete_publish(true);
+        }
+        else if (!is_transient_error(rc) || item->attempts >= AWS_PUBLISH_MAX_ATTEMPTS)
+        {
+            complete_publish(false);
+        }
+        else
+        {
+            // Sent again on the next pass, after the reconnect if
+            // the connection is down
+            ESP_LOGD(TAG, "Publish to %s not acknowledged: %d", item->strings, rc);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// @brief Sleeps until the broker sends something, a message is
+/// queued or the timeout expires
+static void wait_for_activity(uint32_t timeout_ms)
+{
+    TLSDataParams* tls = &client.networkStack.tlsDataParams;
+
+    // Records already decrypted by mbedTLS never show up on the socket
+    if (mbedtls_ssl_get_bytes_avail(&tls->ssl) > 0)
+    {
+        loopStats.socket_wakeups++;
+        return;
+    }
+
+    int sock = tls->server_fd.fd;
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(wakeFd, &fds);
+    if (sock >= 0)
+    {
+        FD_SET(sock, &fds);
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec  = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    int ready = select(((sock > wakeFd) ? sock : wakeFd) + 1, &fds, NULL, NULL, &timeout);
+    if (ready <= 0)
+    {
+        loopStats.timeout_wakeups++;
+        return;
+    }
+
+    if (sock >= 0 && FD_ISSET(sock, &fds))
+    {
+        loopStats.socket_wakeups++;
+    }
+    if (FD_ISSET(wakeFd, &fds))
+    {
+        uint64_t count;
+        read(wakeFd, &count, sizeof(count));
+        loopStats.publish_wakeups++;
+    }
 }
 
 static void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data) 
 {
     ESP_LOGW(TAG, "MQTT Disconnect");
-    IoT_Error_t rc = FAILURE;
 
-    // Notify the application of disconnection
+    // Notify the application of disconnection. The AWS task
+    // reconnects once yield reports the lost connection
     main_app_event_t event;
     event.Type = EVENT_AWS_DISCONNECTED;
     application_sendEvent(event);
+}
 
-    if(NULL == pClient) 
+/// @brief Exponential backoff with jitter, so gateways that lost the
+/// same access point do not reconnect in lockstep
+static uint32_t backoff_ms(uint8_t attempt)
+{
+    uint32_t wait_ms = AWS_RECONNECT_MAX_MS;
+    if (attempt < 16 && (AWS_RECONNECT_MIN_MS << attempt) < AWS_RECONNECT_MAX_MS)
     {
-        return;
+        wait_ms = AWS_RECONNECT_MIN_MS << attempt;
     }
 
-    if(aws_iot_is_autoreconnect_enabled(pClient)) 
+    return wait_ms / 2 + esp_random() % (wait_ms / 2 + 1);
+}
+
+/// @brief Network connect of the SDK, stamping the end of the TLS
+/// handshake
+static IoT_Error_t timed_tls_connect(Network* pNetwork, TLSConnectParams* params)
+{
+    IoT_Error_t rc = tlsConnect(pNetwork, params);
+    tlsConnectedUs = esp_timer_get_time();
+    return rc;
+}
+
+/// @brief Opens the TLS connection and the MQTT session, timing
+/// each phase
+/// @param params Connect parameters, NULL to reuse the previous ones
+static IoT_Error_t connect_broker(IoT_Client_Connect_Params* params)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    // The SDK resolves the host again, from the lwIP cache this time.
+    // Resolving here separates DNS from the rest of the connect
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(HostAddress, NULL, &hints, &result) != 0 || NULL == result)
     {
-        ESP_LOGI(TAG, "Auto Reconnect is enabled, Reconnecting attempt will start now");
-    } 
-    else 
+        ESP_LOGW(TAG, "Could not resolve %s", HostAddress);
+        return NETWORK_ERR_NET_UNKNOWN_HOST;
+    }
+    freeaddrinfo(result);
+    int64_t resolved_us = esp_timer_get_time();
+
+    tlsConnectedUs = resolved_us;
+    IoT_Error_t rc = aws_iot_mqtt_connect(&client, params);
+    int64_t connected_us = esp_timer_get_time();
+    if (SUCCESS != rc)
     {
-        ESP_LOGW(TAG, "Auto Reconnect not enabled. Starting manual reconnect...");
-        rc = aws_iot_mqtt_attempt_reconnect(pClient);
-        if(NETWORK_RECONNECTED == rc) {
-            ESP_LOGW(TAG, "Manual Reconnect Successful");
-        } else {
-            ESP_LOGW(TAG, "Manual Reconnect Failed - %d", rc);
+        ESP_LOGW(TAG, "Error(%d) connecting to %s:%lu", rc, HostAddress, (unsigned long)port);
+        return rc;
+    }
+
+    connectStats.connects++;
+    connectStats.dns_us     = (uint32_t)(resolved_us - start_us);
+    connectStats.tls_us     = (uint32_t)(tlsConnectedUs - resolved_us);
+    connectStats.connect_us = (uint32_t)(connected_us - tlsConnectedUs);
+    return SUCCESS;
+}
+
+static IoT_Error_t subscribe_topics(void)
+{
+    IoT_Error_t rc = aws_iot_mqtt_subscribe(&client, 
+                                            TOPIC_SUB, 
+                                            strlen(TOPIC_SUB), 
+                                            QOS0, 
+                                            iot_subscribe_callback_handler, 
+                                            (void *)(uintptr_t) EVENT_AWS_TOPIC_MSG);
+    if(SUCCESS != rc) {
+        return rc;
+    }
+
+    // QoS1 so a configuration change is not lost to a dropped packet,
+    // and queued by the broker while the gateway is offline
+    return aws_iot_mqtt_subscribe(&client, 
+                                  TOPIC_CONFIG, 
+                                  strlen(TOPIC_CONFIG), 
+                                  QOS1, 
+                                  iot_subscribe_callback_handler, 
+                                  (void *)(uintptr_t) EVENT_AWS_CONFIG_MSG);
+}
+
+static void notify_connected(int64_t start_us)
+{
+    connectStats.total_us = (uint32_t)(esp_timer_get_time() - start_us);
+    ESP_LOGI(TAG, "Connected in %lu ms: dns=%lu tcp+tls=%lu connect=%lu subscribe=%lu",
+             (unsigned long)(connectStats.total_us / 1000),
+             (unsigned long)(connectStats.dns_us / 1000),
+             (unsigned long)(connectStats.tls_us / 1000),
+             (unsigned long)(connectStats.connect_us / 1000),
+             (unsigned long)(connectStats.subscribe_us / 1000));
+
+    boot_mark(BOOT_MQTT_CONNECTED);
+
+    // Notify the application that connection was successful
+    main_app_event_t event;
+    event.Type = EVENT_AWS_CONNECTED;
+    application_sendEvent(event);
+}
+
+/// @brief Reconnects with backoff until it succeeds. The subscriptions
+/// are always sent again: the broker may have dropped the persistent
+/// session before its expiry, and a missing subscription would lose
+/// every command and configuration until the next reboot
+static void reconnect(void)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint8_t attempt = 0;
+
+    do {
+        vTaskDelay(pdMS_TO_TICKS(backoff_ms(attempt)));
+        if (attempt < UINT8_MAX)
+        {
+            attempt++;
         }
+    } while(SUCCESS != connect_broker(NULL));
+
+    int64_t subscribe_start_us = esp_timer_get_time();
+    IoT_Error_t rc = aws_iot_mqtt_resubscribe(&client);
+    if(SUCCESS != rc) {
+        ESP_LOGE(TAG, "Error resubscribing : %d ", rc);
     }
+    connectStats.subscribe_us = (uint32_t)(esp_timer_get_time() - subscribe_start_us);
+
+    connectStats.reconnects++;
+    connectStats.attempts += attempt;
+    notify_connected(start_us);
+}
+
+/// @brief Parses the certificates while Wifi associates, so a broken
+/// one is reported at boot instead of as a TLS failure on every connect
+static bool check_certificates(void)
+{
+    const char* certs[] = { (const char *)aws_root_ca_pem_start,
+                            (const char *)certificate_pem_crt_start };
+    bool ok = true;
+
+    for (size_t i = 0; i < sizeof(certs) / sizeof(certs[0]); i++)
+    {
+        mbedtls_x509_crt crt;
+        mbedtls_x509_crt_init(&crt);
+
+        // PEM input is parsed including its terminator
+        int ret = mbedtls_x509_crt_parse(&crt, (const unsigned char *)certs[i], strlen(certs[i]) + 1);
+        if (ret != 0)
+        {
+            ESP_LOGE(TAG, "Certificate %u could not be parsed: -0x%x", (unsigned)i, (unsigned)-ret);
+            ok = false;
+        }
+        mbedtls_x509_crt_free(&crt);
+    }
+
+    boot_mark(BOOT_CERTS_PARSED);
+    return ok;
 }
 
 static void aws_iot_task(void *param) 
@@ -113,7 +477,8 @@ static void aws_iot_task(void *param)
     ESP_LOGI(TAG, "AWS IoT task running ...");
     ESP_LOGI(TAG, "AWS IoT SDK Version %d.%d.%d-%s", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, VERSION_TAG);
 
-    mqttInitParams.enableAutoReconnect = false; // We enable this later below
+    // Reconnects are handled by this task, with jitter
+    mqttInitParams.enableAutoReconnect = false;
     mqttInitParams.pHostURL = HostAddress;
     mqttInitParams.port = port;
 
@@ -133,96 +498,163 @@ static void aws_iot_task(void *param)
         // TODO: Delete abort, and instead return from task and delete it
         abort();
     }
+    tlsConnect = client.networkStack.connect;
+    client.networkStack.connect = timed_tls_connect;
 
+    // Persistent session: the broker keeps the subscriptions and the
+    // QoS1 messages sent while the gateway is offline
     connectParams.keepAliveIntervalInSec = 10;
-    connectParams.isCleanSession = true;
+    connectParams.isCleanSession = false;
     connectParams.MQTTVersion = MQTT_3_1_1;
     connectParams.pClientID = CONFIG_AWS_EXAMPLE_CLIENT_ID;
     connectParams.clientIDLen = (uint16_t) strlen(CONFIG_AWS_EXAMPLE_CLIENT_ID);
     connectParams.isWillMsgPresent = false;
 
+    // Everything above overlaps with the Wifi association
+    check_certificates();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
     ESP_LOGI(TAG, "Connecting to AWS...");
-    do {
-        rc = aws_iot_mqtt_connect(&client, &connectParams);
-        if(SUCCESS != rc) {
-            ESP_LOGE(TAG, "Error(%d) connecting to %s:%d", rc, mqttInitParams.pHostURL, mqttInitParams.port);
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
+    int64_t start_us = esp_timer_get_time();
+    uint8_t attempt = 0;
+    while(SUCCESS != connect_broker(&connectParams)) {
+        vTaskDelay(pdMS_TO_TICKS(backoff_ms(attempt)));
+        if (attempt < UINT8_MAX)
+        {
+            attempt++;
         }
-    } while(SUCCESS != rc);
-
-    /*
-     * Enable Auto Reconnect functionality. Minimum and Maximum time of Exponential backoff are set in aws_iot_config.h
-     *  #AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL
-     *  #AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL
-     */
-    rc = aws_iot_mqtt_autoreconnect_set_status(&client, true);
-    if(SUCCESS != rc) {
-        ESP_LOGE(TAG, "Unable to set Auto Reconnect to true - %d", rc);
-        abort();
     }
 
     ESP_LOGI(TAG, "Subscribing...");
-    rc = aws_iot_mqtt_subscribe(&client, 
-                                TOPIC_SUB, 
-                                strlen(TOPIC_SUB), 
-                                QOS0, 
-                                iot_subscribe_callback_handler, 
-                                NULL);
+    int64_t subscribe_start_us = esp_timer_get_time();
+    rc = subscribe_topics();
     if(SUCCESS != rc) {
         ESP_LOGE(TAG, "Error subscribing : %d ", rc);
         abort();
     }
+    connectStats.subscribe_us = (uint32_t)(esp_timer_get_time() - subscribe_start_us);
+    notify_connected(start_us);
 
-    // Notify the application that connection was successful
-    main_app_event_t event;
-    event.Type = EVENT_AWS_CONNECTED;
-    application_sendEvent(event);
+    // Idle, the task only wakes up in time for the keep alive
+    uint32_t idle_wait_ms = connectParams.keepAliveIntervalInSec * 1000 / 2;
+    bool publish_pending = false;
+
+    while (true) {
 
-    while((NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc)) {
+        // Messages waiting for a retransmission are retried after a
+        // short pause instead of the full idle wait
+        wait_for_activity(publish_pending ? AWS_RETRY_WAIT_MS : idle_wait_ms);
 
-        //Max time the yield function will wait for read messages
-        rc = aws_iot_mqtt_yield(&client, 100);
-        if(NETWORK_ATTEMPTING_RECONNECT == rc) {
-            // If the client is attempting to reconnect we will skip the rest of the loop.
-            continue;
+        // Reads whatever is available and handles the keep alive
+        rc = aws_iot_mqtt_yield(&client, AWS_YIELD_TIMEOUT_MS);
+        if (NETWORK_DISCONNECTED_ERROR == rc || !aws_iot_mqtt_is_client_connected(&client)) {
+            reconnect();
         }
 
-        vTaskDelay(pdMS_TO_TICKS(500));
+        publish_pending = !service_publish_queue();
     }
 }
 
 // --------------------------------------------------------
 // Public functions
 // --------------------------------------------------------
-void aws_iot_publish(const char* payload)
+bool aws_iot_publish(const char* payload)
 {
-    // If this doesn't work, try with QOS0
-    IoT_Error_t rc = FAILURE;
-    IoT_Publish_Message_Params paramsQOS1;
-
-    // TODO: Payload must be a json-formated string. 
-    // The application will be responsible to convert the CAN
-    // messages into a JSON format before calling this function.
+    return aws_iot_publish_topic(TOPIC_PUB, payload);
+}
 
-    paramsQOS1.qos = QOS1;
-    paramsQOS1.payload = (void *) payload;
-    paramsQOS1.isRetained = 0;
-    paramsQOS1.payloadLen = strlen(payload);
+bool aws_iot_publish_topic(const char* topic, const char* payload)
+{
+    return aws_iot_publish_traced(topic, payload, 0);
+}
 
-    rc = aws_iot_mqtt_publish(&client, TOPIC_PUB, strlen(TOPIC_PUB), &paramsQOS1);
-    if (rc == MQTT_REQUEST_TIMEOUT_ERROR) 
+bool aws_iot_publish_traced(const char* topic, const char* payload, uint32_t origin_us)
+{
+    size_t topic_len   = strlen(topic);
+    size_t payload_len = strlen(payload);
+    void*  memory      = NULL;
+
+    counters_received(COUNTERS_PUBLISH_QUEUE, 1);
+    if (NULL == publishRing || topic_len > UINT8_MAX || payload_len > UINT16_MAX
+        || xRingbufferSendAcquire(publishRing, &memory,
+                                  sizeof(publish_item_t) + topic_len + 1 + payload_len, 0) != pdTRUE)
     {
-        ESP_LOGW(TAG, "QOS1 publish ack not received.");
-        rc = SUCCESS;
+        __atomic_fetch_add(&publishStats.dropped, 1, __ATOMIC_RELAXED);
+        counters_dropped(COUNTERS_PUBLISH_QUEUE, DROP_QUEUE_FULL, 1);
+        return false;
     }
+
+    // The caller's buffer is free again as soon as this returns
+    publish_item_t* item = (publish_item_t *) memory;
+    item->queued_us   = (uint32_t) esp_timer_get_time();
+    item->origin_us   = origin_us;
+    item->payload_len = (uint16_t) payload_len;
+    item->topic_len   = (uint8_t) topic_len;
+    item->attempts    = 0;
+    memcpy(item->strings, topic, topic_len + 1);
+    memcpy(&item->strings[topic_len + 1], payload, payload_len);
+
+    xRingbufferSendComplete(publishRing, memory);
+    __atomic_fetch_add(&publishStats.queued, 1, __ATOMIC_RELAXED);
+    counters_forwarded(COUNTERS_PUBLISH_QUEUE, 1);
+
+    uint64_t wake = 1;
+    write(wakeFd, &wake, sizeof(wake));
+    return true;
+}
+
+void aws_iot_get_publish_stats(aws_publish_stats_t* stats)
+{
+    *stats = publishStats;
+    stats->queued  = __atomic_load_n(&publishStats.queued, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&publishStats.dropped, __ATOMIC_RELAXED);
+}
+
+void aws_iot_get_loop_stats(aws_loop_stats_t* stats)
+{
+    *stats = loopStats;
+}
+
+void aws_iot_get_connect_stats(aws_connect_stats_t* stats)
+{
+    *stats = connectStats;
 }
 
 void aws_iot_task_start()
 {
-    xTaskCreate(&aws_iot_task, 
-                "aws_iot_task", 
-                AWS_TASK_STACK_SIZE, 
-                NULL, 
-                AWS_TASK_PRIORITY,
-                NULL);
+    if (NULL != awsTask)
+    {
+        return;
+    }
+
+    if (NULL == publishRing)
+    {
+        esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+        esp_vfs_eventfd_register(&eventfd_config);
+        wakeFd = eventfd(0, 0);
+
+        publishRing = xRingbufferCreateStatic(AWS_PUBLISH_BUFFER_SIZE,
+                                              RINGBUF_TYPE_NOSPLIT,
+                                              publishRingStorage,
+                                              &publishRingBuffer);
+    }
+
+    awsTask = xTaskCreateStaticPinnedToCore(&aws_iot_task, 
+                                            "aws_iot_task", 
+                                            AWS_TASK_STACK_SIZE, 
+                                            NULL, 
+                                            AWS_TASK_PRIORITY,
+                                            awsStack,
+                                            &awsTaskBuffer,
+                                            AWS_TASK_CORE);
+    mem_budget_account(MEM_AWS, AWS_STATIC_BYTES);
+}
+
+void aws_iot_network_ready()
+{
+    // Only the first one is waited for, the task handles reconnections
+    if (NULL != awsTask)
+    {
+        xTaskNotifyGive(awsTask);
+    }
 }
@@ -6,6 +6,12 @@ extern "C"
 {
 #endif // __cplusplus
 
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
 // --------------------------------------------------------
 // Constants
 // --------------------------------------------------------
@@ -16,17 +22,90 @@ extern "C"
 /// of the AWS Thing. Changing them could break things.
 #define TOPIC_SUB  "AWS/esp32_sub"
 #define TOPIC_PUB  "AWS/esp32_pub"
+#define TOPIC_ACK  "AWS/esp32_ack"
+#define TOPIC_CONFIG "AWS/esp32_config"
+#define TOPIC_METRICS "AWS/esp32_metrics"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t queued;        // Messages accepted by aws_iot_publish_topic
+    uint32_t acked;         // Messages acknowledged by the broker
+    uint32_t failed;        // Messages abandoned after AWS_PUBLISH_MAX_ATTEMPTS
+    uint32_t dropped;       // Messages refused because the queue was full
+    uint32_t retransmits;   // Publishes repeated with the DUP flag
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;    // From queueing to PUBACK, over acked messages
+} aws_publish_stats_t;
+
+typedef struct
+{
+    uint32_t socket_wakeups;    // Data from the broker
+    uint32_t publish_wakeups;   // Messages queued by the application
+    uint32_t timeout_wakeups;   // Keep alive and retransmissions
+} aws_loop_stats_t;
+
+/// @brief Phases of the last successful connect, for finding where
+/// reconnect time goes. The SDK opens the TCP connection and runs
+/// the TLS handshake in one call, they are timed together
+typedef struct
+{
+    uint32_t connects;      // Successful connects, including reconnects
+    uint32_t reconnects;
+    uint32_t attempts;      // Failed attempts before the reconnects
+    uint32_t dns_us;
+    uint32_t tls_us;        // TCP connect and TLS handshake
+    uint32_t connect_us;    // MQTT CONNECT to CONNACK
+    uint32_t subscribe_us;
+    uint32_t total_us;      // Including the backoff waits
+} aws_connect_stats_t;
 
 // --------------------------------------------------------
 // Public definitions
 // --------------------------------------------------------
 
-/// @brief Starts the AWS task and connects to the MQTT broker
+/// @brief Starts the AWS task and its publish queue. The client is
+/// set up right away, the broker is contacted after
+/// aws_iot_network_ready. Messages published before are queued
 void aws_iot_task_start();
 
-/// @brief Publishes message to TOPIC_PUB with MQTT
+/// @brief Lets the AWS task connect, once Wifi has an IP address
+void aws_iot_network_ready();
+
+/// @brief Queues a message for TOPIC_PUB
 /// @param payload message to be published
-void aws_iot_publish(const char* payload);
+/// @return false if the message was dropped
+bool aws_iot_publish(const char* payload);
+
+/// @brief Queues a message for the given topic. Never blocks, the
+/// message is copied and published with QoS1 by the AWS task. Safe
+/// to call from any task
+/// @param topic Topic allowed by the policy of the AWS Thing
+/// @param payload message to be published
+/// @return false if the message was dropped
+bool aws_iot_publish_topic(const char* topic, const char* payload);
+
+/// @brief Queues a message like aws_iot_publish_topic, and times it
+/// from the capture of its frame to the PUBACK
+/// @param topic Topic allowed by the policy of the AWS Thing
+/// @param payload message to be published
+/// @param origin_us LATENCY_NOW() at the capture of the frame, 0 if unknown
+/// @return false if the message was dropped
+bool aws_iot_publish_traced(const char* topic, const char* payload, uint32_t origin_us);
+
+/// @brief Copies the publish counters
+/// @param stats Output statistics
+void aws_iot_get_publish_stats(aws_publish_stats_t* stats);
+
+/// @brief Copies the counters of the AWS task wake-up causes
+/// @param stats Output statistics
+void aws_iot_get_loop_stats(aws_loop_stats_t* stats);
+
+/// @brief Copies the connect counters and the last connect timing
+/// @param stats Output statistics
+void aws_iot_get_connect_stats(aws_connect_stats_t* stats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,209 @@
+// ***************************************************** //
+/// @file batch.c
+/// @brief Groups uplink messages into one MQTT publish per
+/// destination topic, bounded in frames and in delay
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "batch.h"
+#include "gateway_config.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+typedef struct
+{
+    char     data[BATCH_MAX_LEN];
+    uint16_t len;
+    uint16_t messages;
+    uint32_t opened_ms;
+    uint8_t  topic;
+    bool     open;
+} batch_slot_t;
+
+/// Open batches of one bus
+struct batch_context
+{
+    batch_slot_t     slots[BATCH_SLOTS];
+    batch_publish_fn publish_callback;
+    uint16_t         max_messages;
+    uint16_t         max_delay;
+    batch_stats_t    stats;
+};
+
+GW_CONTEXT(batch_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void publish_slot(batch_slot_t* slot)
+{
+    slot->data[slot->len++] = ']';
+    slot->data[slot->len]   = '\0';
+    slot->open = false;
+
+    ctx->stats.publishes++;
+    ctx->publish_callback(slot->topic, slot->data);
+}
+
+static batch_slot_t* find_slot(uint8_t topic, uint32_t now_ms)
+{
+    batch_slot_t* oldest = &ctx->slots[0];
+    batch_slot_t* unused = NULL;
+
+    for (uint8_t i = 0; i < BATCH_SLOTS; i++)
+    {
+        batch_slot_t* slot = &ctx->slots[i];
+        if (!slot->open)
+        {
+            if (unused == NULL)
+            {
+                unused = slot;
+            }
+            continue;
+        }
+        if (slot->topic == topic)
+        {
+            return slot;
+        }
+        if ((int32_t)(slot->opened_ms - oldest->opened_ms) < 0 || !oldest->open)
+        {
+            oldest = slot;
+        }
+    }
+
+    if (unused == NULL)
+    {
+        ctx->stats.evictions++;
+        publish_slot(oldest);
+        unused = oldest;
+    }
+
+    unused->open      = true;
+    unused->topic     = topic;
+    unused->opened_ms = now_ms;
+    unused->messages  = 0;
+    unused->len       = 1;
+    unused->data[0]   = '[';
+    return unused;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void batch_init(batch_publish_fn publish, uint16_t max_frames, uint16_t max_delay_ms)
+{
+    memset(ctx->slots, 0, sizeof(ctx->slots));
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->publish_callback = publish;
+    ctx->max_messages     = max_frames;
+    ctx->max_delay        = max_delay_ms;
+}
+
+void batch_set_limits(uint16_t max_frames, uint16_t max_delay_ms)
+{
+    batch_flush();
+    ctx->max_messages = max_frames;
+    ctx->max_delay    = max_delay_ms;
+}
+
+void batch_add(uint8_t topic, const char* msg, uint32_t now_ms)
+{
+    size_t msg_len = strlen(msg);
+    ctx->stats.messages++;
+
+    // Unbatched, or too large to share a payload: published as is
+    if (ctx->max_messages <= 1 || msg_len + 3 > BATCH_MAX_LEN)
+    {
+        ctx->stats.publishes++;
+        ctx->publish_callback(topic, msg);
+        return;
+    }
+
+    batch_slot_t* slot = find_slot(topic, now_ms);
+
+    // Room for the separator and the closing bracket
+    if (slot->len + msg_len + 2 > BATCH_MAX_LEN)
+    {
+        publish_slot(slot);
+        slot = find_slot(topic, now_ms);
+    }
+
+    if (slot->messages > 0)
+    {
+        slot->data[slot->len++] = ',';
+    }
+    memcpy(&slot->data[slot->len], msg, msg_len);
+    slot->len += (uint16_t)msg_len;
+
+    if (++slot->messages >= ctx->max_messages)
+    {
+        publish_slot(slot);
+    }
+}
+
+void batch_poll(uint32_t now_ms)
+{
+    for (uint8_t i = 0; i < BATCH_SLOTS; i++)
+    {
+        if (ctx->slots[i].open && (uint32_t)(now_ms - ctx->slots[i].opened_ms) >= ctx->max_delay)
+        {
+            publish_slot(&ctx->slots[i]);
+        }
+    }
+}
+
+uint32_t batch_next_due_ms(uint32_t now_ms)
+{
+    uint32_t next = UINT32_MAX;
+
+    for (uint8_t i = 0; i < BATCH_SLOTS; i++)
+    {
+        if (!ctx->slots[i].open)
+        {
+            continue;
+        }
+
+        uint32_t age = now_ms - ctx->slots[i].opened_ms;
+        uint32_t due = (age >= ctx->max_delay) ? 0 : ctx->max_delay - age;
+        if (due < next)
+        {
+            next = due;
+        }
+    }
+
+    return next;
+}
+
+void batch_flush(void)
+{
+    for (uint8_t i = 0; i < BATCH_SLOTS; i++)
+    {
+        if (ctx->slots[i].open)
+        {
+            publish_slot(&ctx->slots[i]);
+        }
+    }
+}
+
+void batch_get_stats(batch_stats_t* out)
+{
+    *out = ctx->stats;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t batch_context_size(void)
+{
+    return sizeof(batch_context_t);
+}
+
+void batch_bind(batch_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
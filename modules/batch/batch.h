@@ -0,0 +1,101 @@
+// ***************************************************** //
+/// @file batch.h
+/// @brief Groups uplink messages into one MQTT publish per
+/// destination topic, bounded in frames and in delay
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Topics with a batch open at the same time. When all are in
+/// use, the oldest batch is published to make room
+#define BATCH_SLOTS             (4)
+
+/// Largest batched payload, a JSON array of messages
+#define BATCH_MAX_LEN           (2048)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct batch_context batch_context_t;
+
+/// @brief Publishes a payload to a topic index from the routing table
+typedef void (*batch_publish_fn)(uint8_t topic, const char* payload);
+
+typedef struct
+{
+    uint32_t messages;      // Messages added
+    uint32_t publishes;     // Payloads handed to the publish callback
+    uint32_t evictions;     // Batches published early for lack of slots
+} batch_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Discards open batches and sets the publish callback
+/// @param publish Called with each complete payload
+/// @param max_frames Messages per payload, 1 disables batching
+/// @param max_delay_ms Longest time a message waits in a batch
+void batch_init(batch_publish_fn publish, uint16_t max_frames, uint16_t max_delay_ms);
+
+/// @brief Changes the limits. Open batches are published first
+/// @param max_frames Messages per payload, 1 disables batching
+/// @param max_delay_ms Longest time a message waits in a batch
+void batch_set_limits(uint16_t max_frames, uint16_t max_delay_ms);
+
+/// @brief Adds a message to the batch of its topic. The batch is
+/// published once it holds max_frames messages or is full
+/// @param topic Destination topic index
+/// @param msg JSON message, null terminated
+/// @param now_ms Current time in milliseconds
+void batch_add(uint8_t topic, const char* msg, uint32_t now_ms);
+
+/// @brief Publishes the batches older than max_delay_ms
+/// @param now_ms Current time in milliseconds
+void batch_poll(uint32_t now_ms);
+
+/// @brief Time until the oldest batch is due
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if no batch is open
+uint32_t batch_next_due_ms(uint32_t now_ms);
+
+/// @brief Publishes every open batch, e.g. before the topic table
+/// changes
+void batch_flush(void);
+
+/// @brief Copies the batching counters
+/// @param stats Output statistics
+void batch_get_stats(batch_stats_t* stats);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t batch_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by batch_init once bound
+/// @param context Context, NULL for the static one
+void batch_bind(batch_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _BATCH_H_
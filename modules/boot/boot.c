@@ -0,0 +1,62 @@
+// ***************************************************** //
+/// @file boot.c
+/// @brief Timestamps of the boot milestones, to measure the
+/// time to the first captured frame and the first publish
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "boot.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char* TAG = "BOOT";
+
+static const char* const NAMES[BOOT_MILESTONES] =
+{
+    "app start", "CAN ready", "first frame", "wifi associated",
+    "wifi IP", "certs parsed", "MQTT connected", "first publish",
+};
+
+/// Milliseconds since the chip started, 0 until reached
+static uint32_t milestones[BOOT_MILESTONES];
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void boot_mark(boot_milestone_e milestone)
+{
+    if (milestone >= BOOT_MILESTONES || milestones[milestone] != 0)
+    {
+        return;
+    }
+
+    uint32_t now_ms   = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t expected = 0;
+    if (now_ms == 0)
+    {
+        now_ms = 1;
+    }
+
+    // Several tasks may reach the same milestone, the first one wins
+    if (__atomic_compare_exchange_n(&milestones[milestone], &expected, now_ms,
+                                    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        ESP_LOGI(TAG, "%s at %lu ms", NAMES[milestone], (unsigned long)now_ms);
+    }
+}
+
+uint32_t boot_elapsed_ms(boot_milestone_e milestone)
+{
+    if (milestone >= BOOT_MILESTONES)
+    {
+        return 0;
+    }
+    return __atomic_load_n(&milestones[milestone], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,56 @@
+// ***************************************************** //
+/// @file boot.h
+/// @brief Timestamps of the boot milestones, to measure the
+/// time to the first captured frame and the first publish
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    BOOT_APP_START,         // Application task running
+    BOOT_CAN_READY,         // Controller configured, frames are received
+    BOOT_FIRST_FRAME,       // First frame read from the controller
+    BOOT_WIFI_ASSOCIATED,
+    BOOT_WIFI_IP,
+    BOOT_CERTS_PARSED,      // Certificates checked by the AWS task
+    BOOT_MQTT_CONNECTED,
+    BOOT_FIRST_PUBLISH,     // First message acknowledged by the broker
+    BOOT_MILESTONES
+} boot_milestone_e;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Records the time of a milestone. Only the first call for
+/// each milestone counts. Safe to call from any task
+/// @param milestone Milestone reached
+void boot_mark(boot_milestone_e milestone);
+
+/// @brief Time of a milestone since the chip started
+/// @param milestone Milestone
+/// @return Milliseconds, 0 if not reached yet
+uint32_t boot_elapsed_ms(boot_milestone_e milestone);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _BOOT_H_
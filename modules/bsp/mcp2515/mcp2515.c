@@ -13,6 +13,9 @@
 #include <string.h>
 #include "mcp2515.h"
 #include "bsp_config.h"
+#include "rtos_config.h"
+#include "mem_budget.h"
+#include "dlog.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
@@ -22,16 +25,6 @@
 // --------------------------------------------------------
 // Local private variables
 // --------------------------------------------------------
-// special address description flags for the CAN_ID 
-#define CAN_EFF_FLAG 0x80000000UL // EFF/SFF is set in the MSB 
-#define CAN_RTR_FLAG 0x40000000UL // remote transmission request 
-#define CAN_ERR_FLAG 0x20000000UL // error message frame 
-
-// valid bits in CAN ID for frame formats 
-#define CAN_SFF_MASK 0x000007FFUL // standard frame format (SFF) 
-#define CAN_EFF_MASK 0x1FFFFFFFUL // extended frame format (EFF) 
-#define CAN_ERR_MASK 0x1FFFFFFFUL // omit EFF, RTR, ERR flags 
-
 #define CAN_SFF_ID_BITS     11
 #define CAN_EFF_ID_BITS     29
 
@@ -101,8 +94,19 @@ typedef struct MCP2515_s{
 
 MCP2515 MCP2515_Object = NULL;
 
+// Driver object and buffer descriptors, allocated once
+static MCP2515_t          mcp2515Storage;
+static struct TXBn_REGS_s txbStorage[N_TXBUFFERS];
+static struct RXBn_REGS_s rxbStorage[N_RXBUFFERS];
+
+_Static_assert(sizeof(mcp2515Storage) + sizeof(txbStorage) + sizeof(rxbStorage) <= MEM_BUDGET_CAN,
+               "MCP2515 driver exceeds MEM_BUDGET_CAN");
+
 static const char* TAG = "MCP2515";
 
+/// SPI transactions since boot
+static uint32_t transactions = 0;
+
 // --------------------------------------------------------
 // Local private functions
 // --------------------------------------------------------
@@ -116,6 +120,12 @@ void MCP2515_setRegisters(const REGISTER_t reg, const uint8_t values[], const ui
 void MCP2515_modifyRegister(const REGISTER_t reg, const uint8_t mask, const uint8_t data);
 void MCP2515_prepareId(uint8_t *buffer, const bool ext, const uint32_t id);
 
+static esp_err_t MCP2515_transmit(spi_transaction_t* trans)
+{
+    __atomic_fetch_add(&transactions, 1, __ATOMIC_RELAXED);
+    return spi_device_transmit(MCP2515_Object->spi, trans);
+}
+
 MCP_ERROR_t MCP2515_setMode(const CANCTRL_REQOP_MODE_t mode)
 {
 	MCP2515_modifyRegister(MCP_CANCTRL, CANCTRL_REQOP, mode);
@@ -149,9 +159,9 @@ uint8_t MCP2515_readRegister(const REGISTER_t reg)
     trans.tx_data[1] = reg;
     trans.tx_data[2] = 0x00;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 
     return trans.rx_data[2];
@@ -171,9 +181,9 @@ void MCP2515_readRegisters(const REGISTER_t reg, uint8_t values[], const uint8_t
     trans.rx_buffer = rx_data;
     trans.tx_buffer = tx_data;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 
     for (uint8_t i = 0; i < n; i++) {
@@ -190,9 +200,9 @@ void MCP2515_setRegister(const REGISTER_t reg, const uint8_t value)
     trans.tx_data[1] = reg;
     trans.tx_data[2] = value;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 }
 
@@ -212,9 +222,9 @@ void MCP2515_setRegisters(const REGISTER_t reg, const uint8_t values[], const ui
     trans.length = ((2 + ((size_t)n)) * 8);
     trans.tx_buffer = data;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 }
 
@@ -229,9 +239,9 @@ void MCP2515_modifyRegister(const REGISTER_t reg, const uint8_t mask, const uint
     trans.tx_data[2] = mask;
     trans.tx_data[3] = data;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 }
 
@@ -265,24 +275,14 @@ void MCP2515_prepareId(uint8_t *buffer, const bool ext, const uint32_t id)
 
 MCP_ERROR_t MCP2515_init()
 {
-	// MEMORY ALLOCATIONS FOR MCP2515 STRUCTURE
-	MCP2515_Object = (MCP2515)malloc(sizeof(MCP2515_t[1]));
+	// Static driver object, the heap is not used
 	if(MCP2515_Object == NULL)
     {
-		ESP_LOGE(TAG, "Cannot initialize MCP2515. No memory available");
-		return ERROR_FAIL;
-	}
-
-	MCP2515_Object->TXB_ptr = NULL;
-	MCP2515_Object->RXB_ptr = NULL;
-	MCP2515_Object->TXB_ptr = (TXBn_REGS)malloc(sizeof(TXBn_REGS_t[N_TXBUFFERS]));
-	MCP2515_Object->RXB_ptr = (RXBn_REGS)malloc(sizeof(RXBn_REGS_t[N_RXBUFFERS]));
-
-	if(MCP2515_Object->TXB_ptr == NULL || MCP2515_Object->RXB_ptr == NULL)
-    {
-		ESP_LOGE(TAG, "Couldn't initialize MCP2515");
-		return ERROR_FAIL;
+		mem_budget_account(MEM_CAN, sizeof(mcp2515Storage) + sizeof(txbStorage) + sizeof(rxbStorage));
 	}
+	MCP2515_Object = mcp2515Storage;
+	MCP2515_Object->TXB_ptr = txbStorage;
+	MCP2515_Object->RXB_ptr = rxbStorage;
 
 	// TXBn and RXBn Register Initialization 
 	MCP2515_Object->TXB_ptr[0].CTRL = MCP_TXB0CTRL;
@@ -334,9 +334,9 @@ MCP_ERROR_t MCP2515_reset(void)
     trans.flags = SPI_TRANS_USE_RXDATA | SPI_TRANS_USE_TXDATA;
     trans.tx_data[0] = INSTRUCTION_RESET;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 
     vTaskDelay(pdMS_TO_TICKS(10));
@@ -395,9 +395,9 @@ uint8_t MCP2515_getStatus(void)
     trans.tx_data[0] = INSTRUCTION_READ_STATUS;
     trans.tx_data[1] = 0x00;
 
-    esp_err_t ret = spi_device_transmit(MCP2515_Object->spi, &trans);
+    esp_err_t ret = MCP2515_transmit(&trans);
     if (ret != ESP_OK) {
-        printf("spi_device_transmit failed\n");
+        DLOG_E(TAG, "spi_device_transmit failed: %d", ret);
     }
 
     return trans.rx_data[1];
@@ -1009,3 +1009,17 @@ void MCP2515_clearERRIF()
 {
 	MCP2515_modifyRegister(MCP_CANINTF, CANINTF_ERRIF, 0);
 }
+
+void MCP2515_getErrorCounters(uint8_t* tec, uint8_t* rec)
+{
+    // TEC and REC are adjacent, one transaction reads both
+    uint8_t values[2];
+    MCP2515_readRegisters(MCP_TEC, values, 2);
+    *tec = values[0];
+    *rec = values[1];
+}
+
+uint32_t MCP2515_getTransactionCount(void)
+{
+    return __atomic_load_n(&transactions, __ATOMIC_RELAXED);
+}
@@ -214,6 +214,8 @@ uint8_t MCP2515_getStatus(void);
 void MCP2515_clearRXnOVR(void);
 void MCP2515_clearMERR();
 void MCP2515_clearERRIF();
+void MCP2515_getErrorCounters(uint8_t* tec, uint8_t* rec);
+uint32_t MCP2515_getTransactionCount(void);
 
 #ifdef __cplusplus
 }
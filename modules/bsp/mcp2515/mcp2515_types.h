@@ -13,6 +13,16 @@
 #define CAN_MAX_DLC 8
 #define CAN_MAX_DLEN 8
 
+// special address description flags for the CAN_ID 
+#define CAN_EFF_FLAG 0x80000000UL // EFF/SFF is set in the MSB 
+#define CAN_RTR_FLAG 0x40000000UL // remote transmission request 
+#define CAN_ERR_FLAG 0x20000000UL // error message frame 
+
+// valid bits in CAN ID for frame formats 
+#define CAN_SFF_MASK 0x000007FFUL // standard frame format (SFF) 
+#define CAN_EFF_MASK 0x1FFFFFFFUL // extended frame format (EFF) 
+#define CAN_ERR_MASK 0x1FFFFFFFUL // omit EFF, RTR, ERR flags 
+
 // Controller Area Network Identifier structure
 //
 // bit 0-28 : CAN identifier (11/29 bit)
@@ -11,6 +11,8 @@
 #include "spi.h"
 #include "application.h"
 #include "bsp_config.h"
+#include "gateway_config.h"
+#include "latency.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -22,13 +24,47 @@
 // --------------------------------------------------------
 static const char* TAG = "CAN";
 
+/// Bitrate of the bus, and bits of the frames received on it
+static uint32_t currentBitrate = 0;
+static uint32_t rxFrames = 0;
+static uint32_t rxBits   = 0;
+
+typedef struct
+{
+    uint32_t    bitrate;
+    CAN_SPEED_t speed;
+} bitrate_entry_t;
+
+static const bitrate_entry_t BITRATES[] =
+{
+    {    5000, CAN_5KBPS    }, {   10000, CAN_10KBPS   }, {   20000, CAN_20KBPS  },
+    {   31250, CAN_31K25BPS }, {   33333, CAN_33KBPS   }, {   40000, CAN_40KBPS  },
+    {   50000, CAN_50KBPS   }, {   80000, CAN_80KBPS   }, {  100000, CAN_100KBPS },
+    {  125000, CAN_125KBPS  }, {  200000, CAN_200KBPS  }, {  250000, CAN_250KBPS },
+    {  500000, CAN_500KBPS  }, { 1000000, CAN_1000KBPS },
+};
+
 static void IRAM_ATTR isr_handler(void *args)
 {
     main_app_event_t event;
     event.Type = EVENT_CAN_MSG;
+    event.Data = (void*)(uintptr_t)LATENCY_NOW();
     application_sendEventFromIsr(event);
 }
 
+static bool bitrate_to_speed(uint32_t bitrate, CAN_SPEED_t* speed)
+{
+    for (size_t i = 0; i < sizeof(BITRATES) / sizeof(BITRATES[0]); i++)
+    {
+        if (BITRATES[i].bitrate == bitrate)
+        {
+            *speed = BITRATES[i].speed;
+            return true;
+        }
+    }
+    return false;
+}
+
 /// @brief Initializes GPIO to configure MCP2515 interrupt
 /// @param None 
 static void GPIO_init(void)
@@ -39,6 +75,7 @@ static void GPIO_init(void)
 	gpio_pulldown_dis(MCP_SPI_PIN_INTERRUPT);
 	gpio_set_intr_type(MCP_SPI_PIN_INTERRUPT, GPIO_INTR_NEGEDGE);
 
+	// The interrupt is allocated on the calling core, APP_TASK_CORE
 	gpio_install_isr_service(0);
 	gpio_isr_handler_add(MCP_SPI_PIN_INTERRUPT, isr_handler, NULL);
 }
@@ -64,26 +101,147 @@ bool CAN_init()
         return false;
     }
 
-    ret = MCP2515_setBitrate(CAN_100KBPS, MCP_8MHZ);
-    if (ERROR_OK != ret)
+    if (!CAN_configure(CAN_DEFAULT_BITRATE, NULL, 0))
+    {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Initialized successfully");
+    return true;
+}
+
+bool CAN_configure(uint32_t bitrate, const CAN_filter_t filters[], uint8_t n_filters)
+{
+    CAN_SPEED_t         speed;
+    CAN_filter_layout_t layout;
+
+    if (!bitrate_to_speed(bitrate, &speed) || !CAN_layout_filters(filters, n_filters, &layout))
     {
         return false;
     }
 
-    ret = MCP2515_setNormalMode();
+    // Enters configuration mode, reception stops until normal mode
+    MCP_ERROR_t ret = MCP2515_setBitrate(speed, MCP_CRYSTAL);
+
+    if (ERROR_OK == ret && layout.n_masks == 0)
+    {
+        // Accept everything: empty masks, and odd filters match
+        // extended frames so both buffers take both formats
+        ret = MCP2515_setFilterMask(MASK0, true, 0);
+        if (ERROR_OK == ret)
+        {
+            ret = MCP2515_setFilterMask(MASK1, true, 0);
+        }
+        for (int i = 0; i < CAN_MAX_FILTERS && ERROR_OK == ret; i++)
+        {
+            ret = MCP2515_setFilter((RXF_t)i, (i % 2) == 1, 0);
+        }
+    }
+    else if (ERROR_OK == ret)
+    {
+        ret = MCP2515_setFilterMask(MASK0, layout.ext[0], layout.mask[0]);
+        if (ERROR_OK == ret)
+        {
+            ret = MCP2515_setFilterMask(MASK1, layout.ext[1], layout.mask[1]);
+        }
+        for (int i = 0; i < CAN_MAX_FILTERS && ERROR_OK == ret; i++)
+        {
+            bool     ext = layout.ext[(i < CAN_RXB0_FILTERS) ? 0 : 1];
+            uint32_t id  = filters[layout.slot[i]].id & (ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+            ret = MCP2515_setFilter((RXF_t)(RXF0 + i), ext, id);
+        }
+    }
+
+    if (ERROR_OK == ret)
+    {
+        ret = MCP2515_setNormalMode();
+    }
+
     if (ERROR_OK != ret)
     {
+        ESP_LOGE(TAG, "Could not configure %lu bit/s with %u filters", (unsigned long)bitrate, n_filters);
         return false;
     }
 
-    ESP_LOGI(TAG, "Initialized successfully");
+    currentBitrate = bitrate;
+    ESP_LOGI(TAG, "Configured %lu bit/s with %u filters", (unsigned long)bitrate, n_filters);
+    return true;
+}
+
+bool CAN_set_listen_only(bool listen_only)
+{
+    MCP_ERROR_t ret = listen_only ? MCP2515_setListenOnlyMode() : MCP2515_setNormalMode();
+    if (ERROR_OK != ret)
+    {
+        ESP_LOGE(TAG, "Could not enter %s mode", listen_only ? "listen only" : "normal");
+        return false;
+    }
     return true;
 }
 
+bool CAN_is_bitrate_supported(uint32_t bitrate)
+{
+    CAN_SPEED_t speed;
+    return bitrate_to_speed(bitrate, &speed);
+}
+
 bool CAN_receive(CAN_frame_t* frame)
 {
     MCP_ERROR_t ret = ERROR_FAIL;
-    ret = MCP2515_readMessage(RXB0, frame);
+
+    // Frames roll over to RXB1 when RXB0 is full, and filters may
+    // route frames to RXB1 directly
+    ret = MCP2515_readMessageAfterStatCheck(frame);
+    if (ERROR_OK != ret)
+    {
+        return false;
+    }
+
+    // Frame length without stuff bits: SOF, arbitration, control,
+    // data, CRC, ACK, EOF and interframe space
+    uint32_t bits = (frame->can_id & CAN_EFF_FLAG) ? 67 : 47;
+    if (!(frame->can_id & CAN_RTR_FLAG))
+    {
+        bits += 8 * frame->can_dlc;
+    }
+    __atomic_store_n(&rxFrames, rxFrames + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&rxBits, rxBits + bits, __ATOMIC_RELAXED);
+    return true;
+}
+
+void CAN_get_stats(CAN_stats_t* stats)
+{
+    MCP2515_getErrorCounters(&stats->tec, &stats->rec);
+    stats->error_flags = MCP2515_getErrorFlags();
+    stats->bitrate     = currentBitrate;
+    stats->rx_frames   = __atomic_load_n(&rxFrames, __ATOMIC_RELAXED);
+    stats->rx_bits     = __atomic_load_n(&rxBits, __ATOMIC_RELAXED);
+}
+
+uint8_t CAN_check_overflow(void)
+{
+    uint8_t eflg = MCP2515_getErrorFlags();
+    uint8_t overflows = ((eflg & EFLG_RX0OVR) ? 1 : 0) + ((eflg & EFLG_RX1OVR) ? 1 : 0);
+
+    if (overflows > 0)
+    {
+        MCP2515_clearRXnOVRFlags();
+    }
+
+    // A pending error interrupt holds the INT line low, and the
+    // falling edge of the next frame would never be seen
+    if (MCP2515_getInterrupts() & (CANINTF_ERRIF | CANINTF_MERRF))
+    {
+        MCP2515_clearERRIF();
+        MCP2515_clearMERR();
+    }
+    return overflows;
+}
+
+bool CAN_send(const CAN_frame_t* frame)
+{
+    MCP_ERROR_t ret = ERROR_FAIL;
+    ret = MCP2515_sendMessageAfterCtrlCheck(frame);
 
     return (ERROR_OK == ret);
-}
\ No newline at end of file
+}
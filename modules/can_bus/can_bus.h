@@ -23,6 +23,38 @@ extern "C"
 // --------------------------------------------------------
 typedef MCP_CAN_frame CAN_frame_t;
 
+/// Acceptance filters of the controller. They share two masks,
+/// one for up to 2 filters and one for up to 4
+#define CAN_MAX_FILTERS     (6)
+#define CAN_RXB0_FILTERS    (2)     // RXF0-1, matched with MASK0
+#define CAN_RXB1_FILTERS    (4)     // RXF2-5, matched with MASK1
+
+/// @brief Accepts frames whose ID matches id on every bit set in mask
+typedef struct
+{
+    uint32_t id;        // Including CAN_EFF_FLAG for extended IDs
+    uint32_t mask;
+} CAN_filter_t;
+
+/// @brief Registers of the controller for a set of filters
+typedef struct
+{
+    uint8_t  n_masks;                   // Distinct masks, 0 to accept every frame
+    bool     ext[2];                    // Format of MASK0 and MASK1 and of their filters
+    uint32_t mask[2];
+    uint8_t  slot[CAN_MAX_FILTERS];     // Requested filter loaded in RXF0-5
+} CAN_filter_layout_t;
+
+typedef struct
+{
+    uint8_t  tec;           // Transmit error counter
+    uint8_t  rec;           // Receive error counter
+    uint8_t  error_flags;   // EFLG register
+    uint32_t bitrate;
+    uint32_t rx_frames;     // Frames accepted by the filters
+    uint32_t rx_bits;       // Their length on the bus, without stuff bits
+} CAN_stats_t;
+
 /// @brief Initializes CAN communication and configures
 /// interrupt to send application events on each received 
 /// message
@@ -30,13 +62,74 @@ typedef MCP_CAN_frame CAN_frame_t;
 /// @return true if successful, false otherwise 
 bool CAN_init();
 
+/// @brief Changes the bitrate and acceptance filters. Reception
+/// stops while the controller is in configuration mode
+/// @param bitrate Bitrate in bit/s, see CAN_is_bitrate_supported
+/// @param filters Acceptance filters, see CAN_check_filters
+/// @param n_filters Number of filters, 0 to accept every frame
+/// @return true if successful, false otherwise
+bool CAN_configure(uint32_t bitrate, const CAN_filter_t filters[], uint8_t n_filters);
+
+/// @brief Switches the controller between normal mode and listen
+/// only mode, where it receives without acknowledging frames or
+/// transmitting. CAN_configure always ends in normal mode
+/// @param listen_only true for listen only, false for normal mode
+/// @return true if the controller entered the mode
+bool CAN_set_listen_only(bool listen_only);
+
+/// @brief Tells if the controller can run at a bitrate
+/// @param bitrate Bitrate in bit/s, e.g. 250000
+/// @return true if supported with the crystal of the board
+bool CAN_is_bitrate_supported(uint32_t bitrate);
+
+/// @brief Tells if a set of filters fits the controller: at most
+/// two distinct masks, one of them shared by at most 2 filters
+/// and the other by at most 4. Filters sharing a mask must all be
+/// standard or all extended
+/// @param filters Acceptance filters
+/// @param n_filters Number of filters
+/// @return true if CAN_configure can apply them
+bool CAN_check_filters(const CAN_filter_t filters[], uint8_t n_filters);
+
+/// @brief Places a set of filters in the masks and filter registers.
+/// A single mask is loaded in both, its filters spread over RXF0-5.
+/// With two masks, the one with fewer filters goes to RXB0
+/// @param filters Acceptance filters
+/// @param n_filters Number of filters
+/// @param layout Registers to load, every requested filter in one
+/// of the slots at least
+/// @return true if the filters fit, see CAN_check_filters
+bool CAN_layout_filters(const CAN_filter_t filters[], uint8_t n_filters, CAN_filter_layout_t* layout);
+
 /// @brief Reads message from MCP2515 controller. Use this
 /// function when receiving an interrupt indicating a new 
-/// message arrives. Otherwise, it will read old messages
+/// message arrives, until it returns false, so both receive
+/// buffers are drained
 /// @param frame Pointer to a CAN frame to place data
-/// @return true if successful, false otherwise 
+/// @return true if a frame was read, false if none is pending
 bool CAN_receive(CAN_frame_t* frame);
 
+/// @brief Queues a frame in the first free transmit buffer
+/// of the MCP2515 controller
+/// @param frame Frame to transmit. CAN_EFF_FLAG selects an
+/// extended identifier
+/// @return true if successful, false if all buffers are busy
+/// or the transmission failed
+bool CAN_send(const CAN_frame_t* frame);
+
+/// @brief Checks and clears the receive overflow flags, and the
+/// error interrupts that would keep the interrupt line asserted.
+/// The controller keeps no count, each flag means at least one
+/// frame was lost since the last check
+/// @return Number of receive buffers that overflowed, 0 to 2
+uint8_t CAN_check_overflow(void);
+
+/// @brief Reads the error counters of the controller and the
+/// receive totals. Talks to the controller, so it must be called
+/// from the task that receives frames
+/// @param stats Output statistics
+void CAN_get_stats(CAN_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,136 @@
+// ***************************************************** //
+/// @file can_filters.c
+/// @brief Placement of the acceptance filters in the masks
+/// and filter registers of the MCP2515. Portable, so the
+/// layout can be checked without the controller
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "can_bus.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief A set of filters sharing the same mask
+typedef struct
+{
+    uint32_t mask;
+    bool     ext;
+    uint8_t  n_filters;
+    uint8_t  filters[CAN_MAX_FILTERS];  // Indexes into the requested filters
+} filter_group_t;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Groups filters by mask and format
+/// @return Number of groups, -1 if there are more than 2
+static int group_filters(const CAN_filter_t filters[], uint8_t n_filters, filter_group_t groups[2])
+{
+    int n_groups = 0;
+
+    for (uint8_t i = 0; i < n_filters; i++)
+    {
+        bool     ext  = (filters[i].id & CAN_EFF_FLAG) != 0;
+        uint32_t mask = filters[i].mask & (ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+
+        int g = 0;
+        while (g < n_groups && (groups[g].mask != mask || groups[g].ext != ext))
+        {
+            g++;
+        }
+        if (g == n_groups)
+        {
+            if (n_groups == 2)
+            {
+                return -1;
+            }
+            groups[g].mask      = mask;
+            groups[g].ext       = ext;
+            groups[g].n_filters = 0;
+            n_groups++;
+        }
+        groups[g].filters[groups[g].n_filters++] = i;
+    }
+
+    return n_groups;
+}
+
+/// @brief Loads a group in the registers of one buffer. Registers
+/// left over repeat the filters of the group, so they accept
+/// nothing more
+static void place_group(CAN_filter_layout_t* layout, uint8_t buffer, uint8_t first, uint8_t n_slots,
+                        const filter_group_t* group)
+{
+    layout->ext[buffer]  = group->ext;
+    layout->mask[buffer] = group->mask;
+    for (uint8_t slot = 0; slot < n_slots; slot++)
+    {
+        layout->slot[first + slot] = group->filters[slot % group->n_filters];
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool CAN_layout_filters(const CAN_filter_t filters[], uint8_t n_filters, CAN_filter_layout_t* layout)
+{
+    filter_group_t groups[2];
+
+    memset(layout, 0, sizeof(*layout));
+    if (n_filters > CAN_MAX_FILTERS)
+    {
+        return false;
+    }
+
+    int n_groups = group_filters(filters, n_filters, groups);
+    if (n_groups < 0)
+    {
+        return false;
+    }
+    layout->n_masks = (uint8_t)n_groups;
+
+    if (n_groups == 1)
+    {
+        // Both masks take the group, its filters are spread over the
+        // registers of both buffers: RXF2-5 first, then RXF0-1
+        filter_group_t rxb0 = groups[0];
+        rxb0.n_filters = 0;
+        for (uint8_t i = CAN_RXB1_FILTERS; i < CAN_MAX_FILTERS; i++)
+        {
+            rxb0.filters[rxb0.n_filters++] = groups[0].filters[i % groups[0].n_filters];
+        }
+        place_group(layout, 0, 0, CAN_RXB0_FILTERS, &rxb0);
+        place_group(layout, 1, CAN_RXB0_FILTERS, CAN_RXB1_FILTERS, &groups[0]);
+    }
+    else if (n_groups == 2)
+    {
+        // The smaller group goes to RXB0, the larger one to RXB1
+        const filter_group_t* small = &groups[0];
+        const filter_group_t* large = &groups[1];
+        if (small->n_filters > large->n_filters)
+        {
+            small = &groups[1];
+            large = &groups[0];
+        }
+        if (small->n_filters > CAN_RXB0_FILTERS || large->n_filters > CAN_RXB1_FILTERS)
+        {
+            return false;
+        }
+        place_group(layout, 0, 0, CAN_RXB0_FILTERS, small);
+        place_group(layout, 1, CAN_RXB0_FILTERS, CAN_RXB1_FILTERS, large);
+    }
+
+    return true;
+}
+
+bool CAN_check_filters(const CAN_filter_t filters[], uint8_t n_filters)
+{
+    CAN_filter_layout_t layout;
+    return CAN_layout_filters(filters, n_filters, &layout);
+}
@@ -0,0 +1,191 @@
+// ***************************************************** //
+/// @file cannelloni.c
+/// @brief Stream of the received frames in UDP datagrams of
+/// the cannelloni protocol, for a laptop on the local network.
+/// Packets are sent by a separate task
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cannelloni.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+_Static_assert(CANNELLONI_PACKETS >= 2, "The stream needs a packet while another is sent");
+
+typedef enum
+{
+    PACKET_FREE,        // Available to the stream
+    PACKET_FILLING,     // Owned by the stream
+    PACKET_FULL         // Owned by the sender
+} packet_state_e;
+
+typedef struct
+{
+    uint8_t  data[CANNELLONI_MAX_PACKET];
+    uint16_t len;
+    uint16_t frames;
+    uint32_t first_ms;      // Time of the oldest frame
+    uint8_t  state;
+} cannelloni_packet_t;
+
+static cannelloni_packet_t packets[CANNELLONI_PACKETS];
+
+static const cannelloni_ops_t* net_ops;
+static uint16_t                max_packet_frames;
+static uint32_t                max_wait_ms;
+
+/// Streaming side
+static cannelloni_packet_t* active = NULL;
+static uint8_t              fill_index = 0;
+static uint8_t              seq_no = 0;
+
+/// Sender side
+static uint8_t send_index = 0;
+
+static cannelloni_stats_t stats;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static cannelloni_packet_t* acquire(uint32_t now_ms)
+{
+    cannelloni_packet_t* packet = &packets[fill_index];
+    if (__atomic_load_n(&packet->state, __ATOMIC_ACQUIRE) != PACKET_FREE)
+    {
+        return NULL;
+    }
+
+    fill_index = (fill_index + 1) % CANNELLONI_PACKETS;
+
+    packet->state    = PACKET_FILLING;
+    packet->len      = CANNELLONI_HEADER_LEN;
+    packet->frames   = 0;
+    packet->first_ms = now_ms;
+    return packet;
+}
+
+static void submit(void)
+{
+    // The sequence number lets the receiver detect lost datagrams
+    active->data[0] = CANNELLONI_VERSION;
+    active->data[1] = CANNELLONI_OP_DATA;
+    active->data[2] = seq_no++;
+    active->data[3] = (uint8_t)(active->frames >> 8);
+    active->data[4] = (uint8_t)active->frames;
+
+    __atomic_store_n(&active->state, PACKET_FULL, __ATOMIC_RELEASE);
+    active = NULL;
+    net_ops->ready();
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void cannelloni_init(const cannelloni_ops_t* ops, uint16_t max_frames, uint32_t timeout_ms)
+{
+    memset(packets, 0, sizeof(packets));
+    memset(&stats, 0, sizeof(stats));
+    net_ops           = ops;
+    max_packet_frames = (max_frames == 0 || max_frames > CANNELLONI_MAX_FRAMES)
+                      ? CANNELLONI_MAX_FRAMES : max_frames;
+    max_wait_ms       = timeout_ms;
+    active            = NULL;
+    fill_index        = 0;
+    send_index        = 0;
+    seq_no            = 0;
+}
+
+bool cannelloni_frame(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    if (net_ops == NULL)
+    {
+        return false;
+    }
+
+    if (active == NULL)
+    {
+        active = acquire(now_ms);
+        if (active == NULL)
+        {
+            stats.dropped++;
+            return false;
+        }
+    }
+
+    // Encoded straight from the received frame into the packet
+    uint8_t  dlc    = (frame->can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->can_dlc;
+    uint8_t  n_data = (frame->can_id & CAN_RTR_FLAG) ? 0 : dlc;
+    uint32_t can_id = frame->can_id;
+    uint8_t* p      = &active->data[active->len];
+
+    p[0] = (uint8_t)(can_id >> 24);
+    p[1] = (uint8_t)(can_id >> 16);
+    p[2] = (uint8_t)(can_id >> 8);
+    p[3] = (uint8_t)can_id;
+    p[4] = dlc;
+    memcpy(&p[CANNELLONI_FRAME_HEADER_LEN], frame->data, n_data);
+
+    active->len += CANNELLONI_FRAME_HEADER_LEN + n_data;
+    active->frames++;
+    stats.frames++;
+
+    // A packet always has room for one more frame until it is sent
+    if (active->frames >= max_packet_frames
+        || active->len > CANNELLONI_MAX_PACKET - CANNELLONI_FRAME_HEADER_LEN - CAN_MAX_DLEN)
+    {
+        submit();
+    }
+    return true;
+}
+
+void cannelloni_poll(uint32_t now_ms)
+{
+    if (active != NULL && (uint32_t)(now_ms - active->first_ms) >= max_wait_ms)
+    {
+        submit();
+    }
+}
+
+uint32_t cannelloni_next_due_ms(uint32_t now_ms)
+{
+    if (active == NULL)
+    {
+        return UINT32_MAX;
+    }
+
+    uint32_t age = now_ms - active->first_ms;
+    return (age >= max_wait_ms) ? 0 : max_wait_ms - age;
+}
+
+bool cannelloni_send_next(void)
+{
+    cannelloni_packet_t* packet = &packets[send_index];
+    if (__atomic_load_n(&packet->state, __ATOMIC_ACQUIRE) != PACKET_FULL)
+    {
+        return false;
+    }
+
+    if (net_ops->send(packet->data, packet->len))
+    {
+        stats.packets++;
+    }
+    else
+    {
+        stats.unsent++;
+    }
+
+    send_index = (send_index + 1) % CANNELLONI_PACKETS;
+    __atomic_store_n(&packet->state, PACKET_FREE, __ATOMIC_RELEASE);
+    return true;
+}
+
+void cannelloni_get_stats(cannelloni_stats_t* out)
+{
+    *out = stats;
+}
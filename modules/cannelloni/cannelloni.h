@@ -0,0 +1,112 @@
+// ***************************************************** //
+/// @file cannelloni.h
+/// @brief Stream of the received frames in UDP datagrams of
+/// the cannelloni protocol, for a laptop on the local network.
+/// Packets are sent by a separate task
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _CANNELLONI_H_
+#define _CANNELLONI_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Packet header, big endian: version (1), op code (1), sequence
+/// number (1), frame count (2). Each frame follows as its ID with the
+/// EFF/RTR/ERR flags (4, big endian), its length (1) and its data,
+/// none for remote frames
+#define CANNELLONI_VERSION          (2)
+#define CANNELLONI_OP_DATA          (0)
+#define CANNELLONI_HEADER_LEN       (5)
+#define CANNELLONI_FRAME_HEADER_LEN (5)
+
+/// Packets filled by the stream and sent by the sender task
+#define CANNELLONI_PACKETS          (4)
+
+/// Largest packet, fits an Ethernet frame without fragmentation
+#define CANNELLONI_MAX_PACKET       (1400)
+
+/// Most frames in a packet, all of them classic frames with 8 bytes
+#define CANNELLONI_MAX_FRAMES       ((CANNELLONI_MAX_PACKET - CANNELLONI_HEADER_LEN) \
+                                     / (CANNELLONI_FRAME_HEADER_LEN + CAN_MAX_DLEN))
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Network side of the stream
+typedef struct
+{
+    /// Sends a packet, called from the sender task. Returns false if
+    /// the packet could not be sent, e.g. no peer is known yet
+    bool (*send)(const uint8_t* data, uint16_t len);
+    /// A packet is waiting, called from the streaming task
+    void (*ready)(void);
+} cannelloni_ops_t;
+
+typedef struct
+{
+    uint32_t frames;        // Frames streamed
+    uint32_t dropped;       // Frames lost, every packet waiting for the sender
+    uint32_t packets;       // Packets sent
+    uint32_t unsent;        // Packets discarded by the sender, no peer or socket error
+} cannelloni_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Empties the packets and sets the batching
+/// @param ops Network operations
+/// @param max_frames Frames per packet, at most CANNELLONI_MAX_FRAMES
+/// @param timeout_ms Longest time a frame waits in a packet
+void cannelloni_init(const cannelloni_ops_t* ops, uint16_t max_frames, uint32_t timeout_ms);
+
+/// @brief Adds a frame to the current packet. Must always be called
+/// from the same task. Does nothing before cannelloni_init
+/// @param frame Received frame
+/// @param now_ms Current time in milliseconds
+/// @return false if the frame was dropped for lack of packet
+bool cannelloni_frame(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Hands a packet older than timeout_ms to the sender. Same
+/// task as cannelloni_frame
+/// @param now_ms Current time in milliseconds
+void cannelloni_poll(uint32_t now_ms);
+
+/// @brief Time until the current packet is due
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if no packet is open
+uint32_t cannelloni_next_due_ms(uint32_t now_ms);
+
+/// @brief Sends the oldest full packet. Called by the sender task
+/// after ops.ready, until it returns false
+/// @return false if no packet was waiting
+bool cannelloni_send_next(void);
+
+/// @brief Copies the stream counters
+/// @param stats Output statistics
+void cannelloni_get_stats(cannelloni_stats_t* stats);
+
+/// @brief Opens the UDP socket, starts the sender task and the stream
+/// with the settings of gateway_config.h. In cannelloni_udp.c
+/// @return false if the socket could not be opened
+bool cannelloni_udp_start(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _CANNELLONI_H_
@@ -0,0 +1,236 @@
+// ***************************************************** //
+/// @file cannelloni_udp.c
+/// @brief UDP side of the cannelloni stream. One task sends
+/// the packets of cannelloni.c and receives the packets of
+/// the peer, to be sent on the bus by the application
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cannelloni.h"
+#include "application.h"
+#include "downlink.h"
+#include "gateway_config.h"
+#include "rtos_config.h"
+#include "mem_budget.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/sockets.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char* TAG = "CANNELLONI";
+
+static int  sock   = -1;
+static int  wakeFd = -1;
+
+/// Destination of the stream, and the only source accepted. Only
+/// used by the UDP task
+static struct sockaddr_in peer;
+static bool               hasPeer = false;
+
+static StackType_t  cannelloniStack[CANNELLONI_TASK_STACK_SIZE];
+static StaticTask_t cannelloniTaskBuffer;
+
+#define CANNELLONI_STATIC_BYTES (CANNELLONI_PACKETS * CANNELLONI_MAX_PACKET + sizeof(cannelloniStack) \
+                                 + sizeof(cannelloniTaskBuffer))
+_Static_assert(CANNELLONI_STATIC_BYTES <= MEM_BUDGET_CANNELLONI, "Cannelloni stream exceeds MEM_BUDGET_CANNELLONI");
+_Static_assert(!CANNELLONI_TX_ENABLE || sizeof(CANNELLONI_REMOTE_IP) > 1,
+               "Sending the frames of the peer on the bus needs CANNELLONI_REMOTE_IP");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool udp_send(const uint8_t* data, uint16_t len)
+{
+    if (!hasPeer)
+    {
+        return false;
+    }
+
+    return sendto(sock, data, len, 0, (const struct sockaddr*)&peer, sizeof(peer)) == len;
+}
+
+static void udp_ready(void)
+{
+    uint64_t count = 1;
+    write(wakeFd, &count, sizeof(count));
+}
+
+static const cannelloni_ops_t UDP_OPS =
+{
+    .send  = udp_send,
+    .ready = udp_ready,
+};
+
+static bool is_peer(const struct sockaddr_in* from)
+{
+    return from->sin_addr.s_addr == peer.sin_addr.s_addr && from->sin_port == peer.sin_port;
+}
+
+/// @brief Reads a packet of the peer. Its frames are sent on the bus
+/// by the application, like a binary command
+static void receive_packet(void)
+{
+    struct sockaddr_in from;
+    socklen_t          from_len = sizeof(from);
+    downlink_buffer_t* buffer   = CANNELLONI_TX_ENABLE ? downlink_acquire() : NULL;
+    int                len;
+
+    if (buffer == NULL)
+    {
+        // Read anyway to learn the peer and empty the socket
+        uint8_t discard[CANNELLONI_HEADER_LEN];
+        len = recvfrom(sock, discard, sizeof(discard), 0, (struct sockaddr*)&from, &from_len);
+    }
+    else
+    {
+        len = recvfrom(sock, buffer->data, sizeof(buffer->data), 0, (struct sockaddr*)&from, &from_len);
+    }
+
+    if (len <= 0)
+    {
+        if (buffer != NULL)
+        {
+            downlink_release(buffer);
+        }
+        return;
+    }
+
+    if (!hasPeer)
+    {
+        // Without a configured address, the stream goes to the first
+        // host that sends a packet, until the next reset. Transmission
+        // always has a configured one
+        peer    = from;
+        hasPeer = true;
+        ESP_LOGI(TAG, "Streaming to %s:%u", inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+    }
+    else if (!is_peer(&from))
+    {
+        // Another host can neither take the stream nor send on the bus
+        ESP_LOGD(TAG, "Packet from %s:%u dropped", inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+        if (buffer != NULL)
+        {
+            downlink_release(buffer);
+        }
+        return;
+    }
+
+    if (buffer != NULL)
+    {
+        buffer->length      = (uint16_t)len;
+        buffer->received_us = (uint32_t)esp_timer_get_time();
+
+        main_app_event_t event;
+        event.Type = EVENT_CANNELLONI_MSG;
+        event.Data = buffer;
+        if (!application_sendEvent(event))
+        {
+            downlink_release(buffer);
+        }
+    }
+}
+
+static void cannelloni_task(void* param)
+{
+    (void)param;
+
+    while (true)
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        FD_SET(wakeFd, &fds);
+
+        if (select(((sock > wakeFd) ? sock : wakeFd) + 1, &fds, NULL, NULL, NULL) <= 0)
+        {
+            continue;
+        }
+
+        if (FD_ISSET(wakeFd, &fds))
+        {
+            uint64_t count;
+            read(wakeFd, &count, sizeof(count));
+            while (cannelloni_send_next())
+            {
+            }
+        }
+        if (FD_ISSET(sock, &fds))
+        {
+            receive_packet();
+        }
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool cannelloni_udp_start(void)
+{
+    // Already registered by the AWS client, the error is harmless
+    esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_vfs_eventfd_register(&eventfd_config);
+    wakeFd = eventfd(0, 0);
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0 || wakeFd < 0)
+    {
+        ESP_LOGE(TAG, "Could not create the socket, stream disabled");
+        return false;
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family      = AF_INET;
+    local.sin_port        = htons(CANNELLONI_LOCAL_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (const struct sockaddr*)&local, sizeof(local)) != 0)
+    {
+        ESP_LOGE(TAG, "Could not bind port %u, stream disabled", CANNELLONI_LOCAL_PORT);
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    memset(&peer, 0, sizeof(peer));
+    if (CANNELLONI_REMOTE_IP[0] != '\0')
+    {
+        peer.sin_family = AF_INET;
+        peer.sin_port   = htons(CANNELLONI_REMOTE_PORT);
+        hasPeer = (inet_aton(CANNELLONI_REMOTE_IP, &peer.sin_addr) != 0);
+    }
+    if (CANNELLONI_TX_ENABLE && !hasPeer)
+    {
+        ESP_LOGE(TAG, "Invalid CANNELLONI_REMOTE_IP %s, stream disabled", CANNELLONI_REMOTE_IP);
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    cannelloni_init(&UDP_OPS, CANNELLONI_BATCH_FRAMES, CANNELLONI_TIMEOUT_MS);
+
+    xTaskCreateStaticPinnedToCore(cannelloni_task,
+                                  "cannelloni_task",
+                                  CANNELLONI_TASK_STACK_SIZE,
+                                  NULL,
+                                  CANNELLONI_TASK_PRIORITY,
+                                  cannelloniStack,
+                                  &cannelloniTaskBuffer,
+                                  CANNELLONI_TASK_CORE);
+    mem_budget_account(MEM_CANNELLONI, CANNELLONI_STATIC_BYTES);
+
+    ESP_LOGI(TAG, "Listening on UDP port %u", CANNELLONI_LOCAL_PORT);
+    return true;
+}
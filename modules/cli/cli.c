@@ -0,0 +1,112 @@
+// ***************************************************** //
+/// @file cli.c
+/// @brief Serial console. The line editor and the command
+/// parser are portable, the console task is in cli_console.c
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cli.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool cli_line_feed(cli_line_t* line, char c)
+{
+    if (c == '\r' || c == '\n')
+    {
+        bool complete = !line->overflow;
+        line->text[line->len] = '\0';
+        line->len      = 0;
+        line->overflow = false;
+
+        // A CR LF pair ends one line, the LF finds an empty line
+        return complete;
+    }
+
+    if (c == '\b' || c == 0x7F)
+    {
+        if (line->len > 0)
+        {
+            line->len--;
+        }
+        return false;
+    }
+
+    if (line->len + 1 < CLI_MAX_LINE_LEN)
+    {
+        line->text[line->len++] = c;
+    }
+    else
+    {
+        line->overflow = true;
+    }
+    return false;
+}
+
+int cli_tokenize(char* line, char* argv[], int max_args)
+{
+    int argc = 0;
+
+    while (*line != '\0')
+    {
+        while (is_blank(*line))
+        {
+            *line++ = '\0';
+        }
+        if (*line == '\0')
+        {
+            break;
+        }
+
+        if (argc == max_args)
+        {
+            return -1;
+        }
+        argv[argc++] = line;
+
+        while (*line != '\0' && !is_blank(*line))
+        {
+            line++;
+        }
+    }
+
+    return argc;
+}
+
+cli_result_e cli_execute(const cli_command_t* commands, size_t n_commands, char* line)
+{
+    char* argv[CLI_MAX_ARGS];
+    int   argc = cli_tokenize(line, argv, CLI_MAX_ARGS);
+
+    if (argc < 0)
+    {
+        return CLI_TOO_MANY_ARGS;
+    }
+    if (argc == 0)
+    {
+        return CLI_EMPTY;
+    }
+
+    for (size_t i = 0; i < n_commands; i++)
+    {
+        if (strcmp(commands[i].name, argv[0]) == 0)
+        {
+            return commands[i].handler(argc, argv) ? CLI_OK : CLI_FAILED;
+        }
+    }
+
+    return CLI_UNKNOWN;
+}
@@ -0,0 +1,96 @@
+// ***************************************************** //
+/// @file cli.h
+/// @brief Serial console. The line editor and the command
+/// parser are portable, the console task is in cli_console.c
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _CLI_H_
+#define _CLI_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Longest command line, including the terminator
+#define CLI_MAX_LINE_LEN    (64)
+
+/// Arguments of a command, including its name
+#define CLI_MAX_ARGS        (8)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    CLI_OK,
+    CLI_EMPTY,              // Blank line, nothing run
+    CLI_UNKNOWN,            // No command of that name
+    CLI_TOO_MANY_ARGS,
+    CLI_FAILED              // The handler reported an error
+} cli_result_e;
+
+/// @brief Runs a command. argv[0] is the command name
+/// @return true if successful
+typedef bool (*cli_handler_fn)(int argc, char* argv[]);
+
+typedef struct
+{
+    const char*    name;
+    const char*    help;
+    cli_handler_fn handler;
+} cli_command_t;
+
+/// @brief Line being typed
+typedef struct
+{
+    char   text[CLI_MAX_LINE_LEN];
+    size_t len;
+    bool   overflow;        // Characters were lost, the line is discarded
+} cli_line_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Adds a typed character to a line. Backspace removes the
+/// last one, CR or LF ends the line
+/// @param line Line being typed, zeroed before the first character
+/// @param c Character received
+/// @return true once the line is complete, in line->text. The next
+/// character starts a new line
+bool cli_line_feed(cli_line_t* line, char c);
+
+/// @brief Splits a line on blanks, in place
+/// @param line Line, modified
+/// @param argv Output arguments, pointing into line
+/// @param max_args Size of argv
+/// @return Number of arguments, -1 if there are more than max_args
+int cli_tokenize(char* line, char* argv[], int max_args);
+
+/// @brief Parses a line and runs the matching command
+/// @param commands Command table
+/// @param n_commands Number of commands
+/// @param line Line, modified
+/// @return Result of the parse or of the handler
+cli_result_e cli_execute(const cli_command_t* commands, size_t n_commands, char* line);
+
+/// @brief Starts the console task on the console UART
+void cli_start(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _CLI_H_
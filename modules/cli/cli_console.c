@@ -0,0 +1,392 @@
+// ***************************************************** //
+/// @file cli_console.c
+/// @brief Console task on the console UART, and the
+/// diagnostic commands
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cli.h"
+#include "rtos_config.h"
+#include "gateway_config.h"
+#include "application.h"
+#include "counters.h"
+#include "latency.h"
+#include "can_bus.h"
+#include "mcp2515.h"
+#include "mem_budget.h"
+#include "slcan.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define CLI_UART            (CONFIG_ESP_CONSOLE_UART_NUM)
+#define CLI_UART_RX_BUFFER  (256)
+
+/// Tasks listed by top and stack
+#define CLI_MAX_TASKS       (24)
+
+/// Sampling period of top
+#define CLI_TOP_PERIOD_MS   (1000)
+
+static bool cmd_help(int argc, char* argv[]);
+static bool cmd_stats(int argc, char* argv[]);
+static bool cmd_lat(int argc, char* argv[]);
+static bool cmd_top(int argc, char* argv[]);
+static bool cmd_heap(int argc, char* argv[]);
+static bool cmd_stack(int argc, char* argv[]);
+static bool cmd_spi(int argc, char* argv[]);
+static bool cmd_can(int argc, char* argv[]);
+#if SLCAN_ENABLE
+static bool cmd_slcan(int argc, char* argv[]);
+#endif
+
+static const cli_command_t COMMANDS[] =
+{
+    { "help",  "List the commands",                          cmd_help  },
+    { "stats", "Frames/s and drops per stage since last call", cmd_stats },
+    { "lat",   "Latency percentiles per stage",              cmd_lat   },
+    { "top",   "CPU usage per task and core over one second", cmd_top   },
+    { "heap",  "Free, minimum and largest free block",       cmd_heap  },
+    { "stack", "Stack high-water mark per task",             cmd_stack },
+    { "spi",   "SPI transactions/s since last call",         cmd_spi   },
+    { "can",   "Error counters and bus load since last call", cmd_can   },
+#if SLCAN_ENABLE
+    { "slcan", "SLCAN adapter on this UART until reset",     cmd_slcan },
+#endif
+};
+#define N_COMMANDS  (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+/// Previous samples, rates are computed between two calls
+static counters_snapshot_t lastCounters;
+static int64_t             lastCountersUs = 0;
+static uint32_t            lastSpiCount   = 0;
+static int64_t             lastSpiUs      = 0;
+static CAN_stats_t         lastCan;
+static int64_t             lastCanUs      = 0;
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t tasks[CLI_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+static TaskStatus_t tasksBefore[CLI_MAX_TASKS];
+#endif
+#endif
+
+#if SLCAN_ENABLE
+/// Set by the slcan command, the console hands the UART over
+static bool enterSlcan = false;
+#endif
+
+static StackType_t  cliStack[CLI_TASK_STACK_SIZE];
+static StaticTask_t cliTaskBuffer;
+
+#if configUSE_TRACE_FACILITY
+#define CLI_STATIC_BYTES    (sizeof(cliStack) + sizeof(cliTaskBuffer) + sizeof(tasks) * 2)
+#else
+#define CLI_STATIC_BYTES    (sizeof(cliStack) + sizeof(cliTaskBuffer))
+#endif
+_Static_assert(CLI_STATIC_BYTES <= MEM_BUDGET_CLI, "Console exceeds MEM_BUDGET_CLI");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Seconds since a previous sample, and updates it
+static float elapsed_s(int64_t* last_us)
+{
+    int64_t now_us = esp_timer_get_time();
+    float   seconds = (float)(now_us - *last_us) / 1e6f;
+    *last_us = now_us;
+    return (seconds > 0) ? seconds : 1;
+}
+
+static bool cmd_help(int argc, char* argv[])
+{
+    for (size_t i = 0; i < N_COMMANDS; i++)
+    {
+        printf("  %-6s %s\n", COMMANDS[i].name, COMMANDS[i].help);
+    }
+    return true;
+}
+
+static bool cmd_stats(int argc, char* argv[])
+{
+    counters_snapshot_t now;
+    counters_get(&now);
+    float seconds = elapsed_s(&lastCountersUs);
+
+    printf("%-14s %10s %10s %10s\n", "stage", "in/s", "out/s", "dropped");
+    for (int stage = 0; stage < COUNTERS_STAGES; stage++)
+    {
+        uint32_t dropped = 0;
+        for (int reason = 0; reason < DROP_REASONS; reason++)
+        {
+            dropped += now.dropped[stage][reason];
+        }
+
+        printf("%-14s %10.1f %10.1f %10lu\n", counters_stage_name((counters_stage_e)stage),
+               (now.received[stage] - lastCounters.received[stage]) / seconds,
+               (now.forwarded[stage] - lastCounters.forwarded[stage]) / seconds,
+               (unsigned long)dropped);
+
+        for (int reason = 0; reason < DROP_REASONS; reason++)
+        {
+            if (now.dropped[stage][reason] != 0)
+            {
+                printf("  %-12s %lu\n", counters_drop_name((counters_drop_e)reason),
+                       (unsigned long)now.dropped[stage][reason]);
+            }
+        }
+    }
+
+    lastCounters = now;
+    return true;
+}
+
+static bool cmd_lat(int argc, char* argv[])
+{
+#if LATENCY_ENABLE
+    printf("%-18s %8s %8s %8s %8s %8s\n", "stage (us)", "n", "p50", "p90", "p99", "max");
+    for (int stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+        latency_summary_t summary;
+        latency_summarize((latency_stage_e)stage, &summary);
+        printf("%-18s %8lu %8lu %8lu %8lu %8lu\n", latency_stage_name((latency_stage_e)stage),
+               (unsigned long)summary.count, (unsigned long)summary.p50_us,
+               (unsigned long)summary.p90_us, (unsigned long)summary.p99_us,
+               (unsigned long)summary.max_us);
+    }
+    return true;
+#else
+    printf("Latency instrumentation disabled (LATENCY_ENABLE)\n");
+    return false;
+#endif
+}
+
+static bool cmd_top(int argc, char* argv[])
+{
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    uint32_t total_before;
+    uint32_t total;
+    UBaseType_t n_before = uxTaskGetSystemState(tasksBefore, CLI_MAX_TASKS, &total_before);
+    vTaskDelay(pdMS_TO_TICKS(CLI_TOP_PERIOD_MS));
+    UBaseType_t n = uxTaskGetSystemState(tasks, CLI_MAX_TASKS, &total);
+
+    // The total counts the time of one core, tasks of both cores add up
+    uint32_t period = (total - total_before) * portNUM_PROCESSORS;
+    if (period == 0)
+    {
+        return false;
+    }
+
+    uint32_t idle[portNUM_PROCESSORS] = {0};
+
+    printf("%-16s %6s %5s\n", "task", "cpu%", "prio");
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        uint32_t before = 0;
+        for (UBaseType_t j = 0; j < n_before; j++)
+        {
+            if (tasksBefore[j].xHandle == tasks[i].xHandle)
+            {
+                before = tasksBefore[j].ulRunTimeCounter;
+                break;
+            }
+        }
+
+        uint32_t run = tasks[i].ulRunTimeCounter - before;
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if (tasks[i].xHandle == xTaskGetIdleTaskHandleForCPU(core))
+            {
+                idle[core] = run;
+            }
+        }
+
+        printf("%-16s %6.1f %5u\n", tasks[i].pcTaskName,
+               100.0f * (float)run / (float)period,
+               (unsigned)tasks[i].uxCurrentPriority);
+    }
+
+    // Utilization of a core is the time its idle task did not run
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        float busy = 100.0f * (1.0f - (float)idle[core] / (float)(total - total_before));
+        printf("core %d busy %5.1f%%\n", core, (busy > 0) ? busy : 0.0f);
+    }
+    return true;
+#else
+    printf("Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+    return false;
+#endif
+}
+
+static bool cmd_heap(int argc, char* argv[])
+{
+    printf("free=%lu min_free=%lu largest_block=%lu internal_free=%lu\n",
+           (unsigned long)esp_get_free_heap_size(),
+           (unsigned long)esp_get_minimum_free_heap_size(),
+           (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    return true;
+}
+
+static bool cmd_stack(int argc, char* argv[])
+{
+#if configUSE_TRACE_FACILITY
+    UBaseType_t n = uxTaskGetSystemState(tasks, CLI_MAX_TASKS, NULL);
+
+    printf("%-16s %10s\n", "task", "free bytes");
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        printf("%-16s %10lu\n", tasks[i].pcTaskName,
+               (unsigned long)tasks[i].usStackHighWaterMark * sizeof(StackType_t));
+    }
+    return true;
+#else
+    printf("Needs CONFIG_FREERTOS_USE_TRACE_FACILITY\n");
+    return false;
+#endif
+}
+
+static bool cmd_spi(int argc, char* argv[])
+{
+    uint32_t count   = MCP2515_getTransactionCount();
+    float    seconds = elapsed_s(&lastSpiUs);
+
+    printf("transactions=%lu rate=%.1f/s\n", (unsigned long)count, (count - lastSpiCount) / seconds);
+    lastSpiCount = count;
+    return true;
+}
+
+static void read_can_stats(void* arg)
+{
+    CAN_get_stats((CAN_stats_t*)arg);
+}
+
+static bool cmd_can(int argc, char* argv[])
+{
+    CAN_stats_t stats;
+
+    // The controller is only accessed from the application task
+    if (!application_call(read_can_stats, &stats))
+    {
+        printf("Application busy\n");
+        return false;
+    }
+
+    float seconds = elapsed_s(&lastCanUs);
+    float load = 0;
+    if (stats.bitrate > 0)
+    {
+        load = 100.0f * (float)(stats.rx_bits - lastCan.rx_bits) / (seconds * (float)stats.bitrate);
+    }
+
+    printf("bitrate=%lu tec=%u rec=%u eflg=0x%02x\n", (unsigned long)stats.bitrate,
+           stats.tec, stats.rec, stats.error_flags);
+    printf("frames=%lu rate=%.1f/s load=%.1f%% (accepted frames, no stuff bits)\n",
+           (unsigned long)stats.rx_frames, (stats.rx_frames - lastCan.rx_frames) / seconds, load);
+
+    lastCan = stats;
+    return true;
+}
+
+#if SLCAN_ENABLE
+static bool cmd_slcan(int argc, char* argv[])
+{
+    printf("SLCAN at %d baud until reset, e.g. slcand -o -s6 -S %d <tty> can0\n",
+           SLCAN_BAUD_RATE, SLCAN_BAUD_RATE);
+    enterSlcan = true;
+    return true;
+}
+#endif
+
+static void cli_task(void* param)
+{
+    static cli_line_t line;
+
+    uart_driver_install(CLI_UART, CLI_UART_RX_BUFFER, 0, 0, NULL, 0);
+    printf("\nConsole ready, type help\n> ");
+    fflush(stdout);
+
+    while (true)
+    {
+        char c;
+        if (uart_read_bytes(CLI_UART, (uint8_t*)&c, 1, portMAX_DELAY) != 1)
+        {
+            continue;
+        }
+
+        // Echo, so the line can be seen while typed. The LF of a
+        // CR LF pair was already echoed by its CR
+        if (c != '\n')
+        {
+            putchar(c == '\r' ? '\n' : c);
+            fflush(stdout);
+        }
+
+        if (!cli_line_feed(&line, c))
+        {
+            continue;
+        }
+
+        switch (cli_execute(COMMANDS, N_COMMANDS, line.text))
+        {
+            case CLI_UNKNOWN:
+                printf("Unknown command, type help\n");
+                break;
+            case CLI_TOO_MANY_ARGS:
+                printf("Too many arguments\n");
+                break;
+            case CLI_EMPTY:
+                if (c == '\n')
+                {
+                    continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+#if SLCAN_ENABLE
+        if (enterSlcan)
+        {
+            slcan_uart_run(CLI_UART);
+        }
+#endif
+        printf("> ");
+        fflush(stdout);
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void cli_start(void)
+{
+    // Lowest priority of the gateway, it only runs when the
+    // frame path is idle
+    xTaskCreateStaticPinnedToCore(cli_task,
+                                  "cli_task",
+                                  CLI_TASK_STACK_SIZE,
+                                  NULL,
+                                  CLI_TASK_PRIORITY,
+                                  cliStack,
+                                  &cliTaskBuffer,
+                                  CLI_TASK_CORE);
+    mem_budget_account(MEM_CLI, CLI_STATIC_BYTES);
+#if SLCAN_ENABLE
+    mem_budget_account(MEM_SLCAN, SLCAN_STATIC_BYTES);
+#endif
+}
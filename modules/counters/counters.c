@@ -0,0 +1,121 @@
+// ***************************************************** //
+/// @file counters.c
+/// @brief Frame accounting along the uplink path. Every stage
+/// counts what it received, forwarded and dropped, and why
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "counters.h"
+#include "gateway_config.h"
+
+#include "esp_attr.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char* const STAGE_NAMES[COUNTERS_STAGES] =
+{
+    "controller", "events", "pipeline", "publish_queue", "broker",
+};
+
+static const char* const DROP_NAMES[DROP_REASONS] =
+{
+    "overflow", "queue_full", "policy", "unchanged", "offline", "publish_failed",
+};
+
+static counters_snapshot_t counters;
+
+#if GW_CONTEXT_PER_THREAD
+/// Threads counting at once. Threads past it share the common block
+#define COUNTERS_MAX_THREADS    (64)
+
+/// One block per thread, on its own cache lines, so threads on
+/// different cores never write the same line
+typedef struct
+{
+    counters_snapshot_t counters;
+} __attribute__((aligned(64))) counters_block_t;
+
+static counters_block_t blocks[COUNTERS_MAX_THREADS];
+static uint32_t         n_blocks;
+
+static _Thread_local counters_snapshot_t* local;
+#endif
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline counters_snapshot_t* IRAM_ATTR thread_counters(void)
+{
+#if GW_CONTEXT_PER_THREAD
+    if (local == NULL)
+    {
+        uint32_t index = __atomic_fetch_add(&n_blocks, 1, __ATOMIC_RELAXED);
+        local = (index < COUNTERS_MAX_THREADS) ? &blocks[index].counters : &counters;
+    }
+    return local;
+#else
+    return &counters;
+#endif
+}
+
+static void add_block(counters_snapshot_t* snapshot, const counters_snapshot_t* block)
+{
+    for (int stage = 0; stage < COUNTERS_STAGES; stage++)
+    {
+        snapshot->received[stage]  += __atomic_load_n(&block->received[stage], __ATOMIC_RELAXED);
+        snapshot->forwarded[stage] += __atomic_load_n(&block->forwarded[stage], __ATOMIC_RELAXED);
+        for (int reason = 0; reason < DROP_REASONS; reason++)
+        {
+            snapshot->dropped[stage][reason] +=
+                __atomic_load_n(&block->dropped[stage][reason], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void IRAM_ATTR counters_received(counters_stage_e stage, uint32_t n)
+{
+    __atomic_fetch_add(&thread_counters()->received[stage], n, __ATOMIC_RELAXED);
+}
+
+void IRAM_ATTR counters_forwarded(counters_stage_e stage, uint32_t n)
+{
+    __atomic_fetch_add(&thread_counters()->forwarded[stage], n, __ATOMIC_RELAXED);
+}
+
+void IRAM_ATTR counters_dropped(counters_stage_e stage, counters_drop_e reason, uint32_t n)
+{
+    __atomic_fetch_add(&thread_counters()->dropped[stage][reason], n, __ATOMIC_RELAXED);
+}
+
+void counters_get(counters_snapshot_t* snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    add_block(snapshot, &counters);
+
+#if GW_CONTEXT_PER_THREAD
+    uint32_t n = __atomic_load_n(&n_blocks, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < n && i < COUNTERS_MAX_THREADS; i++)
+    {
+        add_block(snapshot, &blocks[i].counters);
+    }
+#endif
+}
+
+const char* counters_stage_name(counters_stage_e stage)
+{
+    return (stage < COUNTERS_STAGES) ? STAGE_NAMES[stage] : "";
+}
+
+const char* counters_drop_name(counters_drop_e reason)
+{
+    return (reason < DROP_REASONS) ? DROP_NAMES[reason] : "";
+}
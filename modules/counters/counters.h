@@ -0,0 +1,87 @@
+// ***************************************************** //
+/// @file counters.h
+/// @brief Frame accounting along the uplink path. Every stage
+/// counts what it received, forwarded and dropped, and why
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    COUNTERS_CONTROLLER,        // Frames read from the CAN controller
+    COUNTERS_EVENTS,            // Events posted to the application queue
+    COUNTERS_PIPELINE,          // Frames through policies, decoding and serialization
+    COUNTERS_PUBLISH_QUEUE,     // Messages submitted to the AWS task
+    COUNTERS_BROKER,            // Messages published to the broker
+    COUNTERS_STAGES
+} counters_stage_e;
+
+typedef enum
+{
+    DROP_OVERFLOW,          // Receive buffer of the controller overrun
+    DROP_QUEUE_FULL,        // No room in a queue
+    DROP_POLICY,            // Filtered or rate limited on purpose
+    DROP_UNCHANGED,         // Suppressed by change-of-value
+    DROP_OFFLINE,           // AWS not connected
+    DROP_PUBLISH_FAILED,    // Not acknowledged after all attempts
+    DROP_REASONS
+} counters_drop_e;
+
+typedef struct
+{
+    uint32_t received[COUNTERS_STAGES];
+    uint32_t forwarded[COUNTERS_STAGES];
+    uint32_t dropped[COUNTERS_STAGES][DROP_REASONS];
+} counters_snapshot_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// Counters are cumulative and updated with atomic adds, without
+/// locks. All of them are safe to call from an ISR. A stage may
+/// receive more than it forwards and drops, e.g. frames absorbed
+/// by a transport session or an aggregation window. With
+/// GW_CONTEXT_PER_THREAD each thread adds to its own block and
+/// counters_get merges them
+
+/// @brief Counts items entering a stage
+void counters_received(counters_stage_e stage, uint32_t n);
+
+/// @brief Counts items handed to the next stage
+void counters_forwarded(counters_stage_e stage, uint32_t n);
+
+/// @brief Counts items lost or discarded by a stage
+void counters_dropped(counters_stage_e stage, counters_drop_e reason, uint32_t n);
+
+/// @brief Copies every counter
+/// @param snapshot Output counters
+void counters_get(counters_snapshot_t* snapshot);
+
+/// @brief Name of a stage, for logs and metrics
+const char* counters_stage_name(counters_stage_e stage);
+
+/// @brief Name of a drop reason, for logs and metrics
+const char* counters_drop_name(counters_drop_e reason);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _COUNTERS_H_
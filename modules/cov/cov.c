@@ -0,0 +1,202 @@
+// ***************************************************** //
+/// @file cov.c
+/// @brief Change-of-value and deadband suppression of
+/// repeated CAN frames and decoded signals
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "cov.h"
+#include "gateway_config.h"
+
+#include <string.h>
+#include <math.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define COV_EMPTY_KEY       (0xFFFFFFFFUL)
+#define COV_HASH_BITS       (8)
+#define COV_MAX_PROBES      (8)
+
+/// Last published content of a CAN ID
+typedef struct
+{
+    uint8_t  data[CAN_MAX_DLEN];
+    uint32_t last_ms;
+    uint8_t  dlc;
+} cov_entry_t;
+
+/// Last published value of a signal from one source
+typedef struct
+{
+    float    value;
+    uint32_t last_ms;
+} cov_signal_t;
+
+/// Stored values and counters of one bus
+struct cov_context
+{
+    // Keys are kept apart from the payloads so that probing the
+    // table only touches a few consecutive words
+    uint32_t    id_keys[COV_MAX_IDS];
+    cov_entry_t id_entries[COV_MAX_IDS];
+
+    // Keyed by signal index and source address
+    uint32_t     sig_keys[COV_MAX_SIGNALS];
+    cov_signal_t sig_entries[COV_MAX_SIGNALS];
+
+    uint32_t   heartbeat;
+    cov_stats_t stats;
+};
+
+GW_CONTEXT(cov_context_t);
+
+_Static_assert((COV_MAX_IDS & (COV_MAX_IDS - 1)) == 0, "COV_MAX_IDS must be a power of two");
+_Static_assert(COV_MAX_IDS == (1 << COV_HASH_BITS), "COV_HASH_BITS does not match COV_MAX_IDS");
+_Static_assert(COV_MAX_SIGNALS == (1 << COV_HASH_BITS), "COV_HASH_BITS does not match COV_MAX_SIGNALS");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline bool heartbeat_expired(uint32_t last_ms, uint32_t now_ms)
+{
+    return (ctx->heartbeat != 0) && ((uint32_t)(now_ms - last_ms) >= ctx->heartbeat);
+}
+
+/// @brief Finds the slot of a key, claiming a free one if needed
+/// @param keys Table of COV_MAX_IDS or COV_MAX_SIGNALS keys
+/// @return Slot index, or -1 if the key is not stored and no slot is free
+static int find_slot(uint32_t keys[], uint32_t key, bool* is_new)
+{
+    uint32_t slot = (uint32_t)(key * 0x9E3779B1UL) >> (32 - COV_HASH_BITS);
+
+    for (int probe = 0; probe < COV_MAX_PROBES; probe++)
+    {
+        if (keys[slot] == key)
+        {
+            *is_new = false;
+            return slot;
+        }
+        if (keys[slot] == COV_EMPTY_KEY)
+        {
+            keys[slot] = key;
+            *is_new = true;
+            return slot;
+        }
+        slot = (slot + 1) & ((1U << COV_HASH_BITS) - 1);
+    }
+
+    return -1;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void cov_init(uint32_t heartbeat_ms)
+{
+    memset(ctx->id_keys, 0xFF, sizeof(ctx->id_keys));
+    memset(ctx->id_entries, 0, sizeof(ctx->id_entries));
+    memset(ctx->sig_keys, 0xFF, sizeof(ctx->sig_keys));
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->heartbeat = heartbeat_ms;
+}
+
+bool cov_frame_changed(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    ctx->stats.seen++;
+
+    bool is_new = false;
+    int slot = find_slot(ctx->id_keys, frame->can_id, &is_new);
+    if (slot < 0)
+    {
+        ctx->stats.untracked++;
+        ctx->stats.published++;
+        return true;
+    }
+
+    cov_entry_t* entry = &ctx->id_entries[slot];
+    if (!is_new
+        && entry->dlc == frame->can_dlc
+        && memcmp(entry->data, frame->data, frame->can_dlc) == 0
+        && !heartbeat_expired(entry->last_ms, now_ms))
+    {
+        ctx->stats.suppressed++;
+        return false;
+    }
+
+    memcpy(entry->data, frame->data, frame->can_dlc);
+    entry->dlc = frame->can_dlc;
+    entry->last_ms = now_ms;
+    ctx->stats.published++;
+    return true;
+}
+
+uint8_t cov_filter_signals(dbc_value_t values[], uint8_t n_values, uint8_t source, uint32_t now_ms)
+{
+    ctx->stats.seen++;
+
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < n_values; i++)
+    {
+        uint16_t idx = values[i].signal;
+        bool is_new = false;
+        int slot = find_slot(ctx->sig_keys, ((uint32_t)idx << 8) | source, &is_new);
+        if (slot < 0)
+        {
+            values[kept++] = values[i];
+            continue;
+        }
+
+        cov_signal_t* entry = &ctx->sig_entries[slot];
+        if (!is_new
+            && fabsf(values[i].value - entry->value) <= DBC_SIGNALS[idx].deadband
+            && !heartbeat_expired(entry->last_ms, now_ms))
+        {
+            continue;
+        }
+
+        entry->value = values[i].value;
+        entry->last_ms = now_ms;
+        values[kept++] = values[i];
+    }
+
+    if (kept == 0 && n_values > 0)
+    {
+        ctx->stats.suppressed++;
+    }
+    else
+    {
+        ctx->stats.published++;
+    }
+
+    return kept;
+}
+
+void cov_get_stats(cov_stats_t* out)
+{
+    *out = ctx->stats;
+}
+
+float cov_suppression_ratio(void)
+{
+    if (ctx->stats.seen == 0)
+    {
+        return 0.0f;
+    }
+    return (float)ctx->stats.suppressed / (float)ctx->stats.seen;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t cov_context_size(void)
+{
+    return sizeof(cov_context_t);
+}
+
+void cov_bind(cov_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
@@ -0,0 +1,97 @@
+// ***************************************************** //
+/// @file cov.h
+/// @brief Change-of-value and deadband suppression of
+/// repeated CAN frames and decoded signals
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _COV_H_
+#define _COV_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+#include "dbc.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Number of CAN IDs tracked. Must be a power of two
+#define COV_MAX_IDS         (256)
+
+/// Number of decoded signals tracked, per DBC signal and source
+/// address. Must be a power of two
+#define COV_MAX_SIGNALS     (256)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct cov_context cov_context_t;
+
+typedef struct
+{
+    uint32_t seen;          // Frames offered to the filter
+    uint32_t published;     // Frames that passed
+    uint32_t suppressed;    // Frames dropped as unchanged
+    uint32_t untracked;     // Frames passed because the table was full
+} cov_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Clears all stored values and statistics
+/// @param heartbeat_ms Maximum time an unchanged value is held
+/// back before it is published again. 0 disables the heartbeat
+void cov_init(uint32_t heartbeat_ms);
+
+/// @brief Compares a raw frame against the last published content
+/// of its CAN ID. Updates the stored content when it passes
+/// @param frame Received CAN frame
+/// @param now_ms Current time in milliseconds
+/// @return true if the frame should be published
+bool cov_frame_changed(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Removes decoded values that did not move beyond their
+/// deadband since last published. Values are compacted in place
+/// and the stored values of the remaining ones are updated
+/// @param values Values returned by dbc_decode
+/// @param n_values Number of values
+/// @param source Source address of a J1939 message, so that each
+/// sender of a PGN keeps its own values. 0 for other messages
+/// @param now_ms Current time in milliseconds
+/// @return Number of values left. 0 means the frame is suppressed
+uint8_t cov_filter_signals(dbc_value_t values[], uint8_t n_values, uint8_t source, uint32_t now_ms);
+
+/// @brief Copies the suppression counters
+/// @param stats Output statistics
+void cov_get_stats(cov_stats_t* stats);
+
+/// @brief Ratio of suppressed frames to frames seen
+/// @return Value between 0 and 1
+float cov_suppression_ratio(void);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t cov_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by cov_init once bound
+/// @param context Context, NULL for the static one
+void cov_bind(cov_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _COV_H_
@@ -0,0 +1,118 @@
+// ***************************************************** //
+/// @file dbc.c
+/// @brief Decodes CAN frames into engineering values using
+/// signal tables generated from a DBC file at build time
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "dbc.h"
+
+#include <stddef.h>
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+
+/// @brief Packs the payload in Intel order. Bytes beyond the DLC are zero
+static inline uint64_t payload_le(const CAN_frame_t* frame)
+{
+    uint64_t word = 0;
+    for (int i = frame->can_dlc - 1; i >= 0; i--)
+    {
+        word = (word << 8) | frame->data[i];
+    }
+    return word;
+}
+
+/// @brief Packs the payload in Motorola order. Bytes beyond the DLC are zero
+static inline uint64_t payload_be(const CAN_frame_t* frame)
+{
+    uint64_t word = 0;
+    for (int i = 0; i < CAN_MAX_DLEN; i++)
+    {
+        word = (word << 8) | ((i < frame->can_dlc) ? frame->data[i] : 0);
+    }
+    return word;
+}
+
+static inline int64_t extract(const dbc_signal_t* sig, uint64_t le, uint64_t be)
+{
+    uint64_t raw = ((sig->byte_order == DBC_LITTLE_ENDIAN) ? le : be) >> sig->shift;
+    raw &= sig->mask;
+
+    if (sig->is_signed && (raw >> (sig->length - 1)) & 1U)
+    {
+        raw |= ~sig->mask;
+    }
+
+    return (int64_t)raw;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+const dbc_message_t* dbc_find_message(uint32_t can_id)
+{
+    can_id &= (CAN_EFF_FLAG | CAN_EFF_MASK);
+
+    uint32_t slot = (uint32_t)(can_id * DBC_HASH_SEED) >> (32 - DBC_HASH_BITS);
+    uint16_t idx = DBC_HASH_TABLE[slot];
+
+    if (idx == DBC_HASH_EMPTY || DBC_MESSAGES[idx].can_id != can_id)
+    {
+        return NULL;
+    }
+
+    return &DBC_MESSAGES[idx];
+}
+
+const dbc_message_t* dbc_find_message_pgn(uint32_t pgn)
+{
+    return dbc_find_message(CAN_EFF_FLAG | ((pgn & 0x3FFFFUL) << 8));
+}
+
+int64_t dbc_extract_raw(const dbc_signal_t* sig, const CAN_frame_t* frame)
+{
+    uint64_t le = (sig->byte_order == DBC_LITTLE_ENDIAN) ? payload_le(frame) : 0;
+    uint64_t be = (sig->byte_order == DBC_BIG_ENDIAN) ? payload_be(frame) : 0;
+
+    return extract(sig, le, be);
+}
+
+uint8_t dbc_decode(const dbc_message_t* msg,
+                   const CAN_frame_t* frame,
+                   dbc_value_t values[],
+                   uint8_t max_values)
+{
+    const uint64_t le = payload_le(frame);
+    const uint64_t be = payload_be(frame);
+    const dbc_signal_t* signals = &DBC_SIGNALS[msg->first_signal];
+
+    // Resolve the multiplexor first so multiplexed signals can be skipped
+    int64_t mux = -1;
+    if (msg->mux_signal >= 0)
+    {
+        mux = extract(&signals[msg->mux_signal], le, be);
+    }
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < msg->num_signals && count < max_values; i++)
+    {
+        const dbc_signal_t* sig = &signals[i];
+
+        if (sig->mux_type == DBC_MUX_VALUE && sig->mux_value != mux)
+        {
+            continue;
+        }
+
+        int64_t raw = extract(sig, le, be);
+        values[count].signal = msg->first_signal + i;
+        values[count].value  = (float)raw * sig->factor + sig->offset;
+        count++;
+    }
+
+    return count;
+}
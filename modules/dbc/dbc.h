@@ -0,0 +1,140 @@
+// ***************************************************** //
+/// @file dbc.h
+/// @brief Decodes CAN frames into engineering values using
+/// signal tables generated from a DBC file at build time
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _DBC_H_
+#define _DBC_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Maximum number of signals a single message may define
+#define DBC_MAX_SIGNALS_PER_MSG     (64)
+
+/// Marks an empty slot in the message hash table
+#define DBC_HASH_EMPTY              (0xFFFF)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    DBC_LITTLE_ENDIAN = 0,  // Intel byte order
+    DBC_BIG_ENDIAN    = 1   // Motorola byte order
+} dbc_byte_order_e;
+
+typedef enum
+{
+    DBC_MUX_NONE   = 0,     // Plain signal, always present
+    DBC_MUX_SWITCH = 1,     // Multiplexor signal of the message
+    DBC_MUX_VALUE  = 2      // Only present when switch == mux_value
+} dbc_mux_type_e;
+
+/// @brief Signal descriptor. The shift and mask are precomputed by
+/// the generator so extraction is a single shift-and-mask over the
+/// 64-bit payload word in the signal's byte order.
+typedef struct
+{
+    const char* name;
+    const char* unit;
+    uint64_t    mask;       // (1 << length) - 1
+    float       factor;
+    float       offset;
+    float       deadband;   // Minimum change worth publishing (GwDeadband)
+    uint16_t    mux_value;
+    uint8_t     shift;      // Position of the LSB inside the payload word
+    uint8_t     length;
+    uint8_t     byte_order; // dbc_byte_order_e
+    uint8_t     is_signed;
+    uint8_t     mux_type;   // dbc_mux_type_e
+} dbc_signal_t;
+
+/// @brief Message descriptor. Signals of a message are stored
+/// contiguously in DBC_SIGNALS starting at first_signal
+typedef struct
+{
+    uint32_t    can_id;         // Including CAN_EFF_FLAG for extended IDs. For
+                                // J1939 messages CAN_EFF_FLAG | (PGN << 8)
+    const char* name;
+    uint16_t    first_signal;
+    uint8_t     num_signals;
+    uint8_t     dlc;
+    int8_t      mux_signal;     // Index inside the message, -1 if none
+    uint8_t     is_j1939;       // Keyed on its PGN, any source address
+} dbc_message_t;
+
+/// @brief A single decoded signal
+typedef struct
+{
+    uint16_t signal;            // Index into DBC_SIGNALS
+    float    value;             // Engineering value (raw * factor + offset)
+} dbc_value_t;
+
+// --------------------------------------------------------
+// Generated tables (see tools/dbc2c.py)
+// --------------------------------------------------------
+extern const dbc_signal_t  DBC_SIGNALS[];
+extern const dbc_message_t DBC_MESSAGES[];
+extern const uint16_t      DBC_NUM_SIGNALS;
+extern const uint16_t      DBC_NUM_MESSAGES;
+
+/// Perfect hash over the message IDs: slot = (id * seed) >> (32 - bits)
+extern const uint16_t      DBC_HASH_TABLE[];
+extern const uint32_t      DBC_HASH_SEED;
+extern const uint8_t       DBC_HASH_BITS;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Looks up the message descriptor of a CAN ID in O(1)
+/// @param can_id CAN identifier including the EFF flag. RTR and
+/// ERR flags are ignored
+/// @return Message descriptor, or NULL if the ID is not in the DBC
+const dbc_message_t* dbc_find_message(uint32_t can_id);
+
+/// @brief Looks up the descriptor of a J1939 parameter group in
+/// O(1), whatever the source address and priority of the frame
+/// @param pgn 18-bit parameter group number
+/// @return Message descriptor, or NULL if the PGN is not in the DBC
+/// or not marked with the J1939PG frame format
+const dbc_message_t* dbc_find_message_pgn(uint32_t pgn);
+
+/// @brief Extracts all signals of a message present in the frame.
+/// Multiplexed signals are only reported when the multiplexor
+/// selects them
+/// @param msg Message descriptor returned by dbc_find_message
+/// @param frame Received CAN frame
+/// @param values Output array of decoded values
+/// @param max_values Capacity of values
+/// @return Number of values written
+uint8_t dbc_decode(const dbc_message_t* msg,
+                   const CAN_frame_t* frame,
+                   dbc_value_t values[],
+                   uint8_t max_values);
+
+/// @brief Extracts the raw (unscaled) value of a single signal
+/// @param sig Signal descriptor
+/// @param frame Received CAN frame
+/// @return Raw value, sign-extended for signed signals
+int64_t dbc_extract_raw(const dbc_signal_t* sig, const CAN_frame_t* frame);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _DBC_H_
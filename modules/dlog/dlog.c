@@ -0,0 +1,183 @@
+// ***************************************************** //
+/// @file dlog.c
+/// @brief Deferred logging. Log sites store the format string
+/// and raw arguments in a lock-free ring, a low priority task
+/// formats and prints them
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "dlog.h"
+#include "rtos_config.h"
+#include "mem_budget.h"
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Idle time of the task between two drains of the ring
+#define DLOG_DRAIN_PERIOD_MS    (20)
+
+static const char* TAG = "DLOG";
+
+_Static_assert((DLOG_SLOTS & (DLOG_SLOTS - 1)) == 0, "DLOG_SLOTS must be a power of two");
+
+typedef struct
+{
+    uint64_t    time_us;
+    uint32_t    seq;        // Position + 1 when written, + DLOG_SLOTS when read
+    const char* tag;
+    const char* format;
+    uintptr_t   args[DLOG_MAX_ARGS];
+    uint8_t     level;
+} dlog_record_t;
+
+static const char LEVEL_CHARS[] = "?EWID";
+
+/// Bounded multi-producer queue, a slot is claimed by moving the
+/// head and published by its sequence number. The task is the only
+/// consumer
+static dlog_record_t ring[DLOG_SLOTS];
+static uint32_t      head    = 0;
+static uint32_t      tail    = 0;
+static uint32_t      dropped = 0;
+static bool          muted   = false;
+
+static StackType_t  dlogStack[DLOG_TASK_STACK_SIZE];
+static StaticTask_t dlogTaskBuffer;
+
+#define DLOG_STATIC_BYTES   (sizeof(ring) + sizeof(dlogStack) + sizeof(dlogTaskBuffer))
+_Static_assert(DLOG_STATIC_BYTES <= MEM_BUDGET_LOG, "Deferred log exceeds MEM_BUDGET_LOG");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool read_record(dlog_record_t* out)
+{
+    dlog_record_t* record = &ring[tail & (DLOG_SLOTS - 1)];
+    if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != tail + 1)
+    {
+        return false;
+    }
+
+    *out = *record;
+    __atomic_store_n(&record->seq, tail + DLOG_SLOTS, __ATOMIC_RELEASE);
+    tail++;
+    return true;
+}
+
+static void dlog_task(void* param)
+{
+    (void)param;
+    dlog_record_t record;
+    uint32_t      reported_drops = 0;
+
+    while (true)
+    {
+        bool quiet = __atomic_load_n(&muted, __ATOMIC_RELAXED);
+
+        while (read_record(&record))
+        {
+            if (quiet)
+            {
+                continue;
+            }
+            printf("%c (%lu) %s: ", LEVEL_CHARS[record.level],
+                   (unsigned long)(record.time_us / 1000), record.tag);
+            printf(record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+            putchar('\n');
+        }
+
+        uint32_t drops = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if (drops != reported_drops && !quiet)
+        {
+            ESP_LOGW(TAG, "%lu records lost, ring full", (unsigned long)(drops - reported_drops));
+            reported_drops = drops;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_PERIOD_MS));
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void dlog_start(void)
+{
+    for (uint32_t i = 0; i < DLOG_SLOTS; i++)
+    {
+        ring[i].seq = i;
+    }
+    head = 0;
+    tail = 0;
+
+    xTaskCreateStaticPinnedToCore(dlog_task,
+                                  "dlog_task",
+                                  DLOG_TASK_STACK_SIZE,
+                                  NULL,
+                                  DLOG_TASK_PRIORITY,
+                                  dlogStack,
+                                  &dlogTaskBuffer,
+                                  DLOG_TASK_CORE);
+    mem_budget_account(MEM_LOG, DLOG_STATIC_BYTES);
+}
+
+void IRAM_ATTR dlog_write(uint8_t level, const char* tag, const char* format,
+                          uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3)
+{
+    uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+    while (true)
+    {
+        dlog_record_t* record = &ring[pos & (DLOG_SLOTS - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0)
+        {
+            // Free slot, claim it unless another writer was faster
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                record->time_us = (uint64_t)esp_timer_get_time();
+                record->tag     = tag;
+                record->format  = format;
+                record->level   = (level <= DLOG_LEVEL_DEBUG) ? level : 0;
+                record->args[0] = a0;
+                record->args[1] = a1;
+                record->args[2] = a2;
+                record->args[3] = a3;
+                __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+                return;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Not read yet, the ring is full
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+uint32_t dlog_get_dropped(void)
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+void dlog_set_muted(bool mute)
+{
+    __atomic_store_n(&muted, mute, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,119 @@
+// ***************************************************** //
+/// @file dlog.h
+/// @brief Deferred logging. Log sites store the format string
+/// and raw arguments in a lock-free ring, a low priority task
+/// formats and prints them
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _DLOG_H_
+#define _DLOG_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "gateway_config.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+#define DLOG_LEVEL_NONE     (0)
+#define DLOG_LEVEL_ERROR    (1)
+#define DLOG_LEVEL_WARN     (2)
+#define DLOG_LEVEL_INFO     (3)
+#define DLOG_LEVEL_DEBUG    (4)
+
+/// Arguments per log site
+#define DLOG_MAX_ARGS       (4)
+
+// --------------------------------------------------------
+// Macros
+// --------------------------------------------------------
+/// Arguments are stored as words and printed when the record is
+/// drained. Only integers, pointers and strings that outlive the
+/// record, e.g. literals, may be passed. Floats and 64-bit values
+/// are not supported. The dead printf only checks the format
+#define DLOG_NARGS(...)             DLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define DLOG_CAT(a, b)              DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b)             a##b
+#define DLOG_ARGS_0()               0, 0, 0, 0
+#define DLOG_ARGS_1(a)              (uintptr_t)(a), 0, 0, 0
+#define DLOG_ARGS_2(a, b)           (uintptr_t)(a), (uintptr_t)(b), 0, 0
+#define DLOG_ARGS_3(a, b, c)        (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), 0
+#define DLOG_ARGS_4(a, b, c, d)     (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d)
+
+#define DLOG_WRITE(level, tag, format, ...)                                         \
+    do                                                                              \
+    {                                                                               \
+        if (0)                                                                      \
+        {                                                                           \
+            printf(format, ##__VA_ARGS__);                                          \
+        }                                                                           \
+        dlog_write(level, tag, format,                                              \
+                   DLOG_CAT(DLOG_ARGS_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__));     \
+    } while (0)
+
+/// Sites above DLOG_LEVEL are removed at compile time
+#if DLOG_LEVEL >= DLOG_LEVEL_ERROR
+#define DLOG_E(tag, format, ...)    DLOG_WRITE(DLOG_LEVEL_ERROR, tag, format, ##__VA_ARGS__)
+#else
+#define DLOG_E(tag, format, ...)    do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_WARN
+#define DLOG_W(tag, format, ...)    DLOG_WRITE(DLOG_LEVEL_WARN, tag, format, ##__VA_ARGS__)
+#else
+#define DLOG_W(tag, format, ...)    do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_INFO
+#define DLOG_I(tag, format, ...)    DLOG_WRITE(DLOG_LEVEL_INFO, tag, format, ##__VA_ARGS__)
+#else
+#define DLOG_I(tag, format, ...)    do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_DEBUG
+#define DLOG_D(tag, format, ...)    DLOG_WRITE(DLOG_LEVEL_DEBUG, tag, format, ##__VA_ARGS__)
+#else
+#define DLOG_D(tag, format, ...)    do {} while (0)
+#endif
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Clears the ring and starts the task that prints it. Must
+/// be called before the first log
+void dlog_start(void);
+
+/// @brief Stores a record, use the DLOG_x macros instead. Never
+/// blocks, the record is dropped if the ring is full. Safe to call
+/// from any task or interrupt, on either core
+/// @param level DLOG_LEVEL_x
+/// @param tag Module name, must outlive the record
+/// @param format printf format, must outlive the record
+void dlog_write(uint8_t level, const char* tag, const char* format,
+                uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3);
+
+/// @brief Records dropped because the ring was full
+uint32_t dlog_get_dropped(void);
+
+/// @brief Discards the records instead of printing them, while the
+/// console UART carries another protocol
+/// @param mute true to discard, false to print again
+void dlog_set_muted(bool mute);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _DLOG_H_
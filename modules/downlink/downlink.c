@@ -0,0 +1,438 @@
+// ***************************************************** //
+/// @file downlink.c
+/// @brief Cloud to CAN commands. Payloads are copied once
+/// into pooled buffers and parsed in place into CAN frames
+/// @version 0.1
+// ***************************************************** //
+
+/// Two command formats are accepted on the subscribed topic.
+///
+/// JSON, keys in any order, unknown keys ignored:
+///   {"cmd": "42", "frames": [{"id": 291, "data": "01 02 03"},
+///                            {"id": "0x18FEF100", "ext": true, "data": "ff"},
+///                            {"id": 512, "rtr": true, "dlc": 8}]}
+/// IDs above 0x7FF are sent as extended frames even without "ext".
+///
+/// Binary, little endian:
+///   0xCA | version | cmd_len | cmd[cmd_len] | frames...
+///   frame = can_id (u32, with CAN_EFF_FLAG/CAN_RTR_FLAG) | dlc (u8) | data[dlc]
+/// Remote frames carry no data bytes.
+///
+/// Cannelloni data packets, big endian, see cannelloni.h:
+///   0x02 | op_code 0 | seq_no | count (u16) | frames...
+///   frame = can_id (u32, with CAN_EFF_FLAG/CAN_RTR_FLAG) | len (u8) | data[len]
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "downlink.h"
+#include "json_scan.h"
+#include "cannelloni.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define BINARY_HEADER_LEN       (3)
+#define BINARY_FRAME_HEADER_LEN (5)
+
+static downlink_buffer_t buffers[DOWNLINK_POOL_SIZE];
+static uint32_t          free_mask;     // Bit i set when buffers[i] is free
+static downlink_stats_t  stats;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static int hex_value(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/// @brief Decodes hex bytes, optionally separated by spaces as in
+/// the uplink messages
+static bool parse_hex_data(const uint8_t* str, uint16_t len, uint8_t data[CAN_MAX_DLEN], uint8_t* dlc)
+{
+    uint8_t count = 0;
+    uint16_t i = 0;
+
+    while (i < len)
+    {
+        if (str[i] == ' ' || str[i] == ':' || str[i] == '-')
+        {
+            i++;
+            continue;
+        }
+
+        int high = hex_value(str[i]);
+        int low  = (i + 1 < len) ? hex_value(str[i + 1]) : -1;
+        if (high < 0 || low < 0 || count >= CAN_MAX_DLEN)
+        {
+            return false;
+        }
+
+        data[count++] = (uint8_t)((high << 4) | low);
+        i += 2;
+    }
+
+    *dlc = count;
+    return true;
+}
+
+static bool begin_json(downlink_iter_t* iter, const uint8_t* p, const uint8_t* end)
+{
+    const uint8_t* frames = NULL;
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+
+    p = json_enter(p, end, '{');
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    while ((status = json_next_member(&p, end, &key, &key_len)) == JSON_OK)
+    {
+        const uint8_t* value = p;
+        p = json_skip_value(p, end);
+        if (p == NULL)
+        {
+            return false;
+        }
+
+        if (json_key_is(key, key_len, "cmd"))
+        {
+            const uint8_t* str = value;
+            uint16_t len = (uint16_t)(p - value);
+            if (*value == '"')
+            {
+                json_string(value, end, &str, &len);
+            }
+            iter->cmd_id     = (const char*)str;
+            iter->cmd_id_len = (len > DOWNLINK_MAX_CMD_ID_LEN) ? DOWNLINK_MAX_CMD_ID_LEN : (uint8_t)len;
+        }
+        else if (json_key_is(key, key_len, "frames"))
+        {
+            frames = json_enter(value, end, '[');
+        }
+    }
+
+    if (status == JSON_ERROR || frames == NULL)
+    {
+        return false;
+    }
+
+    iter->cursor = frames;
+    iter->end    = end;
+    iter->format = DOWNLINK_FORMAT_JSON;
+    return true;
+}
+
+static downlink_status_e next_json(downlink_iter_t* iter, CAN_frame_t* frame)
+{
+    const uint8_t* p   = iter->cursor;
+    const uint8_t* end = iter->end;
+
+    json_status_e status = json_next_item(&p, end);
+    if (status != JSON_OK)
+    {
+        // Stay on the closing bracket so later calls end too
+        return (status == JSON_END) ? DOWNLINK_END : DOWNLINK_ERROR;
+    }
+
+    p = json_enter(p, end, '{');
+    if (p == NULL)
+    {
+        return DOWNLINK_ERROR;
+    }
+
+    uint32_t id      = 0;
+    uint32_t dlc     = 0;
+    bool     has_id  = false;
+    bool     has_dlc = false;
+    bool     ext     = false;
+    bool     rtr     = false;
+    uint8_t  n_data  = 0;
+
+    const uint8_t* key;
+    uint16_t key_len;
+    while ((status = json_next_member(&p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "id"))
+        {
+            p = json_uint(p, end, &id);
+            has_id = true;
+        }
+        else if (json_key_is(key, key_len, "dlc"))
+        {
+            p = json_uint(p, end, &dlc);
+            has_dlc = true;
+        }
+        else if (json_key_is(key, key_len, "ext"))
+        {
+            p = json_bool(p, end, &ext);
+        }
+        else if (json_key_is(key, key_len, "rtr"))
+        {
+            p = json_bool(p, end, &rtr);
+        }
+        else if (json_key_is(key, key_len, "data"))
+        {
+            const uint8_t* str;
+            uint16_t len;
+            p = json_string(p, end, &str, &len);
+            if (p != NULL && !parse_hex_data(str, len, frame->data, &n_data))
+            {
+                p = NULL;
+            }
+        }
+        else
+        {
+            p = json_skip_value(p, end);
+        }
+
+        if (p == NULL)
+        {
+            return DOWNLINK_ERROR;
+        }
+    }
+
+    if (status == JSON_ERROR || !has_id || id > CAN_EFF_MASK || (has_dlc && dlc > CAN_MAX_DLEN))
+    {
+        return DOWNLINK_ERROR;
+    }
+    if (id > CAN_SFF_MASK)
+    {
+        ext = true;
+    }
+
+    frame->can_id  = id | (ext ? CAN_EFF_FLAG : 0) | (rtr ? CAN_RTR_FLAG : 0);
+    frame->can_dlc = (rtr && has_dlc) ? (uint8_t)dlc : n_data;
+
+    iter->cursor = p;
+    iter->frames++;
+    return DOWNLINK_FRAME;
+}
+
+static bool begin_binary(downlink_iter_t* iter, const uint8_t* p, const uint8_t* end)
+{
+    if (end - p < BINARY_HEADER_LEN || p[1] != DOWNLINK_BINARY_VERSION)
+    {
+        return false;
+    }
+
+    uint8_t cmd_len = p[2];
+    if (end - p < BINARY_HEADER_LEN + cmd_len || cmd_len > DOWNLINK_MAX_CMD_ID_LEN)
+    {
+        return false;
+    }
+
+    iter->cmd_id     = (const char*)&p[BINARY_HEADER_LEN];
+    iter->cmd_id_len = cmd_len;
+    iter->cursor     = &p[BINARY_HEADER_LEN + cmd_len];
+    iter->end        = end;
+    iter->format     = DOWNLINK_FORMAT_BINARY;
+    return true;
+}
+
+static downlink_status_e next_binary(downlink_iter_t* iter, CAN_frame_t* frame)
+{
+    const uint8_t* p = iter->cursor;
+
+    if (p == iter->end)
+    {
+        return DOWNLINK_END;
+    }
+    if (iter->end - p < BINARY_FRAME_HEADER_LEN)
+    {
+        return DOWNLINK_ERROR;
+    }
+
+    uint32_t can_id = (uint32_t)p[0]
+                    | ((uint32_t)p[1] << 8)
+                    | ((uint32_t)p[2] << 16)
+                    | ((uint32_t)p[3] << 24);
+    uint8_t dlc = p[4];
+    uint8_t n_data = (can_id & CAN_RTR_FLAG) ? 0 : dlc;
+
+    if (dlc > CAN_MAX_DLEN || (can_id & CAN_ERR_FLAG)
+        || iter->end - p < BINARY_FRAME_HEADER_LEN + n_data)
+    {
+        return DOWNLINK_ERROR;
+    }
+    if (!(can_id & CAN_EFF_FLAG) && (can_id & CAN_EFF_MASK) > CAN_SFF_MASK)
+    {
+        return DOWNLINK_ERROR;
+    }
+
+    frame->can_id  = can_id;
+    frame->can_dlc = dlc;
+    memcpy(frame->data, &p[BINARY_FRAME_HEADER_LEN], n_data);
+
+    iter->cursor = p + BINARY_FRAME_HEADER_LEN + n_data;
+    iter->frames++;
+    return DOWNLINK_FRAME;
+}
+
+static bool begin_cannelloni(downlink_iter_t* iter, const uint8_t* p, const uint8_t* end)
+{
+    if (end - p < CANNELLONI_HEADER_LEN || p[1] != CANNELLONI_OP_DATA)
+    {
+        return false;
+    }
+
+    iter->count  = (uint16_t)((p[3] << 8) | p[4]);
+    iter->cursor = &p[CANNELLONI_HEADER_LEN];
+    iter->end    = end;
+    iter->format = DOWNLINK_FORMAT_CANNELLONI;
+    return true;
+}
+
+static downlink_status_e next_cannelloni(downlink_iter_t* iter, CAN_frame_t* frame)
+{
+    const uint8_t* p = iter->cursor;
+
+    // The count is checked too, a truncated packet must not pass
+    if (iter->frames == iter->count)
+    {
+        return (p == iter->end) ? DOWNLINK_END : DOWNLINK_ERROR;
+    }
+    if (iter->end - p < CANNELLONI_FRAME_HEADER_LEN)
+    {
+        return DOWNLINK_ERROR;
+    }
+
+    uint32_t can_id = ((uint32_t)p[0] << 24)
+                    | ((uint32_t)p[1] << 16)
+                    | ((uint32_t)p[2] << 8)
+                    | (uint32_t)p[3];
+    uint8_t len = p[4];
+    uint8_t n_data = (can_id & CAN_RTR_FLAG) ? 0 : len;
+
+    // CAN FD frames, flagged in the length, cannot be sent
+    if (len > CAN_MAX_DLEN || (can_id & CAN_ERR_FLAG)
+        || iter->end - p < CANNELLONI_FRAME_HEADER_LEN + n_data)
+    {
+        return DOWNLINK_ERROR;
+    }
+    if (!(can_id & CAN_EFF_FLAG) && (can_id & CAN_EFF_MASK) > CAN_SFF_MASK)
+    {
+        return DOWNLINK_ERROR;
+    }
+
+    frame->can_id  = can_id;
+    frame->can_dlc = len;
+    memcpy(frame->data, &p[CANNELLONI_FRAME_HEADER_LEN], n_data);
+
+    iter->cursor = p + CANNELLONI_FRAME_HEADER_LEN + n_data;
+    iter->frames++;
+    return DOWNLINK_FRAME;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void downlink_init(void)
+{
+    __atomic_store_n(&free_mask, (uint32_t)((1ULL << DOWNLINK_POOL_SIZE) - 1), __ATOMIC_RELEASE);
+    memset(&stats, 0, sizeof(stats));
+    stats.latency_min_us = UINT32_MAX;
+}
+
+downlink_buffer_t* downlink_acquire(void)
+{
+    uint32_t mask = __atomic_load_n(&free_mask, __ATOMIC_ACQUIRE);
+
+    // Lock free so the MQTT task never waits on the application
+    while (mask != 0)
+    {
+        uint32_t bit = mask & (~mask + 1);
+        if (__atomic_compare_exchange_n(&free_mask, &mask, mask & ~bit, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return &buffers[__builtin_ctz(bit)];
+        }
+    }
+
+    __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void downlink_release(downlink_buffer_t* buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    uint32_t index = (uint32_t)(buffer - buffers);
+    __atomic_fetch_or(&free_mask, 1UL << index, __ATOMIC_RELEASE);
+}
+
+bool downlink_begin(downlink_iter_t* iter, const uint8_t* payload, uint16_t length)
+{
+    memset(iter, 0, sizeof(*iter));
+    iter->cmd_id = "";
+
+    if (length == 0)
+    {
+        return false;
+    }
+
+    if (payload[0] == DOWNLINK_BINARY_MAGIC)
+    {
+        return begin_binary(iter, payload, payload + length);
+    }
+    if (payload[0] == CANNELLONI_VERSION)
+    {
+        return begin_cannelloni(iter, payload, payload + length);
+    }
+
+    return begin_json(iter, payload, payload + length);
+}
+
+downlink_status_e downlink_next(downlink_iter_t* iter, CAN_frame_t* frame)
+{
+    if (iter->format == DOWNLINK_FORMAT_BINARY)
+    {
+        return next_binary(iter, frame);
+    }
+    if (iter->format == DOWNLINK_FORMAT_CANNELLONI)
+    {
+        return next_cannelloni(iter, frame);
+    }
+
+    return next_json(iter, frame);
+}
+
+void downlink_record(uint16_t frames, bool ok, uint32_t latency_us)
+{
+    stats.frames += frames;
+    if (!ok)
+    {
+        stats.errors++;
+        return;
+    }
+
+    stats.commands++;
+    stats.latency_sum_us += latency_us;
+    if (latency_us < stats.latency_min_us)
+    {
+        stats.latency_min_us = latency_us;
+    }
+    if (latency_us > stats.latency_max_us)
+    {
+        stats.latency_max_us = latency_us;
+    }
+}
+
+void downlink_get_stats(downlink_stats_t* out)
+{
+    *out = stats;
+    out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+}
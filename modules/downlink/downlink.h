@@ -0,0 +1,136 @@
+// ***************************************************** //
+/// @file downlink.h
+/// @brief Cloud to CAN commands. Payloads are copied once
+/// into pooled buffers and parsed in place into CAN frames
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _DOWNLINK_H_
+#define _DOWNLINK_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Largest command payload. A binary command of this size
+/// carries about 300 frames, a JSON command about 80
+#define DOWNLINK_MAX_PAYLOAD        (4096)
+
+/// Number of payload buffers, i.e. commands waiting for the
+/// transmit path. At most 32
+#define DOWNLINK_POOL_SIZE          (4)
+
+/// First byte of a binary command. JSON payloads start with
+/// '{' or whitespace and cannelloni packets with their version,
+/// 0x02, so the formats cannot be confused
+#define DOWNLINK_BINARY_MAGIC       (0xCA)
+#define DOWNLINK_BINARY_VERSION     (0x01)
+
+/// Longest command identifier echoed in acknowledgements
+#define DOWNLINK_MAX_CMD_ID_LEN     (32)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief A received command. Owned by whoever acquired it
+/// until downlink_release is called
+typedef struct
+{
+    uint8_t  data[DOWNLINK_MAX_PAYLOAD];
+    uint16_t length;
+    uint32_t received_us;   // Arrival time, for the command latency
+} downlink_buffer_t;
+
+typedef enum
+{
+    DOWNLINK_FORMAT_JSON,
+    DOWNLINK_FORMAT_BINARY,
+    DOWNLINK_FORMAT_CANNELLONI
+} downlink_format_e;
+
+typedef enum
+{
+    DOWNLINK_FRAME,         // A frame was returned
+    DOWNLINK_END,           // All frames of the command were returned
+    DOWNLINK_ERROR          // Malformed frame, the rest of the command is ignored
+} downlink_status_e;
+
+/// @brief Parser state. The command identifier points into the
+/// payload buffer and is not null terminated
+typedef struct
+{
+    const uint8_t* cursor;
+    const uint8_t* end;
+    const char*    cmd_id;
+    uint8_t        cmd_id_len;
+    uint8_t        format;  // downlink_format_e
+    uint16_t       frames;  // Frames returned so far
+    uint16_t       count;   // Frames announced, cannelloni only
+} downlink_iter_t;
+
+typedef struct
+{
+    uint32_t commands;      // Commands fully transmitted
+    uint32_t frames;        // Frames handed to the controller
+    uint32_t errors;        // Malformed commands and transmit timeouts
+    uint32_t dropped;       // Commands lost for lack of buffers
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+} downlink_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Returns all buffers to the pool and clears the counters
+void downlink_init(void);
+
+/// @brief Takes a free buffer. Safe to call from any task
+/// @return Buffer, or NULL if all buffers are in use
+downlink_buffer_t* downlink_acquire(void);
+
+/// @brief Returns a buffer to the pool. Safe to call from any task
+/// @param buffer Buffer returned by downlink_acquire
+void downlink_release(downlink_buffer_t* buffer);
+
+/// @brief Detects the format of a command and locates its frames.
+/// Nothing is copied, the iterator points into the payload
+/// @param iter Parser state to initialize
+/// @param payload Command payload, JSON, binary or cannelloni
+/// @param length Payload length in bytes
+/// @return false if the payload is not a valid command
+bool downlink_begin(downlink_iter_t* iter, const uint8_t* payload, uint16_t length);
+
+/// @brief Parses the next frame of a command
+/// @param iter Parser state initialized by downlink_begin
+/// @param frame Output frame, valid when DOWNLINK_FRAME is returned
+/// @return DOWNLINK_FRAME, DOWNLINK_END or DOWNLINK_ERROR
+downlink_status_e downlink_next(downlink_iter_t* iter, CAN_frame_t* frame);
+
+/// @brief Records the outcome of a command
+/// @param frames Frames transmitted
+/// @param ok false if the command failed part way
+/// @param latency_us Time from arrival to the last transmitted frame
+void downlink_record(uint16_t frames, bool ok, uint32_t latency_us);
+
+/// @brief Copies the downlink counters
+/// @param stats Output statistics
+void downlink_get_stats(downlink_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _DOWNLINK_H_
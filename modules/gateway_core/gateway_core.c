@@ -0,0 +1,490 @@
+// ***************************************************** //
+/// @file gateway_core.c
+/// @brief Frame pipeline of the gateway: reassembly, policy,
+/// decoding, serialization and batching. Free of RTOS and
+/// board dependencies, the target provides the clock, the
+/// bus and the broker through gw_core_ops_t
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "gateway_core.h"
+#include "dbc.h"
+#include "cov.h"
+#include "policy.h"
+#include "aggregate.h"
+#include "isotp.h"
+#include "j1939.h"
+#include "routing.h"
+#include "batch.h"
+#include "counters.h"
+#include "dlog.h"
+#include "gateway_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define MAX_JSON_MSG_LEN            (80)
+#define MAX_JSON_SIGNALS_LEN        (512)
+#define MAX_JSON_SUMMARY_LEN        (1024)
+#define MAX_JSON_ISOTP_LEN          (2 * ISOTP_MAX_MSG_LEN + 96)
+#define MAX_JSON_J1939_LEN          (2 * J1939_MAX_MSG_LEN + 96)
+#define MAX_SEQ_PREFIX_LEN          (32)
+
+/// Module contexts follow the core context, each one aligned
+#define CONTEXT_ALIGN               (64)
+#define CONTEXT_ROUND(size)         (((size) + CONTEXT_ALIGN - 1) & ~(size_t)(CONTEXT_ALIGN - 1))
+
+static const char* TAG = "CORE";
+
+/// Pipeline of one bus
+struct gw_core_context
+{
+    const gw_core_ops_t* target;
+    uint8_t bus;
+
+    /// Capture time of the frame being processed, 0 outside of a frame
+    uint32_t uplinkOriginUs;
+
+    /// Sequence number of the next payload of each topic, so the cloud
+    /// can detect gaps. Restarted when the topic table changes
+    uint32_t uplinkSeq[ROUTING_MAX_TOPICS];
+
+    /// Messages are built here rather than on the stack of the caller
+    char batchMsg[BATCH_MAX_LEN + MAX_SEQ_PREFIX_LEN];
+    char isotpMsg[MAX_JSON_ISOTP_LEN];
+    char j1939Msg[MAX_JSON_J1939_LEN];
+    char summaryMsg[MAX_JSON_SUMMARY_LEN];
+};
+
+GW_CONTEXT(gw_core_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Finds the DBC message of a frame
+/// @param source Output source address of a J1939 message, 0 for
+/// messages matched on their full ID
+static const dbc_message_t* find_dbc_message(const CAN_frame_t* frame, uint8_t* source)
+{
+    const dbc_message_t* dbc_msg = dbc_find_message(frame->can_id);
+    *source = 0;
+
+    // J1939 messages match any source address and priority
+    j1939_id_t j1939_id;
+    if (dbc_msg == NULL && J1939_ENABLE && j1939_parse_id(frame->can_id, &j1939_id))
+    {
+        dbc_msg = dbc_find_message_pgn(j1939_id.pgn);
+        *source = j1939_id.sa;
+    }
+
+    return dbc_msg;
+}
+
+static void construct_JSON_CAN_msg(char msg[MAX_JSON_MSG_LEN], const CAN_frame_t* frame)
+{
+    char data_str[30] = "";
+
+    // Translate the frame's hex data into a string
+    int buf_idx = 0;
+    for (int i = 0; i < frame->can_dlc; i++)
+    {
+        sprintf(&data_str[buf_idx], "%02x ", frame->data[i]);
+        buf_idx += 3;
+    }
+
+    // Construct the JSON message
+    sprintf(msg,
+            "{\n\t\"id\": \"%d\",\n\t \"dlc\": \"%d\",\n\t\"data\": \"%s\"\n}",
+            (int)frame->can_id, frame->can_dlc, data_str);
+}
+
+static void construct_JSON_signals_msg(char msg[MAX_JSON_SIGNALS_LEN],
+                                       const dbc_message_t* dbc_msg,
+                                       const CAN_frame_t* frame,
+                                       const dbc_value_t values[],
+                                       uint8_t n_values)
+{
+    int len = snprintf(msg, MAX_JSON_SIGNALS_LEN,
+                       "{\n\t\"id\": \"%lu\",\n\t\"name\": \"%s\",\n\t\"signals\": {",
+                       (unsigned long)(frame->can_id & CAN_EFF_MASK), dbc_msg->name);
+
+    // Append signals while they fit, the closing braces are always reserved
+    for (uint8_t i = 0; i < n_values; i++)
+    {
+        const dbc_signal_t* sig = &DBC_SIGNALS[values[i].signal];
+        int remaining = MAX_JSON_SIGNALS_LEN - len - 4;
+        int written = snprintf(&msg[len], remaining, "%s\"%s\": %g",
+                               (i == 0) ? "" : ", ", sig->name, values[i].value);
+        if (written < 0 || written >= remaining)
+        {
+            break;
+        }
+        len += written;
+    }
+
+    snprintf(&msg[len], MAX_JSON_SIGNALS_LEN - len, "}\n}");
+}
+
+static void append_hex(char* msg, int len, int size, const uint8_t* data, uint16_t length)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    // Payloads reach several KB, so they are hex encoded without printf.
+    // The buffers are sized for the largest payload plus the header
+    for (uint16_t i = 0; i < length; i++)
+    {
+        msg[len++] = HEX_DIGITS[data[i] >> 4];
+        msg[len++] = HEX_DIGITS[data[i] & 0x0F];
+    }
+    snprintf(&msg[len], size - len, "\"\n}");
+}
+
+static void aggregate_CAN_frame(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    // Frames only feed the window statistics, the summary is
+    // published when the window closes
+    agg_update_frame(frame, now_ms);
+
+    uint8_t source;
+    const dbc_message_t* dbc_msg = find_dbc_message(frame, &source);
+    if (dbc_msg != NULL)
+    {
+        dbc_value_t values[DBC_MAX_SIGNALS_PER_MSG];
+        uint8_t n_values = dbc_decode(dbc_msg, frame, values, DBC_MAX_SIGNALS_PER_MSG);
+        agg_update_signals(values, n_values, source);
+    }
+}
+
+static void publish_CAN_frame(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    // Publish engineering values for messages described in
+    // the DBC, raw bytes for everything else
+    uint8_t source;
+    const dbc_message_t* dbc_msg = find_dbc_message(frame, &source);
+    if (dbc_msg != NULL)
+    {
+        dbc_value_t values[DBC_MAX_SIGNALS_PER_MSG];
+        uint8_t n_values = dbc_decode(dbc_msg, frame, values, DBC_MAX_SIGNALS_PER_MSG);
+
+#if COV_ENABLE
+        // Only signals that moved beyond their deadband are published,
+        // compared with earlier values of the same sender
+        n_values = cov_filter_signals(values, n_values, source, now_ms);
+        if (n_values == 0)
+        {
+            counters_dropped(COUNTERS_PIPELINE, DROP_UNCHANGED, 1);
+            return;
+        }
+#endif
+
+        char msg[MAX_JSON_SIGNALS_LEN];
+        construct_JSON_signals_msg(msg, dbc_msg, frame, values, n_values);
+
+        uint8_t topic = routing_lookup(frame);
+        DLOG_D(TAG, "Sending signals of 0x%lx to topic %u", (unsigned long)frame->can_id, topic);
+        counters_forwarded(COUNTERS_PIPELINE, 1);
+        batch_add(topic, msg, now_ms);
+    }
+    else
+    {
+#if COV_ENABLE
+        if (!cov_frame_changed(frame, now_ms))
+        {
+            counters_dropped(COUNTERS_PIPELINE, DROP_UNCHANGED, 1);
+            return;
+        }
+#endif
+
+        char msg[MAX_JSON_MSG_LEN];
+        construct_JSON_CAN_msg(msg, frame);
+
+        uint8_t topic = routing_lookup(frame);
+        DLOG_D(TAG, "Sending frame 0x%lx to topic %u", (unsigned long)frame->can_id, topic);
+        counters_forwarded(COUNTERS_PIPELINE, 1);
+        batch_add(topic, msg, now_ms);
+    }
+}
+
+static void publish_batch(uint8_t topic, const char* payload)
+{
+    char* msg = ctx->batchMsg;
+    size_t size = sizeof(ctx->batchMsg);
+
+    // Numbered even when dropped, so every loss shows as a gap
+    uint32_t seq = ctx->uplinkSeq[topic]++;
+
+    if (!ctx->target->is_uplink_open())
+    {
+        counters_received(COUNTERS_PUBLISH_QUEUE, 1);
+        counters_dropped(COUNTERS_PUBLISH_QUEUE, DROP_OFFLINE, 1);
+        return;
+    }
+
+    // A single message gets the number as its first member, a batch
+    // is wrapped in an object
+    if (payload[0] == '[')
+    {
+        snprintf(msg, size, "{\"seq\":%lu,\"msgs\":%s}", (unsigned long)seq, payload);
+    }
+    else
+    {
+        snprintf(msg, size, "{\"seq\":%lu,%s", (unsigned long)seq, &payload[1]);
+    }
+
+    // Batches completed while processing a frame are timed from it
+    ctx->target->publish(routing_topic(topic), msg, ctx->uplinkOriginUs);
+}
+
+static bool isotp_send_frame(uint8_t bus, const CAN_frame_t* frame)
+{
+    // Each pipeline serves a single bus
+    (void)bus;
+    return ctx->target->send(frame);
+}
+
+static bool j1939_send_frame(const CAN_frame_t* frame)
+{
+    return ctx->target->send(frame);
+}
+
+static void publish_isotp_msg(const isotp_message_t* isotp_msg)
+{
+    char* msg = ctx->isotpMsg;
+
+    if (!ctx->target->is_connected())
+    {
+        return;
+    }
+
+    int len = snprintf(msg, sizeof(ctx->isotpMsg),
+                       "{\n\t\"rx_id\": \"%lu\",\n\t\"tx_id\": \"%lu\",\n\t\"len\": \"%u\",\n\t\"data\": \"",
+                       (unsigned long)isotp_msg->rx_id, (unsigned long)isotp_msg->tx_id,
+                       isotp_msg->length);
+    append_hex(msg, len, sizeof(ctx->isotpMsg), isotp_msg->data, isotp_msg->length);
+
+    // Routed like a frame of the responding ECU
+    CAN_frame_t route_key;
+    memset(&route_key, 0, sizeof(route_key));
+    route_key.can_id = isotp_msg->rx_id;
+
+    DLOG_I(TAG, "Sending ISO-TP message: %u bytes", isotp_msg->length);
+    ctx->target->publish(routing_topic(routing_lookup(&route_key)), msg, 0);
+}
+
+static void publish_j1939_msg(const j1939_message_t* j1939_msg)
+{
+    char* msg = ctx->j1939Msg;
+
+    if (!ctx->target->is_connected())
+    {
+        return;
+    }
+
+    int len = snprintf(msg, sizeof(ctx->j1939Msg),
+                       "{\n\t\"pgn\": \"%lu\",\n\t\"sa\": \"%u\",\n\t\"da\": \"%u\",\n\t\"len\": \"%u\",\n\t\"data\": \"",
+                       (unsigned long)j1939_msg->pgn, j1939_msg->sa, j1939_msg->da,
+                       j1939_msg->length);
+    append_hex(msg, len, sizeof(ctx->j1939Msg), j1939_msg->data, j1939_msg->length);
+
+    DLOG_I(TAG, "Sending J1939 PGN %lu: %u bytes",
+           (unsigned long)j1939_msg->pgn, j1939_msg->length);
+    ctx->target->publish(routing_topic(routing_lookup_pgn(j1939_msg->pgn)), msg, 0);
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void gw_core_init(const gw_core_ops_t* ops, uint8_t bus, const char* default_topic, const char* thing, uint32_t now_ms)
+{
+    ctx->target = ops;
+    ctx->bus = bus;
+    ctx->uplinkOriginUs = 0;
+    memset(ctx->uplinkSeq, 0, sizeof(ctx->uplinkSeq));
+
+    policy_init(POLICY_DEFAULT_RULE, POLICY_DEFAULT_ARG);
+    cov_init(COV_HEARTBEAT_MS);
+    agg_init(now_ms);
+
+    isotp_init(isotp_send_frame, publish_isotp_msg);
+    for (int i = 0; i < ISOTP_OBD_CHANNELS; i++)
+    {
+        isotp_add_channel(bus,
+                          ISOTP_OBD_RX_BASE_ID + i,
+                          ISOTP_OBD_TX_BASE_ID + i,
+                          ISOTP_FLOW_CONTROL);
+    }
+
+    j1939_init(J1939_GATEWAY_ADDRESS, J1939_CMDT_REPLY ? j1939_send_frame : NULL, publish_j1939_msg);
+    policy_set_j1939(J1939_ENABLE);
+
+    routing_init(default_topic, thing, bus);
+    batch_init(publish_batch, BATCH_MAX_FRAMES, BATCH_MAX_DELAY_MS);
+}
+
+void gw_core_frame(const CAN_frame_t* frame, uint32_t origin_us, uint32_t now_ms)
+{
+    counters_received(COUNTERS_PIPELINE, 1);
+    ctx->uplinkOriginUs = origin_us;
+
+    // Diagnostic sessions are reassembled and published as a whole,
+    // their individual frames never reach the rest of the pipeline
+    if (ISOTP_ENABLE)
+    {
+        if (isotp_process(ctx->bus, frame, now_ms))
+        {
+            ctx->uplinkOriginUs = 0;
+            return;
+        }
+    }
+
+    // Same for J1939 transport sessions. Plain J1939 frames continue
+    // and are matched on their PGN by the policy and the decoder
+    if (J1939_ENABLE)
+    {
+        if (j1939_process(frame, now_ms))
+        {
+            ctx->uplinkOriginUs = 0;
+            return;
+        }
+    }
+
+    // Rate limiting runs first so frames that are never shipped
+    // are not decoded nor serialized
+    if (!policy_evaluate(frame, now_ms))
+    {
+        counters_dropped(COUNTERS_PIPELINE, DROP_POLICY, 1);
+    }
+    else if (GW_MODE == GW_MODE_AGGREGATE)
+    {
+        aggregate_CAN_frame(frame, now_ms);
+    }
+    else if (ctx->target->is_uplink_open())
+    {
+        publish_CAN_frame(frame, now_ms);
+    }
+    else
+    {
+        counters_dropped(COUNTERS_PIPELINE, DROP_OFFLINE, 1);
+    }
+
+    ctx->uplinkOriginUs = 0;
+}
+
+void gw_core_poll(uint32_t now_ms)
+{
+    // Stale sessions give their buffer back even on an idle bus
+    if (ISOTP_ENABLE)
+    {
+        isotp_poll(now_ms);
+    }
+    if (J1939_ENABLE)
+    {
+        j1939_poll(now_ms);
+    }
+    batch_poll(now_ms);
+}
+
+uint32_t gw_core_next_due_ms(uint32_t now_ms)
+{
+    uint32_t next = batch_next_due_ms(now_ms);
+
+    if (ISOTP_ENABLE)
+    {
+        uint32_t isotp_due = isotp_next_due_ms(now_ms);
+        if (isotp_due < next)
+        {
+            next = isotp_due;
+        }
+    }
+    if (J1939_ENABLE)
+    {
+        uint32_t j1939_due = j1939_next_due_ms(now_ms);
+        if (j1939_due < next)
+        {
+            next = j1939_due;
+        }
+    }
+
+    return next;
+}
+
+void gw_core_close_window(uint32_t now_ms)
+{
+    // Statistics of the window are dropped when the broker is not
+    // reachable, the next window starts fresh either way
+    if (ctx->target->is_connected())
+    {
+        char* msg = ctx->summaryMsg;
+        agg_cursor_t cursor;
+        memset(&cursor, 0, sizeof(cursor));
+
+        while (agg_serialize(msg, sizeof(ctx->summaryMsg), &cursor, now_ms))
+        {
+            DLOG_I(TAG, "Sending summary: %u bytes", (unsigned)strlen(msg));
+            ctx->target->publish(routing_topic(ROUTING_DEFAULT_TOPIC), msg, 0);
+        }
+    }
+
+    agg_reset_window(now_ms);
+}
+
+void gw_core_commit_routes(void)
+{
+    // Open batches belong to the old topic table
+    batch_flush();
+    routing_update_commit();
+    memset(ctx->uplinkSeq, 0, sizeof(ctx->uplinkSeq));
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t gw_core_context_size(void)
+{
+    return CONTEXT_ROUND(sizeof(gw_core_context_t))
+         + CONTEXT_ROUND(policy_context_size())
+         + CONTEXT_ROUND(cov_context_size())
+         + CONTEXT_ROUND(agg_context_size())
+         + CONTEXT_ROUND(isotp_context_size())
+         + CONTEXT_ROUND(j1939_context_size())
+         + CONTEXT_ROUND(routing_context_size())
+         + CONTEXT_ROUND(batch_context_size());
+}
+
+void gw_core_bind(gw_core_context_t* context)
+{
+    if (context == NULL)
+    {
+        ctx = &ctxDefault;
+        policy_bind(NULL);
+        cov_bind(NULL);
+        agg_bind(NULL);
+        isotp_bind(NULL);
+        j1939_bind(NULL);
+        routing_bind(NULL);
+        batch_bind(NULL);
+        return;
+    }
+
+    // Same order as gw_core_context_size
+    uint8_t* next = (uint8_t*)context + CONTEXT_ROUND(sizeof(gw_core_context_t));
+    ctx = context;
+    policy_bind((policy_context_t*)next);
+    next += CONTEXT_ROUND(policy_context_size());
+    cov_bind((cov_context_t*)next);
+    next += CONTEXT_ROUND(cov_context_size());
+    agg_bind((agg_context_t*)next);
+    next += CONTEXT_ROUND(agg_context_size());
+    isotp_bind((isotp_context_t*)next);
+    next += CONTEXT_ROUND(isotp_context_size());
+    j1939_bind((j1939_context_t*)next);
+    next += CONTEXT_ROUND(j1939_context_size());
+    routing_bind((routing_context_t*)next);
+    next += CONTEXT_ROUND(routing_context_size());
+    batch_bind((batch_context_t*)next);
+}
+#endif // GW_CONTEXT_PER_THREAD
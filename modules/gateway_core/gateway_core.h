@@ -0,0 +1,104 @@
+// ***************************************************** //
+/// @file gateway_core.h
+/// @brief Frame pipeline of the gateway: reassembly, policy,
+/// decoding, serialization and batching. Free of RTOS and
+/// board dependencies, the target provides the clock, the
+/// bus and the broker through gw_core_ops_t
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _GATEWAY_CORE_H_
+#define _GATEWAY_CORE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Bus and broker of the target. Called from the task
+/// that feeds the frames
+typedef struct
+{
+    /// Publishes a payload. origin_us is the capture time of the
+    /// frame that completed it, 0 if none
+    bool (*publish)(const char* topic, const char* payload, uint32_t origin_us);
+    /// Queues a frame on the bus, for ISO-TP flow control and J1939
+    /// replies
+    bool (*send)(const CAN_frame_t* frame);
+    /// The broker is connected, for session messages and summaries
+    bool (*is_connected)(void);
+    /// Frame messages are accepted. Usually connected, or not yet
+    /// connected so they wait for the first connection
+    bool (*is_uplink_open)(void);
+} gw_core_ops_t;
+
+/// @brief Pipeline of one bus with the contexts of every module it
+/// uses, see GW_CONTEXT_PER_THREAD
+typedef struct gw_core_context gw_core_context_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Initializes the pipeline modules with the settings of
+/// gateway_config.h
+/// @param ops Target operations, must outlive the pipeline
+/// @param bus Index of the bus, for ISO-TP channels and topics
+/// @param default_topic Topic of frames without a route
+/// @param thing Thing name substituted in topic templates
+/// @param now_ms Current time in milliseconds
+void gw_core_init(const gw_core_ops_t* ops, uint8_t bus, const char* default_topic, const char* thing, uint32_t now_ms);
+
+/// @brief Runs a received frame through the pipeline
+/// @param frame Received frame
+/// @param origin_us Capture time, for the latency of the publishes
+/// it completes. 0 if unknown
+/// @param now_ms Current time in milliseconds
+void gw_core_frame(const CAN_frame_t* frame, uint32_t origin_us, uint32_t now_ms);
+
+/// @brief Publishes the batches that are due and aborts the
+/// transport sessions that timed out
+/// @param now_ms Current time in milliseconds
+void gw_core_poll(uint32_t now_ms);
+
+/// @brief Time until gw_core_poll has something to do
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if nothing is pending
+uint32_t gw_core_next_due_ms(uint32_t now_ms);
+
+/// @brief Publishes the summary of the aggregation window and
+/// starts the next one. Only used with GW_MODE_AGGREGATE
+/// @param now_ms Current time in milliseconds
+void gw_core_close_window(uint32_t now_ms);
+
+/// @brief Publishes the open batches, which belong to the old topic
+/// table, then commits the routes staged with routing_update_x and
+/// restarts the sequence numbers
+void gw_core_commit_routes(void);
+
+/// @brief Size of a pipeline, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t gw_core_context_size(void);
+
+/// @brief Binds a pipeline to the calling thread, for every module.
+/// A new pipeline is zeroed, then set up by gw_core_init once bound.
+/// A pipeline must only be bound by one thread at a time
+/// @param context Pipeline, NULL for the static one
+void gw_core_bind(gw_core_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _GATEWAY_CORE_H_
@@ -0,0 +1,344 @@
+// ***************************************************** //
+/// @file isotp.c
+/// @brief ISO 15765-2 (ISO-TP) receive engine. Reassembles
+/// segmented diagnostic messages into pooled buffers
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "isotp.h"
+#include "gateway_config.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define PCI_TYPE(byte)          ((byte) >> 4)
+#define PCI_SINGLE_FRAME        (0x0)
+#define PCI_FIRST_FRAME         (0x1)
+#define PCI_CONSECUTIVE_FRAME   (0x2)
+#define PCI_FLOW_CONTROL        (0x3)
+
+#define FC_CONTINUE             (0x30)
+#define FC_OVERFLOW             (0x32)
+#define FC_PADDING              (0xCC)
+
+#define NO_SESSION              (-1)
+
+typedef struct
+{
+    uint32_t rx_id;
+    uint32_t tx_id;
+    uint8_t  bus;
+    uint8_t  flow_control;
+    int8_t   session;       // Index into sessions, NO_SESSION when idle
+} isotp_channel_t;
+
+typedef struct
+{
+    uint8_t  buffer[ISOTP_MAX_MSG_LEN];
+    uint16_t length;        // Announced by the First Frame
+    uint16_t received;
+    uint32_t last_ms;
+    uint8_t  next_sn;
+    uint8_t  in_use;
+} isotp_session_t;
+
+/// Channels and sessions of one bus
+struct isotp_context
+{
+    isotp_channel_t channels[ISOTP_MAX_CHANNELS];
+    uint8_t         n_channels;
+    isotp_session_t sessions[ISOTP_POOL_SIZE];
+
+    isotp_tx_fn   tx_callback;
+    isotp_rx_fn   rx_callback;
+    isotp_stats_t stats;
+};
+
+GW_CONTEXT(isotp_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static isotp_channel_t* find_channel(uint8_t bus, uint32_t can_id)
+{
+    for (uint8_t i = 0; i < ctx->n_channels; i++)
+    {
+        if (ctx->channels[i].rx_id == can_id && ctx->channels[i].bus == bus)
+        {
+            return &ctx->channels[i];
+        }
+    }
+    return NULL;
+}
+
+static int8_t allocate_session(void)
+{
+    for (int8_t i = 0; i < ISOTP_POOL_SIZE; i++)
+    {
+        if (!ctx->sessions[i].in_use)
+        {
+            ctx->sessions[i].in_use = 1;
+            return i;
+        }
+    }
+    return NO_SESSION;
+}
+
+static void release_session(isotp_channel_t* channel)
+{
+    if (channel->session != NO_SESSION)
+    {
+        ctx->sessions[channel->session].in_use = 0;
+        channel->session = NO_SESSION;
+    }
+}
+
+static void send_flow_control(const isotp_channel_t* channel, uint8_t status)
+{
+    if (ctx->tx_callback == NULL || !channel->flow_control)
+    {
+        return;
+    }
+
+    // Block size 0 and STmin 0: the sender may transmit all
+    // consecutive frames back to back
+    CAN_frame_t fc;
+    fc.can_id  = channel->tx_id;
+    fc.can_dlc = CAN_MAX_DLEN;
+    memset(fc.data, FC_PADDING, sizeof(fc.data));
+    fc.data[0] = status;
+    fc.data[1] = 0;
+    fc.data[2] = 0;
+
+    if (ctx->tx_callback(channel->bus, &fc))
+    {
+        ctx->stats.flow_controls++;
+    }
+}
+
+static void deliver(const isotp_channel_t* channel, const uint8_t* data, uint16_t length)
+{
+    isotp_message_t msg;
+    msg.bus    = channel->bus;
+    msg.rx_id  = channel->rx_id;
+    msg.tx_id  = channel->tx_id;
+    msg.length = length;
+    msg.data   = data;
+
+    if (ctx->rx_callback != NULL)
+    {
+        ctx->rx_callback(&msg);
+    }
+}
+
+static void handle_single_frame(isotp_channel_t* channel, const CAN_frame_t* frame)
+{
+    uint8_t length = frame->data[0] & 0x0F;
+
+    // A length of 0 escapes to CAN FD single frames, not supported
+    if (length == 0 || length > frame->can_dlc - 1)
+    {
+        return;
+    }
+
+    // A new message implicitly aborts a pending reception
+    release_session(channel);
+
+    ctx->stats.single_frames++;
+    deliver(channel, &frame->data[1], length);
+}
+
+static void handle_first_frame(isotp_channel_t* channel, const CAN_frame_t* frame, uint32_t now_ms)
+{
+    uint16_t length = ((uint16_t)(frame->data[0] & 0x0F) << 8) | frame->data[1];
+
+    // A length of 0 escapes to 32-bit lengths, beyond our buffers
+    if (frame->can_dlc != CAN_MAX_DLEN || length < CAN_MAX_DLEN)
+    {
+        return;
+    }
+
+    release_session(channel);
+    channel->session = allocate_session();
+    if (channel->session == NO_SESSION)
+    {
+        ctx->stats.overflows++;
+        send_flow_control(channel, FC_OVERFLOW);
+        return;
+    }
+
+    isotp_session_t* session = &ctx->sessions[channel->session];
+    session->length   = length;
+    session->received = CAN_MAX_DLEN - 2;
+    session->next_sn  = 1;
+    session->last_ms  = now_ms;
+    memcpy(session->buffer, &frame->data[2], CAN_MAX_DLEN - 2);
+
+    send_flow_control(channel, FC_CONTINUE);
+}
+
+static void handle_consecutive_frame(isotp_channel_t* channel, const CAN_frame_t* frame, uint32_t now_ms)
+{
+    if (channel->session == NO_SESSION)
+    {
+        return;
+    }
+
+    isotp_session_t* session = &ctx->sessions[channel->session];
+    if ((frame->data[0] & 0x0F) != session->next_sn)
+    {
+        ctx->stats.sequence_errors++;
+        release_session(channel);
+        return;
+    }
+
+    uint16_t remaining = session->length - session->received;
+    uint16_t chunk = frame->can_dlc - 1;
+    if (chunk > remaining)
+    {
+        chunk = remaining;
+    }
+
+    memcpy(&session->buffer[session->received], &frame->data[1], chunk);
+    session->received += chunk;
+    session->next_sn = (session->next_sn + 1) & 0x0F;
+    session->last_ms = now_ms;
+
+    if (session->received >= session->length)
+    {
+        ctx->stats.multi_frames++;
+        deliver(channel, session->buffer, session->length);
+        release_session(channel);
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void isotp_init(isotp_tx_fn tx, isotp_rx_fn rx)
+{
+    memset(ctx->channels, 0, sizeof(ctx->channels));
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    for (int i = 0; i < ISOTP_POOL_SIZE; i++)
+    {
+        ctx->sessions[i].in_use = 0;
+    }
+
+    ctx->n_channels  = 0;
+    ctx->tx_callback = tx;
+    ctx->rx_callback = rx;
+}
+
+bool isotp_add_channel(uint8_t bus, uint32_t rx_id, uint32_t tx_id, bool flow_control)
+{
+    if (ctx->n_channels >= ISOTP_MAX_CHANNELS)
+    {
+        return false;
+    }
+
+    isotp_channel_t* channel = &ctx->channels[ctx->n_channels++];
+    channel->bus          = bus;
+    channel->rx_id        = rx_id;
+    channel->tx_id        = tx_id;
+    channel->flow_control = flow_control;
+    channel->session      = NO_SESSION;
+    return true;
+}
+
+bool isotp_process(uint8_t bus, const CAN_frame_t* frame, uint32_t now_ms)
+{
+    isotp_channel_t* channel = find_channel(bus, frame->can_id);
+    if (channel == NULL)
+    {
+        return false;
+    }
+
+    if (frame->can_dlc == 0)
+    {
+        return true;
+    }
+
+    switch (PCI_TYPE(frame->data[0]))
+    {
+        case PCI_SINGLE_FRAME:
+            handle_single_frame(channel, frame);
+            break;
+
+        case PCI_FIRST_FRAME:
+            handle_first_frame(channel, frame, now_ms);
+            break;
+
+        case PCI_CONSECUTIVE_FRAME:
+            handle_consecutive_frame(channel, frame, now_ms);
+            break;
+
+        case PCI_FLOW_CONTROL:
+        default:
+            // The gateway only receives, Flow Control from the
+            // other side and invalid frames are ignored
+            break;
+    }
+
+    return true;
+}
+
+void isotp_poll(uint32_t now_ms)
+{
+    for (uint8_t i = 0; i < ctx->n_channels; i++)
+    {
+        isotp_channel_t* channel = &ctx->channels[i];
+        if (channel->session != NO_SESSION
+            && (uint32_t)(now_ms - ctx->sessions[channel->session].last_ms) > ISOTP_TIMEOUT_MS)
+        {
+            ctx->stats.timeouts++;
+            release_session(channel);
+        }
+    }
+}
+
+uint32_t isotp_next_due_ms(uint32_t now_ms)
+{
+    uint32_t next = UINT32_MAX;
+
+    for (uint8_t i = 0; i < ctx->n_channels; i++)
+    {
+        const isotp_channel_t* channel = &ctx->channels[i];
+        if (channel->session == NO_SESSION)
+        {
+            continue;
+        }
+
+        // Sessions are aborted once strictly older than the timeout
+        uint32_t age = now_ms - ctx->sessions[channel->session].last_ms;
+        uint32_t due = (age > ISOTP_TIMEOUT_MS) ? 0 : ISOTP_TIMEOUT_MS + 1 - age;
+        if (due < next)
+        {
+            next = due;
+        }
+    }
+
+    return next;
+}
+
+void isotp_get_stats(isotp_stats_t* out)
+{
+    *out = ctx->stats;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t isotp_context_size(void)
+{
+    return sizeof(isotp_context_t);
+}
+
+void isotp_bind(isotp_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
@@ -0,0 +1,125 @@
+// ***************************************************** //
+/// @file isotp.h
+/// @brief ISO 15765-2 (ISO-TP) receive engine. Reassembles
+/// segmented diagnostic messages into pooled buffers
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _ISOTP_H_
+#define _ISOTP_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Largest message length encodable in a classic First Frame
+#define ISOTP_MAX_MSG_LEN       (4095)
+
+/// Number of reassembly buffers, i.e. concurrent sessions
+#define ISOTP_POOL_SIZE         (4)
+
+/// Number of (bus, rx ID) channels handled by the engine
+#define ISOTP_MAX_CHANNELS      (8)
+
+/// Maximum time between two consecutive frames (N_Cr)
+#define ISOTP_TIMEOUT_MS        (1000)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct isotp_context isotp_context_t;
+
+/// @brief A complete message. Data points into a pooled buffer
+/// that is only valid for the duration of the receive callback
+typedef struct
+{
+    uint8_t        bus;
+    uint32_t       rx_id;
+    uint32_t       tx_id;
+    uint16_t       length;
+    const uint8_t* data;
+} isotp_message_t;
+
+typedef struct
+{
+    uint32_t single_frames;     // Complete messages in a Single Frame
+    uint32_t multi_frames;      // Complete segmented messages
+    uint32_t timeouts;          // Sessions aborted by N_Cr
+    uint32_t sequence_errors;   // Sessions aborted by a wrong sequence number
+    uint32_t overflows;         // First Frames rejected for lack of buffers
+    uint32_t flow_controls;     // Flow Control frames sent
+} isotp_stats_t;
+
+/// @brief Transmits a frame on a bus, used for Flow Control
+typedef bool (*isotp_tx_fn)(uint8_t bus, const CAN_frame_t* frame);
+
+/// @brief Receives a complete message
+typedef void (*isotp_rx_fn)(const isotp_message_t* msg);
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Removes all channels and aborts all sessions
+/// @param tx Transmit function for Flow Control. May be NULL
+/// when the gateway only listens to the bus
+/// @param rx Called for every complete message
+void isotp_init(isotp_tx_fn tx, isotp_rx_fn rx);
+
+/// @brief Enables reassembly of a diagnostic ID pair
+/// @param bus Bus index
+/// @param rx_id ID of the frames to reassemble, e.g. 0x7E8
+/// @param tx_id ID used for Flow Control, e.g. 0x7E0
+/// @param flow_control true to answer First Frames with a
+/// Flow Control frame, false to only listen
+/// @return false if the channel table is full
+bool isotp_add_channel(uint8_t bus, uint32_t rx_id, uint32_t tx_id, bool flow_control);
+
+/// @brief Feeds a received frame to the engine
+/// @param bus Bus index the frame was received on
+/// @param frame Received CAN frame
+/// @param now_ms Current time in milliseconds
+/// @return true if the frame belongs to an ISO-TP channel and was
+/// consumed, false if it should continue through the pipeline
+bool isotp_process(uint8_t bus, const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Aborts sessions that exceeded ISOTP_TIMEOUT_MS
+/// @param now_ms Current time in milliseconds
+void isotp_poll(uint32_t now_ms);
+
+/// @brief Time until isotp_poll aborts the oldest session
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if no session is open
+uint32_t isotp_next_due_ms(uint32_t now_ms);
+
+/// @brief Copies the engine counters
+/// @param stats Output statistics
+void isotp_get_stats(isotp_stats_t* stats);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t isotp_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by isotp_init once bound
+/// @param context Context, NULL for the static one
+void isotp_bind(isotp_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _ISOTP_H_
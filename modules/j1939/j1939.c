@@ -0,0 +1,399 @@
+// ***************************************************** //
+/// @file j1939.c
+/// @brief SAE J1939 identifier decoding and transport
+/// protocol (TP.BAM / TP.CM) reassembly
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "j1939.h"
+#include "gateway_config.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define TP_CM_RTS               (16)
+#define TP_CM_CTS               (17)
+#define TP_CM_EOMA              (19)
+#define TP_CM_BAM               (32)
+#define TP_CM_ABORT             (255)
+
+#define TP_ABORT_NO_RESOURCES   (1)
+#define TP_ABORT_TIMEOUT        (3)
+
+#define TP_DT_PAYLOAD           (7)
+#define TP_PRIORITY             (7)
+
+typedef struct
+{
+    uint8_t  buffer[J1939_MAX_MSG_LEN];
+    uint32_t pgn;
+    uint32_t last_ms;
+    uint16_t length;
+    uint8_t  n_packets;
+    uint8_t  next_packet;
+    uint8_t  packets_per_cts;   // Limit announced by the RTS
+    uint8_t  block_end;         // Last packet of the current CTS
+    uint8_t  sa;
+    uint8_t  da;
+    uint8_t  in_use;
+    uint8_t  is_bam;
+} j1939_session_t;
+
+/// Sessions of one bus
+struct j1939_context
+{
+    j1939_session_t sessions[J1939_POOL_SIZE];
+
+    uint8_t       gateway_address;
+    j1939_tx_fn   tx_callback;
+    j1939_rx_fn   rx_callback;
+    j1939_stats_t stats;
+};
+
+GW_CONTEXT(j1939_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static j1939_session_t* find_session(uint8_t sa, uint8_t da)
+{
+    for (int i = 0; i < J1939_POOL_SIZE; i++)
+    {
+        if (ctx->sessions[i].in_use && ctx->sessions[i].sa == sa && ctx->sessions[i].da == da)
+        {
+            return &ctx->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static j1939_session_t* allocate_session(void)
+{
+    for (int i = 0; i < J1939_POOL_SIZE; i++)
+    {
+        if (!ctx->sessions[i].in_use)
+        {
+            ctx->sessions[i].in_use = 1;
+            return &ctx->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void send_tp_cm(uint8_t sa, uint8_t da, const uint8_t payload[CAN_MAX_DLEN])
+{
+    if (ctx->tx_callback == NULL)
+    {
+        return;
+    }
+
+    CAN_frame_t frame;
+    frame.can_id  = CAN_EFF_FLAG
+                  | ((uint32_t)TP_PRIORITY << 26)
+                  | (J1939_PGN_TP_CM << 8)
+                  | ((uint32_t)da << 8)
+                  | sa;
+    frame.can_dlc = CAN_MAX_DLEN;
+    memcpy(frame.data, payload, CAN_MAX_DLEN);
+
+    ctx->tx_callback(&frame);
+}
+
+/// @brief Answers a session addressed to the gateway
+static void reply(const j1939_session_t* session, uint8_t control, uint8_t arg1, uint8_t arg2)
+{
+    uint8_t payload[CAN_MAX_DLEN];
+    payload[0] = control;
+    payload[1] = arg1;
+    payload[2] = arg2;
+    payload[3] = 0xFF;
+    payload[4] = 0xFF;
+    payload[5] = (uint8_t)(session->pgn);
+    payload[6] = (uint8_t)(session->pgn >> 8);
+    payload[7] = (uint8_t)(session->pgn >> 16);
+
+    if (control == TP_CM_EOMA)
+    {
+        payload[1] = (uint8_t)(session->length);
+        payload[2] = (uint8_t)(session->length >> 8);
+        payload[3] = session->n_packets;
+    }
+
+    send_tp_cm(ctx->gateway_address, session->sa, payload);
+}
+
+static void handle_tp_cm(const j1939_id_t* id, const CAN_frame_t* frame, uint32_t now_ms)
+{
+    const uint8_t* d = frame->data;
+    uint8_t control = d[0];
+
+    if (control == TP_CM_ABORT)
+    {
+        j1939_session_t* session = find_session(id->sa, id->da);
+        if (session == NULL)
+        {
+            // Abort sent by the receiver of a session
+            session = find_session(id->da, id->sa);
+        }
+        if (session != NULL)
+        {
+            ctx->stats.aborts++;
+            session->in_use = 0;
+        }
+        return;
+    }
+
+    if (control != TP_CM_BAM && control != TP_CM_RTS)
+    {
+        // CTS/EOMA from other nodes carry nothing to reassemble
+        return;
+    }
+
+    uint16_t length = (uint16_t)d[1] | ((uint16_t)d[2] << 8);
+    uint8_t n_packets = d[3];
+    if (length < 9 || length > J1939_MAX_MSG_LEN
+        || n_packets != (length + TP_DT_PAYLOAD - 1) / TP_DT_PAYLOAD)
+    {
+        return;
+    }
+
+    // A new announcement from the same sender replaces the old session
+    j1939_session_t* session = find_session(id->sa, id->da);
+    if (session == NULL)
+    {
+        session = allocate_session();
+    }
+    if (session == NULL)
+    {
+        ctx->stats.overflows++;
+        if (control == TP_CM_RTS && id->da == ctx->gateway_address)
+        {
+            j1939_session_t rejected = { .pgn = (uint32_t)d[5] | ((uint32_t)d[6] << 8) | ((uint32_t)d[7] << 16),
+                                         .sa = id->sa };
+            reply(&rejected, TP_CM_ABORT, TP_ABORT_NO_RESOURCES, 0xFF);
+        }
+        return;
+    }
+
+    session->pgn         = (uint32_t)d[5] | ((uint32_t)d[6] << 8) | ((uint32_t)d[7] << 16);
+    session->length      = length;
+    session->n_packets   = n_packets;
+    session->next_packet = 1;
+    session->sa          = id->sa;
+    session->da          = id->da;
+    session->is_bam      = (control == TP_CM_BAM);
+    session->last_ms     = now_ms;
+
+    // The sender caps the packets per CTS, 0xFF means no limit. A
+    // CTS for 0 packets would hold the session until it times out, a
+    // cap of 0 is taken as no limit too
+    session->packets_per_cts = (d[4] != 0 && d[4] < n_packets) ? d[4] : n_packets;
+    session->block_end       = session->packets_per_cts;
+
+    if (control == TP_CM_RTS && id->da == ctx->gateway_address)
+    {
+        reply(session, TP_CM_CTS, session->packets_per_cts, 1);
+    }
+}
+
+static void handle_tp_dt(const j1939_id_t* id, const CAN_frame_t* frame, uint32_t now_ms)
+{
+    j1939_session_t* session = find_session(id->sa, id->da);
+    if (session == NULL || frame->can_dlc != CAN_MAX_DLEN)
+    {
+        return;
+    }
+
+    uint8_t sequence = frame->data[0];
+    if (sequence != session->next_packet)
+    {
+        ctx->stats.sequence_errors++;
+        session->in_use = 0;
+        return;
+    }
+
+    uint16_t offset = (uint16_t)(sequence - 1) * TP_DT_PAYLOAD;
+    uint16_t chunk = session->length - offset;
+    if (chunk > TP_DT_PAYLOAD)
+    {
+        chunk = TP_DT_PAYLOAD;
+    }
+
+    memcpy(&session->buffer[offset], &frame->data[1], chunk);
+    session->next_packet++;
+    session->last_ms = now_ms;
+
+    if (sequence < session->n_packets)
+    {
+        // Clear the next block once the current one is complete
+        if (!session->is_bam && session->da == ctx->gateway_address && sequence == session->block_end)
+        {
+            uint8_t remaining = session->n_packets - sequence;
+            uint8_t count = (session->packets_per_cts < remaining) ? session->packets_per_cts : remaining;
+            session->block_end = sequence + count;
+            reply(session, TP_CM_CTS, count, sequence + 1);
+        }
+        return;
+    }
+
+    if (session->is_bam)
+    {
+        ctx->stats.bam_sessions++;
+    }
+    else
+    {
+        ctx->stats.cmdt_sessions++;
+        if (session->da == ctx->gateway_address)
+        {
+            reply(session, TP_CM_EOMA, 0, 0);
+        }
+    }
+
+    if (ctx->rx_callback != NULL)
+    {
+        j1939_message_t msg;
+        msg.pgn    = session->pgn;
+        msg.sa     = session->sa;
+        msg.da     = session->da;
+        msg.length = session->length;
+        msg.data   = session->buffer;
+        ctx->rx_callback(&msg);
+    }
+
+    session->in_use = 0;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool j1939_parse_id(uint32_t can_id, j1939_id_t* id)
+{
+    if (!(can_id & CAN_EFF_FLAG))
+    {
+        return false;
+    }
+
+    uint32_t raw = can_id & CAN_EFF_MASK;
+    uint8_t  pf  = (uint8_t)(raw >> 16);
+    uint8_t  ps  = (uint8_t)(raw >> 8);
+
+    id->priority = (uint8_t)((raw >> 26) & 0x07);
+    id->sa       = (uint8_t)raw;
+
+    if (pf < 240)
+    {
+        // PDU1: PS is the destination address
+        id->pgn = (raw >> 8) & 0x3FF00UL;
+        id->da  = ps;
+    }
+    else
+    {
+        // PDU2: PS is the group extension, always broadcast
+        id->pgn = (raw >> 8) & 0x3FFFFUL;
+        id->da  = J1939_ADDR_GLOBAL;
+    }
+
+    return true;
+}
+
+void j1939_init(uint8_t own_address, j1939_tx_fn tx, j1939_rx_fn rx)
+{
+    for (int i = 0; i < J1939_POOL_SIZE; i++)
+    {
+        ctx->sessions[i].in_use = 0;
+    }
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+
+    ctx->gateway_address = own_address;
+    ctx->tx_callback     = tx;
+    ctx->rx_callback     = rx;
+}
+
+bool j1939_process(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    j1939_id_t id;
+    if (!j1939_parse_id(frame->can_id, &id))
+    {
+        return false;
+    }
+
+    if (id.pgn == J1939_PGN_TP_CM)
+    {
+        if (frame->can_dlc == CAN_MAX_DLEN)
+        {
+            handle_tp_cm(&id, frame, now_ms);
+        }
+        return true;
+    }
+
+    if (id.pgn == J1939_PGN_TP_DT)
+    {
+        handle_tp_dt(&id, frame, now_ms);
+        return true;
+    }
+
+    return false;
+}
+
+void j1939_poll(uint32_t now_ms)
+{
+    for (int i = 0; i < J1939_POOL_SIZE; i++)
+    {
+        j1939_session_t* session = &ctx->sessions[i];
+        if (session->in_use && (uint32_t)(now_ms - session->last_ms) > J1939_TIMEOUT_MS)
+        {
+            ctx->stats.timeouts++;
+            if (!session->is_bam && session->da == ctx->gateway_address)
+            {
+                reply(session, TP_CM_ABORT, TP_ABORT_TIMEOUT, 0xFF);
+            }
+            session->in_use = 0;
+        }
+    }
+}
+
+uint32_t j1939_next_due_ms(uint32_t now_ms)
+{
+    uint32_t next = UINT32_MAX;
+
+    for (int i = 0; i < J1939_POOL_SIZE; i++)
+    {
+        const j1939_session_t* session = &ctx->sessions[i];
+        if (!session->in_use)
+        {
+            continue;
+        }
+
+        uint32_t age = now_ms - session->last_ms;
+        uint32_t due = (age > J1939_TIMEOUT_MS) ? 0 : J1939_TIMEOUT_MS + 1 - age;
+        if (due < next)
+        {
+            next = due;
+        }
+    }
+
+    return next;
+}
+
+void j1939_get_stats(j1939_stats_t* out)
+{
+    *out = ctx->stats;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t j1939_context_size(void)
+{
+    return sizeof(j1939_context_t);
+}
+
+void j1939_bind(j1939_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
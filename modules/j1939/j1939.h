@@ -0,0 +1,134 @@
+// ***************************************************** //
+/// @file j1939.h
+/// @brief SAE J1939 identifier decoding and transport
+/// protocol (TP.BAM / TP.CM) reassembly
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _J1939_H_
+#define _J1939_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Largest parameter group carried by the transport protocol
+#define J1939_MAX_MSG_LEN       (1785)
+
+/// Number of reassembly buffers, i.e. concurrent sessions
+#define J1939_POOL_SIZE         (8)
+
+/// Maximum time between two packets of a session (T1/T2)
+#define J1939_TIMEOUT_MS        (1250)
+
+#define J1939_PGN_TP_CM         (0x00EC00UL)
+#define J1939_PGN_TP_DT         (0x00EB00UL)
+
+#define J1939_ADDR_GLOBAL       (0xFF)
+#define J1939_ADDR_NULL         (0xFE)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct j1939_context j1939_context_t;
+
+/// @brief Fields of a 29-bit J1939 identifier
+typedef struct
+{
+    uint32_t pgn;           // 18-bit parameter group number
+    uint8_t  priority;
+    uint8_t  sa;            // Source address
+    uint8_t  da;            // Destination address, global for PDU2
+} j1939_id_t;
+
+/// @brief A complete parameter group. Data points into a pooled
+/// buffer that is only valid during the receive callback
+typedef struct
+{
+    uint32_t       pgn;
+    uint8_t        sa;
+    uint8_t        da;
+    uint16_t       length;
+    const uint8_t* data;
+} j1939_message_t;
+
+typedef struct
+{
+    uint32_t bam_sessions;      // Completed broadcast sessions
+    uint32_t cmdt_sessions;     // Completed connection mode sessions
+    uint32_t timeouts;
+    uint32_t sequence_errors;
+    uint32_t overflows;         // Sessions rejected for lack of buffers
+    uint32_t aborts;            // Sessions aborted by the sender or receiver
+} j1939_stats_t;
+
+/// @brief Transmits a frame, used for CTS/EOMA answers
+typedef bool (*j1939_tx_fn)(const CAN_frame_t* frame);
+
+/// @brief Receives a reassembled parameter group
+typedef void (*j1939_rx_fn)(const j1939_message_t* msg);
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Splits an extended identifier into J1939 fields
+/// @param can_id CAN identifier with CAN_EFF_FLAG
+/// @param id Output fields
+/// @return false if the frame is not an extended frame
+bool j1939_parse_id(uint32_t can_id, j1939_id_t* id);
+
+/// @brief Aborts all sessions and configures the engine
+/// @param own_address Address of the gateway. Connection mode
+/// sessions addressed to it are answered with CTS/EOMA
+/// @param tx Transmit function, may be NULL to only listen
+/// @param rx Called for every reassembled parameter group
+void j1939_init(uint8_t own_address, j1939_tx_fn tx, j1939_rx_fn rx);
+
+/// @brief Feeds a received frame to the transport protocol
+/// @param frame Received CAN frame
+/// @param now_ms Current time in milliseconds
+/// @return true if the frame was a TP.CM/TP.DT frame and was
+/// consumed, false if it should continue through the pipeline
+bool j1939_process(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Aborts sessions that exceeded J1939_TIMEOUT_MS
+/// @param now_ms Current time in milliseconds
+void j1939_poll(uint32_t now_ms);
+
+/// @brief Time until j1939_poll aborts the oldest session
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if no session is open
+uint32_t j1939_next_due_ms(uint32_t now_ms);
+
+/// @brief Copies the transport protocol counters
+/// @param stats Output statistics
+void j1939_get_stats(j1939_stats_t* stats);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t j1939_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by j1939_init once bound
+/// @param context Context, NULL for the static one
+void j1939_bind(j1939_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _J1939_H_
@@ -0,0 +1,258 @@
+// ***************************************************** //
+/// @file json_scan.c
+/// @brief Minimal in-place JSON scanner. Walks a document
+/// without copying it nor allocating memory
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "json_scan.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static bool is_ws(uint8_t c)
+{
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+static int hex_value(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/// @brief Shared by objects and arrays: skips the separator in
+/// front of the next element or consumes the closing character
+static json_status_e next_element(const uint8_t** p, const uint8_t* end, uint8_t close)
+{
+    const uint8_t* cursor = json_skip_ws(*p, end);
+    if (cursor >= end)
+    {
+        return JSON_ERROR;
+    }
+
+    if (*cursor == close)
+    {
+        *p = cursor + 1;
+        return JSON_END;
+    }
+    if (*cursor == ',')
+    {
+        cursor = json_skip_ws(cursor + 1, end);
+    }
+
+    *p = cursor;
+    return (cursor < end) ? JSON_OK : JSON_ERROR;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+const uint8_t* json_skip_ws(const uint8_t* p, const uint8_t* end)
+{
+    while (p < end && is_ws(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+const uint8_t* json_enter(const uint8_t* p, const uint8_t* end, uint8_t open)
+{
+    p = json_skip_ws(p, end);
+    return (p < end && *p == open) ? p + 1 : NULL;
+}
+
+const uint8_t* json_string(const uint8_t* p, const uint8_t* end,
+                           const uint8_t** str, uint16_t* len)
+{
+    if (p >= end || *p != '"')
+    {
+        return NULL;
+    }
+
+    const uint8_t* start = ++p;
+    while (p < end && *p != '"')
+    {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    if (p >= end)
+    {
+        return NULL;
+    }
+
+    *str = start;
+    *len = (uint16_t)(p - start);
+    return p + 1;
+}
+
+const uint8_t* json_skip_value(const uint8_t* p, const uint8_t* end)
+{
+    const uint8_t* str;
+    uint16_t len;
+    int depth = 0;
+
+    do
+    {
+        p = json_skip_ws(p, end);
+        if (p >= end)
+        {
+            return NULL;
+        }
+
+        if (*p == '"')
+        {
+            p = json_string(p, end, &str, &len);
+            if (p == NULL)
+            {
+                return NULL;
+            }
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            depth++;
+            p++;
+        }
+        else if (*p == '}' || *p == ']')
+        {
+            depth--;
+            p++;
+        }
+        else if (*p == ',' || *p == ':')
+        {
+            if (depth == 0)
+            {
+                return NULL;
+            }
+            p++;
+        }
+        else
+        {
+            // Number or literal
+            while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_ws(*p))
+            {
+                p++;
+            }
+        }
+    } while (depth > 0);
+
+    return (depth == 0) ? p : NULL;
+}
+
+const uint8_t* json_uint(const uint8_t* p, const uint8_t* end, uint32_t* value)
+{
+    const uint8_t* str;
+    uint16_t len = 0;
+    const uint8_t* next;
+
+    if (p < end && *p == '"')
+    {
+        next = json_string(p, end, &str, &len);
+        if (next == NULL)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        str = p;
+        while (p + len < end && (hex_value(p[len]) >= 0 || p[len] == 'x' || p[len] == 'X'))
+        {
+            len++;
+        }
+        next = p + len;
+    }
+
+    uint32_t base = 10;
+    if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+        base = 16;
+        str += 2;
+        len -= 2;
+    }
+    if (len == 0 || len > 10)
+    {
+        return NULL;
+    }
+
+    uint64_t result = 0;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        int digit = hex_value(str[i]);
+        if (digit < 0 || (uint32_t)digit >= base)
+        {
+            return NULL;
+        }
+        result = result * base + (uint32_t)digit;
+    }
+    if (result > 0xFFFFFFFFULL)
+    {
+        return NULL;
+    }
+
+    *value = (uint32_t)result;
+    return next;
+}
+
+const uint8_t* json_bool(const uint8_t* p, const uint8_t* end, bool* value)
+{
+    if (end - p >= 4 && memcmp(p, "true", 4) == 0)
+    {
+        *value = true;
+        return p + 4;
+    }
+    if (end - p >= 5 && memcmp(p, "false", 5) == 0)
+    {
+        *value = false;
+        return p + 5;
+    }
+    if (p < end && (*p == '0' || *p == '1'))
+    {
+        *value = (*p == '1');
+        return p + 1;
+    }
+    return NULL;
+}
+
+json_status_e json_next_member(const uint8_t** p, const uint8_t* end,
+                               const uint8_t** key, uint16_t* key_len)
+{
+    json_status_e status = next_element(p, end, '}');
+    if (status != JSON_OK)
+    {
+        return status;
+    }
+
+    const uint8_t* cursor = json_string(*p, end, key, key_len);
+    if (cursor == NULL)
+    {
+        return JSON_ERROR;
+    }
+
+    cursor = json_skip_ws(cursor, end);
+    if (cursor >= end || *cursor != ':')
+    {
+        return JSON_ERROR;
+    }
+
+    *p = json_skip_ws(cursor + 1, end);
+    return (*p < end) ? JSON_OK : JSON_ERROR;
+}
+
+json_status_e json_next_item(const uint8_t** p, const uint8_t* end)
+{
+    return next_element(p, end, ']');
+}
+
+bool json_key_is(const uint8_t* key, uint16_t key_len, const char* name)
+{
+    return key_len == strlen(name) && memcmp(key, name, key_len) == 0;
+}
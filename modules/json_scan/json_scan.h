@@ -0,0 +1,81 @@
+// ***************************************************** //
+/// @file json_scan.h
+/// @brief Minimal in-place JSON scanner. Walks a document
+/// without copying it nor allocating memory
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _JSON_SCAN_H_
+#define _JSON_SCAN_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    JSON_OK,                // A member or item follows
+    JSON_END,               // Closing brace or bracket reached and consumed
+    JSON_ERROR              // Malformed document
+} json_status_e;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+// Every function takes the current position and the end of the
+// document, and returns the position after what it consumed, or
+// NULL if the input is malformed.
+
+/// @brief Skips spaces, tabs and line breaks
+const uint8_t* json_skip_ws(const uint8_t* p, const uint8_t* end);
+
+/// @brief Consumes the opening brace or bracket of a container
+/// @param open '{' or '['
+const uint8_t* json_enter(const uint8_t* p, const uint8_t* end, uint8_t open);
+
+/// @brief Reads a string. The content is returned in place, not
+/// terminated and with escapes left as they are
+const uint8_t* json_string(const uint8_t* p, const uint8_t* end,
+                           const uint8_t** str, uint16_t* len);
+
+/// @brief Skips a value of any type, including nested containers
+const uint8_t* json_skip_value(const uint8_t* p, const uint8_t* end);
+
+/// @brief Reads a decimal or 0x prefixed number, bare or quoted
+const uint8_t* json_uint(const uint8_t* p, const uint8_t* end, uint32_t* value);
+
+/// @brief Reads true, false, 0 or 1
+const uint8_t* json_bool(const uint8_t* p, const uint8_t* end, bool* value);
+
+/// @brief Moves to the value of the next member of an object
+/// @param p In: position after the previous value or after the
+/// opening brace. Out: position of the value when JSON_OK
+/// @param key Member name, in place
+/// @return JSON_OK, JSON_END after the closing brace, or JSON_ERROR
+json_status_e json_next_member(const uint8_t** p, const uint8_t* end,
+                               const uint8_t** key, uint16_t* key_len);
+
+/// @brief Moves to the next item of an array
+/// @param p In: position after the previous item or after the
+/// opening bracket. Out: position of the item when JSON_OK
+/// @return JSON_OK, JSON_END after the closing bracket, or JSON_ERROR
+json_status_e json_next_item(const uint8_t** p, const uint8_t* end);
+
+/// @brief Compares a member name with a C string
+bool json_key_is(const uint8_t* key, uint16_t key_len, const char* name);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _JSON_SCAN_H_
@@ -0,0 +1,141 @@
+// ***************************************************** //
+/// @file latency.c
+/// @brief Latency histograms of the uplink pipeline stages,
+/// from the CAN interrupt to the PUBACK of the broker
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "latency.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char* const NAMES[LATENCY_STAGES] =
+{
+    "isr_to_dequeue", "spi_read", "process", "submit_to_puback", "end_to_end",
+};
+
+/// Counts per core, so the two cores never write the same word
+static uint32_t buckets[portNUM_PROCESSORS][LATENCY_STAGES][LATENCY_BUCKETS];
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+/// @brief Log-linear bucket: values below 4 have their own bucket,
+/// then each power of two is split in LATENCY_SUB_BUCKETS
+static inline uint32_t IRAM_ATTR bucket_of(uint32_t value)
+{
+    if (value < LATENCY_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    uint32_t msb    = 31 - __builtin_clz(value);
+    uint32_t sub    = (value >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    uint32_t bucket = (msb - 1) * LATENCY_SUB_BUCKETS + sub;
+    return (bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/// @brief Largest value that falls in a bucket
+static uint32_t bucket_upper(uint32_t bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    uint32_t msb = bucket / LATENCY_SUB_BUCKETS + 1;
+    uint32_t sub = bucket % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void IRAM_ATTR latency_record(latency_stage_e stage, uint32_t elapsed_us)
+{
+    // Tasks on the same core may still preempt each other
+    uint32_t* bucket = &buckets[xPortGetCoreID()][stage][bucket_of(elapsed_us)];
+    __atomic_fetch_add(bucket, 1, __ATOMIC_RELAXED);
+}
+
+void latency_summarize(latency_stage_e stage, latency_summary_t* summary)
+{
+    uint32_t merged[LATENCY_BUCKETS];
+    uint32_t count = 0;
+
+    for (uint32_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        merged[b] = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            merged[b] += __atomic_load_n(&buckets[core][stage][b], __ATOMIC_RELAXED);
+        }
+        count += merged[b];
+    }
+
+    memset(summary, 0, sizeof(*summary));
+    summary->count = count;
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Ranks of the percentiles, rounded up
+    uint32_t p50 = (uint32_t)(((uint64_t)count * 50 + 99) / 100);
+    uint32_t p90 = (uint32_t)(((uint64_t)count * 90 + 99) / 100);
+    uint32_t p99 = (uint32_t)(((uint64_t)count * 99 + 99) / 100);
+    uint32_t seen = 0;
+
+    for (uint32_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        if (merged[b] == 0)
+        {
+            continue;
+        }
+
+        uint32_t upper = bucket_upper(b);
+        if (seen < p50 && seen + merged[b] >= p50)
+        {
+            summary->p50_us = upper;
+        }
+        if (seen < p90 && seen + merged[b] >= p90)
+        {
+            summary->p90_us = upper;
+        }
+        if (seen < p99 && seen + merged[b] >= p99)
+        {
+            summary->p99_us = upper;
+        }
+        seen += merged[b];
+        summary->max_us = upper;
+    }
+}
+
+const char* latency_stage_name(latency_stage_e stage)
+{
+    return (stage < LATENCY_STAGES) ? NAMES[stage] : "";
+}
+
+void latency_reset(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        for (int stage = 0; stage < LATENCY_STAGES; stage++)
+        {
+            for (int b = 0; b < LATENCY_BUCKETS; b++)
+            {
+                __atomic_store_n(&buckets[core][stage][b], 0, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
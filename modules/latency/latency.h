@@ -0,0 +1,93 @@
+// ***************************************************** //
+/// @file latency.h
+/// @brief Latency histograms of the uplink pipeline stages,
+/// from the CAN interrupt to the PUBACK of the broker
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "gateway_config.h"
+#include "esp_timer.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Sub-buckets per power of two. Percentiles are exact to 1/4 of
+/// their power of two
+#define LATENCY_SUB_BUCKETS     (4)
+
+/// Buckets up to 2^24 us, about 16 s. Longer samples go to the last
+#define LATENCY_BUCKETS         (92)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    LATENCY_ISR_TO_DEQUEUE,     // Interrupt to the app task taking the event
+    LATENCY_SPI_READ,           // Reading a frame from the controller
+    LATENCY_PROCESS,            // Filtering, decoding and serializing a frame
+    LATENCY_SUBMIT_TO_PUBACK,   // Publish queue to PUBACK
+    LATENCY_END_TO_END,         // Interrupt to PUBACK
+    LATENCY_STAGES
+} latency_stage_e;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;        // Upper bound of the highest bucket used
+} latency_summary_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// Timestamps are taken on the microsecond timer, which both cores
+/// share. The cycle counters are per core and not synchronized, so
+/// they cannot time stages that start and end in different tasks.
+/// With LATENCY_ENABLE set to 0 the instrumentation compiles out
+#if LATENCY_ENABLE
+#define LATENCY_NOW()                   ((uint32_t)esp_timer_get_time())
+#define LATENCY_RECORD(stage, start)    latency_record((stage), LATENCY_NOW() - (uint32_t)(start))
+#else
+#define LATENCY_NOW()                   ((uint32_t)0)
+#define LATENCY_RECORD(stage, start)    do { (void)(start); } while (0)
+#endif
+
+/// @brief Adds a sample to the histogram of a stage. Lock free, each
+/// core counts into its own buckets. Safe to call from an ISR
+/// @param stage Pipeline stage
+/// @param elapsed_us Duration of the stage
+void latency_record(latency_stage_e stage, uint32_t elapsed_us);
+
+/// @brief Computes the percentiles of a stage over both cores
+/// @param stage Pipeline stage
+/// @param summary Output percentiles
+void latency_summarize(latency_stage_e stage, latency_summary_t* summary);
+
+/// @brief Name of a stage, for logs and metrics
+const char* latency_stage_name(latency_stage_e stage);
+
+/// @brief Clears every histogram, to start a new reporting period
+void latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _LATENCY_H_
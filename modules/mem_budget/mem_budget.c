@@ -0,0 +1,74 @@
+// ***************************************************** //
+/// @file mem_budget.c
+/// @brief Statically allocated memory per subsystem, checked
+/// against the budgets of rtos_config.h, and boot report
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "mem_budget.h"
+#include "rtos_config.h"
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+static const char* TAG = "MEMORY";
+
+static const char* const NAMES[MEM_SUBSYSTEMS] =
+{
+    "CAN", "app", "AWS", "config", "CLI", "log", "trace", "stream", "slcan",
+};
+
+static const uint32_t BUDGETS[MEM_SUBSYSTEMS] =
+{
+    MEM_BUDGET_CAN, MEM_BUDGET_APP, MEM_BUDGET_AWS, MEM_BUDGET_CONFIG, MEM_BUDGET_CLI,
+    MEM_BUDGET_LOG, MEM_BUDGET_TRACE, MEM_BUDGET_CANNELLONI,
+    MEM_BUDGET_SLCAN,
+};
+
+static uint32_t used[MEM_SUBSYSTEMS];
+
+/// Bounds of the static data in internal RAM, from the linker script
+extern int _data_start, _data_end, _bss_start, _bss_end;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void mem_budget_account(mem_subsystem_e subsystem, uint32_t bytes)
+{
+    if (subsystem < MEM_SUBSYSTEMS)
+    {
+        __atomic_fetch_add(&used[subsystem], bytes, __ATOMIC_RELAXED);
+    }
+}
+
+void mem_budget_report(void)
+{
+    uint32_t total_used   = 0;
+    uint32_t total_budget = 0;
+
+    for (int i = 0; i < MEM_SUBSYSTEMS; i++)
+    {
+        uint32_t bytes = __atomic_load_n(&used[i], __ATOMIC_RELAXED);
+        total_used   += bytes;
+        total_budget += BUDGETS[i];
+        ESP_LOGI(TAG, "%-6s %6lu / %6lu B", NAMES[i],
+                 (unsigned long)bytes, (unsigned long)BUDGETS[i]);
+    }
+
+    uint32_t data = (uint32_t)((char*)&_data_end - (char*)&_data_start);
+    uint32_t bss  = (uint32_t)((char*)&_bss_end - (char*)&_bss_start);
+
+    ESP_LOGI(TAG, "subsystems %lu / %lu B, static total %lu B (data %lu, bss %lu)",
+             (unsigned long)total_used, (unsigned long)total_budget,
+             (unsigned long)(data + bss), (unsigned long)data, (unsigned long)bss);
+    ESP_LOGI(TAG, "heap free %lu B, minimum %lu B, largest block %lu B",
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+             (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
@@ -0,0 +1,57 @@
+// ***************************************************** //
+/// @file mem_budget.h
+/// @brief Statically allocated memory per subsystem, checked
+/// against the budgets of rtos_config.h, and boot report
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _MEM_BUDGET_H_
+#define _MEM_BUDGET_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    MEM_CAN,            // Controller driver object
+    MEM_APP,            // Application task, event queue and timers
+    MEM_AWS,            // AWS task and publish queue
+    MEM_CONFIG,         // Remote configuration task and queue
+    MEM_CLI,            // Console task and task lists
+    MEM_LOG,            // Deferred log ring and task
+    MEM_TRACE,          // Frame capture buffers and writer task
+    MEM_CANNELLONI,     // UDP stream packets and task
+    MEM_SLCAN,          // SLCAN stream buffers
+    MEM_SUBSYSTEMS
+} mem_subsystem_e;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Adds static memory to a subsystem. The owner also checks
+/// the size against the budget at compile time. Safe to call from
+/// any task
+/// @param subsystem Owner of the memory
+/// @param bytes Size of the objects, from sizeof
+void mem_budget_account(mem_subsystem_e subsystem, uint32_t bytes);
+
+/// @brief Logs the memory used and the budget of each subsystem,
+/// the static total and the state of the heap
+void mem_budget_report(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _MEM_BUDGET_H_
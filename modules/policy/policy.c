@@ -0,0 +1,360 @@
+// ***************************************************** //
+/// @file policy.c
+/// @brief Per CAN ID rate limiting and downsampling rules
+/// evaluated on the receive path before serialization
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "policy.h"
+#include "gateway_config.h"
+#include "j1939.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define POLICY_EMPTY_KEY    (0xFFFFFFFFUL)
+
+// PGN keys share the extended hash. Bit 31 is clear, so they
+// never collide with extended IDs that always carry CAN_EFF_FLAG
+#define POLICY_PGN_KEY(pgn) (CAN_RTR_FLAG | ((pgn) & 0x3FFFFUL))
+
+typedef struct
+{
+    uint32_t arg;
+    uint32_t counter;       // Decimation counter
+    uint32_t last_ms;       // Last forwarded frame or current window start
+    uint8_t  rule;
+    uint8_t  started;
+} policy_entry_t;
+
+typedef struct
+{
+    /// Entry 0 is the default rule. Listed IDs use entries 1..POLICY_MAX_ENTRIES
+    policy_entry_t entries[POLICY_MAX_ENTRIES + 1];
+    uint8_t        n_entries;
+
+    /// Standard IDs index the entry table directly
+    uint8_t  std_index[CAN_SFF_MASK + 1];
+
+    /// Extended IDs go through an open-addressed hash
+    uint32_t ext_keys[POLICY_EXT_SLOTS];
+    uint8_t  ext_index[POLICY_EXT_SLOTS];
+} policy_table_t;
+
+/// Rule tables and counters of one bus
+struct policy_context
+{
+    /// The receive path reads the active table while updates are
+    /// built in the other one, then the pointer is swapped
+    policy_table_t  tables[2];
+    policy_table_t* active;
+
+    /// Incremented by the reader when entering and leaving
+    /// policy_evaluate. Odd while a frame is being evaluated
+    uint32_t reader_seq;
+
+    policy_stats_t stats;
+    bool           j1939_mode;
+};
+
+GW_CONTEXT(policy_context_t);
+
+static const char* RULE_NAMES[N_POLICY_RULES] =
+{
+    "pass", "drop", "decimate", "min_interval", "first_of_window"
+};
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline uint32_t ext_hash(uint32_t can_id)
+{
+    return ((uint32_t)(can_id * 0x9E3779B1UL) >> 16) & (POLICY_EXT_SLOTS - 1);
+}
+
+static uint8_t* find_ext_index(policy_table_t* table, uint32_t key, bool create)
+{
+    uint32_t slot = ext_hash(key);
+    for (uint32_t probe = 0; probe < POLICY_EXT_SLOTS; probe++)
+    {
+        if (table->ext_keys[slot] == key)
+        {
+            return &table->ext_index[slot];
+        }
+        if (table->ext_keys[slot] == POLICY_EMPTY_KEY)
+        {
+            if (!create)
+            {
+                return NULL;
+            }
+            table->ext_keys[slot] = key;
+            return &table->ext_index[slot];
+        }
+        slot = (slot + 1) & (POLICY_EXT_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+static uint8_t* find_index(policy_table_t* table, uint32_t can_id, bool create)
+{
+    if (!(can_id & CAN_EFF_FLAG))
+    {
+        return &table->std_index[can_id & CAN_SFF_MASK];
+    }
+
+    return find_ext_index(table, can_id & (CAN_EFF_FLAG | CAN_EFF_MASK), create);
+}
+
+static void entry_configure(policy_entry_t* entry, policy_rule_e rule, uint32_t arg)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->rule = (uint8_t)rule;
+    entry->arg  = arg;
+}
+
+static bool set_rule(policy_table_t* table, uint8_t* index, policy_rule_e rule, uint32_t arg)
+{
+    if (index == NULL)
+    {
+        return false;
+    }
+
+    if (*index == 0)
+    {
+        if (table->n_entries >= POLICY_MAX_ENTRIES)
+        {
+            return false;
+        }
+        *index = ++table->n_entries;
+    }
+
+    entry_configure(&table->entries[*index], rule, arg);
+    return true;
+}
+
+static bool rule_is_valid(policy_rule_e rule, uint32_t arg)
+{
+    if (rule >= N_POLICY_RULES)
+    {
+        return false;
+    }
+    if ((rule == POLICY_DECIMATE || rule == POLICY_FIRST_OF_WINDOW) && arg == 0)
+    {
+        return false;
+    }
+    return true;
+}
+
+static void table_init(policy_table_t* table, policy_rule_e default_rule, uint32_t default_arg)
+{
+    memset(table->entries, 0, sizeof(table->entries));
+    memset(table->std_index, 0, sizeof(table->std_index));
+    memset(table->ext_keys, 0xFF, sizeof(table->ext_keys));
+    memset(table->ext_index, 0, sizeof(table->ext_index));
+    table->n_entries = 0;
+
+    entry_configure(&table->entries[0], default_rule, default_arg);
+}
+
+static bool table_set(policy_table_t* table, uint32_t can_id, policy_rule_e rule, uint32_t arg)
+{
+    if (!rule_is_valid(rule, arg))
+    {
+        return false;
+    }
+
+    return set_rule(table, find_index(table, can_id, true), rule, arg);
+}
+
+static bool table_set_pgn(policy_table_t* table, uint32_t pgn, policy_rule_e rule, uint32_t arg)
+{
+    if (!rule_is_valid(rule, arg))
+    {
+        return false;
+    }
+
+    return set_rule(table, find_ext_index(table, POLICY_PGN_KEY(pgn), true), rule, arg);
+}
+
+static policy_table_t* standby_table(void)
+{
+    return (__atomic_load_n(&ctx->active, __ATOMIC_ACQUIRE) == &ctx->tables[0]) ? &ctx->tables[1] : &ctx->tables[0];
+}
+
+static bool entry_apply(policy_entry_t* entry, uint32_t now_ms)
+{
+    switch (entry->rule)
+    {
+        case POLICY_PASS:
+            return true;
+
+        case POLICY_DROP:
+            return false;
+
+        case POLICY_DECIMATE:
+            if (entry->counter == 0)
+            {
+                entry->counter = entry->arg - 1;
+                return true;
+            }
+            entry->counter--;
+            return false;
+
+        case POLICY_MIN_INTERVAL:
+            if (entry->started && (uint32_t)(now_ms - entry->last_ms) < entry->arg)
+            {
+                return false;
+            }
+            entry->started = 1;
+            entry->last_ms = now_ms;
+            return true;
+
+        case POLICY_FIRST_OF_WINDOW:
+        {
+            // Windows are aligned to multiples of arg so they stay on a fixed grid
+            uint32_t window = now_ms - (now_ms % entry->arg);
+            if (entry->started && window == entry->last_ms)
+            {
+                return false;
+            }
+            entry->started = 1;
+            entry->last_ms = window;
+            return true;
+        }
+
+        default:
+            return true;
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void policy_init(policy_rule_e default_rule, uint32_t default_arg)
+{
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    __atomic_store_n(&ctx->active, &ctx->tables[0], __ATOMIC_RELEASE);
+
+    table_init(&ctx->tables[0], default_rule, default_arg);
+}
+
+bool policy_set(uint32_t can_id, policy_rule_e rule, uint32_t arg)
+{
+    return table_set(ctx->active, can_id, rule, arg);
+}
+
+bool policy_set_pgn(uint32_t pgn, policy_rule_e rule, uint32_t arg)
+{
+    return table_set_pgn(ctx->active, pgn, rule, arg);
+}
+
+void policy_set_j1939(bool enable)
+{
+    ctx->j1939_mode = enable;
+}
+
+void policy_update_begin(policy_rule_e default_rule, uint32_t default_arg)
+{
+    table_init(standby_table(), default_rule, default_arg);
+}
+
+bool policy_update_set(uint32_t can_id, policy_rule_e rule, uint32_t arg)
+{
+    return table_set(standby_table(), can_id, rule, arg);
+}
+
+bool policy_update_set_pgn(uint32_t pgn, policy_rule_e rule, uint32_t arg)
+{
+    return table_set_pgn(standby_table(), pgn, rule, arg);
+}
+
+void policy_update_commit(void (*wait)(void))
+{
+    __atomic_store_n(&ctx->active, standby_table(), __ATOMIC_SEQ_CST);
+
+    // A frame evaluated while the pointer was swapped may still use
+    // the old table. Once the count moves it has left, and the old
+    // table can be rebuilt by the next update
+    uint32_t seq = __atomic_load_n(&ctx->reader_seq, __ATOMIC_SEQ_CST);
+    while ((seq & 1) && __atomic_load_n(&ctx->reader_seq, __ATOMIC_ACQUIRE) == seq)
+    {
+        if (wait != NULL)
+        {
+            wait();
+        }
+    }
+}
+
+bool policy_evaluate(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    __atomic_add_fetch(&ctx->reader_seq, 1, __ATOMIC_SEQ_CST);
+    policy_table_t* table = __atomic_load_n(&ctx->active, __ATOMIC_SEQ_CST);
+
+    uint8_t* index = NULL;
+
+    j1939_id_t j1939_id;
+    if (ctx->j1939_mode && j1939_parse_id(frame->can_id, &j1939_id))
+    {
+        index = find_ext_index(table, POLICY_PGN_KEY(j1939_id.pgn), false);
+    }
+    if (index == NULL || *index == 0)
+    {
+        index = find_index(table, frame->can_id, false);
+    }
+    policy_entry_t* entry = &table->entries[(index != NULL) ? *index : 0];
+
+    bool    forward = entry_apply(entry, now_ms);
+    uint8_t rule    = entry->rule;
+
+    // The table may be rebuilt by the next update once released
+    __atomic_add_fetch(&ctx->reader_seq, 1, __ATOMIC_RELEASE);
+
+    ctx->stats.hits[rule]++;
+    if (forward)
+    {
+        ctx->stats.passed[rule]++;
+    }
+
+    return forward;
+}
+
+void policy_get_stats(policy_stats_t* out)
+{
+    *out = ctx->stats;
+}
+
+const char* policy_rule_name(policy_rule_e rule)
+{
+    return (rule < N_POLICY_RULES) ? RULE_NAMES[rule] : "unknown";
+}
+
+bool policy_rule_from_name(const char* name, uint16_t len, policy_rule_e* rule)
+{
+    for (int i = 0; i < N_POLICY_RULES; i++)
+    {
+        if (strlen(RULE_NAMES[i]) == len && memcmp(RULE_NAMES[i], name, len) == 0)
+        {
+            *rule = (policy_rule_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t policy_context_size(void)
+{
+    return sizeof(policy_context_t);
+}
+
+void policy_bind(policy_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
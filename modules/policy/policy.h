@@ -0,0 +1,140 @@
+// ***************************************************** //
+/// @file policy.h
+/// @brief Per CAN ID rate limiting and downsampling rules
+/// evaluated on the receive path before serialization
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Maximum number of IDs with their own rule
+#define POLICY_MAX_ENTRIES      (64)
+
+/// Slots of the extended ID hash. Must be a power of two
+#define POLICY_EXT_SLOTS        (128)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct policy_context policy_context_t;
+
+typedef enum
+{
+    POLICY_PASS,            // Forward every frame
+    POLICY_DROP,            // Never forward
+    POLICY_DECIMATE,        // Forward one out of every arg frames
+    POLICY_MIN_INTERVAL,    // Forward if arg ms passed since the last forwarded frame
+    POLICY_FIRST_OF_WINDOW, // Forward the first frame of each fixed arg ms window
+
+    N_POLICY_RULES
+} policy_rule_e;
+
+typedef struct
+{
+    uint32_t hits[N_POLICY_RULES];      // Frames evaluated by each rule
+    uint32_t passed[N_POLICY_RULES];    // Frames forwarded by each rule
+} policy_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Removes all rules and sets the rule for unlisted IDs
+/// @param default_rule Rule applied to IDs without an entry
+/// @param default_arg Argument of the default rule
+void policy_init(policy_rule_e default_rule, uint32_t default_arg);
+
+/// @brief Adds or replaces the rule of a CAN ID. Must be called
+/// from the same task that evaluates frames
+/// @param can_id CAN identifier including the EFF flag
+/// @param rule Rule to apply
+/// @param arg Decimation factor or interval in ms, depending on rule
+/// @return false if the table is full or the argument is invalid
+bool policy_set(uint32_t can_id, policy_rule_e rule, uint32_t arg);
+
+/// @brief Adds or replaces the rule of a J1939 parameter group.
+/// Applies to every source address sending the PGN
+/// @param pgn 18-bit parameter group number
+/// @param rule Rule to apply
+/// @param arg Decimation factor or interval in ms, depending on rule
+/// @return false if the table is full or the argument is invalid
+bool policy_set_pgn(uint32_t pgn, policy_rule_e rule, uint32_t arg);
+
+/// @brief Enables PGN keyed rules for extended frames. A rule set
+/// for the PGN of a frame takes precedence over one for its raw ID
+/// @param enable true if the bus carries J1939 traffic
+void policy_set_j1939(bool enable);
+
+/// @brief Starts building a new rule set in the standby table. The
+/// active rules keep being applied until policy_update_commit.
+/// Only one task may update the rules at a time
+/// @param default_rule Rule applied to IDs without an entry
+/// @param default_arg Argument of the default rule
+void policy_update_begin(policy_rule_e default_rule, uint32_t default_arg);
+
+/// @brief Same as policy_set, on the rule set being built
+bool policy_update_set(uint32_t can_id, policy_rule_e rule, uint32_t arg);
+
+/// @brief Same as policy_set_pgn, on the rule set being built
+bool policy_update_set_pgn(uint32_t pgn, policy_rule_e rule, uint32_t arg);
+
+/// @brief Atomically replaces the active rules with the new set.
+/// The receive path never blocks. Returns once no frame is being
+/// evaluated with the old set anymore
+/// @param wait Called while waiting for the receive path, e.g. to
+/// sleep one tick. May be NULL to spin
+void policy_update_commit(void (*wait)(void));
+
+/// @brief Decides if a frame is forwarded. O(1) for both standard
+/// and extended identifiers. Must always be called from the same task
+/// @param frame Received CAN frame
+/// @param now_ms Current time in milliseconds
+/// @return true if the frame should be forwarded
+bool policy_evaluate(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Copies the per-rule hit counters
+/// @param stats Output statistics
+void policy_get_stats(policy_stats_t* stats);
+
+/// @brief Name of a rule, for logs and configuration
+const char* policy_rule_name(policy_rule_e rule);
+
+/// @brief Looks up a rule by the name returned by policy_rule_name
+/// @param name Rule name, not necessarily null terminated
+/// @param len Length of the name
+/// @param rule Output rule
+/// @return false if no rule has that name
+bool policy_rule_from_name(const char* name, uint16_t len, policy_rule_e* rule);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t policy_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by policy_init once bound
+/// @param context Context, NULL for the static one
+void policy_bind(policy_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _POLICY_H_
@@ -0,0 +1,713 @@
+// ***************************************************** //
+/// @file remote_config.c
+/// @brief Runtime configuration received over MQTT. Covers the
+/// controller bitrate and filters, the policies and batching
+/// @version 0.1
+// ***************************************************** //
+
+/// Configuration document, every section but the version is optional:
+///   {"version": 7,
+///    "bitrate": 250000,
+///    "filters": [{"id": "0x100", "mask": "0x7F0"},
+///                {"id": "0x18FEF100", "mask": "0x3FFFF00", "ext": true}],
+///    "default": {"rule": "pass", "arg": 0},
+///    "policies": [{"id": "0x100", "rule": "decimate", "arg": 10},
+///                 {"pgn": 61444, "rule": "min_interval", "arg": 100}],
+///    "routes": [{"ids": ["0x100", "0x1FF"], "topic": "fleet/{thing}/bus{bus}/0x{id}"},
+///               {"pgn": 61444, "topic": "fleet/{thing}/engine"}],
+///    "batch": {"max_frames": 20, "max_delay_ms": 200}}
+/// A document is only applied if its version is newer than the
+/// running one. The last applied document is stored in NVS.
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "remote_config.h"
+#include "json_scan.h"
+#include "gateway_config.h"
+#include "rtos_config.h"
+#include "mem_budget.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define CONFIG_QUEUE_SIZE   (2)
+#define NVS_NAMESPACE       "gw_config"
+#define NVS_KEY_DOCUMENT    "document"
+
+static const char *TAG = "CONFIG";
+
+/// The running config and the one being validated
+static remote_config_t  configs[2];
+static remote_config_t* active_config = NULL;
+
+static QueueHandle_t           configQueue = NULL;
+static remote_config_apply_fn  apply_callback;
+static remote_config_report_fn report_callback;
+
+// Task and queue are allocated statically
+static StackType_t   configStack[CONFIG_TASK_STACK_SIZE];
+static StaticTask_t  configTaskBuffer;
+static uint8_t       configQueueStorage[CONFIG_QUEUE_SIZE * sizeof(downlink_buffer_t*)];
+static StaticQueue_t configQueueBuffer;
+
+#define CONFIG_STATIC_BYTES (sizeof(configStack) + sizeof(configTaskBuffer) \
+                             + sizeof(configQueueStorage) + sizeof(configQueueBuffer))
+_Static_assert(CONFIG_STATIC_BYTES <= MEM_BUDGET_CONFIG, "Remote config exceeds MEM_BUDGET_CONFIG");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void set_defaults(remote_config_t* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->bitrate            = CAN_DEFAULT_BITRATE;
+    config->default_rule       = POLICY_DEFAULT_RULE;
+    config->default_arg        = POLICY_DEFAULT_ARG;
+    config->batch_max_frames   = BATCH_MAX_FRAMES;
+    config->batch_max_delay_ms = BATCH_MAX_DELAY_MS;
+}
+
+static const char* parse_rule(const uint8_t** p, const uint8_t* end, uint8_t* rule, uint32_t* arg)
+{
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+
+    bool has_rule = false;
+    *arg = 0;
+
+    while ((status = json_next_member(p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "rule"))
+        {
+            const uint8_t* name;
+            uint16_t name_len;
+            policy_rule_e value;
+
+            *p = json_string(*p, end, &name, &name_len);
+            if (*p == NULL || !policy_rule_from_name((const char*)name, name_len, &value))
+            {
+                return "unknown rule";
+            }
+            *rule = (uint8_t)value;
+            has_rule = true;
+        }
+        else if (json_key_is(key, key_len, "arg"))
+        {
+            *p = json_uint(*p, end, arg);
+        }
+        else
+        {
+            // The ID or PGN of a policy is read by the caller
+            *p = json_skip_value(*p, end);
+        }
+
+        if (*p == NULL)
+        {
+            return "malformed rule";
+        }
+    }
+
+    if (status == JSON_ERROR || !has_rule)
+    {
+        return "malformed rule";
+    }
+    if ((*rule == POLICY_DECIMATE || *rule == POLICY_FIRST_OF_WINDOW) && *arg == 0)
+    {
+        return "rule needs a non zero arg";
+    }
+    return NULL;
+}
+
+static const char* parse_policy(const uint8_t** p, const uint8_t* end, remote_config_policy_t* policy)
+{
+    const uint8_t* start = json_enter(*p, end, '{');
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+    bool has_key = false;
+
+    if (start == NULL)
+    {
+        return "malformed policy";
+    }
+
+    // First pass for the ID or PGN, the rule is parsed from the start
+    *p = start;
+    while ((status = json_next_member(p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "id") || json_key_is(key, key_len, "pgn"))
+        {
+            policy->is_pgn = json_key_is(key, key_len, "pgn");
+            *p = json_uint(*p, end, &policy->key);
+            has_key = true;
+        }
+        else
+        {
+            *p = json_skip_value(*p, end);
+        }
+
+        if (*p == NULL)
+        {
+            return "malformed policy";
+        }
+    }
+    if (status == JSON_ERROR || !has_key)
+    {
+        return "policy without id or pgn";
+    }
+
+    if (policy->is_pgn)
+    {
+        if (policy->key > 0x3FFFF)
+        {
+            return "invalid pgn";
+        }
+    }
+    else
+    {
+        if (policy->key > CAN_EFF_MASK)
+        {
+            return "invalid id";
+        }
+        if (policy->key > CAN_SFF_MASK)
+        {
+            policy->key |= CAN_EFF_FLAG;
+        }
+    }
+
+    const uint8_t* after = *p;
+    *p = start;
+    const char* error = parse_rule(p, end, &policy->rule, &policy->arg);
+    *p = after;
+    return error;
+}
+
+static const char* parse_filter(const uint8_t** p, const uint8_t* end, CAN_filter_t* filter)
+{
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+    bool has_id = false;
+    bool ext = false;
+
+    *p = json_enter(*p, end, '{');
+    if (*p == NULL)
+    {
+        return "malformed filter";
+    }
+
+    filter->mask = CAN_EFF_MASK;
+    while ((status = json_next_member(p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "id"))
+        {
+            *p = json_uint(*p, end, &filter->id);
+            has_id = true;
+        }
+        else if (json_key_is(key, key_len, "mask"))
+        {
+            *p = json_uint(*p, end, &filter->mask);
+        }
+        else if (json_key_is(key, key_len, "ext"))
+        {
+            *p = json_bool(*p, end, &ext);
+        }
+        else
+        {
+            *p = json_skip_value(*p, end);
+        }
+
+        if (*p == NULL)
+        {
+            return "malformed filter";
+        }
+    }
+
+    if (status == JSON_ERROR || !has_id || filter->id > CAN_EFF_MASK)
+    {
+        return "invalid filter id";
+    }
+    if (ext || filter->id > CAN_SFF_MASK)
+    {
+        filter->id |= CAN_EFF_FLAG;
+    }
+    return NULL;
+}
+
+static const char* parse_route(const uint8_t** p, const uint8_t* end, remote_config_route_t* route)
+{
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+    bool has_key = false;
+    bool ext = false;
+
+    *p = json_enter(*p, end, '{');
+    if (*p == NULL)
+    {
+        return "malformed route";
+    }
+
+    route->topic[0] = '\0';
+    while ((status = json_next_member(p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "id") || json_key_is(key, key_len, "pgn"))
+        {
+            route->is_pgn = json_key_is(key, key_len, "pgn");
+            *p = json_uint(*p, end, &route->first);
+            route->last = route->first;
+            has_key = true;
+        }
+        else if (json_key_is(key, key_len, "ids"))
+        {
+            // [first, last]
+            uint32_t bounds[2];
+            uint8_t n_bounds = 0;
+
+            *p = json_enter(*p, end, '[');
+            while (*p != NULL && (status = json_next_item(p, end)) == JSON_OK)
+            {
+                *p = (n_bounds < 2) ? json_uint(*p, end, &bounds[n_bounds++]) : NULL;
+            }
+            if (status != JSON_END || n_bounds != 2)
+            {
+                return "malformed route";
+            }
+
+            route->first  = bounds[0];
+            route->last   = bounds[1];
+            route->is_pgn = false;
+            has_key = true;
+        }
+        else if (json_key_is(key, key_len, "ext"))
+        {
+            *p = json_bool(*p, end, &ext);
+        }
+        else if (json_key_is(key, key_len, "topic"))
+        {
+            const uint8_t* str;
+            uint16_t len;
+            *p = json_string(*p, end, &str, &len);
+            if (*p != NULL && (len == 0 || len >= ROUTING_MAX_TOPIC_LEN))
+            {
+                return "invalid route topic";
+            }
+            if (*p != NULL)
+            {
+                memcpy(route->topic, str, len);
+                route->topic[len] = '\0';
+            }
+        }
+        else
+        {
+            *p = json_skip_value(*p, end);
+        }
+
+        if (*p == NULL)
+        {
+            return "malformed route";
+        }
+    }
+
+    if (status == JSON_ERROR || !has_key || route->topic[0] == '\0')
+    {
+        return "route without id, pgn or topic";
+    }
+
+    if (route->is_pgn)
+    {
+        return (route->first > 0x3FFFF) ? "invalid pgn" : NULL;
+    }
+    if (route->last < route->first || route->last > CAN_EFF_MASK)
+    {
+        return "invalid id range";
+    }
+    if (ext || route->last > CAN_SFF_MASK)
+    {
+        route->first |= CAN_EFF_FLAG;
+        route->last  |= CAN_EFF_FLAG;
+    }
+    return NULL;
+}
+
+static const char* parse_batch(const uint8_t** p, const uint8_t* end, remote_config_t* config)
+{
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+    uint32_t value;
+
+    *p = json_enter(*p, end, '{');
+    if (*p == NULL)
+    {
+        return "malformed batch";
+    }
+
+    while ((status = json_next_member(p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "max_frames"))
+        {
+            *p = json_uint(*p, end, &value);
+            if (*p != NULL && (value == 0 || value > UINT16_MAX))
+            {
+                return "invalid max_frames";
+            }
+            config->batch_max_frames = (uint16_t)value;
+        }
+        else if (json_key_is(key, key_len, "max_delay_ms"))
+        {
+            *p = json_uint(*p, end, &value);
+            if (*p != NULL && value > UINT16_MAX)
+            {
+                return "invalid max_delay_ms";
+            }
+            config->batch_max_delay_ms = (uint16_t)value;
+        }
+        else
+        {
+            *p = json_skip_value(*p, end);
+        }
+
+        if (*p == NULL)
+        {
+            return "malformed batch";
+        }
+    }
+
+    return (status == JSON_ERROR) ? "malformed batch" : NULL;
+}
+
+static const char* parse_document(const uint8_t* p, const uint8_t* end, remote_config_t* config)
+{
+    const uint8_t* key;
+    uint16_t key_len;
+    json_status_e status;
+    const char* error = NULL;
+    bool has_version = false;
+
+    p = json_enter(p, end, '{');
+    if (p == NULL)
+    {
+        return "not a JSON object";
+    }
+
+    while ((status = json_next_member(&p, end, &key, &key_len)) == JSON_OK)
+    {
+        if (json_key_is(key, key_len, "version"))
+        {
+            p = json_uint(p, end, &config->version);
+            has_version = true;
+        }
+        else if (json_key_is(key, key_len, "bitrate"))
+        {
+            p = json_uint(p, end, &config->bitrate);
+            if (p != NULL && !CAN_is_bitrate_supported(config->bitrate))
+            {
+                return "unsupported bitrate";
+            }
+        }
+        else if (json_key_is(key, key_len, "filters"))
+        {
+            p = json_enter(p, end, '[');
+            while (p != NULL && error == NULL && (status = json_next_item(&p, end)) == JSON_OK)
+            {
+                if (config->n_filters >= CAN_MAX_FILTERS)
+                {
+                    return "too many filters";
+                }
+                error = parse_filter(&p, end, &config->filters[config->n_filters++]);
+            }
+            if (status == JSON_ERROR)
+            {
+                return "malformed filters";
+            }
+        }
+        else if (json_key_is(key, key_len, "default"))
+        {
+            p = json_enter(p, end, '{');
+            if (p != NULL)
+            {
+                error = parse_rule(&p, end, &config->default_rule, &config->default_arg);
+            }
+        }
+        else if (json_key_is(key, key_len, "policies"))
+        {
+            p = json_enter(p, end, '[');
+            while (p != NULL && error == NULL && (status = json_next_item(&p, end)) == JSON_OK)
+            {
+                if (config->n_policies >= POLICY_MAX_ENTRIES)
+                {
+                    return "too many policies";
+                }
+                error = parse_policy(&p, end, &config->policies[config->n_policies++]);
+            }
+            if (status == JSON_ERROR)
+            {
+                return "malformed policies";
+            }
+        }
+        else if (json_key_is(key, key_len, "routes"))
+        {
+            p = json_enter(p, end, '[');
+            while (p != NULL && error == NULL && (status = json_next_item(&p, end)) == JSON_OK)
+            {
+                if (config->n_routes >= REMOTE_CONFIG_MAX_ROUTES)
+                {
+                    return "too many routes";
+                }
+                error = parse_route(&p, end, &config->routes[config->n_routes++]);
+            }
+            if (status == JSON_ERROR)
+            {
+                return "malformed routes";
+            }
+        }
+        else if (json_key_is(key, key_len, "batch"))
+        {
+            error = parse_batch(&p, end, config);
+        }
+        else
+        {
+            p = json_skip_value(p, end);
+        }
+
+        if (error != NULL)
+        {
+            return error;
+        }
+        if (p == NULL)
+        {
+            return "malformed document";
+        }
+    }
+
+    if (status == JSON_ERROR)
+    {
+        return "malformed document";
+    }
+    if (!has_version)
+    {
+        return "missing version";
+    }
+    if (!CAN_check_filters(config->filters, config->n_filters))
+    {
+        return "filters need more than 2 masks";
+    }
+    return NULL;
+}
+
+static bool can_settings_differ(const remote_config_t* a, const remote_config_t* b)
+{
+    return a->bitrate != b->bitrate
+        || a->n_filters != b->n_filters
+        || memcmp(a->filters, b->filters, a->n_filters * sizeof(CAN_filter_t)) != 0;
+}
+
+static void wait_one_tick(void)
+{
+    vTaskDelay(1);
+}
+
+/// @brief Builds the policy table of a config and swaps it in
+static void apply_policies(const remote_config_t* config, void (*wait)(void))
+{
+    policy_update_begin((policy_rule_e)config->default_rule, config->default_arg);
+
+    for (uint8_t i = 0; i < config->n_policies; i++)
+    {
+        const remote_config_policy_t* policy = &config->policies[i];
+        if (policy->is_pgn)
+        {
+            policy_update_set_pgn(policy->key, (policy_rule_e)policy->rule, policy->arg);
+        }
+        else
+        {
+            policy_update_set(policy->key, (policy_rule_e)policy->rule, policy->arg);
+        }
+    }
+
+    policy_update_commit(wait);
+}
+
+static void persist(const uint8_t* doc, uint16_t length)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, NVS_KEY_DOCUMENT, doc, length);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Could not store config in NVS: %s", esp_err_to_name(err));
+    }
+}
+
+static void process_document(const uint8_t* doc, uint16_t length)
+{
+    remote_config_t* next = (active_config == &configs[0]) ? &configs[1] : &configs[0];
+    const char* error = NULL;
+
+    set_defaults(next);
+    error = parse_document(doc, doc + length, next);
+
+    if (error == NULL && next->version <= active_config->version)
+    {
+        error = "version not newer than the running one";
+    }
+
+    if (error == NULL)
+    {
+        // Hardware and routes first, so a rejected bitrate or
+        // topic leaves every setting as it was
+        next->can_changed = can_settings_differ(active_config, next);
+        if (apply_callback != NULL)
+        {
+            error = apply_callback(next);
+        }
+    }
+
+    if (error == NULL)
+    {
+        apply_policies(next, wait_one_tick);
+        active_config = next;
+        persist(doc, length);
+        ESP_LOGI(TAG, "Applied config version %lu", (unsigned long)next->version);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Rejected config version %lu: %s", (unsigned long)next->version, error);
+    }
+
+    if (report_callback != NULL)
+    {
+        report_callback(next->version, error == NULL, error);
+    }
+}
+
+static void config_task(void* pvParameters)
+{
+    (void)pvParameters;
+    downlink_buffer_t* buffer;
+
+    while (true)
+    {
+        if (xQueueReceive(configQueue, &buffer, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        process_document(buffer->data, buffer->length);
+        downlink_release(buffer);
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool remote_config_parse(const uint8_t* doc, uint16_t length,
+                         remote_config_t* config, const char** error)
+{
+    set_defaults(config);
+    *error = parse_document(doc, doc + length, config);
+    return (*error == NULL);
+}
+
+const remote_config_t* remote_config_load(void)
+{
+    set_defaults(&configs[0]);
+    active_config = &configs[0];
+
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        // Nothing stored yet
+        return NULL;
+    }
+
+    downlink_buffer_t* buffer = downlink_acquire();
+    size_t length = sizeof(buffer->data);
+    esp_err_t err = ESP_FAIL;
+    if (buffer != NULL)
+    {
+        err = nvs_get_blob(handle, NVS_KEY_DOCUMENT, buffer->data, &length);
+    }
+    nvs_close(handle);
+
+    // Sections missing from the document keep the compiled defaults,
+    // as for a document received at runtime
+    const char* error = "no stored document";
+    if (err == ESP_OK)
+    {
+        set_defaults(&configs[1]);
+        error = parse_document(buffer->data, buffer->data + length, &configs[1]);
+    }
+    downlink_release(buffer);
+
+    if (error != NULL)
+    {
+        ESP_LOGW(TAG, "Booting with the compiled config: %s", error);
+        return NULL;
+    }
+
+    // No frame is evaluated yet, the swap needs no grace period
+    configs[1].can_changed = can_settings_differ(&configs[0], &configs[1]);
+    apply_policies(&configs[1], NULL);
+    active_config = &configs[1];
+
+    ESP_LOGI(TAG, "Loaded config version %lu from NVS", (unsigned long)active_config->version);
+    return active_config;
+}
+
+void remote_config_start(remote_config_apply_fn apply, remote_config_report_fn report)
+{
+    if (active_config == NULL)
+    {
+        set_defaults(&configs[0]);
+        active_config = &configs[0];
+    }
+
+    apply_callback  = apply;
+    report_callback = report;
+
+    configQueue = xQueueCreateStatic(CONFIG_QUEUE_SIZE,
+                                     sizeof(downlink_buffer_t*),
+                                     configQueueStorage,
+                                     &configQueueBuffer);
+
+    xTaskCreateStaticPinnedToCore(config_task,
+                                  "config_task",
+                                  CONFIG_TASK_STACK_SIZE,
+                                  NULL,
+                                  CONFIG_TASK_PRIORITY,
+                                  configStack,
+                                  &configTaskBuffer,
+                                  CONFIG_TASK_CORE);
+    mem_budget_account(MEM_CONFIG, CONFIG_STATIC_BYTES);
+}
+
+bool remote_config_submit(downlink_buffer_t* buffer)
+{
+    if (configQueue == NULL)
+    {
+        return false;
+    }
+
+    return (xQueueSend(configQueue, &buffer, 0) == pdTRUE);
+}
@@ -0,0 +1,119 @@
+// ***************************************************** //
+/// @file remote_config.h
+/// @brief Runtime configuration received over MQTT. Covers the
+/// controller bitrate and filters, the policies and batching
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _REMOTE_CONFIG_H_
+#define _REMOTE_CONFIG_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+#include "policy.h"
+#include "downlink.h"
+#include "routing.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Largest configuration document, shares the downlink buffers
+#define REMOTE_CONFIG_MAX_LEN       DOWNLINK_MAX_PAYLOAD
+
+/// Longest error message reported for a rejected document
+#define REMOTE_CONFIG_MAX_ERROR_LEN (48)
+
+/// Routing rules per document
+#define REMOTE_CONFIG_MAX_ROUTES    (16)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef struct
+{
+    uint32_t key;           // CAN ID with CAN_EFF_FLAG, or PGN
+    uint32_t arg;
+    uint8_t  rule;          // policy_rule_e
+    uint8_t  is_pgn;
+} remote_config_policy_t;
+
+typedef struct
+{
+    uint32_t first;         // CAN ID with CAN_EFF_FLAG, or PGN
+    uint32_t last;          // Last ID of the range, equal to first for a PGN
+    uint8_t  is_pgn;
+    char     topic[ROUTING_MAX_TOPIC_LEN];  // Topic template
+} remote_config_route_t;
+
+/// @brief A validated configuration document. Sections missing
+/// from the document keep the compiled defaults
+typedef struct
+{
+    uint32_t               version;
+    uint32_t               bitrate;
+    uint8_t                n_filters;
+    CAN_filter_t           filters[CAN_MAX_FILTERS];
+    uint8_t                default_rule;
+    uint32_t               default_arg;
+    uint8_t                n_policies;
+    remote_config_policy_t policies[POLICY_MAX_ENTRIES];
+    uint8_t                n_routes;
+    remote_config_route_t  routes[REMOTE_CONFIG_MAX_ROUTES];
+    uint16_t               batch_max_frames;
+    uint16_t               batch_max_delay_ms;
+    bool                   can_changed;     // Bitrate or filters differ from the previous config
+} remote_config_t;
+
+/// @brief Applies the parts of a config owned by the task that
+/// drives the controller and publishes. Called from the
+/// configuration task, must block until done
+/// @return NULL on success, otherwise why the settings were rejected
+typedef const char* (*remote_config_apply_fn)(const remote_config_t* config);
+
+/// @brief Receives the outcome of every submitted document
+typedef void (*remote_config_report_fn)(uint32_t version, bool ok, const char* error);
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Validates a document and fills a config. Does not change
+/// the running configuration
+/// @param doc JSON document
+/// @param length Document length in bytes
+/// @param config Output configuration
+/// @param error Output description of the first problem found
+/// @return false if the document is invalid
+bool remote_config_parse(const uint8_t* doc, uint16_t length,
+                         remote_config_t* config, const char** error);
+
+/// @brief Loads the last good document from NVS and applies its
+/// policies. Must be called before the receive path starts
+/// @return The loaded config, NULL if none was stored or it was invalid
+const remote_config_t* remote_config_load(void);
+
+/// @brief Creates the configuration task
+/// @param apply Applies controller, routing and batching settings
+/// @param report Called with the result of every document
+void remote_config_start(remote_config_apply_fn apply, remote_config_report_fn report);
+
+/// @brief Hands a document to the configuration task. The buffer is
+/// released by the task once the document has been processed
+/// @param buffer Document received on the config topic
+/// @return false if the task queue is full, the buffer is not taken
+bool remote_config_submit(downlink_buffer_t* buffer);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _REMOTE_CONFIG_H_
@@ -0,0 +1,365 @@
+// ***************************************************** //
+/// @file routing.c
+/// @brief Maps CAN IDs and J1939 PGNs to MQTT topics. Topics
+/// are rendered once when the rules are set, never per frame
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "routing.h"
+#include "gateway_config.h"
+#include "j1939.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define ROUTING_EMPTY_KEY       (0xFFFFFFFFUL)
+#define ROUTING_MAX_THING_LEN   (32)
+
+// Same key space as the policy table, PGN keys never collide
+// with extended IDs that always carry CAN_EFF_FLAG
+#define ROUTING_PGN_KEY(pgn)    (CAN_RTR_FLAG | ((pgn) & 0x3FFFFUL))
+
+typedef struct
+{
+    char    topics[ROUTING_MAX_TOPICS][ROUTING_MAX_TOPIC_LEN];
+    uint8_t n_topics;
+    uint8_t n_pgn_rules;
+
+    /// Standard IDs index the topic table directly
+    uint8_t  std_route[CAN_SFF_MASK + 1];
+
+    /// Extended IDs and PGNs go through an open-addressed hash
+    uint32_t ext_keys[ROUTING_EXT_SLOTS];
+    uint8_t  ext_route[ROUTING_EXT_SLOTS];
+} routing_table_t;
+
+/// Topic tables of one bus
+struct routing_context
+{
+    /// Frames are routed with the active table while updates are
+    /// built in the other one
+    routing_table_t  tables[2];
+    routing_table_t* active;
+
+    char    thing_name[ROUTING_MAX_THING_LEN];
+    uint8_t bus_index;
+};
+
+GW_CONTEXT(routing_context_t);
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static inline uint32_t ext_hash(uint32_t key)
+{
+    return ((uint32_t)(key * 0x9E3779B1UL) >> 16) & (ROUTING_EXT_SLOTS - 1);
+}
+
+static uint8_t* find_ext_route(routing_table_t* table, uint32_t key, bool create)
+{
+    uint32_t slot = ext_hash(key);
+    for (uint32_t probe = 0; probe < ROUTING_EXT_SLOTS; probe++)
+    {
+        if (table->ext_keys[slot] == key)
+        {
+            return &table->ext_route[slot];
+        }
+        if (table->ext_keys[slot] == ROUTING_EMPTY_KEY)
+        {
+            if (!create)
+            {
+                return NULL;
+            }
+            table->ext_keys[slot] = key;
+            return &table->ext_route[slot];
+        }
+        slot = (slot + 1) & (ROUTING_EXT_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+static routing_table_t* standby_table(void)
+{
+    return (ctx->active == &ctx->tables[0]) ? &ctx->tables[1] : &ctx->tables[0];
+}
+
+static void table_init(routing_table_t* table, const char* default_topic)
+{
+    memset(table->std_route, ROUTING_DEFAULT_TOPIC, sizeof(table->std_route));
+    memset(table->ext_keys, 0xFF, sizeof(table->ext_keys));
+    table->n_pgn_rules = 0;
+    table->n_topics    = 1;
+    snprintf(table->topics[ROUTING_DEFAULT_TOPIC], ROUTING_MAX_TOPIC_LEN, "%s", default_topic);
+}
+
+static bool name_is(const char* name, size_t len, const char* expected)
+{
+    return strlen(expected) == len && memcmp(name, expected, len) == 0;
+}
+
+/// @brief Expands a template into out
+/// @param var Name of the placeholder holding value, "id" or "pgn"
+static bool render_topic(char out[ROUTING_MAX_TOPIC_LEN], const char* topic_template,
+                         const char* var, uint32_t value)
+{
+    size_t len = 0;
+    const char* p = topic_template;
+
+    while (*p != '\0')
+    {
+        // Wildcards are not allowed in published topics
+        if (*p == '+' || *p == '#' || *p == '}')
+        {
+            return false;
+        }
+
+        if (*p != '{')
+        {
+            if (len + 1 >= ROUTING_MAX_TOPIC_LEN)
+            {
+                return false;
+            }
+            out[len++] = *p++;
+            continue;
+        }
+
+        const char* close = strchr(p, '}');
+        if (close == NULL)
+        {
+            return false;
+        }
+
+        const char* name = p + 1;
+        size_t name_len = (size_t)(close - name);
+        size_t room = ROUTING_MAX_TOPIC_LEN - len;
+        int written;
+
+        if (name_is(name, name_len, "thing"))
+        {
+            written = snprintf(&out[len], room, "%s", ctx->thing_name);
+        }
+        else if (name_is(name, name_len, "bus"))
+        {
+            written = snprintf(&out[len], room, "%u", ctx->bus_index);
+        }
+        else if (name_is(name, name_len, "id") && strcmp(var, "id") == 0)
+        {
+            written = snprintf(&out[len], room, "%lX", (unsigned long)value);
+        }
+        else if (name_is(name, name_len, "pgn") && strcmp(var, "pgn") == 0)
+        {
+            written = snprintf(&out[len], room, "%lu", (unsigned long)value);
+        }
+        else
+        {
+            return false;
+        }
+
+        if (written < 0 || (size_t)written >= room)
+        {
+            return false;
+        }
+        len += (size_t)written;
+        p = close + 1;
+    }
+
+    out[len] = '\0';
+    return (len > 0);
+}
+
+/// @brief Renders a topic and returns its index, reusing an
+/// identical topic if there is one
+/// @return Topic index, or ROUTING_MAX_TOPICS on failure
+static uint8_t add_topic(routing_table_t* table, const char* topic_template,
+                         const char* var, uint32_t value)
+{
+    char topic[ROUTING_MAX_TOPIC_LEN];
+    if (!render_topic(topic, topic_template, var, value))
+    {
+        return ROUTING_MAX_TOPICS;
+    }
+
+    for (uint8_t i = 0; i < table->n_topics; i++)
+    {
+        if (strcmp(table->topics[i], topic) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (table->n_topics >= ROUTING_MAX_TOPICS)
+    {
+        return ROUTING_MAX_TOPICS;
+    }
+
+    memcpy(table->topics[table->n_topics], topic, sizeof(topic));
+    return table->n_topics++;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void routing_init(const char* default_topic, const char* thing, uint8_t bus)
+{
+    snprintf(ctx->thing_name, sizeof(ctx->thing_name), "%s", thing);
+    ctx->bus_index = bus;
+
+    // Gateways with several buses keep their default topics apart
+    char topic[ROUTING_MAX_TOPIC_LEN];
+    if (!render_topic(topic, default_topic, "", 0))
+    {
+        snprintf(topic, sizeof(topic), "%s", default_topic);
+    }
+
+    table_init(&ctx->tables[0], topic);
+    ctx->active = &ctx->tables[0];
+}
+
+void routing_update_begin(void)
+{
+    table_init(standby_table(), ctx->active->topics[ROUTING_DEFAULT_TOPIC]);
+}
+
+bool routing_update_ids(uint32_t first, uint32_t last, const char* topic_template)
+{
+    routing_table_t* table = standby_table();
+    bool     ext      = (first & CAN_EFF_FLAG) != 0;
+    uint32_t mask     = ext ? CAN_EFF_MASK : CAN_SFF_MASK;
+    bool     per_id   = (strstr(topic_template, "{id}") != NULL);
+    uint8_t  index    = ROUTING_DEFAULT_TOPIC;
+
+    first &= mask;
+    if ((ext != ((last & CAN_EFF_FLAG) != 0)) || (last & ~CAN_EFF_FLAG) > mask || (last & mask) < first)
+    {
+        return false;
+    }
+    last &= mask;
+
+    // Extended ranges are stored ID by ID in the hash
+    if (ext && last - first >= ROUTING_EXT_SLOTS)
+    {
+        return false;
+    }
+
+    if (!per_id)
+    {
+        index = add_topic(table, topic_template, "id", 0);
+        if (index == ROUTING_MAX_TOPICS)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t id = first; id <= last; id++)
+    {
+        if (per_id)
+        {
+            index = add_topic(table, topic_template, "id", id);
+            if (index == ROUTING_MAX_TOPICS)
+            {
+                return false;
+            }
+        }
+
+        if (ext)
+        {
+            uint8_t* route = find_ext_route(table, CAN_EFF_FLAG | id, true);
+            if (route == NULL)
+            {
+                return false;
+            }
+            *route = index;
+        }
+        else
+        {
+            table->std_route[id] = index;
+        }
+    }
+
+    return true;
+}
+
+bool routing_update_pgn(uint32_t pgn, const char* topic_template)
+{
+    routing_table_t* table = standby_table();
+
+    if (pgn > 0x3FFFF)
+    {
+        return false;
+    }
+
+    uint8_t index = add_topic(table, topic_template, "pgn", pgn);
+    if (index == ROUTING_MAX_TOPICS)
+    {
+        return false;
+    }
+
+    uint8_t* route = find_ext_route(table, ROUTING_PGN_KEY(pgn), true);
+    if (route == NULL)
+    {
+        return false;
+    }
+
+    *route = index;
+    table->n_pgn_rules++;
+    return true;
+}
+
+void routing_update_commit(void)
+{
+    ctx->active = standby_table();
+}
+
+uint8_t routing_lookup(const CAN_frame_t* frame)
+{
+    routing_table_t* table = ctx->active;
+
+    if (!(frame->can_id & CAN_EFF_FLAG))
+    {
+        return table->std_route[frame->can_id & CAN_SFF_MASK];
+    }
+
+    const uint8_t* route = find_ext_route(table, frame->can_id & (CAN_EFF_FLAG | CAN_EFF_MASK), false);
+    if (route != NULL)
+    {
+        return *route;
+    }
+
+    j1939_id_t j1939_id;
+    if (table->n_pgn_rules > 0 && j1939_parse_id(frame->can_id, &j1939_id))
+    {
+        return routing_lookup_pgn(j1939_id.pgn);
+    }
+
+    return ROUTING_DEFAULT_TOPIC;
+}
+
+uint8_t routing_lookup_pgn(uint32_t pgn)
+{
+    const uint8_t* route = find_ext_route(ctx->active, ROUTING_PGN_KEY(pgn), false);
+    return (route != NULL) ? *route : ROUTING_DEFAULT_TOPIC;
+}
+
+const char* routing_topic(uint8_t index)
+{
+    return ctx->active->topics[(index < ctx->active->n_topics) ? index : ROUTING_DEFAULT_TOPIC];
+}
+
+#if GW_CONTEXT_PER_THREAD
+size_t routing_context_size(void)
+{
+    return sizeof(routing_context_t);
+}
+
+void routing_bind(routing_context_t* context)
+{
+    ctx = (context != NULL) ? context : &ctxDefault;
+}
+#endif // GW_CONTEXT_PER_THREAD
@@ -0,0 +1,108 @@
+// ***************************************************** //
+/// @file routing.h
+/// @brief Maps CAN IDs and J1939 PGNs to MQTT topics. Topics
+/// are rendered once when the rules are set, never per frame
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _ROUTING_H_
+#define _ROUTING_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Rendered topics, including the default one at index 0
+#define ROUTING_MAX_TOPICS      (32)
+
+/// Longest topic, including the terminator
+#define ROUTING_MAX_TOPIC_LEN   (64)
+
+/// Slots of the extended ID and PGN hash. Must be a power of two
+#define ROUTING_EXT_SLOTS       (128)
+
+/// Topic of frames that match no rule
+#define ROUTING_DEFAULT_TOPIC   (0)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief State of one bus, see GW_CONTEXT_PER_THREAD
+typedef struct routing_context routing_context_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Clears all rules. Every frame goes to the default topic
+/// @param default_topic Topic of frames without a rule. May hold
+/// {thing} and {bus}, a topic that does not render is kept as is
+/// @param thing Replaces {thing} in topic templates
+/// @param bus Replaces {bus} in topic templates
+void routing_init(const char* default_topic, const char* thing, uint8_t bus);
+
+/// @brief Starts building a new rule set. The active rules keep
+/// being used until routing_update_commit. If adding a rule fails
+/// the new set is incomplete and must not be committed
+void routing_update_begin(void);
+
+/// @brief Routes a range of IDs to a topic template. Templates may
+/// contain {thing}, {bus} and {id}, the ID in hex. A template with
+/// {id} renders one topic per ID of the range
+/// @param first First CAN ID, with CAN_EFF_FLAG for extended IDs
+/// @param last Last CAN ID, of the same kind as first
+/// @param topic_template Topic template
+/// @return false if the topics or the hash are full, or the template is invalid
+bool routing_update_ids(uint32_t first, uint32_t last, const char* topic_template);
+
+/// @brief Routes a J1939 parameter group to a topic template, for
+/// every source address. Templates may contain {thing}, {bus} and {pgn}
+/// @param pgn 18-bit parameter group number
+/// @param topic_template Topic template
+/// @return false if the topics or the hash are full, or the template is invalid
+bool routing_update_pgn(uint32_t pgn, const char* topic_template);
+
+/// @brief Makes the new rule set active. Must be called from the
+/// task that routes frames, topic indexes of the old set are invalid
+void routing_update_commit(void);
+
+/// @brief Finds the topic of a frame. An exact extended ID rule takes
+/// precedence over the PGN rule of a J1939 frame
+/// @param frame Received CAN frame
+/// @return Topic index, ROUTING_DEFAULT_TOPIC if no rule matches
+uint8_t routing_lookup(const CAN_frame_t* frame);
+
+/// @brief Finds the topic of a reassembled J1939 parameter group
+/// @param pgn 18-bit parameter group number
+/// @return Topic index, ROUTING_DEFAULT_TOPIC if no rule matches
+uint8_t routing_lookup_pgn(uint32_t pgn);
+
+/// @brief Rendered topic of an index returned by a lookup
+const char* routing_topic(uint8_t index);
+
+/// @brief Size of a context, allocated by the caller for each bus.
+/// Only with GW_CONTEXT_PER_THREAD
+size_t routing_context_size(void);
+
+/// @brief Binds a context to the calling thread. A new context is
+/// zeroed, then set up by routing_init once bound
+/// @param context Context, NULL for the static one
+void routing_bind(routing_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _ROUTING_H_
@@ -0,0 +1,452 @@
+// ***************************************************** //
+/// @file slcan.c
+/// @brief SLCAN (Lawicel) protocol on the console UART, so
+/// the gateway can be used as a CAN adapter by slcand. The
+/// encoder and the command parser are portable, the UART
+/// side is in slcan_uart.c
+/// @version 0.1
+// ***************************************************** //
+
+/// Commands, each ended by a CR. Replies are CR on success and BEL
+/// on error:
+///   Sn       Bitrate while closed, n = 0..8 for 10k, 20k, 50k, 100k,
+///            125k, 250k, 500k, 800k and 1M bit/s
+///   O / L    Opens the channel, L in listen only mode: the controller
+///            acknowledges no frame and transmit is refused
+///   C        Closes the channel
+///   Zn       Timestamps off (0) or on (1), while closed
+///   tiiildd  Transmits a standard frame, replies z and CR
+///   Tiiiiiiiildd   Extended frame, replies Z and CR
+///   riiil / Riiiiiiiil   Remote frames
+///   V / N    Version and serial number
+///   F        Status flags, bit 3 when frames were lost
+/// Received frames are streamed in the transmit format, followed by
+/// the time in milliseconds modulo 60000 when timestamps are on.
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "slcan.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define SLCAN_STATUS_OVERRUN    (0x08)
+
+_Static_assert(SLCAN_BUFFERS >= 2, "The stream needs a buffer while another is written");
+
+typedef enum
+{
+    BUFFER_FREE,        // Available to the stream
+    BUFFER_FILLING,     // Owned by the stream
+    BUFFER_FULL         // Owned by the writer
+} buffer_state_e;
+
+typedef struct
+{
+    char     data[SLCAN_BUFFER_SIZE];
+    uint32_t len;
+    uint32_t first_ms;      // Time of the oldest line
+    uint8_t  state;
+} slcan_buffer_t;
+
+static slcan_buffer_t buffers[SLCAN_BUFFERS];
+
+static const slcan_ops_t* stream_ops = NULL;
+static bool               stream_timestamps;
+static uint32_t           max_wait_ms;
+
+/// Kept after slcan_stream_stop, full buffers are still written
+static const slcan_ops_t* write_ops = NULL;
+
+/// Streaming side
+static slcan_buffer_t* active = NULL;
+static uint8_t         fill_index = 0;
+
+/// Writer side
+static uint8_t write_index = 0;
+
+static slcan_stats_t stats;
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static const uint32_t BITRATES[] =
+{
+    10000, 20000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000,
+};
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static char* put_hex(char* p, uint32_t value, uint8_t digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        p[i] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+    return p + digits;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex(const char* p, uint8_t digits, uint32_t* value)
+{
+    uint32_t result = 0;
+
+    for (uint8_t i = 0; i < digits; i++)
+    {
+        int nibble = hex_value(p[i]);
+        if (nibble < 0)
+        {
+            return false;
+        }
+        result = (result << 4) | (uint32_t)nibble;
+    }
+
+    *value = result;
+    return true;
+}
+
+static uint8_t reply_error(char* reply)
+{
+    reply[0] = SLCAN_ERROR;
+    return 1;
+}
+
+static uint8_t reply_ok(char* reply)
+{
+    reply[0] = SLCAN_OK;
+    return 1;
+}
+
+static uint8_t execute(slcan_parser_t* parser, const slcan_ops_t* ops, char* reply)
+{
+    const char* cmd = parser->text;
+    uint8_t     len = parser->len;
+
+    switch (cmd[0])
+    {
+        case 'S':
+            if (parser->open || len != 2 || cmd[1] < '0' || cmd[1] > '8'
+                || !ops->set_bitrate(BITRATES[cmd[1] - '0']))
+            {
+                return reply_error(reply);
+            }
+            return reply_ok(reply);
+
+        case 'O':
+        case 'L':
+            if (parser->open || len != 1 || !ops->open(parser->timestamps, cmd[0] == 'L'))
+            {
+                return reply_error(reply);
+            }
+            parser->open        = true;
+            parser->listen_only = (cmd[0] == 'L');
+            return reply_ok(reply);
+
+        case 'C':
+            // slcand closes before configuring, a closed channel is fine
+            if (parser->open)
+            {
+                ops->close();
+                parser->open        = false;
+                parser->listen_only = false;
+            }
+            return reply_ok(reply);
+
+        case 'Z':
+            if (parser->open || len != 2 || (cmd[1] != '0' && cmd[1] != '1'))
+            {
+                return reply_error(reply);
+            }
+            parser->timestamps = (cmd[1] == '1');
+            return reply_ok(reply);
+
+        case 't':
+        case 'T':
+        case 'r':
+        case 'R':
+        {
+            CAN_frame_t frame;
+            if (!parser->open || parser->listen_only || !slcan_decode(cmd, len, &frame)
+                || !ops->transmit(&frame))
+            {
+                return reply_error(reply);
+            }
+            reply[0] = (cmd[0] == 't' || cmd[0] == 'r') ? 'z' : 'Z';
+            reply[1] = SLCAN_OK;
+            return 2;
+        }
+
+        case 'V':
+            memcpy(reply, "V0101\r", 6);
+            return 6;
+
+        case 'N':
+            memcpy(reply, "NGW01\r", 6);
+            return 6;
+
+        case 'F':
+        {
+            if (!parser->open)
+            {
+                return reply_error(reply);
+            }
+
+            uint32_t drops = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+            uint8_t  flags = (drops != parser->reported_drops) ? SLCAN_STATUS_OVERRUN : 0;
+            parser->reported_drops = drops;
+
+            reply[0] = 'F';
+            put_hex(&reply[1], flags, 2);
+            reply[3] = SLCAN_OK;
+            return 4;
+        }
+
+        default:
+            return reply_error(reply);
+    }
+}
+
+static slcan_buffer_t* acquire(uint32_t now_ms)
+{
+    slcan_buffer_t* buffer = &buffers[fill_index];
+    if (__atomic_load_n(&buffer->state, __ATOMIC_ACQUIRE) != BUFFER_FREE)
+    {
+        return NULL;
+    }
+
+    fill_index = (fill_index + 1) % SLCAN_BUFFERS;
+
+    buffer->state    = BUFFER_FILLING;
+    buffer->len      = 0;
+    buffer->first_ms = now_ms;
+    return buffer;
+}
+
+static void submit(void)
+{
+    __atomic_store_n(&active->state, BUFFER_FULL, __ATOMIC_RELEASE);
+    active = NULL;
+    stream_ops->ready();
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+uint8_t slcan_encode(const CAN_frame_t* frame, bool timestamps, uint32_t time_ms, char* out)
+{
+    uint32_t can_id = frame->can_id;
+    bool     ext    = (can_id & CAN_EFF_FLAG) != 0;
+    bool     rtr    = (can_id & CAN_RTR_FLAG) != 0;
+    uint8_t  dlc    = (frame->can_dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->can_dlc;
+    char*    p      = out;
+
+    if (can_id & CAN_ERR_FLAG)
+    {
+        return 0;
+    }
+
+    if (ext)
+    {
+        *p++ = rtr ? 'R' : 'T';
+        p = put_hex(p, can_id & CAN_EFF_MASK, 8);
+    }
+    else
+    {
+        *p++ = rtr ? 'r' : 't';
+        p = put_hex(p, can_id & CAN_SFF_MASK, 3);
+    }
+    *p++ = (char)('0' + dlc);
+
+    if (!rtr)
+    {
+        for (uint8_t i = 0; i < dlc; i++)
+        {
+            *p++ = HEX_DIGITS[frame->data[i] >> 4];
+            *p++ = HEX_DIGITS[frame->data[i] & 0xF];
+        }
+    }
+    if (timestamps)
+    {
+        p = put_hex(p, time_ms % 60000, 4);
+    }
+    *p++ = SLCAN_OK;
+
+    return (uint8_t)(p - out);
+}
+
+bool slcan_decode(const char* cmd, uint8_t len, CAN_frame_t* frame)
+{
+    bool    ext    = (cmd[0] == 'T' || cmd[0] == 'R');
+    bool    rtr    = (cmd[0] == 'r' || cmd[0] == 'R');
+    uint8_t id_len = ext ? 8 : 3;
+    uint32_t id;
+
+    if (len < 1 + id_len + 1 || !parse_hex(&cmd[1], id_len, &id)
+        || id > (ext ? CAN_EFF_MASK : CAN_SFF_MASK))
+    {
+        return false;
+    }
+
+    uint8_t dlc = (uint8_t)(cmd[1 + id_len] - '0');
+    if (dlc > CAN_MAX_DLEN)
+    {
+        return false;
+    }
+
+    uint8_t n_data = rtr ? 0 : dlc;
+    if (len != 2 + id_len + 2 * n_data)
+    {
+        return false;
+    }
+
+    const char* data = &cmd[2 + id_len];
+    for (uint8_t i = 0; i < n_data; i++)
+    {
+        uint32_t byte;
+        if (!parse_hex(&data[2 * i], 2, &byte))
+        {
+            return false;
+        }
+        frame->data[i] = (uint8_t)byte;
+    }
+
+    frame->can_id  = id | (ext ? CAN_EFF_FLAG : 0) | (rtr ? CAN_RTR_FLAG : 0);
+    frame->can_dlc = dlc;
+    return true;
+}
+
+uint8_t slcan_feed(slcan_parser_t* parser, const slcan_ops_t* ops, char c, char* reply)
+{
+    if (c == '\n')
+    {
+        return 0;
+    }
+
+    if (c != '\r')
+    {
+        if (parser->len < SLCAN_MAX_CMD_LEN)
+        {
+            parser->text[parser->len++] = c;
+        }
+        else
+        {
+            parser->overflow = true;
+        }
+        return 0;
+    }
+
+    // A bare CR, e.g. slcand flushing the line, needs no reply
+    uint8_t reply_len = 0;
+    if (parser->overflow)
+    {
+        reply_len = reply_error(reply);
+    }
+    else if (parser->len > 0)
+    {
+        reply_len = execute(parser, ops, reply);
+    }
+
+    parser->len      = 0;
+    parser->overflow = false;
+    return reply_len;
+}
+
+void slcan_stream_start(const slcan_ops_t* ops, bool timestamps, uint32_t flush_ms)
+{
+    // The ring is kept: buffers filled before a close are still owned
+    // by the writer, and the new lines follow them
+    stream_timestamps = timestamps;
+    max_wait_ms       = flush_ms;
+    write_ops         = ops;
+    stream_ops        = ops;
+}
+
+void slcan_stream_stop(void)
+{
+    // The lines received before the close are still written
+    if (active != NULL)
+    {
+        submit();
+    }
+    stream_ops = NULL;
+}
+
+bool slcan_frame(const CAN_frame_t* frame, uint32_t now_ms)
+{
+    // Error frames have no SLCAN line
+    if (stream_ops == NULL || (frame->can_id & CAN_ERR_FLAG))
+    {
+        return false;
+    }
+
+    if (active == NULL)
+    {
+        active = acquire(now_ms);
+        if (active == NULL)
+        {
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+
+    // Encoded in place, the buffer always has room for one line
+    active->len += slcan_encode(frame, stream_timestamps, now_ms, &active->data[active->len]);
+    stats.frames++;
+
+    if (active->len > SLCAN_BUFFER_SIZE - SLCAN_MAX_FRAME_LEN)
+    {
+        submit();
+    }
+    return true;
+}
+
+void slcan_poll(uint32_t now_ms)
+{
+    if (active != NULL && (uint32_t)(now_ms - active->first_ms) >= max_wait_ms)
+    {
+        submit();
+    }
+}
+
+uint32_t slcan_next_due_ms(uint32_t now_ms)
+{
+    if (active == NULL)
+    {
+        return UINT32_MAX;
+    }
+
+    uint32_t age = now_ms - active->first_ms;
+    return (age >= max_wait_ms) ? 0 : max_wait_ms - age;
+}
+
+bool slcan_write_next(void)
+{
+    slcan_buffer_t* buffer = &buffers[write_index];
+    if (__atomic_load_n(&buffer->state, __ATOMIC_ACQUIRE) != BUFFER_FULL)
+    {
+        return false;
+    }
+
+    write_ops->write(buffer->data, buffer->len);
+    stats.bytes += buffer->len;
+
+    write_index = (write_index + 1) % SLCAN_BUFFERS;
+    __atomic_store_n(&buffer->state, BUFFER_FREE, __ATOMIC_RELEASE);
+    return true;
+}
+
+void slcan_get_stats(slcan_stats_t* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,166 @@
+// ***************************************************** //
+/// @file slcan.h
+/// @brief SLCAN (Lawicel) protocol on the console UART, so
+/// the gateway can be used as a CAN adapter by slcand. The
+/// encoder and the command parser are portable, the UART
+/// side is in slcan_uart.c
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _SLCAN_H_
+#define _SLCAN_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Longest frame line: 'T', 8 ID digits, DLC, 16 data digits,
+/// 4 timestamp digits and the CR
+#define SLCAN_MAX_FRAME_LEN     (31)
+
+/// Longest command, a transmitted extended frame without its CR
+#define SLCAN_MAX_CMD_LEN       (26)
+
+/// Longest reply to a command
+#define SLCAN_MAX_REPLY_LEN     (8)
+
+/// Buffers filled by the stream and written to the UART
+#define SLCAN_BUFFERS           (4)
+#define SLCAN_BUFFER_SIZE       (1024)
+
+/// Static memory of the stream, for the memory budget
+#define SLCAN_STATIC_BYTES      (SLCAN_BUFFERS * SLCAN_BUFFER_SIZE)
+
+/// Replies of the protocol
+#define SLCAN_OK                '\r'
+#define SLCAN_ERROR             '\a'
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+/// @brief Controller and UART side of the protocol
+typedef struct
+{
+    /// Starts streaming the received frames, the controller in listen
+    /// only mode or in normal mode. Called from the parser
+    bool (*open)(bool timestamps, bool listen_only);
+    /// Stops streaming, the controller back in normal mode. Called
+    /// from the parser
+    void (*close)(void);
+    /// Changes the bitrate while closed, called from the parser
+    bool (*set_bitrate)(uint32_t bitrate);
+    /// Queues a frame on the bus, called from the parser
+    bool (*transmit)(const CAN_frame_t* frame);
+    /// Writes streamed lines, called from the writer
+    void (*write)(const char* data, uint32_t len);
+    /// A buffer is waiting, called from the streaming task
+    void (*ready)(void);
+} slcan_ops_t;
+
+/// @brief Command being received and state of the channel. Only
+/// used by the parser task
+typedef struct
+{
+    char     text[SLCAN_MAX_CMD_LEN];
+    uint8_t  len;
+    bool     overflow;          // Characters were lost, the command fails
+    bool     open;
+    bool     listen_only;       // Opened with 'L', transmit is refused
+    bool     timestamps;        // 'Z1', frames carry a millisecond stamp
+    uint32_t reported_drops;    // Drops already reported by 'F'
+} slcan_parser_t;
+
+typedef struct
+{
+    uint32_t frames;        // Frames streamed
+    uint32_t dropped;       // Frames lost, every buffer waiting for the UART
+    uint32_t bytes;         // Bytes written
+} slcan_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Writes a frame as an SLCAN line, with its CR
+/// @param frame Frame to encode
+/// @param timestamps Appends the time as 4 hex digits
+/// @param time_ms Time in milliseconds, modulo 60000 on the wire
+/// @param out Output, at least SLCAN_MAX_FRAME_LEN characters
+/// @return Length of the line, 0 for error frames
+uint8_t slcan_encode(const CAN_frame_t* frame, bool timestamps, uint32_t time_ms, char* out);
+
+/// @brief Parses the command of a transmit line: t, T, r or R
+/// @param cmd Command without its CR
+/// @param len Length of the command
+/// @param frame Output frame
+/// @return false if the command is malformed
+bool slcan_decode(const char* cmd, uint8_t len, CAN_frame_t* frame);
+
+/// @brief Adds a received character to the command. On CR the
+/// command is run with the parser operations
+/// @param parser Parser, zeroed before the first character
+/// @param ops Operations
+/// @param c Character received
+/// @param reply Output reply, at least SLCAN_MAX_REPLY_LEN characters
+/// @return Length of the reply to write back, 0 if none yet
+uint8_t slcan_feed(slcan_parser_t* parser, const slcan_ops_t* ops, char c, char* reply);
+
+/// @brief Starts streaming. Lines still waiting from the previous
+/// stream are written first. Must be called from the task that
+/// receives frames
+/// @param ops Operations
+/// @param timestamps Lines carry a millisecond stamp
+/// @param flush_ms Longest time a line waits in a buffer
+void slcan_stream_start(const slcan_ops_t* ops, bool timestamps, uint32_t flush_ms);
+
+/// @brief Stops streaming, the waiting lines are still written. Same
+/// task as slcan_stream_start
+void slcan_stream_stop(void);
+
+/// @brief Stores a frame while streaming. Same task as slcan_stream_start
+/// @param frame Received frame
+/// @param now_ms Current time in milliseconds
+/// @return false if the frame was dropped for lack of buffer
+bool slcan_frame(const CAN_frame_t* frame, uint32_t now_ms);
+
+/// @brief Hands a buffer older than flush_ms to the writer. Same
+/// task as slcan_frame
+/// @param now_ms Current time in milliseconds
+void slcan_poll(uint32_t now_ms);
+
+/// @brief Time until slcan_poll has something to do
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if nothing is pending
+uint32_t slcan_next_due_ms(uint32_t now_ms);
+
+/// @brief Writes the oldest full buffer with ops.write. Called by
+/// the writer after ops.ready, until it returns false
+/// @return false if no buffer was waiting
+bool slcan_write_next(void);
+
+/// @brief Copies the stream counters
+/// @param stats Output statistics
+void slcan_get_stats(slcan_stats_t* stats);
+
+/// @brief Turns the console UART into an SLCAN adapter at
+/// SLCAN_BAUD_RATE, until the next reset. Logs are muted. Called
+/// by the console task, never returns. In slcan_uart.c
+/// @param uart Console UART, its driver already installed
+void slcan_uart_run(int uart);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _SLCAN_H_
@@ -0,0 +1,182 @@
+// ***************************************************** //
+/// @file slcan_uart.c
+/// @brief UART side of the SLCAN adapter. The console task
+/// hands the UART over and becomes the SLCAN task
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "slcan.h"
+#include "application.h"
+#include "dlog.h"
+#include "gateway_config.h"
+#include "rtos_config.h"
+
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Period of the command reads while no buffer is waiting
+#define SLCAN_RX_POLL_MS    (2)
+
+/// Characters read from the UART at once
+#define SLCAN_RX_CHUNK      (64)
+
+_Static_assert(SLCAN_STATIC_BYTES <= MEM_BUDGET_SLCAN, "SLCAN stream exceeds MEM_BUDGET_SLCAN");
+
+static int               uartPort = 0;
+static SemaphoreHandle_t readySemaphore = NULL;
+static StaticSemaphore_t readySemaphoreBuffer;
+
+/// @brief Controller request run by the application task
+typedef struct
+{
+    uint32_t           bitrate;
+    const CAN_frame_t* frame;
+    bool               timestamps;
+    bool               listen_only;
+    bool               ok;
+} slcan_call_t;
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void uart_write(const char* data, uint32_t len)
+{
+    uart_write_bytes(uartPort, data, len);
+}
+
+static void uart_ready(void)
+{
+    xSemaphoreGive(readySemaphore);
+}
+
+static bool slcan_open(bool timestamps, bool listen_only);
+static void slcan_close(void);
+static bool slcan_set_bitrate(uint32_t bitrate);
+static bool slcan_transmit(const CAN_frame_t* frame);
+
+static const slcan_ops_t UART_OPS =
+{
+    .open        = slcan_open,
+    .close       = slcan_close,
+    .set_bitrate = slcan_set_bitrate,
+    .transmit    = slcan_transmit,
+    .write       = uart_write,
+    .ready       = uart_ready,
+};
+
+// The stream and the controller belong to the application task,
+// the parser reaches them through application_call
+static void app_open(void* arg)
+{
+    slcan_call_t* call = (slcan_call_t*)arg;
+    call->ok = CAN_set_listen_only(call->listen_only);
+    if (call->ok)
+    {
+        slcan_stream_start(&UART_OPS, call->timestamps, SLCAN_FLUSH_MS);
+    }
+}
+
+static void app_close(void* arg)
+{
+    (void)arg;
+    slcan_stream_stop();
+    CAN_set_listen_only(false);
+}
+
+static void app_set_bitrate(void* arg)
+{
+    // As with any adapter, every frame is received
+    slcan_call_t* call = (slcan_call_t*)arg;
+    call->ok = CAN_configure(call->bitrate, NULL, 0);
+}
+
+static void app_transmit(void* arg)
+{
+    slcan_call_t* call = (slcan_call_t*)arg;
+    call->ok = CAN_send(call->frame);
+}
+
+static bool slcan_open(bool timestamps, bool listen_only)
+{
+    slcan_call_t call = { .timestamps = timestamps, .listen_only = listen_only, .ok = false };
+    return application_call(app_open, &call) && call.ok;
+}
+
+static void slcan_close(void)
+{
+    application_call(app_close, NULL);
+}
+
+static bool slcan_set_bitrate(uint32_t bitrate)
+{
+    slcan_call_t call = { .bitrate = bitrate, .ok = false };
+    if (!CAN_is_bitrate_supported(bitrate) || !application_call(app_set_bitrate, &call))
+    {
+        return false;
+    }
+    return call.ok;
+}
+
+static bool slcan_transmit(const CAN_frame_t* frame)
+{
+    slcan_call_t call = { .frame = frame, .ok = false };
+    return application_call(app_transmit, &call) && call.ok;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void slcan_uart_run(int uart)
+{
+    static slcan_parser_t parser;
+    char rx[SLCAN_RX_CHUNK];
+
+    uartPort       = uart;
+    readySemaphore = xSemaphoreCreateBinaryStatic(&readySemaphoreBuffer);
+
+    // Any other output would break the frame lines
+    esp_log_level_set("*", ESP_LOG_NONE);
+    dlog_set_muted(true);
+    fflush(stdout);
+    uart_wait_tx_done(uart, portMAX_DELAY);
+    uart_set_baudrate(uart, SLCAN_BAUD_RATE);
+    uart_flush_input(uart);
+
+    // Buffers must be written at the rate of the bus, above the
+    // priority of the console
+    vTaskPrioritySet(NULL, SLCAN_TASK_PRIORITY);
+
+    while (true)
+    {
+        xSemaphoreTake(readySemaphore, pdMS_TO_TICKS(SLCAN_RX_POLL_MS));
+
+        while (slcan_write_next())
+        {
+        }
+
+        int n;
+        while ((n = uart_read_bytes(uart, (uint8_t*)rx, sizeof(rx), 0)) > 0)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                char    reply[SLCAN_MAX_REPLY_LEN];
+                uint8_t len = slcan_feed(&parser, &UART_OPS, rx[i], reply);
+                if (len > 0)
+                {
+                    uart_write_bytes(uart, reply, len);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,485 @@
+// ***************************************************** //
+/// @file trace.c
+/// @brief Capture of every received frame to a file, in
+/// binary, candump or ASC format. Double buffered, files
+/// are written in whole sectors by a separate task
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "trace.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+/// Interface name of candump records
+#define TRACE_INTERFACE     "can0"
+
+#define TRACE_BINARY_HEADER (16)
+
+_Static_assert(TRACE_BUFFER_SIZE % TRACE_SECTOR_SIZE == 0, "Buffers must hold whole sectors");
+_Static_assert(TRACE_BUFFERS >= 2, "The capture needs a buffer while another is written");
+
+typedef enum
+{
+    BUFFER_FREE,        // Available to the capture
+    BUFFER_FILLING,     // Owned by the capture
+    BUFFER_FULL         // Owned by the writer
+} buffer_state_e;
+
+typedef struct
+{
+    uint8_t  data[TRACE_BUFFER_SIZE] __attribute__((aligned(4)));
+    uint32_t len;
+    uint32_t limit;         // Ends on a sector boundary of the file
+    uint32_t first_ms;      // Time of the oldest record
+    uint8_t  state;
+    bool     open_file;     // Starts a new file
+    bool     close_file;    // Ends the file
+} trace_buffer_t;
+
+static trace_buffer_t buffers[TRACE_BUFFERS];
+
+static const trace_ops_t* file_ops;
+static trace_format_e     file_format;
+static uint32_t           max_bytes;
+static uint32_t           max_ms;
+static uint32_t           max_wait_ms;
+
+/// Capture side
+static trace_buffer_t* active = NULL;
+static uint8_t         fill_index = 0;
+static bool            file_started = false;
+static uint32_t        file_bytes = 0;
+static uint32_t        file_start_ms = 0;
+
+/// Writer side
+static uint8_t write_index = 0;
+static bool    writer_file_open = false;
+
+static trace_stats_t stats;
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static char* put_hex(char* p, uint32_t value, uint8_t digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        p[i] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+    return p + digits;
+}
+
+/// @brief Hex without leading zeros
+static char* put_hex_min(char* p, uint32_t value)
+{
+    uint8_t digits = 1;
+    while (digits < 8 && (value >> (4 * digits)) != 0)
+    {
+        digits++;
+    }
+    return put_hex(p, value, digits);
+}
+
+/// @brief Decimal, padded on the left to width with fill
+static char* put_dec(char* p, uint32_t value, uint8_t width, char fill)
+{
+    char    digits[10];
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (width > n)
+    {
+        *p++ = fill;
+        width--;
+    }
+    while (n > 0)
+    {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+static uint8_t frame_dlc(const CAN_frame_t* frame)
+{
+    return (frame->can_dlc <= CAN_MAX_DLEN) ? frame->can_dlc : CAN_MAX_DLEN;
+}
+
+/// @brief (1.000100) can0 123#0102 or (1.000100) can0 18FEF100#R
+static uint32_t format_candump(char* out, const CAN_frame_t* frame, uint64_t time_us)
+{
+    char* p = out;
+
+    *p++ = '(';
+    p = put_dec(p, (uint32_t)(time_us / 1000000), 1, '0');
+    *p++ = '.';
+    p = put_dec(p, (uint32_t)(time_us % 1000000), 6, '0');
+    memcpy(p, ") " TRACE_INTERFACE " ", sizeof(TRACE_INTERFACE) + 2);
+    p += sizeof(TRACE_INTERFACE) + 2;
+
+    if (frame->can_id & CAN_EFF_FLAG)
+    {
+        p = put_hex(p, frame->can_id & CAN_EFF_MASK, 8);
+    }
+    else
+    {
+        p = put_hex(p, frame->can_id & CAN_SFF_MASK, 3);
+    }
+    *p++ = '#';
+
+    if (frame->can_id & CAN_RTR_FLAG)
+    {
+        *p++ = 'R';
+    }
+    else
+    {
+        for (uint8_t i = 0; i < frame_dlc(frame); i++)
+        {
+            p = put_hex(p, frame->data[i], 2);
+        }
+    }
+    *p++ = '\n';
+
+    return (uint32_t)(p - out);
+}
+
+/// @brief    1.000100 1  18FEF100x       Rx   d 2 01 02
+static uint32_t format_asc(char* out, const CAN_frame_t* frame, uint64_t time_us)
+{
+    char* p = out;
+
+    p = put_dec(p, (uint32_t)(time_us / 1000000), 4, ' ');
+    *p++ = '.';
+    p = put_dec(p, (uint32_t)(time_us % 1000000), 6, '0');
+    memcpy(p, " 1  ", 4);
+    p += 4;
+
+    char* id = p;
+    if (frame->can_id & CAN_EFF_FLAG)
+    {
+        p = put_hex_min(p, frame->can_id & CAN_EFF_MASK);
+        *p++ = 'x';
+    }
+    else
+    {
+        p = put_hex_min(p, frame->can_id & CAN_SFF_MASK);
+    }
+    while (p - id < 16)
+    {
+        *p++ = ' ';
+    }
+
+    if (frame->can_id & CAN_RTR_FLAG)
+    {
+        memcpy(p, "Rx   r", 6);
+        p += 6;
+    }
+    else
+    {
+        memcpy(p, "Rx   d ", 7);
+        p += 7;
+        *p++ = (char)('0' + frame_dlc(frame));
+        for (uint8_t i = 0; i < frame_dlc(frame); i++)
+        {
+            *p++ = ' ';
+            p = put_hex(p, frame->data[i], 2);
+        }
+    }
+    *p++ = '\n';
+
+    return (uint32_t)(p - out);
+}
+
+static void put_le(uint8_t* p, uint64_t value, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t format_binary(uint8_t* out, const CAN_frame_t* frame, uint64_t time_us)
+{
+    memset(out, 0, TRACE_BINARY_RECORD);
+    put_le(&out[0], time_us, 8);
+    put_le(&out[8], frame->can_id, 4);
+    out[12] = frame_dlc(frame);
+    memcpy(&out[16], frame->data, frame_dlc(frame));
+    return TRACE_BINARY_RECORD;
+}
+
+static uint32_t format_header(uint8_t* out)
+{
+    static const char ASC_HEADER[] =
+        "date Thu Jan  1 00:00:00.000 am 1970\n"
+        "base hex  timestamps absolute\n"
+        "no internal events logged\n";
+
+    switch (file_format)
+    {
+        case TRACE_FORMAT_BINARY:
+            memset(out, 0, TRACE_BINARY_HEADER);
+            memcpy(out, "GWTRACE", 8);
+            put_le(&out[8], TRACE_BINARY_VERSION, 2);
+            put_le(&out[10], TRACE_BINARY_RECORD, 2);
+            return TRACE_BINARY_HEADER;
+
+        case TRACE_FORMAT_ASC:
+            memcpy(out, ASC_HEADER, sizeof(ASC_HEADER) - 1);
+            return sizeof(ASC_HEADER) - 1;
+
+        default:
+            return 0;
+    }
+}
+
+static bool buffer_free(uint8_t index)
+{
+    return __atomic_load_n(&buffers[index].state, __ATOMIC_ACQUIRE) == BUFFER_FREE;
+}
+
+static trace_buffer_t* acquire(uint32_t now_ms)
+{
+    if (!buffer_free(fill_index))
+    {
+        return NULL;
+    }
+
+    trace_buffer_t* buffer = &buffers[fill_index];
+    fill_index = (fill_index + 1) % TRACE_BUFFERS;
+
+    buffer->state      = BUFFER_FILLING;
+    buffer->len        = 0;
+    buffer->first_ms   = now_ms;
+    buffer->open_file  = false;
+    buffer->close_file = false;
+
+    // After a partial buffer, the next one realigns the file
+    // offset on a sector
+    buffer->limit = TRACE_BUFFER_SIZE - (file_started ? file_bytes % TRACE_SECTOR_SIZE : 0);
+    return buffer;
+}
+
+static void submit(void)
+{
+    __atomic_store_n(&active->state, BUFFER_FULL, __ATOMIC_RELEASE);
+    active = NULL;
+    file_ops->ready();
+}
+
+static void end_file(void)
+{
+    if (active != NULL && active->len > 0)
+    {
+        active->close_file = true;
+        submit();
+    }
+    file_started = false;
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void trace_init(const trace_ops_t* ops, trace_format_e format,
+                uint32_t max_file_bytes, uint32_t max_file_ms, uint32_t flush_ms)
+{
+    memset(buffers, 0, sizeof(buffers));
+    memset(&stats, 0, sizeof(stats));
+    file_ops         = ops;
+    file_format      = format;
+    max_bytes        = max_file_bytes;
+    max_ms           = max_file_ms;
+    max_wait_ms      = flush_ms;
+    active           = NULL;
+    fill_index       = 0;
+    write_index      = 0;
+    file_started     = false;
+    writer_file_open = false;
+}
+
+bool trace_frame(const CAN_frame_t* frame, uint64_t time_us)
+{
+    if (file_ops == NULL)
+    {
+        return false;
+    }
+
+    uint32_t now_ms = (uint32_t)(time_us / 1000);
+
+    if (file_started && (file_bytes >= max_bytes || (uint32_t)(now_ms - file_start_ms) >= max_ms))
+    {
+        end_file();
+    }
+
+    if (active == NULL)
+    {
+        active = acquire(now_ms);
+        if (active == NULL)
+        {
+            stats.dropped++;
+            return false;
+        }
+    }
+
+    if (!file_started)
+    {
+        // A file starts on a buffer of its own, end_file handed
+        // over the last one of the previous file
+        active->open_file = true;
+        active->limit     = TRACE_BUFFER_SIZE;
+        active->len       = format_header(active->data);
+        file_started  = true;
+        file_bytes    = active->len;
+        file_start_ms = now_ms;
+    }
+
+    uint8_t  record[TRACE_MAX_RECORD];
+    uint32_t len;
+    switch (file_format)
+    {
+        case TRACE_FORMAT_BINARY:
+            len = format_binary(record, frame, time_us);
+            break;
+        case TRACE_FORMAT_ASC:
+            len = format_asc((char*)record, frame, time_us);
+            break;
+        default:
+            len = format_candump((char*)record, frame, time_us);
+            break;
+    }
+
+    uint32_t room = active->limit - active->len;
+    if (len > room)
+    {
+        // Split over two buffers, the second one must be free
+        if (!buffer_free(fill_index))
+        {
+            stats.dropped++;
+            return false;
+        }
+
+        memcpy(&active->data[active->len], record, room);
+        active->len += room;
+        file_bytes  += room;
+        submit();
+
+        active = acquire(now_ms);
+        memcpy(active->data, &record[room], len - room);
+        active->len  = len - room;
+        file_bytes  += len - room;
+    }
+    else
+    {
+        memcpy(&active->data[active->len], record, len);
+        active->len += len;
+        file_bytes  += len;
+        if (active->len == active->limit)
+        {
+            submit();
+        }
+    }
+
+    stats.frames++;
+    return true;
+}
+
+void trace_poll(uint32_t now_ms)
+{
+    if (file_ops == NULL)
+    {
+        return;
+    }
+
+    if (file_started && (uint32_t)(now_ms - file_start_ms) >= max_ms)
+    {
+        end_file();
+    }
+    else if (active != NULL && active->len > 0 && (uint32_t)(now_ms - active->first_ms) >= max_wait_ms)
+    {
+        submit();
+    }
+}
+
+uint32_t trace_next_due_ms(uint32_t now_ms)
+{
+    uint32_t next = UINT32_MAX;
+
+    if (active != NULL && active->len > 0)
+    {
+        uint32_t age = now_ms - active->first_ms;
+        next = (age >= max_wait_ms) ? 0 : max_wait_ms - age;
+    }
+    if (file_started)
+    {
+        uint32_t age = now_ms - file_start_ms;
+        uint32_t due = (age >= max_ms) ? 0 : max_ms - age;
+        if (due < next)
+        {
+            next = due;
+        }
+    }
+
+    return next;
+}
+
+bool trace_write_next(void)
+{
+    trace_buffer_t* buffer = &buffers[write_index];
+    if (__atomic_load_n(&buffer->state, __ATOMIC_ACQUIRE) != BUFFER_FULL)
+    {
+        return false;
+    }
+
+    if (buffer->open_file)
+    {
+        writer_file_open = file_ops->open(file_format);
+        if (writer_file_open)
+        {
+            stats.files++;
+        }
+        else
+        {
+            stats.errors++;
+        }
+    }
+
+    // Without a file, the records are discarded until the next one
+    if (writer_file_open && buffer->len > 0)
+    {
+        if (file_ops->write(buffer->data, buffer->len))
+        {
+            stats.bytes += buffer->len;
+        }
+        else
+        {
+            stats.errors++;
+        }
+    }
+
+    if (writer_file_open && buffer->close_file)
+    {
+        file_ops->close();
+        writer_file_open = false;
+    }
+
+    write_index = (write_index + 1) % TRACE_BUFFERS;
+    __atomic_store_n(&buffer->state, BUFFER_FREE, __ATOMIC_RELEASE);
+    return true;
+}
+
+void trace_get_stats(trace_stats_t* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,123 @@
+// ***************************************************** //
+/// @file trace.h
+/// @brief Capture of every received frame to a file, in
+/// binary, candump or ASC format. Double buffered, files
+/// are written in whole sectors by a separate task
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_bus.h"
+
+// --------------------------------------------------------
+// Constants
+// --------------------------------------------------------
+/// Buffers filled by the capture and written by the writer
+#define TRACE_BUFFERS           (2)
+
+/// Size of a buffer, a multiple of the sector size
+#define TRACE_BUFFER_SIZE       (16 * 1024)
+
+#define TRACE_SECTOR_SIZE       (512)
+
+/// Longest record of any format
+#define TRACE_MAX_RECORD        (96)
+
+/// Binary records, little endian: time in microseconds (8 bytes),
+/// ID with the EFF/RTR/ERR flags (4), DLC (1), reserved (3), data (8).
+/// Files start with a 16-byte header, "GWTRACE" and a null, then
+/// the version (2) and the record size (2)
+#define TRACE_BINARY_VERSION    (1)
+#define TRACE_BINARY_RECORD     (24)
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    TRACE_FORMAT_BINARY,
+    TRACE_FORMAT_CANDUMP,   // Log format of can-utils, for canplayer
+    TRACE_FORMAT_ASC        // Vector ASCII log
+} trace_format_e;
+
+/// @brief File side of the capture, called from the writer task
+typedef struct
+{
+    /// Closes the current file if any and opens the next one
+    bool (*open)(trace_format_e format);
+    bool (*write)(const uint8_t* data, uint32_t len);
+    void (*close)(void);
+    /// A buffer is waiting, called from the capture task
+    void (*ready)(void);
+} trace_ops_t;
+
+typedef struct
+{
+    uint32_t frames;        // Frames captured
+    uint32_t dropped;       // Frames lost, every buffer waiting for the file
+    uint32_t bytes;         // Bytes written
+    uint32_t files;         // Files opened
+    uint32_t errors;        // Failed opens and writes
+} trace_stats_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Empties the buffers and sets the file rotation
+/// @param ops File operations
+/// @param format Format of the records
+/// @param max_file_bytes A new file is started past this size
+/// @param max_file_ms A new file is started past this age
+/// @param flush_ms Longest time a record waits in a buffer
+void trace_init(const trace_ops_t* ops, trace_format_e format,
+                uint32_t max_file_bytes, uint32_t max_file_ms, uint32_t flush_ms);
+
+/// @brief Stores a frame. Must always be called from the same task.
+/// Does nothing before trace_init
+/// @param frame Received frame
+/// @param time_us Reception time in microseconds
+/// @return false if the frame was dropped for lack of buffer
+bool trace_frame(const CAN_frame_t* frame, uint64_t time_us);
+
+/// @brief Hands a buffer older than flush_ms to the writer and starts
+/// a new file when the current one is too old. Same task as trace_frame
+/// @param now_ms Current time in milliseconds
+void trace_poll(uint32_t now_ms);
+
+/// @brief Time until trace_poll has something to do
+/// @param now_ms Current time in milliseconds
+/// @return Milliseconds, UINT32_MAX if nothing is pending
+uint32_t trace_next_due_ms(uint32_t now_ms);
+
+/// @brief Writes the oldest full buffer. Called by the writer task
+/// after ops.ready, until it returns false
+/// @return false if no buffer was waiting
+bool trace_write_next(void);
+
+/// @brief Copies the capture counters
+/// @param stats Output statistics
+void trace_get_stats(trace_stats_t* stats);
+
+/// @brief Mounts the SD card, starts the writer task and the capture
+/// with the settings of gateway_config.h. In trace_sd.c
+/// @return false if there is no usable card, frames are not captured
+bool trace_sd_start(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _TRACE_H_
@@ -0,0 +1,192 @@
+// ***************************************************** //
+/// @file trace_sd.c
+/// @brief Writer of the frame capture on an SD card, in the
+/// SDMMC slot. One task writes the buffers of trace.c
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "trace.h"
+#include "gateway_config.h"
+#include "rtos_config.h"
+#include "mem_budget.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "driver/sdmmc_host.h"
+
+// --------------------------------------------------------
+// Local private variables
+// --------------------------------------------------------
+#define TRACE_MOUNT_POINT   "/sdcard"
+#define TRACE_DIR           TRACE_MOUNT_POINT "/trace"
+
+/// Period of the directory entry updates. Records written since
+/// the last one are lost if the power fails
+#define TRACE_SYNC_MS       (1000)
+
+static const char* TAG = "TRACE";
+
+static const char* const EXTENSIONS[] = { "BIN", "LOG", "ASC" };
+
+static FILE*        file = NULL;
+static uint32_t     fileIndex = 0;
+static int64_t      lastSyncUs = 0;
+static TaskHandle_t writerTask = NULL;
+
+static StackType_t  traceStack[TRACE_TASK_STACK_SIZE];
+static StaticTask_t traceTaskBuffer;
+
+#define TRACE_STATIC_BYTES  (TRACE_BUFFERS * TRACE_BUFFER_SIZE + sizeof(traceStack) + sizeof(traceTaskBuffer))
+_Static_assert(TRACE_STATIC_BYTES <= MEM_BUDGET_TRACE, "Frame capture exceeds MEM_BUDGET_TRACE");
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void sd_close(void)
+{
+    if (file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+static bool sd_open(trace_format_e format)
+{
+    char path[40];
+
+    sd_close();
+    snprintf(path, sizeof(path), TRACE_DIR "/TR%06lu.%s",
+             (unsigned long)fileIndex++, EXTENSIONS[format]);
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Could not create %s", path);
+        return false;
+    }
+
+    // Writes are whole buffers already, skip the stdio copy
+    setvbuf(file, NULL, _IONBF, 0);
+    lastSyncUs = esp_timer_get_time();
+    ESP_LOGI(TAG, "Capturing to %s", path);
+    return true;
+}
+
+static bool sd_write(const uint8_t* data, uint32_t len)
+{
+    bool ok = (fwrite(data, 1, len, file) == len);
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - lastSyncUs >= TRACE_SYNC_MS * 1000)
+    {
+        fsync(fileno(file));
+        lastSyncUs = now_us;
+    }
+    return ok;
+}
+
+static void sd_ready(void)
+{
+    xTaskNotifyGive(writerTask);
+}
+
+static const trace_ops_t SD_OPS =
+{
+    .open  = sd_open,
+    .write = sd_write,
+    .close = sd_close,
+    .ready = sd_ready,
+};
+
+/// @brief Continues the numbering of the files on the card
+static uint32_t next_file_index(void)
+{
+    uint32_t next = 0;
+    DIR*     dir  = opendir(TRACE_DIR);
+
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        unsigned long index;
+        if (sscanf(entry->d_name, "TR%06lu.", &index) == 1 && index >= next)
+        {
+            next = (uint32_t)index + 1;
+        }
+    }
+    closedir(dir);
+
+    return next;
+}
+
+static void trace_task(void* param)
+{
+    (void)param;
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (trace_write_next())
+        {
+        }
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+bool trace_sd_start(void)
+{
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    sdmmc_slot_config_t slot = SDMMC_SLOT_CONFIG_DEFAULT();
+
+    // Clusters of a buffer size, a buffer never spans two of them
+    esp_vfs_fat_sdmmc_mount_config_t mount_config =
+    {
+        .format_if_mount_failed = false,
+        .max_files              = 2,
+        .allocation_unit_size   = TRACE_BUFFER_SIZE,
+    };
+
+    sdmmc_card_t* card;
+    esp_err_t ret = esp_vfs_fat_sdmmc_mount(TRACE_MOUNT_POINT, &host, &slot, &mount_config, &card);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SD card not mounted, capture disabled: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    mkdir(TRACE_DIR, 0775);
+    fileIndex = next_file_index();
+
+    writerTask = xTaskCreateStaticPinnedToCore(trace_task,
+                                               "trace_task",
+                                               TRACE_TASK_STACK_SIZE,
+                                               NULL,
+                                               TRACE_TASK_PRIORITY,
+                                               traceStack,
+                                               &traceTaskBuffer,
+                                               TRACE_TASK_CORE);
+    mem_budget_account(MEM_TRACE, TRACE_STATIC_BYTES);
+
+    trace_init(&SD_OPS, TRACE_FORMAT, TRACE_FILE_MAX_BYTES, TRACE_FILE_MAX_MS, TRACE_FLUSH_MS);
+    return true;
+}
@@ -2,8 +2,11 @@
 // Includes
 // --------------------------------------------------------
 #include "wifi.h"
+#include "wifi_sm.h"
 #include "wifi_credentials.h"
 #include "application.h"
+#include "gateway_config.h"
+#include "boot.h"
 
 // Standard Includes
 #include <stdio.h>
@@ -19,6 +22,8 @@
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "esp_wifi_default.h"
 #include "esp_wifi_types.h"
 #include "nvs.h"
@@ -38,70 +43,232 @@
 // --------------------------------------------------------
 // Local private variables
 // --------------------------------------------------------
-typedef enum
-{
-    WIFI_SUCCESS,
-    WIFI_FAILURE
-} Wifi_outcomes_e;
-
 static const char* HOST_NAME = "CAN-WIFI Gateway";
 static const char* TAG = "WIFI";
 
-static uint16_t retry_num = 0;
-static const uint16_t MAX_FAILURES = 10;
+/// Last associated AP, read at boot to skip the scan
+static const char* NVS_NAMESPACE = "gw_wifi";
+static const char* NVS_KEY_AP    = "ap";
+
+/// Retry timer expirations are posted to the default event loop, so
+/// the state machine only ever runs in the event task
+ESP_EVENT_DEFINE_BASE(WIFI_RETRY_EVENT);
+
+static wifi_sm_t          wifiSm;
+static esp_timer_handle_t retryTimer = NULL;
 
 // --------------------------------------------------------
 // Local private functions
 // --------------------------------------------------------
-static void event_handler(
-        void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void fill_sta_config(wifi_config_t* wifi_config, const wifi_sm_ap_t* ap)
+{
+    memset(wifi_config, 0, sizeof(*wifi_config));
+    strncpy((char*)wifi_config->sta.ssid, CRED_WIFI_SSID, CRED_WIFI_MAX_SSID_LEN);
+    strncpy((char*)wifi_config->sta.password, CRED_WIFI_PASSWORD, CRED_WIFI_MAX_PASS_LEN);
+    wifi_config->sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    wifi_config->sta.pmf_cfg.capable = true;
+    wifi_config->sta.pmf_cfg.required = false;
+
+    if (ap != NULL)
+    {
+        // Probe only the channel of the known AP
+        wifi_config->sta.bssid_set   = true;
+        memcpy(wifi_config->sta.bssid, ap->bssid, sizeof(ap->bssid));
+        wifi_config->sta.channel     = ap->channel;
+        wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        wifi_config->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config->sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+}
+
+static void op_connect(const wifi_sm_ap_t* ap)
+{
+    wifi_config_t wifi_config;
+    fill_sta_config(&wifi_config, ap);
+
+    if (ap != NULL)
+    {
+        ESP_LOGI(TAG, "Connecting to " MACSTR " on channel %d", MAC2STR(ap->bssid), ap->channel);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Scanning for \"%s\"", CRED_WIFI_SSID);
+    }
+
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK)
+    {
+        // No disconnection event follows, count it as a failed attempt
+        ESP_LOGW(TAG, "Connect failed: %s", esp_err_to_name(err));
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, 0);
+    }
+}
+
+static void op_start_timer(uint32_t ms)
+{
+    ESP_LOGI(TAG, "Retrying in %lu ms", (unsigned long)ms);
+    esp_timer_stop(retryTimer);
+    esp_timer_start_once(retryTimer, (uint64_t)ms * 1000);
+}
+
+static void op_online(bool online)
 {
     main_app_event_t app_event;
+    app_event.Type = online ? EVENT_WIFI_CONNECTED : EVENT_WIFI_DISCONNECTED;
+    app_event.Data = NULL;
+    application_sendEvent(app_event);
+}
+
+static void op_save_ap(const wifi_sm_ap_t* ap)
+{
+    // Only written when the AP changes, not on every association
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return;
+    }
+
+    if (nvs_set_blob(handle, NVS_KEY_AP, ap, sizeof(*ap)) == ESP_OK)
+    {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+static uint32_t op_random(void)
+{
+    return esp_random();
+}
+
+static const wifi_sm_ops_t wifiOps =
+{
+    .connect     = op_connect,
+    .start_timer = op_start_timer,
+    .online      = op_online,
+    .save_ap     = op_save_ap,
+    .random      = op_random,
+};
 
+static bool load_ap(wifi_sm_ap_t* ap)
+{
+    nvs_handle_t handle;
+    size_t       len = sizeof(*ap);
+    bool         found = false;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    if (nvs_get_blob(handle, NVS_KEY_AP, ap, &len) == ESP_OK && len == sizeof(*ap))
+    {
+        found = ap->valid;
+    }
+    nvs_close(handle);
+    return found;
+}
+
+static void retry_timer_callback(void* arg)
+{
+    esp_event_post(WIFI_RETRY_EVENT, 0, NULL, 0, 0);
+}
+
+static void set_static_ip(esp_netif_t* netif)
+{
+    esp_netif_ip_info_t ip_info = {0};
+    esp_netif_dns_info_t dns_info = {0};
+
+    // Skips DHCP, the address is known as soon as the STA associates
+    ip_info.ip.addr      = ipaddr_addr(WIFI_STATIC_IP);
+    ip_info.netmask.addr = ipaddr_addr(WIFI_STATIC_NETMASK);
+    ip_info.gw.addr      = ipaddr_addr(WIFI_STATIC_GATEWAY);
+
+    ESP_ERROR_CHECK(esp_netif_dhcpc_stop(netif));
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(netif, &ip_info));
+
+    dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+    dns_info.ip.u_addr.ip4.addr = ipaddr_addr(WIFI_STATIC_DNS);
+    ESP_ERROR_CHECK(esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info));
+
+    ESP_LOGI(TAG, "Static IP %s", WIFI_STATIC_IP);
+}
+
+static void event_handler(
+        void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
-        ESP_LOGI(TAG, "Connecting to Access Point ...");
-        esp_wifi_connect();
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_START, NULL, now_ms());
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        ESP_LOGI(TAG, "DISCONNECTED");
-        if (retry_num < MAX_FAILURES)
+        if (event_data != NULL)
         {
-            ESP_LOGI(TAG, 
-                     "Attempting reconnection to AP. Retry num=%d/%d", 
-                     retry_num,
-                     MAX_FAILURES);
-
-            retry_num++;
-            esp_wifi_connect();
+            wifi_event_sta_disconnected_t* disconnected = (wifi_event_sta_disconnected_t*)event_data;
+            ESP_LOGI(TAG, "DISCONNECTED, reason %d", disconnected->reason);
         }
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_DISCONNECTED, NULL, now_ms());
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
     {
+        wifi_event_sta_connected_t* connected = (wifi_event_sta_connected_t*)event_data;
+        wifi_sm_ap_t ap;
+
+        memcpy(ap.bssid, connected->bssid, sizeof(ap.bssid));
+        ap.channel = connected->channel;
+        ap.valid   = true;
+
         ESP_LOGI(TAG, "Wifi STA Connected");
+        boot_mark(BOOT_WIFI_ASSOCIATED);
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_ASSOCIATED, &ap, now_ms());
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
         ip_event_got_ip_t* ipEvent = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "IP obtained: " IPSTR, IP2STR(&ipEvent->ip_info.ip));
-        retry_num = 0;
-
-        // Notify the application that connection was successful 
-        app_event.Type = EVENT_WIFI_CONNECTED;
-        application_sendEventFromIsr(app_event);
+        boot_mark(BOOT_WIFI_IP);
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_GOT_IP, NULL, now_ms());
+        ESP_LOGI(TAG, "IP obtained: " IPSTR " in %lu ms", IP2STR(&ipEvent->ip_info.ip),
+                 (unsigned long)wifiSm.stats.last_time_to_ip_ms);
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP)
+    {
+        ESP_LOGI(TAG, "IP lost");
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_LOST_IP, NULL, now_ms());
+    }
+    else if (event_base == WIFI_RETRY_EVENT)
+    {
+        wifi_sm_handle(&wifiSm, WIFI_SM_EV_TIMER, NULL, now_ms());
     }
     else
     {
-        ESP_LOGW(TAG, "Unhandled event: %s:%d", event_base, event_id);
+        ESP_LOGD(TAG, "Unhandled event: %s:%d", event_base, event_id);
     }
 }
 
 static void wifi_connect()
 {
     esp_netif_t*  netif = NULL;
-    wifi_config_t wifi_config = {0};
+    wifi_config_t wifi_config;
     wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_sm_ap_t  cached;
+    const esp_timer_create_args_t timer_args =
+    {
+        .callback = retry_timer_callback,
+        .name     = "wifi_retry"
+    };
+
+    bool has_cached = load_ap(&cached);
+    wifi_sm_init(&wifiSm, &wifiOps, has_cached ? &cached : NULL);
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &retryTimer));
 
     // Initialize ESP network interface
     ESP_ERROR_CHECK(esp_netif_init());
@@ -117,17 +284,26 @@ static void wifi_connect()
                                                IP_EVENT_STA_GOT_IP, 
                                                &event_handler, 
                                                NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, 
+                                               IP_EVENT_STA_LOST_IP, 
+                                               &event_handler, 
+                                               NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_RETRY_EVENT, 
+                                               ESP_EVENT_ANY_ID, 
+                                               &event_handler, 
+                                               NULL));
 
-    // Start the wifi interface
-    strncpy((char*)wifi_config.sta.ssid, CRED_WIFI_SSID, CRED_WIFI_MAX_SSID_LEN);
-    strncpy((char*)wifi_config.sta.password, CRED_WIFI_PASSWORD, CRED_WIFI_MAX_PASS_LEN);
-    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
-    wifi_config.sta.pmf_cfg.capable = true;
-    wifi_config.sta.pmf_cfg.required = false;
+    // Start the wifi interface. The first attempt goes straight to the
+    // AP of the last boot when it is known
+    fill_sta_config(&wifi_config, has_cached ? &cached : NULL);
 
     ESP_LOGI(TAG, "Starting Wifi STA. SSID = \"%s\"", CRED_WIFI_SSID);
     netif = esp_netif_create_default_wifi_sta();
     ESP_ERROR_CHECK(esp_netif_set_hostname(netif, HOST_NAME));
+    if (WIFI_STATIC_IP[0] != '\0')
+    {
+        set_static_ip(netif);
+    }
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE) );
@@ -140,17 +316,12 @@ static void wifi_connect()
 // --------------------------------------------------------
 void wifi_init()
 {
-    // Initialize Non-volatile storage to save Wifi config
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES
-        || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-    {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ESP_ERROR_CHECK(nvs_flash_init());
-    }
-
-    // Try to connect to an Access point
+    // Try to connect to an Access point. Retries never stop
     wifi_connect();
     return;
 }
- 
+
+void wifi_get_stats(wifi_stats_t* stats)
+{
+    *stats = wifiSm.stats;
+}
@@ -10,16 +10,22 @@ extern "C"
 // Includes
 // --------------------------------------------------------
 #include <stdbool.h>
+#include "wifi_sm.h"
 
 // --------------------------------------------------------
 // Public definitions
 // --------------------------------------------------------
 
 /// @brief Initializes Wifi, connects with the lwIP stack
-/// and starts the Wifi thread.
-/// @return True if successful, False otherwise
+/// and starts the Wifi thread. NVS must be initialized. The connection is retried with
+/// backoff for as long as it is down, EVENT_WIFI_CONNECTED and
+/// EVENT_WIFI_DISCONNECTED report its state to the application
 void wifi_init(void);
 
+/// @brief Copies the connection counters and time to IP
+/// @param stats Output statistics
+void wifi_get_stats(wifi_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
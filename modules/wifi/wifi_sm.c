@@ -0,0 +1,163 @@
+// ***************************************************** //
+/// @file wifi_sm.c
+/// @brief Wifi connection state machine. Free of ESP-IDF
+/// calls, the driver is reached through an ops table
+/// @version 0.1
+// ***************************************************** //
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include "wifi_sm.h"
+#include "gateway_config.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Local private functions
+// --------------------------------------------------------
+static void start_attempt(wifi_sm_t* sm)
+{
+    // The cached AP is tried once after each disconnection. If it
+    // fails, e.g. the AP moved to another channel, scan for it
+    sm->fast_attempt = sm->ap.valid && sm->failures == 0;
+    if (sm->fast_attempt)
+    {
+        sm->stats.fast_connects++;
+    }
+    else
+    {
+        sm->stats.full_scans++;
+    }
+
+    sm->state = WIFI_SM_CONNECTING;
+    sm->ops->connect(sm->fast_attempt ? &sm->ap : NULL);
+}
+
+static void attempt_failed(wifi_sm_t* sm)
+{
+    if (sm->failures < UINT8_MAX)
+    {
+        sm->failures++;
+    }
+
+    sm->state = WIFI_SM_BACKOFF;
+    sm->ops->start_timer(wifi_sm_backoff_ms(sm));
+}
+
+static void set_ap(wifi_sm_t* sm, const wifi_sm_ap_t* ap)
+{
+    if (ap == NULL || !ap->valid)
+    {
+        return;
+    }
+
+    if (!sm->ap.valid || sm->ap.channel != ap->channel
+        || memcmp(sm->ap.bssid, ap->bssid, sizeof(ap->bssid)) != 0)
+    {
+        sm->ap = *ap;
+        sm->ops->save_ap(ap);
+    }
+}
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+void wifi_sm_init(wifi_sm_t* sm, const wifi_sm_ops_t* ops, const wifi_sm_ap_t* cached)
+{
+    memset(sm, 0, sizeof(*sm));
+    sm->ops   = ops;
+    sm->state = WIFI_SM_IDLE;
+    if (cached != NULL)
+    {
+        sm->ap = *cached;
+    }
+}
+
+void wifi_sm_handle(wifi_sm_t* sm, wifi_sm_event_e event, const wifi_sm_ap_t* ap, uint32_t now_ms)
+{
+    switch (event)
+    {
+        case WIFI_SM_EV_START:
+            if (sm->state == WIFI_SM_IDLE)
+            {
+                sm->outage_start_ms = now_ms;
+                start_attempt(sm);
+            }
+            break;
+
+        case WIFI_SM_EV_ASSOCIATED:
+            if (sm->state == WIFI_SM_CONNECTING)
+            {
+                sm->state = WIFI_SM_ASSOCIATED;
+                set_ap(sm, ap);
+            }
+            break;
+
+        case WIFI_SM_EV_GOT_IP:
+            if (sm->state == WIFI_SM_ASSOCIATED || sm->state == WIFI_SM_CONNECTING)
+            {
+                uint32_t time_to_ip = now_ms - sm->outage_start_ms;
+                sm->stats.connects++;
+                sm->stats.last_time_to_ip_ms = time_to_ip;
+                if (time_to_ip > sm->stats.max_time_to_ip_ms)
+                {
+                    sm->stats.max_time_to_ip_ms = time_to_ip;
+                }
+
+                sm->failures = 0;
+                sm->state    = WIFI_SM_ONLINE;
+                sm->ops->online(true);
+            }
+            break;
+
+        case WIFI_SM_EV_LOST_IP:
+            if (sm->state == WIFI_SM_ONLINE)
+            {
+                // Still associated, DHCP keeps trying on its own
+                sm->outage_start_ms = now_ms;
+                sm->state = WIFI_SM_ASSOCIATED;
+                sm->ops->online(false);
+            }
+            break;
+
+        case WIFI_SM_EV_DISCONNECTED:
+            if (sm->state == WIFI_SM_ONLINE)
+            {
+                sm->stats.disconnects++;
+                sm->outage_start_ms = now_ms;
+                sm->ops->online(false);
+
+                // The AP was fine a moment ago, retry it right away
+                start_attempt(sm);
+            }
+            else if (sm->state == WIFI_SM_CONNECTING || sm->state == WIFI_SM_ASSOCIATED)
+            {
+                attempt_failed(sm);
+            }
+            break;
+
+        case WIFI_SM_EV_TIMER:
+            if (sm->state == WIFI_SM_BACKOFF)
+            {
+                start_attempt(sm);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+uint32_t wifi_sm_backoff_ms(const wifi_sm_t* sm)
+{
+    uint32_t wait_ms = WIFI_RETRY_MAX_MS;
+    uint8_t  doublings = (sm->failures > 0) ? sm->failures - 1 : 0;
+
+    if (doublings < 16 && ((uint32_t)WIFI_RETRY_MIN_MS << doublings) < WIFI_RETRY_MAX_MS)
+    {
+        wait_ms = (uint32_t)WIFI_RETRY_MIN_MS << doublings;
+    }
+
+    return wait_ms / 2 + sm->ops->random() % (wait_ms / 2 + 1);
+}
@@ -0,0 +1,113 @@
+// ***************************************************** //
+/// @file wifi_sm.h
+/// @brief Wifi connection state machine. Free of ESP-IDF
+/// calls, the driver is reached through an ops table
+/// @version 0.1
+// ***************************************************** //
+
+#ifndef _WIFI_SM_H_
+#define _WIFI_SM_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+// --------------------------------------------------------
+// Includes
+// --------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------
+// Types
+// --------------------------------------------------------
+typedef enum
+{
+    WIFI_SM_IDLE,
+    WIFI_SM_CONNECTING,     // Association in progress
+    WIFI_SM_ASSOCIATED,     // Waiting for an IP address
+    WIFI_SM_ONLINE,
+    WIFI_SM_BACKOFF         // Waiting before the next attempt
+} wifi_sm_state_e;
+
+typedef enum
+{
+    WIFI_SM_EV_START,
+    WIFI_SM_EV_ASSOCIATED,
+    WIFI_SM_EV_DISCONNECTED,
+    WIFI_SM_EV_GOT_IP,
+    WIFI_SM_EV_LOST_IP,
+    WIFI_SM_EV_TIMER        // The timer of ops.start_timer expired
+} wifi_sm_event_e;
+
+/// @brief Access point of the last association, to skip the scan
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool    valid;
+} wifi_sm_ap_t;
+
+typedef struct
+{
+    uint32_t connects;          // IP addresses obtained
+    uint32_t disconnects;       // Losses of connection after being online
+    uint32_t fast_connects;     // Attempts on the cached BSSID and channel
+    uint32_t full_scans;        // Attempts with a scan of all channels
+    uint32_t last_time_to_ip_ms;    // From start or disconnection to IP
+    uint32_t max_time_to_ip_ms;
+} wifi_stats_t;
+
+/// @brief Driver side of the state machine
+typedef struct
+{
+    /// Starts an association, on the given AP or after a full scan if NULL
+    void     (*connect)(const wifi_sm_ap_t* ap);
+    /// Arms a one shot timer that feeds WIFI_SM_EV_TIMER
+    void     (*start_timer)(uint32_t ms);
+    /// Reports the connectivity to the application
+    void     (*online)(bool online);
+    /// Persists the AP for the next boot
+    void     (*save_ap)(const wifi_sm_ap_t* ap);
+    uint32_t (*random)(void);
+} wifi_sm_ops_t;
+
+typedef struct
+{
+    const wifi_sm_ops_t* ops;
+    wifi_sm_state_e      state;
+    wifi_sm_ap_t         ap;
+    bool                 fast_attempt;      // Current attempt uses the cached AP
+    uint8_t              failures;          // Consecutive failed attempts
+    uint32_t             outage_start_ms;
+    wifi_stats_t         stats;
+} wifi_sm_t;
+
+// --------------------------------------------------------
+// Public functions
+// --------------------------------------------------------
+
+/// @brief Initializes the state machine, idle
+/// @param sm State machine
+/// @param ops Driver operations
+/// @param cached AP of the last association, NULL if unknown
+void wifi_sm_init(wifi_sm_t* sm, const wifi_sm_ops_t* ops, const wifi_sm_ap_t* cached);
+
+/// @brief Feeds an event. Must always be called from the same task
+/// @param sm State machine
+/// @param event Driver or timer event
+/// @param ap AP joined, for WIFI_SM_EV_ASSOCIATED only
+/// @param now_ms Current time in milliseconds
+void wifi_sm_handle(wifi_sm_t* sm, wifi_sm_event_e event, const wifi_sm_ap_t* ap, uint32_t now_ms);
+
+/// @brief Delay before the next attempt, exponential with jitter
+/// @param sm State machine
+/// @return Delay in milliseconds
+uint32_t wifi_sm_backoff_ms(const wifi_sm_t* sm);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _WIFI_SM_H_
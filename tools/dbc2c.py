@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+# ****************************************************************************
+# CAN-WIFI Gateway to AWS cloud
+# ****************************************************************************
+# Generates the constant signal tables used by modules/dbc from a DBC file.
+#
+# For every signal the shift and mask inside the 64-bit payload word are
+# precomputed, so the firmware only does a shift-and-mask per signal. The
+# message lookup uses a perfect hash, searched here at build time, so the
+# gateway can map a CAN ID to its descriptor with a single probe.
+#
+# Messages with the J1939PG frame format are keyed on their parameter group
+# instead of the raw ID, so they match whatever the source address and
+# priority of the frame are.
+#
+# Usage: dbc2c.py <input.dbc> <output.c>
+
+import re
+import sys
+
+CAN_EFF_FLAG = 0x80000000
+CAN_EFF_MASK = 0x1FFFFFFF
+VFRAME_J1939 = 3
+MAX_HASH_BITS = 16
+
+RE_MESSAGE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+\w+')
+RE_DEADBAND = re.compile(
+    r'^BA_\s+"GwDeadband"\s+SG_\s+(\d+)\s+(\w+)\s+([-+.\deE]+)\s*;')
+RE_FRAME_FORMAT = re.compile(
+    r'^BA_\s+"VFrameFormat"\s+BO_\s+(\d+)\s+(\d+)\s*;')
+RE_SIGNAL = re.compile(
+    r'^SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+    r'\(([^,]+),([^)]+)\)\s*\[[^]]*\]\s*"([^"]*)"')
+
+
+class Signal:
+    def __init__(self, name, mux, start, length, order, sign, factor, offset, unit):
+        self.name = name
+        self.start = int(start)
+        self.length = int(length)
+        self.big_endian = (order == '0')
+        self.is_signed = (sign == '-')
+        self.factor = float(factor)
+        self.offset = float(offset)
+        self.unit = unit
+        self.deadband = 0.0
+        self.mux_type = 'DBC_MUX_NONE'
+        self.mux_value = 0
+        if mux == 'M':
+            self.mux_type = 'DBC_MUX_SWITCH'
+        elif mux:
+            self.mux_type = 'DBC_MUX_VALUE'
+            self.mux_value = int(mux[1:])
+
+        if not 1 <= self.length <= 64:
+            raise ValueError(f'signal {name}: invalid length {self.length}')
+
+    @property
+    def shift(self):
+        if not self.big_endian:
+            return self.start
+        # Motorola start bit is the MSB in sawtooth numbering. Map it to the
+        # bit index inside the payload packed as a big-endian 64-bit word.
+        msb = (7 - self.start // 8) * 8 + self.start % 8
+        lsb = msb - (self.length - 1)
+        if lsb < 0:
+            raise ValueError(f'signal {self.name}: does not fit in 8 bytes')
+        return lsb
+
+
+class Message:
+    def __init__(self, can_id, name, dlc):
+        self.can_id = can_id
+        self.name = name
+        self.dlc = dlc
+        self.signals = []
+        self.is_j1939 = False
+
+    @property
+    def key(self):
+        if not self.is_j1939:
+            return self.can_id
+        # Same key as dbc_find_message_pgn: the PGN in the PF/PS bits with
+        # priority and source address cleared. PDU1 PGNs drop the
+        # destination address.
+        raw = self.can_id & CAN_EFF_MASK
+        pgn = (raw >> 8) & 0x3FFFF
+        if (pgn >> 8) & 0xFF < 240:
+            pgn &= 0x3FF00
+        return CAN_EFF_FLAG | (pgn << 8)
+
+
+def parse_dbc(path):
+    messages = []
+    deadbands = {}
+    j1939 = set()
+    current = None
+    with open(path, encoding='latin-1') as f:
+        for line in f:
+            line = line.strip()
+            m = RE_MESSAGE.match(line)
+            if m:
+                dbc_id = int(m.group(1))
+                # DBC marks extended identifiers with bit 31, which matches
+                # the CAN_EFF_FLAG convention used by the gateway
+                current = Message(dbc_id, m.group(2), int(m.group(3)))
+                if current.name != 'VECTOR__INDEPENDENT_SIG_MSG':
+                    messages.append(current)
+                continue
+            m = RE_SIGNAL.match(line)
+            if m and current is not None:
+                current.signals.append(Signal(*m.groups()))
+                continue
+            m = RE_DEADBAND.match(line)
+            if m:
+                deadbands[(int(m.group(1)), m.group(2))] = float(m.group(3))
+                continue
+            m = RE_FRAME_FORMAT.match(line)
+            if m:
+                if int(m.group(2)) == VFRAME_J1939:
+                    j1939.add(int(m.group(1)))
+                continue
+            if not line:
+                current = None
+
+    for msg in messages:
+        msg.is_j1939 = msg.can_id in j1939 and bool(msg.can_id & CAN_EFF_FLAG)
+        for sig in msg.signals:
+            sig.deadband = deadbands.get((msg.can_id, sig.name), 0.0)
+
+    keys = [msg.key for msg in messages]
+    if len(set(keys)) != len(keys):
+        raise ValueError('two messages share the same ID or J1939 PGN')
+    return messages
+
+
+def find_perfect_hash(ids):
+    bits = 1
+    while (1 << bits) < 2 * len(ids):
+        bits += 1
+
+    while bits <= MAX_HASH_BITS:
+        size = 1 << bits
+        for seed in range(0x9E3779B1, 0x9E3779B1 + 200000, 2):
+            slots = {((i * seed) & 0xFFFFFFFF) >> (32 - bits) for i in ids}
+            if len(slots) == len(ids):
+                return seed, bits, size
+        bits += 1
+
+    raise RuntimeError('could not find a perfect hash for the message IDs')
+
+
+def c_float(value):
+    text = repr(float(value))
+    return (text if ('e' in text or '.' in text) else text + '.0') + 'f'
+
+
+def generate(messages, source):
+    ids = [msg.key for msg in messages]
+    seed, bits, size = find_perfect_hash(ids) if ids else (1, 1, 2)
+
+    table = ['DBC_HASH_EMPTY'] * size
+    for idx, can_id in enumerate(ids):
+        table[((can_id * seed) & 0xFFFFFFFF) >> (32 - bits)] = str(idx)
+
+    out = []
+    out.append('// ***************************************************** //')
+    out.append('/// @file dbc_table.c')
+    out.append(f'/// @brief Generated by tools/dbc2c.py from {source}.')
+    out.append('/// Do not edit by hand.')
+    out.append('// ***************************************************** //')
+    out.append('')
+    out.append('#include "dbc.h"')
+    out.append('')
+
+    out.append('const dbc_signal_t DBC_SIGNALS[] =')
+    out.append('{')
+    first = 0
+    for msg in messages:
+        out.append(f'    // {msg.name}')
+        for sig in msg.signals:
+            order = 'DBC_BIG_ENDIAN' if sig.big_endian else 'DBC_LITTLE_ENDIAN'
+            mask = (1 << sig.length) - 1
+            out.append(
+                f'    {{ "{sig.name}", "{sig.unit}", 0x{mask:X}ULL, '
+                f'{c_float(sig.factor)}, {c_float(sig.offset)}, '
+                f'{c_float(sig.deadband)}, {sig.mux_value}, '
+                f'{sig.shift}, {sig.length}, {order}, {int(sig.is_signed)}, '
+                f'{sig.mux_type} }},')
+    if not any(msg.signals for msg in messages):
+        out.append('    { "", "", 0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0, 0 },')
+    out.append('};')
+    out.append('')
+
+    out.append('const dbc_message_t DBC_MESSAGES[] =')
+    out.append('{')
+    for msg in messages:
+        mux = next((i for i, s in enumerate(msg.signals)
+                    if s.mux_type == 'DBC_MUX_SWITCH'), -1)
+        if len(msg.signals) > 64:
+            raise ValueError(f'message {msg.name}: too many signals')
+        out.append(f'    {{ 0x{msg.key:08X}UL, "{msg.name}", {first}, '
+                   f'{len(msg.signals)}, {msg.dlc}, {mux}, {int(msg.is_j1939)} }},')
+        first += len(msg.signals)
+    if not messages:
+        out.append('    { 0xFFFFFFFFUL, "", 0, 0, 0, -1, 0 },')
+    out.append('};')
+    out.append('')
+
+    out.append(f'const uint16_t DBC_NUM_SIGNALS  = {first};')
+    out.append(f'const uint16_t DBC_NUM_MESSAGES = {len(messages)};')
+    out.append('')
+    out.append(f'const uint32_t DBC_HASH_SEED = 0x{seed:08X}UL;')
+    out.append(f'const uint8_t  DBC_HASH_BITS = {bits};')
+    out.append('')
+    out.append(f'const uint16_t DBC_HASH_TABLE[{size}] =')
+    out.append('{')
+    for i in range(0, size, 8):
+        out.append('    ' + ', '.join(table[i:i + 8]) + ',')
+    out.append('};')
+    out.append('')
+    return '\n'.join(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f'usage: {sys.argv[0]} <input.dbc> <output.c>')
+
+    messages = parse_dbc(sys.argv[1])
+    text = generate(messages, sys.argv[1].split('/')[-1])
+    with open(sys.argv[2], 'w') as f:
+        f.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# ****************************************************************************
+# CAN-WIFI Gateway to AWS cloud
+# ****************************************************************************
+# Converts binary frame captures of modules/trace (TRxxxxxx.BIN on the SD
+# card) to the candump log format of can-utils, for canplayer or any tool
+# that reads it.
+#
+# Usage: trace2log.py <input.bin> [<output.log>]
+
+import struct
+import sys
+
+MAGIC = b'GWTRACE\0'
+HEADER = struct.Struct('<8sHH4x')
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+CAN_EFF_MASK = 0x1FFFFFFF
+CAN_SFF_MASK = 0x7FF
+
+
+def convert(data, out, interface='can0'):
+    magic, version, record_size = HEADER.unpack_from(data)
+    if magic != MAGIC or version != 1:
+        raise ValueError('not a version 1 gateway trace')
+
+    record = struct.Struct('<QIB3x8s')
+    for offset in range(HEADER.size, len(data) - record_size + 1, record_size):
+        time_us, can_id, dlc, payload = record.unpack_from(data, offset)
+        if can_id & CAN_EFF_FLAG:
+            ident = '%08X' % (can_id & CAN_EFF_MASK)
+        else:
+            ident = '%03X' % (can_id & CAN_SFF_MASK)
+        body = 'R' if can_id & CAN_RTR_FLAG else payload[:min(dlc, 8)].hex().upper()
+        out.write('(%d.%06d) %s %s#%s\n' % (time_us // 1000000, time_us % 1000000,
+                                             interface, ident, body))
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit('Usage: trace2log.py <input.bin> [<output.log>]')
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as out:
+            convert(data, out)
+    else:
+        convert(data, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()